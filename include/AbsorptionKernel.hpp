@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+namespace simulator {
+namespace physics {
+
+/**
+ * How the time-harmonic factor of the field is integrated over a step
+ */
+enum AbsorptionMode {
+  INSTANTANEOUS,  ///< Sampled at the beginning of the step
+  CYCLE_AVERAGED, ///< Integrated analytically over the step
+};
+
+/**
+ * Magnetron radiating at the common source frequency
+ */
+struct FieldSource {
+  glm::vec3 m_position{};  ///< m
+  float m_amplitude = 0.f; ///< V/m
+  float m_phase = 0.f;     ///< rad
+};
+
+/**
+ * The field at a point is E(t) = Re(P * e^(iwt)) for a complex phasor P, so
+ * E(t)^2 = |P|^2 / 2 + Re(P^2 * e^(2iwt)) / 2. Integrated over a step this is
+ * m_mean * |P|^2 + m_cos * Re(P^2) + m_sin * Im(P^2).
+ */
+struct HarmonicFactors {
+  double m_mean = 0.0; ///< s
+  double m_cos = 0.0;  ///< s
+  double m_sin = 0.0;  ///< s
+};
+
+/**
+ * @brief harmonicFactors Integrates the time dependence of E(t)^2 over
+ * [t0, t0 + dt]. The cycle averaged mode is exact for any step: whole periods
+ * contribute |P|^2 * dt / 2 and the partial one is added in closed form, so
+ * the step is only bound by the thermal dynamics instead of the source
+ * period.
+ * @param omega rad/s
+ * @param t0 s
+ * @param dt s
+ * @param mode
+ * @return
+ */
+HarmonicFactors harmonicFactors(double omega, double t0, double dt,
+                                AbsorptionMode mode);
+
+/**
+ * @brief absorbField Integrates one step of the absorption formula for every
+ * vertex, temperature += coefficient * integral of E(t)^2. The loop is branch
+ * free so it auto-vectorizes to the widest SIMD extension the target is
+ * compiled for. Instantiated for float and double temperatures, the sum is
+ * taken in the precision of the temperature.
+ * @param field_re Real part of the field phasor per vertex, V/m
+ * @param field_im Imaginary part of the field phasor per vertex, V/m
+ * @param temperature
+ * @param count
+ * @param coefficient Material coefficient, K/s per V^2/m^2
+ * @param factors
+ */
+template <typename Real>
+void absorbField(const float *field_re, const float *field_im,
+                 Real *temperature, size_t count, float coefficient,
+                 const HarmonicFactors &factors);
+
+/**
+ * @brief absorbField Same with a coefficient per vertex, for materials whose
+ * properties follow the temperature
+ * @param field_re
+ * @param field_im
+ * @param temperature
+ * @param count
+ * @param coefficient K/s per V^2/m^2, one per vertex
+ * @param factors
+ */
+template <typename Real>
+void absorbField(const float *field_re, const float *field_im,
+                 Real *temperature, size_t count, const float *coefficient,
+                 const HarmonicFactors &factors);
+
+} // namespace physics
+} // namespace simulator
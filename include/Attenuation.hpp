@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <AbsorptionKernel.hpp>
+#include <TriangleBvh.hpp>
+
+namespace simulator {
+namespace physics {
+
+/**
+ * @brief attenuationConstant Decay rate of the field amplitude in a lossy
+ * dielectric, the reciprocal of its skin depth. It tends to
+ * sqrt(pi * f * mu0 * sigma) for a good conductor.
+ * @param conductivity S/m
+ * @param relative_permittivity
+ * @param frequency Hz
+ * @return 1/m
+ */
+float attenuationConstant(float conductivity, float relative_permittivity,
+                          float frequency);
+
+/**
+ * @brief materialAttenuation Attenuation constants of every material of
+ * every model, for TriangleBvh::setAttenuation
+ * @param models
+ * @param frequency Hz
+ * @return Per model, per entry of its material table, 1/m
+ */
+std::vector<std::vector<float>>
+materialAttenuation(const std::vector<model::Model> &models, float frequency);
+
+/**
+ * @brief transmittedPower Share of the source power left at every point
+ * after the path from each source through the bodies, Lambert's law
+ * e^(-2 sum alpha_i d_i) over the bodies the path crosses. Sources are
+ * weighted by A^2.
+ * @param bodies Closed meshes the sources shine through, with the
+ * attenuation of their materials set
+ * @param sources
+ * @param x
+ * @param y
+ * @param z
+ * @param count
+ * @param offset Added to every point to bring it to world space
+ * @param out
+ */
+void transmittedPower(const TriangleBvh &bodies,
+                      const std::vector<FieldSource> &sources,
+                      const float *x, const float *y, const float *z,
+                      size_t count, const glm::vec3 &offset, float *out);
+
+} // namespace physics
+} // namespace simulator
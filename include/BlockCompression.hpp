@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simulator {
+
+/**
+ * @brief compressBound
+ * @param size Input bytes
+ * @return Largest output compressBlock can produce for it
+ */
+size_t compressBound(size_t size);
+
+/**
+ * @brief compressBlock Greedy LZ77 in the LZ4 block format, so any LZ4 block
+ * decoder reads the output. Matches are found through a hash of the next
+ * four bytes within a 64 KiB window, which is what makes the long zero runs
+ * of shuffled deltas nearly free.
+ * @param in
+ * @param size Below 4 GiB
+ * @param out At least compressBound(size) bytes
+ * @return Compressed bytes
+ */
+size_t compressBlock(const uint8_t *in, size_t size, uint8_t *out);
+
+/**
+ * @brief decompressBlock Every length and offset is checked, a corrupt
+ * block is rejected instead of read or written out of bounds
+ * @param in
+ * @param size Compressed bytes
+ * @param out
+ * @param raw_size Bytes the block must decompress to
+ * @return false if the block is corrupt
+ */
+bool decompressBlock(const uint8_t *in, size_t size, uint8_t *out,
+                     size_t raw_size);
+
+} // namespace simulator
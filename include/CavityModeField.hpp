@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <AbsorptionKernel.hpp>
+#include <FieldProvider.hpp>
+#include <FieldTable.hpp>
+
+namespace simulator {
+namespace physics {
+
+struct CavityModeConfig {
+  float m_quality_factor = 50.f;   ///< Loaded Q, sets the resonance width
+  float m_mode_band = 0.1f;        ///< Modes within k * (1 +- band) are summed
+  int m_cells_per_wavelength = 16; ///< Table resolution
+  std::string m_cache_dir = "field_cache"; ///< Empty disables the disk cache
+};
+
+/**
+ * Standing wave field of an empty rectangular metal cavity, expanded in its
+ * closed form TE/TM modes. Every mode near the source wavenumber is excited
+ * through the E_z of the mode at the sources (the same vertical probe the
+ * FDTD solver drives) with a damped resonant response, and the modes are
+ * summed as complex vectors. Peak |E|^2 is tabulated once on a regular grid
+ * and kept on disk, so a restart with the same cavity, sources and frequency
+ * only reads the table back. The load does not detune the modes.
+ */
+class CavityModeField : public FieldProvider {
+public:
+  /**
+   * @brief CavityModeField Loads the table from the cache or builds it
+   * @param cavity
+   * @param sources
+   * @param frequency Hz
+   * @param cfg
+   */
+  CavityModeField(const Cavity &cavity, const std::vector<FieldSource> &sources,
+                  float frequency, const CavityModeConfig &cfg);
+
+  /**
+   * @brief samplePhasor The table holds |E|^2 of a vector field, it is
+   * returned as a real amplitude
+   */
+  void samplePhasor(const float *x, const float *y, const float *z,
+                    size_t count, const glm::vec3 &offset, float *field_re,
+                    float *field_im) const override;
+
+  const FieldTable &getTable() const { return m_table; }
+
+private:
+  /**
+   * @brief build Sums the modes at every table sample, z slabs run in
+   * parallel
+   */
+  void build();
+
+  /**
+   * @brief loadCache
+   * @param path
+   * @return False if the file is missing or was written for another setup
+   */
+  bool loadCache(const std::string &path);
+
+  /**
+   * @brief saveCache Failing to write only costs the next startup a rebuild
+   * @param path
+   */
+  void saveCache(const std::string &path) const;
+
+  Cavity m_cavity;
+  std::vector<FieldSource> m_sources;
+  float m_frequency = 0.f;
+  CavityModeConfig m_cfg;
+
+  // Everything the table depends on, flattened, names the cache file and is
+  // compared on load
+  std::vector<float> m_key;
+
+  FieldTable m_table;
+};
+
+} // namespace physics
+} // namespace simulator
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace simulator {
+
+/**
+ * What a checkpoint section holds
+ */
+enum CheckpointSectionKind : uint32_t {
+  ENGINE_RECORD,     ///< Fixed size configuration record
+  ENGINE_SOURCES,    ///< FieldSource array
+  ENGINE_STRING,     ///< Characters, the index tells which string
+  MESH_TEMPERATURE,  ///< Vertices of one mesh, counted across models, K
+  MESH_ENTHALPY,     ///< Same order, J/kg, empty without a phase change
+  VOXEL_TEMPERATURE, ///< Conduction voxels of one model, K in double
+  VOXEL_ENTHALPY,    ///< Same order, J/kg, empty without a phase change
+  MODEL_MATERIALS,   ///< Material table size of one model, uint32_t
+};
+
+/**
+ * Start of a checkpoint file. The section table follows it and every section
+ * starts on a cache line, so a mapped file is used in place.
+ */
+struct CheckpointHeader {
+  uint32_t m_magic = 0;
+  uint32_t m_version = 0;
+  uint64_t m_file_size = 0; ///< bytes, a torn file is rejected
+  double m_timeline = 0.0;  ///< s
+  double m_next_step = 0.0; ///< s, proposed by the error control
+  uint64_t m_step_count = 0;
+  uint64_t m_rejected_count = 0;
+  uint32_t m_model_count = 0;
+  uint32_t m_mesh_count = 0; ///< Over every model
+  uint32_t m_section_count = 0;
+  uint32_t m_reserved = 0;
+};
+
+struct CheckpointSection {
+  uint32_t m_kind = 0;
+  uint32_t m_index = 0;  ///< Mesh, model or string, by kind
+  uint64_t m_offset = 0; ///< bytes from the start of the file
+  uint64_t m_size = 0;   ///< bytes
+};
+
+/**
+ * Section to be packed, the bytes are copied out of the caller's memory
+ */
+struct CheckpointSpan {
+  uint32_t m_kind = 0;
+  uint32_t m_index = 0;
+  const void *m_data = nullptr;
+  size_t m_size = 0; ///< bytes
+};
+
+/**
+ * Configuration part of every checkpoint, packed once when the run starts
+ */
+struct CheckpointBlob {
+  uint32_t m_kind = 0;
+  uint32_t m_index = 0;
+  std::vector<char> m_bytes;
+};
+
+struct CheckpointConfig {
+  std::string m_path = "";  ///< "" disables checkpointing
+  double m_interval = 60.0; ///< Simulated s between checkpoints
+  std::vector<CheckpointBlob> m_config; ///< Copied into every checkpoint
+};
+
+/**
+ * @brief packCheckpoint Lays a checkpoint out in memory exactly as it is
+ * stored
+ * @param header Magic, version, size and section count are filled in
+ * @param spans
+ * @param image Resized, its capacity is reused between checkpoints
+ */
+void packCheckpoint(CheckpointHeader header,
+                    const std::vector<CheckpointSpan> &spans,
+                    std::vector<char> &image);
+
+/**
+ * Writes packed checkpoints on a thread of its own. The producer hands an
+ * image over by swapping buffers, so it only ever waits for a mutex, and an
+ * image that is still queued when the next one arrives is replaced by it.
+ * Files are written through a shared mapping to a temporary name and renamed
+ * over the previous checkpoint, so a preempted write never leaves a torn
+ * file behind.
+ */
+class CheckpointWriter {
+public:
+  CheckpointWriter();
+  /**
+   * @brief ~CheckpointWriter Finishes the queued write
+   */
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter &) = delete;
+  CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+  /**
+   * @brief submit
+   * @param path
+   * @param image Swapped with a buffer the writer is done with
+   */
+  void submit(const std::string &path, std::vector<char> &image);
+
+  /**
+   * @brief flush Blocks until every submitted image is on disk
+   */
+  void flush();
+
+  uint64_t getWrittenCount() const;
+  uint64_t getDroppedCount() const;
+
+private:
+  void loop();
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_idle;
+  std::string m_pending_path;
+  std::vector<char> m_pending;
+  std::vector<char> m_writing;
+  bool m_has_pending = false;
+  bool m_busy = false;
+  bool m_quit = false;
+  uint64_t m_written = 0;
+  uint64_t m_dropped = 0; ///< Replaced before they were written
+  std::thread m_thread;
+};
+
+/**
+ * Read only mapping of a checkpoint. The header and section table are
+ * checked once when it is opened, sections are then read in place and pages
+ * are only brought in when they are touched.
+ */
+class CheckpointFile {
+public:
+  /**
+   * @brief CheckpointFile
+   * @param path
+   * @throws std::runtime_error when the file is missing, torn or of another
+   * version
+   */
+  explicit CheckpointFile(const std::string &path);
+  ~CheckpointFile();
+
+  CheckpointFile(const CheckpointFile &) = delete;
+  CheckpointFile &operator=(const CheckpointFile &) = delete;
+
+  const CheckpointHeader &getHeader() const {
+    return *reinterpret_cast<const CheckpointHeader *>(m_data);
+  }
+
+  /**
+   * @brief find
+   * @param kind
+   * @param index
+   * @param size bytes, 0 when the section is missing
+   * @return nullptr when the section is missing
+   */
+  const void *find(uint32_t kind, uint32_t index, size_t &size) const;
+
+  /**
+   * @brief findArray Section of a known element type
+   * @param kind
+   * @param index
+   * @param count Elements, 0 when the section is missing
+   * @return
+   */
+  template <typename T>
+  const T *findArray(uint32_t kind, uint32_t index, size_t &count) const {
+    size_t size = 0;
+    const void *data = find(kind, index, size);
+    count = size / sizeof(T);
+    return static_cast<const T *>(data);
+  }
+
+private:
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+} // namespace simulator
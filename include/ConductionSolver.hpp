@@ -0,0 +1,313 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <AbsorptionKernel.hpp>
+#include <ConjugateGradient.hpp>
+#include <CsrMatrix.hpp>
+#include <FieldProvider.hpp>
+#include <Mesh.hpp>
+#include <MultigridPreconditioner.hpp>
+#include <Precision.hpp>
+#include <SparseGrid.hpp>
+#include <Turntable.hpp>
+
+namespace simulator {
+
+/**
+ * How diffusion is integrated over a step
+ */
+enum ConductionScheme {
+  EXPLICIT,       ///< Forward Euler, sub-stepped under the stability limit
+  CRANK_NICOLSON, ///< Implicit trapezoidal, one linear solve per step
+};
+
+/**
+ * Preconditioner of the Crank-Nicolson solve
+ */
+enum ConductionPreconditioner {
+  JACOBI,    ///< Cheapest per iteration, iterations grow with resolution
+  MULTIGRID, ///< Geometric V-cycle, iterations stay flat with resolution
+};
+
+struct ConductionConfig {
+  ConductionScheme m_scheme = ConductionScheme::EXPLICIT;
+  ConductionPreconditioner m_preconditioner = ConductionPreconditioner::JACOBI;
+  CgConfig m_cg; ///< Tolerance in K
+  Precision m_precision = Precision::SINGLE; ///< Of the voxel state
+};
+
+/**
+ * Finite volume heat conduction through the voxelized body of a model. Every
+ * voxel takes the properties of its entry in the material table of the
+ * model. Heat flows between face neighbours that are both inside the body,
+ * through the harmonic mean of their conductivities, the surface is
+ * insulated. Absorption is added as a volumetric source and diffusion is
+ * integrated either explicitly, sub-stepped under the stability limit, or
+ * with Crank-Nicolson, which is stable for any step. Materials with a phase
+ * change integrate the enthalpy: diffusion runs on the temperature with the
+ * sensible heat capacity and its change is moved into the enthalpy, which
+ * pins the temperature while the latent heat is taken up. The state is kept
+ * per slot of a SparseGrid, only the bricks the body touches take memory.
+ *
+ * This part holds what doesn't depend on the precision: the grid, the field
+ * the voxels see and the implicit system. BasicConductionSolver keeps the
+ * state and runs the kernels, makeConductionSolver picks its instantiation.
+ */
+class ConductionSolver {
+public:
+  /**
+   * @brief ConductionSolver Voxelizes the model and keeps the bricks of the
+   * body
+   * @param model
+   * @param resolution Voxels along the longest side of the model
+   * @param shell Voxels the surface touches are part of the body
+   * @param cfg
+   */
+  ConductionSolver(model::Model &model, int resolution, bool shell,
+                   const ConductionConfig &cfg);
+
+  virtual ~ConductionSolver() = default;
+
+  /**
+   * @brief sampleField Recomputes the per-voxel heating rate, only needed
+   * when the model moves through the field
+   * @param field
+   */
+  void sampleField(const physics::FieldProvider &field);
+
+  /**
+   * @brief attenuate Scales the heating of every voxel by the share of the
+   * source power the bodies let through to its center, after sampleField
+   * @param bodies Over every model, at their current positions, with the
+   * attenuation of their materials set
+   * @param sources
+   */
+  void attenuate(const TriangleBvh &bodies,
+                 const std::vector<physics::FieldSource> &sources);
+
+  /**
+   * @brief buildTurntable Caches the field at the voxels of the body for
+   * every turntable angle, replaces sampleField on a turntable
+   * @param field
+   * @param pivot Point on the turntable axis
+   * @param cfg
+   */
+  void buildTurntable(const physics::FieldProvider &field,
+                      const glm::vec3 &pivot,
+                      const physics::TurntableConfig &cfg);
+
+  /**
+   * @brief sampleTurntable Sets the heating rate to the field the voxels see
+   * while the turntable sweeps from angle0 to angle1
+   * @param angle0 rad
+   * @param angle1 rad
+   */
+  void sampleTurntable(double angle0, double angle1);
+
+  /**
+   * @brief step Advances the voxel temperatures by dt seconds and writes them
+   * back to the vertices of the model
+   * @param timestamp
+   * @param dt
+   * @param frequency Hz
+   * @param mode
+   */
+  virtual void step(double timestamp, double dt, float frequency,
+                    physics::AbsorptionMode mode) = 0;
+
+  const SparseGrid &getGrid() const { return m_grid; }
+
+  /**
+   * @brief getTemperatureCount
+   * @return One temperature per slot of the grid
+   */
+  size_t getTemperatureCount() const { return m_grid.size(); }
+
+  /**
+   * @brief getEnthalpyCount
+   * @return One enthalpy per slot, none without a phase change
+   */
+  size_t getEnthalpyCount() const;
+
+  /**
+   * @brief getState Copies the state out, double holds every precision
+   * exactly so a round trip through setState loses nothing
+   * @param temperature K, getTemperatureCount values
+   * @param enthalpy J/kg, getEnthalpyCount values
+   */
+  virtual void getState(double *temperature, double *enthalpy) const = 0;
+
+  /**
+   * @brief setState Overwrites every voxel and the vertices reading them,
+   * used to roll back a rejected step
+   * @param temperature K, one value per slot of the grid
+   * @param enthalpy J/kg, one value per slot, only read with a phase change
+   */
+  virtual void setState(const double *temperature,
+                        const double *enthalpy) = 0;
+
+  /**
+   * @brief getLastSolve Crank-Nicolson only
+   * @return Iterations and residual of the latest step
+   */
+  const CgResult &getLastSolve() const { return m_last_solve; }
+
+protected:
+  /**
+   * @brief faceConductance Harmonic mean of the conductivities of two slots,
+   * the series conductance of the two half voxels
+   * @param a
+   * @param b
+   * @return W/m*K, 0 when either slot is outside the body
+   */
+  float faceConductance(size_t a, size_t b) const;
+
+  /**
+   * @brief assembleLaplacian Numbers the voxels of the body and builds the
+   * Laplacian of their faces, each weighted by its conductance over the
+   * geometric mean of the volumetric heats on either side, once per geometry
+   */
+  void assembleLaplacian();
+
+  /**
+   * @brief mapVertices Finds the voxel every vertex reads its temperature from
+   */
+  void mapVertices();
+
+  /**
+   * @brief solveIncrement Solves (I + r/2 L) dy = m_rhs into m_increment,
+   * from dy = 0. The unknowns are T times m_unknown_scale, which makes the
+   * system symmetric over any mix of materials. With m_rhs = -r L y that
+   * is the Crank-Nicolson change of y, so the solve only rounds the change
+   * and the state keeps its own precision.
+   * @param ratio dt / h^2
+   */
+  void solveIncrement(float ratio);
+
+  model::Model *m_model;
+  ConductionConfig m_cfg;
+  SparseGrid m_grid;
+  // Per slot, padding slots read as material 0 with no conductivity
+  std::vector<uint32_t> m_material;      ///< Table index, for the gathers
+  std::vector<float> m_conductivity;     ///< W/m*K, 0 on padding
+  std::vector<float> m_inv_heat_capacity; ///< 1 / (rho * c), 0 on padding
+  // Largest sum of face conductances over 6 rho c of any voxel, the
+  // diffusivity the explicit limit has to hold for
+  float m_max_diffusivity = 0.f; ///< m^2/s
+  // Largest c / c(T) over the phase curves, the explicit sweeps shrink by it
+  float m_capacity_ratio = 1.f;
+  // sqrt(sigma / (rho * c)) per table entry, 1 when the rate comes per step
+  std::vector<float> m_field_scale;
+  // Field phasor per voxel scaled by the field scale of its material, so its
+  // square is the heating rate in K/s. Zero on the padding slots.
+  std::vector<float> m_heating_re;
+  std::vector<float> m_heating_im;
+  std::vector<std::vector<size_t>> m_vertex_voxels; ///< Slots, per mesh
+
+  // Turntable, the cache covers the voxels of the body only
+  std::vector<size_t> m_turntable_cells;
+  physics::TurntableCache m_turntable;
+  std::vector<float> m_turntable_re, m_turntable_im;
+
+  // Crank-Nicolson, unknowns are the voxels of the body in slot order
+  std::vector<size_t> m_cells;     ///< Slot of every unknown
+  // sqrt(rho c / smallest rho c of the body), at least 1 so the tolerance on
+  // the scaled unknowns bounds the one on T
+  std::vector<float> m_unknown_scale;
+  CsrMatrix m_laplacian;           ///< m^2/s, symmetric
+  CsrMatrix m_system;              ///< I + r/2 L, same pattern
+  float m_system_ratio = -1.f;     ///< r m_system was built for
+  JacobiPreconditioner m_jacobi;
+  MultigridPreconditioner m_multigrid;
+  ConjugateGradient m_cg;
+  CgResult m_last_solve;
+  std::vector<float> m_increment, m_rhs;
+};
+
+/**
+ * The state and kernels of conduction in one precision, float or double.
+ * Temperatures are kept relative to the mean temperature the body starts
+ * at, so a float state resolves the small increments of a step against the
+ * rise rather than against the 293 K every voxel shares. The enthalpy is held
+ * in the same precision, material properties stay float tables.
+ */
+template <typename Real>
+class BasicConductionSolver : public ConductionSolver {
+public:
+  /**
+   * @brief BasicConductionSolver Starts every voxel at the mean temperature
+   * of the model
+   * @param model
+   * @param resolution Voxels along the longest side of the model
+   * @param shell Voxels the surface touches are part of the body
+   * @param cfg
+   */
+  BasicConductionSolver(model::Model &model, int resolution, bool shell,
+                        const ConductionConfig &cfg);
+
+  void step(double timestamp, double dt, float frequency,
+            physics::AbsorptionMode mode) override;
+
+  void getState(double *temperature, double *enthalpy) const override;
+
+  void setState(const double *temperature, const double *enthalpy) override;
+
+private:
+  /**
+   * @brief absorb Adds the heat of the step to every voxel
+   * @param factors
+   */
+  void absorb(const physics::HarmonicFactors &factors);
+
+  /**
+   * @brief diffuse One explicit sweep of the 7-point stencil from
+   * m_temperature into m_scratch, leaf by leaf on the brick padded with the
+   * faces of its neighbours
+   * @param ratio dt / h^2
+   */
+  void diffuse(Real ratio);
+
+  /**
+   * @brief stepImplicit Solves (I + r/2 L) y' = (I - r/2 L) y for the change
+   * of the scaled temperatures y, with the product L y taken in Real
+   * @param ratio dt / h^2
+   */
+  void stepImplicit(float ratio);
+
+  /**
+   * @brief releaseLatentHeat Moves the temperature change of the last
+   * diffusion, m_temperature - m_scratch, into the enthalpy and reads the
+   * temperature back from it
+   */
+  void releaseLatentHeat();
+
+  /**
+   * @brief gatherVertexTemperatures
+   */
+  void gatherVertexTemperatures();
+
+  Real m_reference = 0;            ///< K the stored temperatures are off
+  std::vector<Real> m_temperature; ///< K above m_reference
+  std::vector<Real> m_scratch;     ///< K above m_reference
+  std::vector<Real> m_enthalpy;    ///< J/kg, with phase change only
+  std::vector<Real> m_gathered, m_product; ///< y and L y per unknown
+};
+
+extern template class BasicConductionSolver<float>;
+extern template class BasicConductionSolver<double>;
+
+/**
+ * @brief makeConductionSolver
+ * @param model
+ * @param resolution Voxels along the longest side of the model
+ * @param shell Voxels the surface touches are part of the body
+ * @param cfg m_precision picks the instantiation
+ * @return
+ */
+std::unique_ptr<ConductionSolver>
+makeConductionSolver(model::Model &model, int resolution, bool shell,
+                     const ConductionConfig &cfg = ConductionConfig());
+
+} // namespace simulator
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include <CsrMatrix.hpp>
+
+namespace simulator {
+
+/**
+ * Approximate inverse applied once per conjugate gradient iteration, must be
+ * symmetric positive definite
+ */
+class Preconditioner {
+public:
+  virtual ~Preconditioner() = default;
+
+  /**
+   * @brief apply z = M^-1 * r
+   * @param r
+   * @param z
+   */
+  virtual void apply(const float *r, float *z) const = 0;
+};
+
+/**
+ * Inverse of the matrix diagonal
+ */
+class JacobiPreconditioner : public Preconditioner {
+public:
+  /**
+   * @brief update Picks up new matrix values, the pattern may change too
+   * @param matrix
+   */
+  void update(const CsrMatrix &matrix);
+
+  void apply(const float *r, float *z) const override;
+
+private:
+  std::vector<float> m_inverse_diagonal;
+};
+
+struct CgConfig {
+  float m_tolerance = 1e-4f; ///< RMS residual, in the units of b
+  int m_max_iterations = 200;
+};
+
+struct CgResult {
+  int m_iterations = 0;
+  float m_residual = 0.f; ///< RMS
+};
+
+/**
+ * Preconditioned conjugate gradient for symmetric positive definite systems.
+ * Every vector kernel and reduction runs on the thread pool, reductions are
+ * summed per fixed block so results don't depend on the thread count. The
+ * scratch vectors are kept between solves.
+ */
+class ConjugateGradient {
+public:
+  /**
+   * @brief solve A * x = b, x holds the initial guess on entry
+   * @param matrix
+   * @param preconditioner
+   * @param b
+   * @param x
+   * @param cfg
+   * @return
+   */
+  CgResult solve(const CsrMatrix &matrix, const Preconditioner &preconditioner,
+                 const float *b, float *x, const CgConfig &cfg);
+
+private:
+  /**
+   * @brief dot
+   * @param a
+   * @param b
+   * @param count
+   * @return Sum in double precision
+   */
+  double dot(const float *a, const float *b, size_t count);
+
+  std::vector<float> m_r, m_z, m_p, m_q;
+  std::vector<double> m_partials; ///< Per reduction block
+};
+
+} // namespace simulator
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace simulator {
+
+/**
+ * Philox4x32-10 counter-based generator (Salmon et al., SC'11). Every output
+ * is a pure function of the seed, a stream index and a draw counter, so each
+ * ensemble member draws from its own stream without any state shared
+ * between threads, and an ensemble reproduces whatever the scheduling.
+ */
+class CounterRng {
+public:
+  /**
+   * @brief CounterRng
+   * @param seed
+   * @param stream E.g. the ensemble member
+   */
+  CounterRng(uint64_t seed, uint64_t stream)
+      : m_key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)},
+        m_stream(stream) {}
+
+  /**
+   * @brief uniform
+   * @return In (0, 1), 24 bits
+   */
+  float uniform() {
+    if (m_used == m_block.size()) {
+      m_block = generate(m_draw++);
+      m_used = 0;
+    }
+    return ((m_block[m_used++] >> 8) + 0.5f) * (1.f / 16777216.f);
+  }
+
+  /**
+   * @brief normal Box-Muller, the second variate of the pair is dropped as
+   * draws are cheap next to a run
+   * @return Standard normal
+   */
+  float normal() {
+    const float u1 = uniform();
+    const float u2 = uniform();
+    return std::sqrt(-2.f * std::log(u1)) *
+           std::cos(6.2831853071795865f * u2);
+  }
+
+private:
+  std::array<uint32_t, 4> generate(uint64_t draw) const {
+    std::array<uint32_t, 4> c = {
+        static_cast<uint32_t>(draw), static_cast<uint32_t>(draw >> 32),
+        static_cast<uint32_t>(m_stream), static_cast<uint32_t>(m_stream >> 32)};
+    uint32_t k0 = m_key[0];
+    uint32_t k1 = m_key[1];
+    for (int round = 0; round < 10; ++round) {
+      const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c[0];
+      const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c[2];
+      c = {static_cast<uint32_t>(p1 >> 32) ^ c[1] ^ k0,
+           static_cast<uint32_t>(p1),
+           static_cast<uint32_t>(p0 >> 32) ^ c[3] ^ k1,
+           static_cast<uint32_t>(p0)};
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+    return c;
+  }
+
+  std::array<uint32_t, 2> m_key;
+  uint64_t m_stream;
+  uint64_t m_draw = 0;
+  std::array<uint32_t, 4> m_block{};
+  size_t m_used = 4; ///< Forces a block on the first draw
+};
+
+} // namespace simulator
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace simulator {
+
+/**
+ * Square sparse matrix in compressed sparse row form, the columns of every
+ * row are sorted
+ */
+struct CsrMatrix {
+  std::vector<size_t> m_row_offsets; ///< Rows + 1 entries
+  std::vector<uint32_t> m_columns;
+  std::vector<float> m_values;
+
+  size_t rows() const {
+    return m_row_offsets.empty() ? 0 : m_row_offsets.size() - 1;
+  }
+
+  /**
+   * @brief multiply y = A * x, rows run in parallel. Instantiated for float
+   * and double vectors, the sum is kept in the precision of the vector.
+   * @param x
+   * @param y
+   */
+  template <typename T> void multiply(const T *x, T *y) const;
+};
+
+} // namespace simulator
@@ -1,2 +1,60 @@
 #pragma once
+
+#include <cstddef>
+
 void runSimulation();
+
+/**
+ * @brief runHeadlessSimulation Steps the physics as fast as possible without
+ * a window or a GL context
+ * @param duration Simulated seconds
+ * @param output_interval Simulated seconds between two written frames
+ * @param output_dir
+ * @param time_step Solver step in seconds, 0 keeps the default. The first
+ * step when adaptive.
+ * @param tolerance Local error per step in K, 0 keeps fixed steps
+ */
+void runHeadlessSimulation(double duration, double output_interval,
+                           const char *output_dir, double time_step = 0.0,
+                           double tolerance = 0.0);
+
+/**
+ * @brief extractHistoryFrame Writes the history frame at or before a time in
+ * the layout of one temperature.bin frame
+ * @param history_path
+ * @param time s
+ * @param output_path
+ */
+void extractHistoryFrame(const char *history_path, double time,
+                         const char *output_path);
+
+/**
+ * @brief runParameterSweep Runs the demo over a grid of frequencies, source
+ * positions, thicknesses and conductivities, concurrently
+ * @param duration Simulated seconds per run
+ * @param output_path CSV with one summary row per run
+ * @param threads Concurrent runs, 0 uses every hardware thread
+ */
+void runParameterSweep(double duration, const char *output_path,
+                       size_t threads = 0);
+
+/**
+ * @brief runEnsembleSimulation Runs the demo with its material properties
+ * drawn from their error bars and writes per-vertex statistics
+ * @param members
+ * @param duration Simulated seconds per member
+ * @param output_dir
+ */
+void runEnsembleSimulation(size_t members, double duration,
+                           const char *output_dir);
+
+/**
+ * @brief runResumableSimulation Runs headless with periodic checkpoints and
+ * continues from the checkpoint when it already exists, so a preempted run
+ * is resumed by running the same command again
+ * @param duration s
+ * @param checkpoint_path
+ * @param interval Simulated s between checkpoints
+ */
+void runResumableSimulation(double duration, const char *checkpoint_path,
+                            double interval);
@@ -5,8 +5,13 @@
 
 #include <glm/glm.hpp>
 
+#include <memory>
+#include <vector>
+
 #include <CameraHandler.hpp>
+#include <GraphicsUtils.hpp>
 #include <Mesh.hpp>
+#include <Solver.hpp>
 
 static constexpr float kMHz = 1e6;
 static constexpr float kGHz = 1e9;
@@ -19,6 +24,7 @@ struct ShaderAttr {
   GLuint m_view_id;
   GLuint m_projec_id;
   GLuint m_rotation_id;
+  GLuint m_temperature_range_id;
   GLint m_image_loc;
 };
 
@@ -26,15 +32,56 @@ enum EngineState { INTERRUPT, RUNNING };
 
 struct EngineConfig {
   float m_source_freq = 300 * kMHz;
-  glm::vec3 m_source_position{};
+  std::vector<physics::FieldSource> m_sources;
+  double m_time_scale = 1.0; ///< Simulated seconds per wall clock second
+  double m_time_step = 0.0;  ///< s, 0 keeps the default solver step
+  physics::AbsorptionMode m_absorption_mode = physics::CYCLE_AVERAGED;
+  ThermalModel m_thermal_model = ThermalModel::SURFACE;
+  int m_voxel_resolution = 128;
+  bool m_voxel_shell = false; ///< Keeps walls thinner than a voxel
+  ConductionConfig m_conduction;
+  AdaptiveStepConfig m_adaptive;
+  std::string m_step_log_path = "steps.csv"; ///< CSV of every solver step
+  physics::FieldModel m_field_model = physics::FREE_SPACE;
+  bool m_occlusion = false;   ///< Models shadow each other, free space only
+  bool m_attenuation = false; ///< Skin depth decay through the food
+  physics::Cavity m_cavity;
+  physics::FdtdConfig m_fdtd;
+  physics::CavityModeConfig m_cavity_modes;
+  physics::RayTraceConfig m_ray_trace;
+  physics::TurntableConfig m_turntable;
   std::string m_vertex_shader_path = "";
   std::string m_fragment_shader_path = "";
+  std::string m_checkpoint_path = "";  ///< "" disables checkpointing
+  double m_checkpoint_interval = 60.0; ///< Simulated s between checkpoints
+  TimeSeriesConfig m_history;
 };
 
+/**
+ * @brief makeSolverConfig Physics part of the engine configuration
+ * @param cfg
+ * @return
+ */
+SolverConfig makeSolverConfig(const EngineConfig &cfg);
+
+/**
+ * @brief packEngineConfig Configuration sections every checkpoint carries
+ * @param cfg
+ * @return
+ */
+std::vector<CheckpointBlob> packEngineConfig(const EngineConfig &cfg);
+
+/**
+ * @brief unpackEngineConfig Configuration a checkpointed run restarts with
+ * @param file
+ * @return
+ */
+EngineConfig unpackEngineConfig(const CheckpointFile &file);
+
 class Engine {
 public:
   Engine(const EngineConfig &cfg, std::vector<model::Model> &models);
-  ~Engine() { glDeleteProgram(m_shader_cfg.m_program_id); };
+  ~Engine();
   /**
    * @brief run
    * @return
@@ -42,7 +89,23 @@ public:
   EngineState run();
 
 private:
+  /**
+   * @brief uploadTemperatures Pushes the latest solver snapshot to the GPU
+   */
+  void uploadTemperatures();
+
+  /**
+   * @brief turntableRotation Turn of a model at the time of the latest
+   * snapshot, about the turntable axis
+   * @param position Of the model, render() translates by it afterwards
+   * @return Identity without a turntable
+   */
+  glm::mat4 turntableRotation(const glm::vec3 &position) const;
+
   std::vector<model::Model> m_models;
+  std::vector<graphics_utils::ModelBuffers> m_buffers; ///< Per model
+  std::vector<glm::vec3> m_positions; ///< Of the latest snapshot, per model
+  std::unique_ptr<Solver> m_solver;
   CameraHandler m_camera;
   ShaderAttr m_shader_cfg;
   EngineConfig m_engine_cfg;
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Engine.hpp>
+#include <EnsembleAccumulator.hpp>
+#include <Mesh.hpp>
+
+namespace simulator {
+
+/**
+ * Distribution of the relative error of a measured property
+ */
+enum UncertaintyShape {
+  NORMAL,  ///< Truncated so the property stays positive
+  UNIFORM, ///< Flat over the error bar
+};
+
+struct Uncertainty {
+  UncertaintyShape m_shape = UncertaintyShape::NORMAL;
+  /// Relative standard deviation for NORMAL, half width for UNIFORM
+  float m_spread = 0.f;
+};
+
+struct EnsembleConfig {
+  size_t m_members = 64;
+  uint64_t m_seed = 0; ///< Same seed, same ensemble
+  double m_duration = 60.0; ///< Simulated seconds per member
+  float m_initial_temperature = model::kRoomTemperature; ///< K
+  size_t m_threads = 0; ///< Concurrent members, 0 uses every hardware thread
+  // Constants and their temperature curves are scaled together
+  Uncertainty m_density;
+  Uncertainty m_heat_capacity;
+  Uncertainty m_electrical_conductivity;
+  std::vector<float> m_percentiles{0.05f, 0.5f, 0.95f}; ///< In (0, 1)
+  std::string m_members_path = ""; ///< CSV of the sampled members, "" skips
+};
+
+/**
+ * @brief sampleMaterial Draws the properties of one member from its own
+ * counter-based stream, so a member is the same whatever ran before it
+ * @param base
+ * @param cfg
+ * @param member
+ * @return
+ */
+model::Material sampleMaterial(const model::Material &base,
+                               const EnsembleConfig &cfg, size_t member);
+
+/**
+ * @brief runEnsemble Runs cfg.m_members solvers with sampled materials on
+ * a work-stealing pool and folds each final temperature field into the
+ * statistics as it finishes. Means and variances are Welford sums and
+ * percentiles are P^2 estimates (Jain and Chlamtac), five markers per
+ * vertex and percentile, so memory does not grow with the ensemble. Members
+ * are folded in index order, only the ones finishing ahead of an earlier
+ * member are held, which keeps the result independent of the scheduling.
+ * At most two members per thread are in flight past the next one to fold,
+ * so no more than that many fields are ever held. Each member writes the
+ * step log of the engine to its own runPath.
+ * @param prototype Imported once, only read
+ * @param engine
+ * @param material Nominal properties
+ * @param cfg
+ * @return
+ */
+EnsembleResult runEnsemble(const model::Model &prototype,
+                           const EngineConfig &engine,
+                           const model::Material &material,
+                           const EnsembleConfig &cfg);
+
+} // namespace simulator
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace simulator {
+
+/**
+ * Per-vertex temperature statistics over the ensemble, models and meshes
+ * concatenated like TemperatureSnapshot
+ */
+struct EnsembleResult {
+  size_t m_members = 0;
+  std::vector<float> m_mean; ///< K
+  std::vector<float> m_std;  ///< K
+  std::vector<std::vector<float>> m_percentile_maps; ///< K, per percentile
+};
+
+/**
+ * Streaming per-vertex statistics, Welford sums in double and one P^2
+ * estimator per vertex and percentile
+ */
+class EnsembleAccumulator {
+public:
+  /**
+   * @brief EnsembleAccumulator
+   * @param count Values per member
+   * @param percentiles In (0, 1)
+   */
+  EnsembleAccumulator(size_t count, const std::vector<float> &percentiles);
+
+  /**
+   * @brief add Folds one member in
+   * @param temperature One value per vertex
+   */
+  void add(const float *temperature);
+
+  /**
+   * @brief finish
+   * @param result Maps are filled in
+   */
+  void finish(EnsembleResult &result) const;
+
+private:
+  float &height(size_t p, int marker, size_t v);
+  float height(size_t p, int marker, size_t v) const;
+  float &position(size_t p, int marker, size_t v);
+  void addQuantile(size_t p, size_t v, float x);
+  float quantile(size_t p, size_t v) const;
+
+  size_t m_count;
+  size_t m_n = 0;
+  std::vector<float> m_percentiles;
+  std::vector<double> m_mean;
+  std::vector<double> m_m2;
+  std::vector<float> m_heights;   ///< [percentile][marker][vertex]
+  std::vector<float> m_positions; ///< [percentile][marker][vertex]
+};
+
+} // namespace simulator
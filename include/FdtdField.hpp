@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <AbsorptionKernel.hpp>
+#include <FieldProvider.hpp>
+#include <FieldTable.hpp>
+#include <SparseGrid.hpp>
+
+namespace simulator {
+namespace physics {
+
+struct FdtdConfig {
+  int m_cells_per_wavelength = 20; ///< In the densest material
+  int m_pml_cells = 0;         ///< Absorbing layer, 0 keeps the metal walls
+  int m_warmup_periods = 30;   ///< Periods run before averaging starts
+  int m_average_periods = 10;  ///< Periods |E|^2 is averaged over
+  float m_courant = 0.99f;     ///< Fraction of the 3D stability limit
+};
+
+/**
+ * Finite difference time domain solution of Maxwell's equations on a Yee grid
+ * spanning the cavity. The walls are perfect conductors unless a graded
+ * conductivity absorbing layer (matched electric and magnetic loss) is
+ * requested. Sources are driven sinusoidally until the field settles, then
+ * the time averaged |E|^2 is tabulated at the cell centers.
+ */
+class FdtdField : public FieldProvider {
+public:
+  /**
+   * @brief FdtdField Sizes the grid so the shortest wavelength spans
+   * m_cells_per_wavelength cells
+   * @param cavity
+   * @param frequency Hz
+   * @param max_relative_permittivity Of any material added later
+   * @param cfg
+   */
+  FdtdField(const Cavity &cavity, float frequency,
+            float max_relative_permittivity, const FdtdConfig &cfg);
+
+  /**
+   * @brief addSource Drives E_z at the cell closest to the source, with the
+   * amplitude and phase of the source
+   * @param source
+   */
+  void addSource(const FieldSource &source);
+
+  /**
+   * @brief addMaterial Makes every cell whose center is inside the voxelized
+   * body lossy and dielectric, with the material of the voxel
+   * @param grid
+   * @param offset World position of the model space origin of the grid
+   * @param materials The grid indexes
+   */
+  void addMaterial(const SparseGrid &grid, const glm::vec3 &offset,
+                   const model::MaterialTable &materials);
+
+  /**
+   * @brief solve Time steps the grid and fills the |E|^2 table
+   */
+  void solve();
+
+  /**
+   * @brief samplePhasor The time average drops the phase, the field is
+   * returned as a real amplitude
+   */
+  void samplePhasor(const float *x, const float *y, const float *z,
+                    size_t count, const glm::vec3 &offset, float *field_re,
+                    float *field_im) const override;
+
+  const FieldTable &getTable() const { return m_table; }
+
+private:
+  /**
+   * @brief buildCoefficients Turns the material and absorbing layer
+   * conductivities into update coefficients
+   */
+  void buildCoefficients();
+
+  /**
+   * @brief updateH Half step of the magnetic field, z slabs run in parallel
+   */
+  void updateH();
+
+  /**
+   * @brief updateE Half step of the electric field, z slabs run in parallel
+   */
+  void updateE();
+
+  /**
+   * @brief driveSources
+   * @param time s
+   */
+  void driveSources(double time);
+
+  /**
+   * @brief accumulateFieldSq Adds |E|^2 interpolated at every cell center
+   */
+  void accumulateFieldSq();
+
+  size_t index(int i, int j, int k) const {
+    return (static_cast<size_t>(k) * m_dims.y + j) * m_dims.x + i;
+  }
+
+  FdtdConfig m_cfg;
+  glm::ivec3 m_dims{};
+  glm::vec3 m_origin{};  ///< World position of node (0, 0, 0)
+  float m_spacing = 0.f; ///< m
+  float m_frequency = 0.f;
+  double m_dt = 0.0;
+  int m_steps_per_period = 0;
+
+  // Yee staggered components, E on the cell edges and H on the faces
+  std::vector<float> m_ex, m_ey, m_ez;
+  std::vector<float> m_hx, m_hy, m_hz;
+
+  // Per cell electric and magnetic conductivity and permittivity
+  std::vector<float> m_sigma_e, m_sigma_m, m_eps_r;
+
+  // E = ca * E + cb * curl(H), H = da * H - db * curl(E)
+  std::vector<float> m_ca, m_cb, m_da, m_db;
+
+  std::vector<size_t> m_source_cells;
+  std::vector<FieldSource> m_sources;
+
+  FieldTable m_table;
+};
+
+} // namespace physics
+} // namespace simulator
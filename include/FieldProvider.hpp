@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+namespace simulator {
+namespace physics {
+
+/**
+ * Axis aligned metal box the food sits in, world space
+ */
+struct Cavity {
+  glm::vec3 m_min{-0.25f}; ///< m
+  glm::vec3 m_max{0.25f};  ///< m
+};
+
+/**
+ * Which model provides the electric field
+ */
+enum FieldModel {
+  FREE_SPACE, ///< README 1/r decay from every source, summed as phasors
+  FDTD,       ///< Maxwell's equations solved on a Yee grid over the cavity
+  CAVITY_MODES, ///< Closed form modes of the empty rectangular cavity
+  RAY_TRACED,   ///< Image sources reflected off the walls of the cavity
+};
+
+/**
+ * Source of the complex field phasor P the absorption step integrates, such
+ * that E(t) = Re(P * e^(iwt)). Providers are sampled in batches, only when
+ * the geometry moves, so the per-step cost doesn't depend on the field model.
+ */
+class FieldProvider {
+public:
+  virtual ~FieldProvider() = default;
+
+  /**
+   * @brief samplePhasor
+   * @param x
+   * @param y
+   * @param z
+   * @param count
+   * @param offset Added to every point to bring it to world space
+   * @param field_re V/m
+   * @param field_im V/m
+   */
+  virtual void samplePhasor(const float *x, const float *y, const float *z,
+                            size_t count, const glm::vec3 &offset,
+                            float *field_re, float *field_im) const = 0;
+};
+
+} // namespace physics
+} // namespace simulator
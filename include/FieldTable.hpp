@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace simulator {
+namespace physics {
+
+/**
+ * Peak |E|^2, or one part of a phasor, tabulated on a regular grid, values
+ * are stored x fastest, then y, then z
+ */
+struct FieldTable {
+  glm::ivec3 m_dims{};   ///< Samples per axis
+  glm::vec3 m_origin{};  ///< World position of sample (0, 0, 0)
+  float m_spacing = 0.f; ///< m
+  std::vector<float> m_values;
+
+  size_t size() const {
+    return static_cast<size_t>(m_dims.x) * m_dims.y * m_dims.z;
+  }
+
+  size_t index(int i, int j, int k) const {
+    return (static_cast<size_t>(k) * m_dims.y + j) * m_dims.x + i;
+  }
+
+  /**
+   * @brief sample Trilinear interpolation, points outside the table read
+   * its closest face
+   * @param x
+   * @param y
+   * @param z
+   * @param count
+   * @param offset Added to every point to bring it to world space
+   * @param out
+   */
+  void sample(const float *x, const float *y, const float *z, size_t count,
+              const glm::vec3 &offset, float *out) const;
+};
+
+} // namespace physics
+} // namespace simulator
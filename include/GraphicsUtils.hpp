@@ -4,6 +4,7 @@
 #include <GL/gl.h>
 
 #include <string>
+#include <vector>
 
 #include <CameraHandler.hpp>
 #include <Mesh.hpp>
@@ -12,6 +13,22 @@ namespace simulator {
 namespace graphics_utils {
 enum GraphicsRes { FAIL = -1, SUCCESS = 1 };
 
+/**
+ * GPU buffers of one mesh. The renderer owns them, so the models and the
+ * solver link no GL.
+ */
+struct MeshBuffers {
+  GLuint m_VAO = 0;
+  GLuint m_VBO_pos = 0;
+  GLuint m_VBO_norm = 0;
+  GLuint m_VBO_tex = 0;
+  GLuint m_VBO_temp = 0;
+  GLuint m_EBO = 0;
+};
+
+/// Buffers of every mesh of a model, in mesh order
+using ModelBuffers = std::vector<MeshBuffers>;
+
 /**
  * @brief load_texture_from_image
  * @param file_name
@@ -32,16 +49,39 @@ GraphicsRes loadShaders(const char *fragment_shader_path,
 /**
  * @brief bind_to_GPU
  * @param model
- * @return
+ * @return The buffers of its meshes, released by releaseGPU
+ */
+ModelBuffers bindToGPU(const model::Model &model);
+
+/**
+ * @brief releaseGPU Deletes the buffers of a model, with the context current
+ * @param buffers
+ */
+void releaseGPU(ModelBuffers &buffers);
+
+/**
+ * @brief uploadTemperature Streams per-vertex temperatures into the meshes'
+ * temperature VBOs
+ * @param model
+ * @param buffers Of the model
+ * @param temperature Temperatures of every mesh of the model, in mesh order
+ * @return Pointer past the last temperature consumed
  */
-void bindToGPU(model::Model &model);
+const float *uploadTemperature(const model::Model &model,
+                               const ModelBuffers &buffers,
+                               const float *temperature);
 
 /**
  * @brief render
  * @param model
+ * @param buffers Of the model
+ * @param position Of the model in the latest snapshot, the solver thread owns
+ * the model's own
  * @return
  */
-GraphicsRes render(model::Model &model, GLuint view_id, glm::mat4 view_matrix);
+GraphicsRes render(const model::Model &model, const ModelBuffers &buffers,
+                   const glm::vec3 &position, GLuint view_id,
+                   glm::mat4 view_matrix);
 
 /**
  * @brief debugOpenGL
@@ -54,6 +94,7 @@ void debugOpenGL();
  * @param camera
  * @param model_pos
  */
-void updateOnEvents(CameraHandler &camera, glm::vec3 *model_pos = nullptr);
+void updateOnEvents(CameraHandler &camera,
+                    const glm::vec3 *model_pos = nullptr);
 } // namespace graphics_utils
 } // namespace simulator
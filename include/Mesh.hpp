@@ -1,32 +1,86 @@
 #pragma once
 
-#include <GL/glew.h>
-
-#include <GL/gl.h>
-
+#include <cstdint>
 #include <glm/glm.hpp>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include <AbsorptionKernel.hpp>
+#include <FieldProvider.hpp>
+#include <PropertyTable.hpp>
+#include <Turntable.hpp>
+
 namespace simulator {
+
+class TriangleBvh;
+
 namespace model {
 
+static constexpr float kRoomTemperature = 293.15f; ///< K
+
+/**
+ * Vertex data the physics reads but never writes. The runs of a sweep or an
+ * ensemble point at one copy of it instead of each holding their own.
+ */
+struct MeshGeometry {
+  std::vector<glm::vec3> m_vert_positions;
+  std::vector<size_t> m_vert_indices;
+  // Structure-of-arrays copies of the positions for the physics kernels
+  std::vector<float> m_pos_x;
+  std::vector<float> m_pos_y;
+  std::vector<float> m_pos_z;
+};
+
 struct Mesh {
-  GLuint m_VAO;
-  GLuint m_VBO_pos;
-  GLuint m_VBO_norm;
-  GLuint m_VBO_tex;
-  GLuint m_EBO;
   std::vector<glm::vec3> m_vert_positions;
   std::vector<glm::vec3> m_vert_normals;
   std::vector<glm::vec2> m_tex_coords;
   std::vector<size_t> m_vert_indices;
-  size_t m_tex_handle;
+  size_t m_tex_handle = 0; ///< GL texture name, the renderer binds it
   std::string m_name;
+  std::string m_material_name;   ///< Assimp material the mesh came with
+  uint32_t m_material_index = 0; ///< Into the material table of the model
+
+  // Structure-of-arrays copies of the vertex data for the physics kernels
+  std::vector<float> m_pos_x;
+  std::vector<float> m_pos_y;
+  std::vector<float> m_pos_z;
+  std::vector<float> m_temperature; ///< K, one entry per vertex
+  std::vector<float> m_enthalpy;    ///< J/kg per vertex, with phase change
+  std::vector<float> m_field_re;    ///< Field phasor (V/m) per vertex
+  std::vector<float> m_field_im;
+  std::vector<uint32_t> m_material; ///< Material table index per vertex
+  // Power share the body lets through to the vertex, empty for all of it
+  std::vector<float> m_attenuation;
+  physics::TurntableCache m_turntable; ///< Only filled on a turntable
+  // Read instead of the vertex data above when set, which stays empty then
+  std::shared_ptr<const MeshGeometry> m_shared_geometry;
+
+  const std::vector<glm::vec3> &getVertPositions() const {
+    return m_shared_geometry ? m_shared_geometry->m_vert_positions
+                             : m_vert_positions;
+  }
+  const std::vector<size_t> &getVertIndices() const {
+    return m_shared_geometry ? m_shared_geometry->m_vert_indices
+                             : m_vert_indices;
+  }
+  const float *getPosX() const {
+    return m_shared_geometry ? m_shared_geometry->m_pos_x.data()
+                             : m_pos_x.data();
+  }
+  const float *getPosY() const {
+    return m_shared_geometry ? m_shared_geometry->m_pos_y.data()
+                             : m_pos_y.data();
+  }
+  const float *getPosZ() const {
+    return m_shared_geometry ? m_shared_geometry->m_pos_z.data()
+                             : m_pos_z.data();
+  }
 };
 
 struct Texture {
-  GLuint m_texture_id;
+  uint32_t m_texture_id; ///< GL texture name
   std::string m_image_name;
 };
 
@@ -35,39 +89,277 @@ struct Material {
   float m_thickness = 0.f;               ///< m
   float m_heat_capacity = 0.f;           ///< J/kg*K
   float m_electrical_conductivity = 0.f; ///< S/m
+  float m_thermal_conductivity = 0.f;    ///< W/m*K
+  float m_relative_permittivity = 1.f;
+
+  // Optional temperature curves, an empty table keeps the constant above.
+  // Conduction keeps the diffusivity of the constants.
+  PropertyTable m_electrical_conductivity_table;
+  PropertyTable m_heat_capacity_table;
+  PropertyTable m_density_table;
+
+  // Latent heats, a phase stays out while its heat is 0. With either one set
+  // the integrated state is the specific enthalpy, zero for the solid at the
+  // melting point, and the temperature is read back from it.
+  float m_melting_temperature = 273.15f;        ///< K
+  float m_latent_heat_fusion = 0.f;             ///< J/kg
+  float m_boiling_temperature = 373.15f;        ///< K
+  float m_latent_heat_vaporization = 0.f;       ///< J/kg
+  float m_frozen_electrical_conductivity = 0.f; ///< S/m of the solid phase
+
+  // Baked by bakePhaseChange
+  PropertyTable m_enthalpy_table;        ///< J/kg over K
+  PropertyTable m_temperature_table;     ///< K over J/kg
+  PropertyTable m_liquid_fraction_table; ///< Over J/kg
+
+  bool isTemperatureDependent() const {
+    return !m_electrical_conductivity_table.empty() ||
+           !m_heat_capacity_table.empty() || !m_density_table.empty();
+  }
+
+  bool hasPhaseChange() const {
+    return m_latent_heat_fusion > 0.f || m_latent_heat_vaporization > 0.f;
+  }
+};
+
+/**
+ * Materials of a model, named after the Assimp materials they stand for.
+ * bake() lays the properties out as one array or table row per material, so
+ * the absorption kernel gathers them through the material index of every
+ * vertex instead of branching per mesh. Entry 0 is the fallback for meshes
+ * whose material name isn't in the table.
+ */
+struct MaterialTable {
+  std::vector<std::string> m_names;
+  std::vector<Material> m_materials;
+
+  // Baked by bake()
+  std::vector<float> m_inv_thickness; ///< 1 / (4 * h)
+  std::vector<float> m_absorption;    ///< sigma / (4 * rho * h * c)
+  std::vector<float> m_frozen_electrical_conductivity;
+  PropertyStack m_electrical_conductivity; ///< S/m over K
+  PropertyStack m_density;                 ///< kg/m^3 over K
+  PropertyStack m_heat_capacity;           ///< J/kg*K over K
+  PropertyStack m_enthalpy;                ///< J/kg over K
+  PropertyStack m_temperature;             ///< K over J/kg
+  PropertyStack m_liquid_fraction;         ///< Over J/kg
+  bool m_temperature_dependent = false;    ///< Of any material
+  bool m_phase_change = false;             ///< Of any material
+  bool m_configured = false;               ///< Of every material
+
+  size_t size() const { return m_materials.size(); }
+
+  /**
+   * @brief add
+   * @param name Assimp material name
+   * @param material
+   * @return Index of the material
+   */
+  uint32_t add(const std::string &name, const Material &material);
+
+  /**
+   * @brief find
+   * @param name Assimp material name
+   * @return Index of the material, 0 if there is none of that name
+   */
+  uint32_t find(const std::string &name) const;
+
+  /**
+   * @brief bake Tabulates the phase change of every material and stacks the
+   * property tables. With phase change in any material every vertex runs
+   * through the enthalpy, the others get their sensible enthalpy curve.
+   * @throws std::runtime_error if the table is empty
+   */
+  void bake();
 };
 
+/**
+ * @brief heatingRate sigma(T) / (rho(T) * c(T)) for every temperature,
+ * gathered over a baked material table. Properties without a curve read as
+ * their constant.
+ * @param table
+ * @param material Table index of every temperature
+ * @param temperature K
+ * @param count
+ * @param out K/s per V^2/m^2
+ */
+void heatingRate(const MaterialTable &table, const uint32_t *material,
+                 const float *temperature, size_t count, float *out);
+
+/**
+ * @brief enthalpyRate sigma / rho(T) for every enthalpy, gathered over a
+ * baked material table with phase change. Sigma is blended from the solid to
+ * the liquid one by the melted fraction.
+ * @param table
+ * @param material Table index of every temperature
+ * @param temperature K
+ * @param enthalpy J/kg
+ * @param count
+ * @param out J/kg*s per V^2/m^2
+ */
+void enthalpyRate(const MaterialTable &table, const uint32_t *material,
+                  const float *temperature, const float *enthalpy,
+                  size_t count, float *out);
+
+/**
+ * @brief bakePhaseChange Tabulates the enthalpy of the material from 200 K
+ * below its melting point to 200 K above its boiling point, and its inverse, so
+ * reading the temperature back costs one table lookup per vertex. Outside
+ * that range the state clamps. The heat capacity curve is integrated if set.
+ * @param material
+ */
+void bakePhaseChange(Material &material);
+
 class Model {
 public:
-  Model() = default;
+  Model() { setMaterial(Material()); }
   Model(Material &material);
-  ~Model() {
-    for (auto &m : m_mesh) {
-      glDeleteVertexArrays(1, &m.m_VAO);
-      glDeleteBuffers(1, &m.m_VBO_pos);
-      glDeleteBuffers(1, &m.m_VBO_norm);
-      glDeleteBuffers(1, &m.m_VBO_tex);
-      glDeleteBuffers(1, &m.m_EBO);
-    }
-  }
 
   void updatePosition(const glm::vec3 &new_position) {
     m_position = new_position;
   };
 
-  void calculateTemperature(float timestamp);
+  /**
+   * @brief initializeThermalState Builds the SoA position buffers out of the
+   * imported vertices, unless the geometry is shared, and resets every
+   * vertex to the given temperature.
+   * Vertices take the material of their mesh unless their indices were set.
+   * @param temperature
+   */
+  void initializeThermalState(float temperature);
+
+  /**
+   * @brief shareGeometry Copies the vertex data of every mesh once, for
+   * other models to point their meshes at
+   * @return One entry per mesh
+   */
+  std::vector<std::shared_ptr<const MeshGeometry>> shareGeometry() const;
+
+  /**
+   * @brief sampleField Caches the field at every vertex for the current
+   * position of the model
+   * @param field
+   */
+  void sampleField(const physics::FieldProvider &field);
+
+  /**
+   * @brief attenuate Caches the share of the source power every vertex gets
+   * through the food in front of it, from the optical depth along the
+   * source rays through every body they cross. Absorption then costs one
+   * more multiply per vertex.
+   * @param bodies Over every model, at their current positions, with the
+   * attenuation of their materials set
+   * @param sources
+   */
+  void attenuate(const TriangleBvh &bodies,
+                 const std::vector<physics::FieldSource> &sources);
+
+  /**
+   * @brief buildTurntable Caches the field at every vertex for every
+   * turntable angle, for the current position of the model
+   * @param field
+   * @param pivot Point on the turntable axis
+   * @param cfg
+   */
+  void buildTurntable(const physics::FieldProvider &field,
+                      const glm::vec3 &pivot,
+                      const physics::TurntableConfig &cfg);
+
+  /**
+   * @brief sampleTurntable Sets the cached field to the one the vertices
+   * see while the turntable sweeps from angle0 to angle1
+   * @param angle0 rad
+   * @param angle1 rad
+   */
+  void sampleTurntable(double angle0, double angle1);
+
+  /**
+   * @brief isFieldValid
+   * @return false if the field was never sampled or the model moved since
+   */
+  bool isFieldValid() const {
+    return m_field_valid && m_field_position == m_position;
+  }
+
+  /**
+   * @brief invalidateField Resamples the field on the next step, for changes
+   * the model can't see such as another model moving into its way
+   */
+  void invalidateField() { m_field_valid = false; }
+
+  /**
+   * @brief validateField Marks the field current at this position without
+   * sampling it, for models whose field is cached by their conduction voxels
+   */
+  void validateField() {
+    m_field_position = m_position;
+    m_field_valid = true;
+  }
+
+  /**
+   * @brief calculateTemperature Advances the per-vertex temperature field by
+   * dt seconds starting at timestamp, using the cached field
+   * @param timestamp
+   * @param dt
+   * @param frequency Hz
+   * @param mode
+   */
+  void calculateTemperature(double timestamp, double dt, float frequency,
+                            physics::AbsorptionMode mode);
+
+  /**
+   * @brief getMeanTemperature
+   * @return
+   */
+  float getMeanTemperature() const;
 
   std::vector<Mesh> &getMeshVec() { return m_mesh; }
+  const std::vector<Mesh> &getMeshVec() const { return m_mesh; }
   std::vector<Texture> &getTextureVec() { return m_texture; }
   glm::vec3 &getPosition() { return m_position; }
+  const glm::vec3 &getPosition() const { return m_position; }
   void setPosition(const glm::vec3 &position) { m_position = position; }
+  Material &getMaterial() { return m_materials.m_materials.front(); }
+  const Material &getMaterial() const {
+    return m_materials.m_materials.front();
+  }
+  const MaterialTable &getMaterialTable() const { return m_materials; }
+
+  /**
+   * @brief setMaterial Makes the material the only one of the model, bakes
+   * its phase change tables and derives the enthalpy of every vertex from
+   * its temperature
+   * @param material
+   */
+  void setMaterial(const Material &material);
+
+  /**
+   * @brief setMaterials Bakes the table and assigns its materials to the
+   * meshes by name
+   * @param table
+   */
+  void setMaterials(const MaterialTable &table);
+
+  /**
+   * @brief assignMaterials Points every mesh and all of its vertices at the
+   * table entry named like its Assimp material, or at entry 0. Regions of a
+   * mesh can be given other materials afterwards through Mesh::m_material.
+   */
+  void assignMaterials();
+
+  /**
+   * @brief updateEnthalpy Derives the enthalpy of every vertex from its
+   * temperature and material, after either one was changed directly
+   */
+  void updateEnthalpy();
 
 private:
   glm::vec3 m_position{};
-  float m_temperature = 0.f; ///< K
+  glm::vec3 m_field_position{}; ///< Position the field was sampled at
+  bool m_field_valid = false;
   std::vector<Mesh> m_mesh;
   std::vector<Texture> m_texture;
-  Material m_material;
+  MaterialTable m_materials;
 };
 
 } // namespace model
@@ -6,8 +6,10 @@ namespace simulator {
  * @brief load_model
  * @param model_path
  * @param textures_path
- * @param model
+ * @param model Meshes take the entry of its material table named like their
+ * Assimp material, so the table is set before loading
+ * @param load_textures Textures need a GL context, headless runs skip them
  */
 void loadModel(const char *model_path, const char *textures_path,
-                model::Model &model);
+               model::Model &model, bool load_textures = true);
 } // namespace simulator
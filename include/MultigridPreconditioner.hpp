@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <ConjugateGradient.hpp>
+#include <CsrMatrix.hpp>
+
+namespace simulator {
+
+/**
+ * One geometric multigrid V-cycle for I + c L on the voxels of a body, with L
+ * the face Laplacian. Coarse levels merge 2x2x2 voxels and their operators
+ * are the Galerkin products of the level above, so the insulated surface of
+ * the body carries down to every level. Smoothing is red-black Gauss-Seidel,
+ * reversed on the way up so the cycle stays symmetric as conjugate gradient
+ * needs. Every sweep, restriction and prolongation runs over z slabs on the
+ * thread pool.
+ */
+class MultigridPreconditioner : public Preconditioner {
+public:
+  /**
+   * @brief update Rebuilds the hierarchy for a new geometry or coupling
+   * @param dims Of the grid, whose outermost layer is empty
+   * @param cells Grid index of every unknown
+   * @param laplacian Symmetric face Laplacian of the unknowns, a negative
+   * weight per face
+   * @param coupling c, dt / (2 h^2) for Crank-Nicolson
+   */
+  void update(const glm::ivec3 &dims, const std::vector<size_t> &cells,
+              const CsrMatrix &laplacian, float coupling);
+
+  void apply(const float *r, float *z) const override;
+
+  size_t getLevelCount() const { return m_levels.size(); }
+
+private:
+  /**
+   * 7-point operator on a padded grid, A x = diag * x - sum of w * neighbour,
+   * the one cell border is never active
+   */
+  struct Level {
+    glm::ivec3 m_dims{};
+    std::vector<float> m_diag;
+    std::vector<float> m_inv_diag; ///< 0 on inactive cells
+    std::vector<float> m_wx, m_wy, m_wz; ///< Coupling to the +x/+y/+z cell
+    // Scratch of the cycle
+    std::vector<float> m_x, m_b, m_r;
+
+    size_t size() const {
+      return static_cast<size_t>(m_dims.x) * m_dims.y * m_dims.z;
+    }
+    size_t index(int i, int j, int k) const {
+      return (static_cast<size_t>(k) * m_dims.y + j) * m_dims.x + i;
+    }
+  };
+
+  /**
+   * @brief coarsen Galerkin product of the finest level so far
+   */
+  void coarsen();
+
+  /**
+   * @brief residual m_r = m_b - A * m_x
+   */
+  static void residual(Level &level);
+
+  /**
+   * @brief relax Gauss-Seidel update of the cells of one color of the
+   * (i + j + k) checkerboard
+   * @param level
+   * @param color
+   * @param from_zero Treats the current m_x as 0
+   */
+  static void relax(Level &level, int color, bool from_zero);
+
+  /**
+   * @brief smooth Red-black Gauss-Seidel sweeps on A * m_x = m_b
+   * @param level
+   * @param sweeps
+   * @param forward Red first, the post-smoother runs backward
+   * @param from_zero Treats the current m_x as 0
+   */
+  static void smooth(Level &level, int sweeps, bool forward, bool from_zero);
+
+  /**
+   * @brief cycle V-cycle from a zero guess
+   * @param l Level index
+   */
+  void cycle(size_t l) const;
+
+  std::vector<size_t> m_cells;
+  mutable std::vector<Level> m_levels;
+};
+
+} // namespace simulator
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include <AbsorptionKernel.hpp>
+#include <FieldProvider.hpp>
+#include <TriangleBvh.hpp>
+
+namespace simulator {
+namespace physics {
+
+/**
+ * Free space field of several magnetrons at a common frequency. Every source
+ * contributes A / r * e^(i(phi - kr)) and the contributions are summed as
+ * phasors, so their relative phases set where the interference heats.
+ * With occluders a source only reaches the points it has a line of sight
+ * to.
+ */
+class PhasorField : public FieldProvider {
+public:
+  /**
+   * @brief PhasorField
+   * @param sources
+   * @param frequency Hz
+   * @param occluders Shadow the sources, nullptr for none. Must outlive the
+   * field.
+   */
+  PhasorField(const std::vector<FieldSource> &sources, float frequency,
+              const TriangleBvh *occluders = nullptr);
+
+  /**
+   * @brief samplePhasor Vertices are processed in blocks that stay in L1
+   * while every source is accumulated into them, the inner loop over the
+   * block is branch free, sin/cos included, so it vectorizes
+   */
+  void samplePhasor(const float *x, const float *y, const float *z,
+                    size_t count, const glm::vec3 &offset, float *field_re,
+                    float *field_im) const override;
+
+private:
+  // Sources as structure of arrays
+  std::vector<float> m_x;
+  std::vector<float> m_y;
+  std::vector<float> m_z;
+  std::vector<float> m_amplitude;
+  std::vector<float> m_phase;
+  float m_wavenumber = 0.f; ///< rad/m
+  const TriangleBvh *m_occluders = nullptr;
+};
+
+} // namespace physics
+} // namespace simulator
@@ -0,0 +1,15 @@
+#pragma once
+
+namespace simulator {
+
+/**
+ * Precision the conduction state is stored and integrated in, picked per run.
+ * Each one is its own instantiation of the kernels, so nothing branches on it
+ * inside a loop.
+ */
+enum Precision {
+  SINGLE, ///< Stored and computed in float
+  DOUBLE, ///< Stored and computed in double, for long integrations
+};
+
+} // namespace simulator
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace simulator {
+namespace model {
+
+/**
+ * Material property sampled at uniformly spaced arguments, the temperature
+ * for the material curves and the specific enthalpy for the phase change.
+ * Lookups clamp to the end samples and interpolate linearly without
+ * branches, so a batch of them vectorizes (the samples are gathered on AVX2
+ * and up).
+ */
+struct PropertyTable {
+  float m_min_argument = 0.f; ///< Argument of the first sample
+  float m_inv_spacing = 0.f;
+  std::vector<float> m_values;
+
+  bool empty() const { return m_values.empty(); }
+
+  /**
+   * @brief lookup
+   * @param argument K, or J/kg for the enthalpy tables
+   * @param count
+   * @param out
+   */
+  void lookup(const float *argument, size_t count, float *out) const;
+};
+
+/**
+ * Property tables of several materials resampled to one length, a row each.
+ * Every row keeps its own argument range. A lookup takes the row of every
+ * argument, so vertices of different materials share one branch-free loop.
+ */
+struct PropertyStack {
+  size_t m_samples = 0;              ///< Per row
+  std::vector<float> m_min_argument; ///< Per row
+  std::vector<float> m_inv_spacing;  ///< Per row
+  std::vector<float> m_values;       ///< Row after row
+
+  bool empty() const { return m_values.empty(); }
+
+  /**
+   * @brief lookup
+   * @param row Row of every argument
+   * @param argument K, or J/kg for the enthalpy tables
+   * @param count
+   * @param out
+   */
+  void lookup(const uint32_t *row, const float *argument, size_t count,
+              float *out) const;
+};
+
+/**
+ * @brief makePropertyTable Bakes a curve once, it is never called per vertex
+ * @param curve Property as a function of the argument
+ * @param min_argument
+ * @param max_argument
+ * @param samples At least 2
+ * @return
+ */
+PropertyTable makePropertyTable(const std::function<float(float)> &curve,
+                                float min_argument, float max_argument,
+                                size_t samples);
+
+/**
+ * @brief makePropertyStack Rows shorter than the longest table are
+ * resampled over their own range
+ * @param tables One per row, an empty table stands for its constant
+ * @param constants One per row
+ * @return
+ */
+PropertyStack
+makePropertyStack(const std::vector<const PropertyTable *> &tables,
+                  const std::vector<float> &constants);
+
+} // namespace model
+} // namespace simulator
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <AbsorptionKernel.hpp>
+#include <FieldProvider.hpp>
+#include <FieldTable.hpp>
+#include <TriangleBvh.hpp>
+
+namespace simulator {
+namespace physics {
+
+struct RayTraceConfig {
+  float m_reflectance = 0.9f;     ///< Field amplitude a wall reflects
+  int m_max_order = 3;            ///< Reflections per path
+  int m_cells_per_wavelength = 8; ///< Table resolution
+};
+
+/**
+ * Field of the sources bounced between the walls of a metal cavity, traced
+ * with image sources. Mirroring a source in a wall gives the origin of every
+ * ray that wall reflects, so each image up to the configured order stands
+ * for one specular path. The path reaches a point if tracing it back through
+ * the wall BVH meets exactly the walls the image was mirrored in, in order,
+ * and then the source. Valid paths add A * (-R)^n / L * e^(i(phi - kL)),
+ * with L their unfolded length and n their reflections, a wall flips the
+ * field like a conductor that keeps R of it. The complex sum is tabulated
+ * over the cavity in cubic tiles the thread pool hands out one by one, and
+ * interpolated per component, so the phase survives. The food is not on the
+ * paths, the field is that of the empty oven.
+ */
+class RayTracedField : public FieldProvider {
+public:
+  /**
+   * @brief RayTracedField Mirrors the sources and traces the table
+   * @param walls Three corners per triangle of a closed cavity, coplanar
+   * triangles form one wall
+   * @param sources Inside the cavity
+   * @param frequency Hz
+   * @param cfg
+   * @throws std::runtime_error when cfg is out of range or there are no
+   * walls
+   */
+  RayTracedField(const std::vector<glm::vec3> &walls,
+                 const std::vector<FieldSource> &sources, float frequency,
+                 const RayTraceConfig &cfg);
+
+  /**
+   * @brief boxWalls Two triangles per face of the box
+   * @param cavity
+   * @return
+   */
+  static std::vector<glm::vec3> boxWalls(const Cavity &cavity);
+
+  /**
+   * @brief samplePhasor Interpolates the real and imaginary tables
+   */
+  void samplePhasor(const float *x, const float *y, const float *z,
+                    size_t count, const glm::vec3 &offset, float *field_re,
+                    float *field_im) const override;
+
+  size_t getWallCount() const { return m_walls.size(); }
+  size_t getImageCount() const { return m_images.size(); }
+  const FieldTable &getRealTable() const { return m_re; }
+  const FieldTable &getImagTable() const { return m_im; }
+
+private:
+  /**
+   * Plane of coplanar wall triangles, normal pointing into the cavity
+   */
+  struct Wall {
+    glm::vec3 m_normal{};
+    float m_offset = 0.f; ///< dot(normal, x) on the plane
+  };
+
+  struct Image {
+    glm::vec3 m_position{};
+    // Wall mirrored in last, kMiss for a source
+    uint32_t m_wall = TriangleBvh::kMiss;
+    int32_t m_parent = -1;   ///< Image mirrored from, -1 for a source
+    float m_amplitude = 0.f; ///< A * (-R)^n, V/m
+    float m_phase = 0.f;     ///< rad
+  };
+
+  /**
+   * @brief groupWalls Merges coplanar triangles into walls and builds the
+   * BVH over them
+   * @param corners
+   */
+  void groupWalls(const std::vector<glm::vec3> &corners);
+
+  /**
+   * @brief mirrorSources Images order by order, never back into the wall
+   * they came from nor in a wall they are behind
+   * @param sources
+   */
+  void mirrorSources(const std::vector<FieldSource> &sources);
+
+  /**
+   * @brief build Traces every image to every table sample, tile by tile
+   * @param lo Of the cavity
+   * @param hi Of the cavity
+   */
+  void build(const glm::vec3 &lo, const glm::vec3 &hi);
+
+  RayTraceConfig m_cfg;
+  float m_wavenumber = 0.f; ///< rad/m
+  std::vector<Wall> m_walls;
+  std::vector<Image> m_images; ///< Parents before children
+  TriangleBvh m_bvh;           ///< Of the walls, grouped by wall
+  FieldTable m_re;             ///< Real part of the phasor, V/m
+  FieldTable m_im;             ///< Imaginary part, V/m
+};
+
+} // namespace physics
+} // namespace simulator
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <AbsorptionKernel.hpp>
+#include <CavityModeField.hpp>
+#include <Checkpoint.hpp>
+#include <ConductionSolver.hpp>
+#include <FdtdField.hpp>
+#include <FieldProvider.hpp>
+#include <Mesh.hpp>
+#include <PhasorField.hpp>
+#include <RayTracedField.hpp>
+#include <TimeSeries.hpp>
+#include <TriangleBvh.hpp>
+#include <TripleBuffer.hpp>
+#include <Turntable.hpp>
+
+namespace simulator {
+
+/**
+ * Where heat is tracked
+ */
+enum ThermalModel {
+  SURFACE,    ///< Per-vertex absorption only
+  VOLUMETRIC, ///< Absorption plus conduction through the voxelized body
+};
+
+/**
+ * Step doubling error control, every step is also taken as two half steps and
+ * the difference sets the next step size
+ */
+struct AdaptiveStepConfig {
+  bool m_enabled = false;
+  double m_tolerance = 0.05; ///< K, largest local error per step
+  double m_min_step = 1e-3;  ///< s
+  double m_max_step = 10.0;  ///< s
+};
+
+struct SolverConfig {
+  std::vector<physics::FieldSource> m_sources;
+  float m_frequency = 0.f; ///< Hz, shared by every source
+  physics::FieldModel m_field_model = physics::FREE_SPACE;
+  bool m_occlusion = false;   ///< Shadow rays to every vertex, free space only
+  bool m_attenuation = false; ///< Skin depth decay through the food
+  physics::Cavity m_cavity;
+  physics::FdtdConfig m_fdtd;
+  physics::CavityModeConfig m_cavity_modes;
+  physics::RayTraceConfig m_ray_trace;
+  physics::TurntableConfig m_turntable;
+  ThermalModel m_thermal_model = ThermalModel::SURFACE;
+  int m_voxel_resolution = 128; ///< Voxels along the longest model side
+  bool m_voxel_shell = false;   ///< Voxels the surface touches are inside
+  ConductionConfig m_conduction;
+  physics::AbsorptionMode m_absorption_mode = physics::CYCLE_AVERAGED;
+  double m_time_step = 1e-3;  ///< s, the first step when adaptive
+  double m_time_scale = 1.0;  ///< Simulated seconds per wall clock second
+  AdaptiveStepConfig m_adaptive;
+  std::string m_step_log_path = "steps.csv"; ///< Every step, "" disables
+  CheckpointConfig m_checkpoint;
+  TimeSeriesConfig m_history; ///< Temperature of every vertex over time
+};
+
+/**
+ * Per-vertex temperatures of every mesh of every model, concatenated in model
+ * and mesh order, and the positions they were computed at.
+ */
+struct TemperatureSnapshot {
+  double m_timeline = 0.0; ///< s
+  std::vector<float> m_temperature;
+  std::vector<glm::vec3> m_positions; ///< Per model
+};
+
+class Solver {
+public:
+  Solver(std::vector<model::Model> &models, const SolverConfig &cfg);
+  ~Solver() { stop(); }
+
+  // The worker thread keeps a pointer to this
+  Solver(const Solver &) = delete;
+  Solver &operator=(const Solver &) = delete;
+
+  /**
+   * @brief start Launches the fixed timestep solver thread
+   */
+  void start();
+
+  /**
+   * @brief stop Joins the solver thread
+   */
+  void stop();
+
+  /**
+   * @brief step Advances every model by one time step on the calling thread
+   * @param end_time Adaptive steps are shortened so they don't run past it
+   * @return The step taken, s
+   */
+  double step(double end_time = std::numeric_limits<double>::infinity());
+
+  /**
+   * @brief checkpoint Packs the state and hands it to the writer thread, the
+   * caller only waits for the copy. step() calls it every configured
+   * interval.
+   */
+  void checkpoint();
+
+  /**
+   * @brief flushCheckpoints Blocks until every checkpoint is on disk
+   */
+  void flushCheckpoints();
+
+  /**
+   * @brief closeHistory Writes the queued history frames and the index
+   */
+  void closeHistory();
+
+  /**
+   * @brief restore Continues from a checkpoint of the same models, before
+   * start()
+   * @param file
+   * @throws std::runtime_error when its state doesn't fit the models
+   */
+  void restore(const CheckpointFile &file);
+
+  /**
+   * @brief publish Copies the current temperatures into the triple buffer
+   */
+  void publish();
+
+  /**
+   * @brief acquireSnapshot Consumer side, never blocks
+   * @return true if a newer snapshot than the previous one is available
+   */
+  bool acquireSnapshot() { return m_snapshots.update(); }
+
+  /**
+   * @brief getSnapshot Latest snapshot acquired by the consumer
+   * @return
+   */
+  const TemperatureSnapshot &getSnapshot() const {
+    return m_snapshots.front();
+  }
+
+  double getTimeline() const {
+    return m_timeline.load(std::memory_order_relaxed);
+  }
+  size_t getVertexCount() const { return m_vertex_count; }
+  uint64_t getStepCount() const { return m_step_count; }
+  uint64_t getRejectedCount() const { return m_rejected_count; }
+
+  /**
+   * @brief getHistorySeconds
+   * @return Wall time step() spent handing frames to the history, s, so a
+   * caller can keep it out of the stepping time
+   */
+  double getHistorySeconds() const { return m_history_seconds; }
+
+  /**
+   * @brief getHistorySpilledCount
+   * @return Frames the history queued past its depth, 0 without a history
+   */
+  uint64_t getHistorySpilledCount() const {
+    return m_history ? m_history->getSpilledCount() : 0;
+  }
+
+  /**
+   * @brief getLag
+   * @return Simulated seconds the solver thread still owes the wall clock
+   * after its latest publish, 0 while it keeps up
+   */
+  double getLag() const { return m_lag.load(std::memory_order_relaxed); }
+
+private:
+  /**
+   * @brief buildField Sets up the field provider, FDTD is solved here once
+   */
+  void buildField();
+
+  /**
+   * @brief advance Integrates every model from timestamp over dt
+   * @param timestamp
+   * @param dt
+   */
+  void advance(double timestamp, double dt);
+
+  /**
+   * @brief stepAdaptive Step doubling, retried with a shorter step until the
+   * error estimate is within tolerance
+   * @param end_time
+   * @return
+   */
+  double stepAdaptive(double end_time);
+
+  /**
+   * @brief stepFixed
+   * @return
+   */
+  double stepFixed();
+
+  /**
+   * @brief captureState Copies the temperatures the solver integrates, the
+   * voxels for conduction and the vertices otherwise, followed by their
+   * enthalpies for materials with a phase change. Double holds every
+   * precision of the voxel state exactly.
+   * @param state
+   * @return Number of temperatures at the front, the error is measured on
+   * them only
+   */
+  size_t captureState(std::vector<double> &state) const;
+
+  /**
+   * @brief restoreState
+   * @param state
+   */
+  void restoreState(const std::vector<double> &state);
+
+  /**
+   * @brief recordHistory Queues the vertex temperatures as a history frame
+   */
+  void recordHistory();
+
+  /**
+   * @brief loop Body of the solver thread
+   */
+  void loop();
+
+  std::vector<model::Model> &m_models;
+  std::vector<std::unique_ptr<ConductionSolver>> m_conduction; ///< Per model
+  std::unique_ptr<physics::FieldProvider> m_field;
+  std::unique_ptr<TriangleBvh> m_bodies; ///< For shadows and attenuation
+  bool m_attenuate = false;              ///< Attenuation applies here
+  SolverConfig m_cfg;
+  size_t m_vertex_count = 0;
+  uint64_t m_step_count = 0;
+  uint64_t m_rejected_count = 0;
+  double m_next_step = 0.0; ///< s, proposed by the error control
+  std::vector<double> m_state_start, m_state_full, m_state_half;
+  std::ofstream m_step_log;
+  std::unique_ptr<CheckpointWriter> m_checkpoint_writer;
+  std::vector<char> m_checkpoint_image;
+  std::vector<double> m_checkpoint_voxels; ///< Voxel state being packed
+  double m_next_checkpoint = 0.0; ///< s
+  std::unique_ptr<TimeSeriesWriter> m_history;
+  std::vector<float> m_history_frame;
+  double m_history_seconds = 0.0; ///< Spent in recordHistory
+  std::atomic<double> m_timeline{0.0};
+  std::atomic<double> m_lag{0.0}; ///< s, see getLag()
+  std::atomic<bool> m_running{false};
+  std::thread m_thread;
+  TripleBuffer<TemperatureSnapshot> m_snapshots;
+};
+
+} // namespace simulator
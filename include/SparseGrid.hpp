@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <VoxelGrid.hpp>
+
+namespace simulator {
+
+/**
+ * Sparse voxel topology in the spirit of OpenVDB, three tiers deep. A hash
+ * map of the occupied 128^3 blocks of the grid points at internal nodes of
+ * 16^3 child slots, each either empty or a leaf brick of 8^3 voxels. Leaves
+ * are numbered a row of bricks along y after the other, and every per-voxel
+ * array lives outside the tree as kLeafVoxels consecutive slots per leaf, so
+ * the solver walks the leaves as flat memory and runs its stencils on dense
+ * bricks. A bit mask per leaf marks the voxels of the body, the others pad
+ * the brick. Memory scales with the bricks the body touches, not with its
+ * bounding box, even while the grid is built.
+ */
+class SparseGrid {
+public:
+  static constexpr int kLeafSize = 8; ///< Voxels per leaf edge
+  static constexpr size_t kLeafVoxels = 512;
+  static constexpr int kNodeSize = 16; ///< Leaves per internal node edge
+  /// Missing leaf or neighbour
+  static constexpr uint32_t kNone = UINT32_MAX;
+  /// Slot of a voxel outside every leaf
+  static constexpr size_t kNoSlot = SIZE_MAX;
+
+  /**
+   * @brief build Voxelizes a model band by band, one row of bricks per band,
+   * and allocates a leaf for every brick holding an occupied voxel. The
+   * dense grid is never held, only a band per thread while it's sparsified.
+   * @param model
+   * @param resolution See voxelizeModel
+   * @param shell See voxelizeModel
+   */
+  void build(const model::Model &model, int resolution, bool shell);
+
+  size_t getLeafCount() const { return m_leaf_origins.size(); }
+
+  /**
+   * @brief size
+   * @return Slots of every leaf, what per-voxel arrays are sized to
+   */
+  size_t size() const { return getLeafCount() * kLeafVoxels; }
+
+  /**
+   * @brief getActiveCount
+   * @return Occupied voxels
+   */
+  size_t getActiveCount() const { return m_active_count; }
+
+  /**
+   * @brief find Walks the root map, the internal node and the leaf
+   * @return Slot of the voxel, kNoSlot when no leaf covers it
+   */
+  size_t find(int i, int j, int k) const;
+
+  bool isActive(size_t slot) const {
+    return (m_active[slot >> 6] >> (slot & 63)) & 1;
+  }
+
+  uint8_t getMaterial(size_t slot) const { return m_material[slot]; }
+
+  /**
+   * @brief getNeighbour
+   * @param leaf
+   * @param face -x, +x, -y, +y, -z, +z
+   * @return Leaf across the face, kNone for an empty brick
+   */
+  uint32_t getNeighbour(size_t leaf, int face) const {
+    return m_neighbours[6 * leaf + face];
+  }
+
+  /**
+   * @brief neighbourSlot
+   * @param slot
+   * @param face -x, +x, -y, +y, -z, +z
+   * @return Slot across the face, kNoSlot in an empty brick
+   */
+  size_t neighbourSlot(size_t slot, int face) const;
+
+  const glm::ivec3 &getLeafOrigin(size_t leaf) const {
+    return m_leaf_origins[leaf];
+  }
+
+  glm::ivec3 coord(size_t slot) const {
+    const size_t local = slot % kLeafVoxels;
+    return m_leaf_origins[slot / kLeafVoxels] +
+           glm::ivec3(static_cast<int>(local % kLeafSize),
+                      static_cast<int>(local / kLeafSize % kLeafSize),
+                      static_cast<int>(local / (kLeafSize * kLeafSize)));
+  }
+
+  glm::vec3 center(size_t slot) const {
+    return m_origin + m_spacing * (glm::vec3(coord(slot)) + glm::vec3(0.5f));
+  }
+
+  static size_t localIndex(int x, int y, int z) {
+    return (static_cast<size_t>(z) * kLeafSize + y) * kLeafSize + x;
+  }
+
+  glm::ivec3 m_dims{};   ///< Of the dense grid, border included
+  glm::vec3 m_origin{};  ///< Model space corner of voxel (0, 0, 0)
+  float m_spacing = 0.f; ///< m
+
+private:
+  static uint64_t blockKey(int i, int j, int k);
+
+  /// Slot of the leaf of a voxel among the children of its internal node
+  static size_t childIndex(int i, int j, int k);
+
+  /**
+   * @brief findLeaf Walks the root map and the internal node
+   * @return Leaf covering the voxel, kNone when there is none
+   */
+  uint32_t findLeaf(int i, int j, int k) const;
+
+  std::unordered_map<uint64_t, uint32_t> m_root; ///< Block to internal node
+  std::vector<uint32_t> m_children; ///< kNodeSize^3 leaves per node
+  std::vector<glm::ivec3> m_leaf_origins;
+  std::vector<uint32_t> m_neighbours; ///< 6 per leaf
+  std::vector<uint64_t> m_active;     ///< 8 words per leaf, a bit per voxel
+  std::vector<uint8_t> m_material;    ///< Material table index per slot
+  size_t m_active_count = 0;
+};
+
+} // namespace simulator
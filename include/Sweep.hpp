@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Engine.hpp>
+#include <Mesh.hpp>
+
+namespace simulator {
+
+struct SweepConfig {
+  double m_duration = 60.0; ///< Simulated seconds per run
+  float m_initial_temperature = model::kRoomTemperature; ///< K
+  size_t m_threads = 0; ///< Concurrent runs, 0 uses every hardware thread
+  std::string m_output_path = "sweep.csv";
+};
+
+/**
+ * Outcome of one run, temperatures are over every vertex of the model
+ */
+struct SweepSummary {
+  size_t m_engine = 0;   ///< Index into the engine configurations
+  size_t m_material = 0; ///< Index into the materials
+  float m_mean_temperature = 0.f; ///< K
+  float m_min_temperature = 0.f;  ///< K
+  float m_max_temperature = 0.f;  ///< K
+  float m_std_temperature = 0.f;  ///< K
+  uint64_t m_steps = 0;
+  uint64_t m_rejected = 0;
+  double m_wall_time = 0.0; ///< s
+};
+
+/// Geometry of every mesh of a prototype, read by all of its runs
+using SharedGeometry = std::vector<std::shared_ptr<const model::MeshGeometry>>;
+
+/**
+ * @brief copyRunModel Fills an empty model with the part of a prototype the
+ * physics reads. The run points at the shared geometry and only holds its
+ * own material assignment and thermal state.
+ * @param prototype
+ * @param material Replaces entry 0 of the prototype's material table
+ * @param temperature K, initial
+ * @param geometry Of the prototype, from Model::shareGeometry
+ * @param run
+ */
+void copyRunModel(const model::Model &prototype,
+                  const model::Material &material, float temperature,
+                  const SharedGeometry &geometry, model::Model &run);
+
+/**
+ * @brief runPath Names the file of one run after the file of the sweep,
+ * steps.csv becomes steps_12.csv for run 12
+ * @param path
+ * @param run
+ * @return "" when path is ""
+ */
+std::string runPath(const std::string &path, size_t run);
+
+/**
+ * @brief expandSweep Cartesian product of a list of variants with one more
+ * parameter
+ * @param variants
+ * @param values
+ * @param apply apply(variant, value) sets the value on a copy of a variant
+ * @return variants.size() * values.size() variants, the new parameter
+ * varying fastest
+ */
+template <typename Variant, typename Value, typename Apply>
+std::vector<Variant> expandSweep(const std::vector<Variant> &variants,
+                                 const std::vector<Value> &values,
+                                 Apply apply) {
+  std::vector<Variant> expanded;
+  expanded.reserve(variants.size() * values.size());
+  for (const Variant &variant : variants) {
+    for (const Value &value : values) {
+      expanded.push_back(variant);
+      apply(expanded.back(), value);
+    }
+  }
+  return expanded;
+}
+
+/**
+ * @brief runSweep Runs every engine configuration with every material on
+ * the same imported model, one run per task of a work-stealing pool, and
+ * streams a summary row per run to cfg.m_output_path as runs finish. The
+ * solvers step on the calling worker only, so a node is saturated by runs
+ * rather than by kernels. Each run writes the step log of its configuration
+ * to its own runPath.
+ * @param prototype Imported once, only read. Runs copy its positions and
+ * indices, never its normals or texture coordinates.
+ * @param engines
+ * @param materials
+ * @param cfg
+ * @return Summaries in run order, engine major
+ */
+std::vector<SweepSummary>
+runSweep(const model::Model &prototype,
+         const std::vector<EngineConfig> &engines,
+         const std::vector<model::Material> &materials,
+         const SweepConfig &cfg);
+
+} // namespace simulator
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace simulator {
+
+/**
+ * Persistent worker threads shared by every parallel kernel, so sweeps don't
+ * pay for thread creation on every step.
+ */
+class ThreadPool {
+public:
+  using RangeFn = std::function<void(size_t, size_t)>;
+
+  /**
+   * @brief getInstance
+   * @return
+   */
+  static ThreadPool &getInstance() {
+    static ThreadPool instance;
+    return instance;
+  }
+
+  /**
+   * @brief getThreadCount Workers plus the calling thread
+   * @return
+   */
+  size_t getThreadCount() const { return m_workers.size() + 1; }
+
+  /**
+   * @brief parallelFor Splits [begin, end) in chunks of at most grain items
+   * and runs fn(chunk_begin, chunk_end) on them across all threads. The
+   * calling thread takes part and the call returns once every chunk is done.
+   * Must not be called from inside fn.
+   * @param begin
+   * @param end
+   * @param fn
+   * @param grain
+   */
+  void parallelFor(size_t begin, size_t end, const RangeFn &fn,
+                   size_t grain = 1);
+
+  /**
+   * While alive, parallelFor runs the whole range inline on the thread that
+   * created it. For work that is already parallel at a coarser level, such
+   * as the runs of a sweep, so their kernels neither queue on the pool nor
+   * nest inside it.
+   */
+  class InlineScope {
+  public:
+    InlineScope();
+    ~InlineScope();
+
+    InlineScope(const InlineScope &) = delete;
+    InlineScope &operator=(const InlineScope &) = delete;
+
+  private:
+    bool m_previous;
+  };
+
+private:
+  ThreadPool();
+  ~ThreadPool();
+
+  // Delete copy ctor and assignment
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief workerLoop
+   */
+  void workerLoop();
+
+  /**
+   * @brief runChunks Claims chunks of the current job until none is left
+   */
+  void runChunks();
+
+  std::vector<std::thread> m_workers;
+
+  // Serializes callers, a single job is in flight at a time
+  std::mutex m_submit_mutex;
+
+  std::mutex m_mutex;
+  std::condition_variable m_job_cv;
+  std::condition_variable m_done_cv;
+  uint64_t m_generation = 0;
+  size_t m_busy_workers = 0;
+  bool m_stop = false;
+
+  // Current job
+  const RangeFn *m_fn = nullptr;
+  size_t m_end = 0;
+  size_t m_grain = 1;
+  std::atomic<size_t> m_next{0};
+};
+
+} // namespace simulator
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace simulator {
+
+struct TimeSeriesConfig {
+  std::string m_path = "";      ///< "" disables the history
+  int m_stride = 1;             ///< Solver steps per frame
+  int m_keyframe_interval = 64; ///< Frames per self-contained frame
+  int m_mantissa_bits = 23;     ///< Kept per float, 23 is lossless
+  size_t m_queue_depth = 8;     ///< Frames buffered ahead of the disk
+  // Past a full queue a frame replaces the newest queued one instead of
+  // spilling past the depth, for runs that must keep their memory bounded
+  bool m_drop_frames = false;
+};
+
+/**
+ * Chunk of one frame in a time series file, followed by its compressed bytes
+ */
+struct TimeSeriesChunk {
+  double m_time = 0.0; ///< s
+  uint32_t m_frame = 0;
+  uint32_t m_skipped = 0; ///< Frames dropped right before this one
+  uint32_t m_flags = 0;   ///< 1 for a keyframe
+  uint32_t m_size = 0;    ///< Compressed bytes
+};
+
+/**
+ * Entry of the index at the end of a time series file, one per frame
+ */
+struct TimeSeriesIndexEntry {
+  double m_time = 0.0;   ///< s
+  uint64_t m_offset = 0; ///< Of the chunk header
+  uint32_t m_flags = 0;
+  uint32_t m_size = 0;
+  uint32_t m_skipped = 0; ///< Frames dropped right before this one
+  uint32_t m_reserved = 0;
+};
+
+/**
+ * Appends temperature frames to a chunked file on an I/O thread of its own.
+ * A frame is rounded to the configured mantissa bits and predicted by
+ * extrapolating the two previous frames, which leaves residuals of a few
+ * units in the last place while the heating rate changes slowly.
+ * Keyframes predict from the previous vertex and the frame after them from
+ * the keyframe alone. Residuals are zigzag coded and byte shuffled, so their
+ * mostly zero high bytes line up, and LZ compressed. The producer hands
+ * frames over through a queue by swapping buffers and never waits for the
+ * disk. When the disk falls a full queue behind, the queue spills past its
+ * depth into fresh buffers and counts the frames that did, or with
+ * m_drop_frames the frame replaces the newest queued one and the chunk
+ * records the skipped step. Closing appends a time index.
+ */
+class TimeSeriesWriter {
+public:
+  /**
+   * @brief TimeSeriesWriter Opens the file and writes its header
+   * @param cfg
+   * @param vertex_count Floats per frame
+   * @throws std::runtime_error when the file can't be opened or cfg is out
+   * of range
+   */
+  TimeSeriesWriter(const TimeSeriesConfig &cfg, size_t vertex_count);
+  ~TimeSeriesWriter() { close(); }
+
+  TimeSeriesWriter(const TimeSeriesWriter &) = delete;
+  TimeSeriesWriter &operator=(const TimeSeriesWriter &) = delete;
+
+  /**
+   * @brief push Queues a frame without waiting. Past a full queue the frame
+   * spills into a fresh buffer, or with m_drop_frames replaces the newest
+   * queued one.
+   * @param time s
+   * @param frame vertex_count floats, swapped with a recycled buffer
+   */
+  void push(double time, std::vector<float> &frame);
+
+  /**
+   * @brief close Writes every queued frame and the index, later pushes are
+   * ignored
+   */
+  void close();
+
+  uint64_t getFrameCount() const;
+  uint64_t getStoredBytes() const;  ///< Compressed chunks and their headers
+  uint64_t getDroppedCount() const; ///< Frames replaced before the disk
+  uint64_t getSpilledCount() const; ///< Frames queued past the depth
+
+private:
+  struct Frame {
+    double m_time = 0.0;
+    uint32_t m_skipped = 0; ///< Replaced while it was queued
+    std::vector<float> m_values;
+  };
+
+  void loop();
+
+  /**
+   * @brief encode Compresses and appends one frame, on the I/O thread
+   * @param frame
+   */
+  void encode(const Frame &frame);
+
+  TimeSeriesConfig m_cfg;
+  size_t m_vertex_count = 0;
+  std::ofstream m_file;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::deque<Frame> m_queue;
+  std::vector<std::vector<float>> m_free; ///< Recycled frame buffers
+  bool m_quit = false;
+  bool m_closed = false;
+  uint64_t m_frames = 0;
+  uint64_t m_dropped = 0;
+  uint64_t m_spilled = 0;
+  uint64_t m_stored_bytes = 0;
+  std::thread m_thread;
+
+  // I/O thread only
+  std::vector<uint32_t> m_previous; ///< Rounded bits of the last frame
+  std::vector<uint32_t> m_before;   ///< And of the one before it
+  std::vector<uint8_t> m_shuffled;
+  std::vector<uint8_t> m_compressed;
+  std::vector<TimeSeriesIndexEntry> m_index;
+  bool m_failed = false;
+};
+
+/**
+ * Random access to a time series file. A frame is decoded from the keyframe
+ * at or before it, reading consecutive frames decodes each chunk once. Files
+ * whose index was never written, because the run was killed, are indexed by
+ * walking the chunk headers.
+ */
+class TimeSeriesReader {
+public:
+  /**
+   * @brief TimeSeriesReader
+   * @param path
+   * @throws std::runtime_error when the file is missing or of another
+   * version
+   */
+  explicit TimeSeriesReader(const std::string &path);
+
+  size_t getFrameCount() const { return m_index.size(); }
+  size_t getVertexCount() const { return m_vertex_count; }
+  double getTime(size_t frame) const { return m_index[frame].m_time; }
+  /// Frames the writer dropped between this one and the one before it
+  uint32_t getSkipped(size_t frame) const { return m_index[frame].m_skipped; }
+
+  /**
+   * @brief findFrame
+   * @param time s
+   * @return Last frame at or before time, the first one before it
+   */
+  size_t findFrame(double time) const;
+
+  /**
+   * @brief readFrame
+   * @param frame
+   * @param temperature Resized to the vertex count, K
+   * @throws std::runtime_error on a corrupt chunk
+   */
+  void readFrame(size_t frame, std::vector<float> &temperature);
+
+private:
+  /**
+   * @brief decode Applies one chunk on top of m_bits
+   * @param frame
+   */
+  void decode(size_t frame);
+
+  std::ifstream m_file;
+  size_t m_vertex_count = 0;
+  size_t m_keyframe_interval = 1;
+  int m_dropped_bits = 0; ///< Mantissa bits the writer rounded off
+  std::vector<TimeSeriesIndexEntry> m_index;
+  std::vector<uint32_t> m_bits;   ///< Of m_decoded, shifted down
+  std::vector<uint32_t> m_before; ///< Of the frame before it
+  size_t m_decoded = SIZE_MAX;    ///< Frame in m_bits, SIZE_MAX for none
+  std::vector<uint8_t> m_shuffled;
+  std::vector<uint8_t> m_compressed;
+};
+
+} // namespace simulator
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Mesh.hpp>
+
+namespace simulator {
+
+/**
+ * Node of a TriangleBvh, two per cache line. The children of a node are
+ * stored next to each other, after it.
+ */
+struct BvhNode {
+  glm::vec3 m_min{};
+  uint32_t m_first = 0; ///< Left child, or the first triangle of a leaf
+  glm::vec3 m_max{};
+  uint32_t m_count = 0; ///< Triangles of a leaf, 0 for inner nodes
+};
+
+/**
+ * Bounding volume hierarchy over the triangles of every mesh of every model,
+ * or over loose triangles, in world space. Splits minimize the surface area
+ * heuristic over binned centroids. The top levels are split with binning
+ * spread over the thread pool, then the subtrees below them are built in
+ * parallel. Triangles are stored as arrays in leaf order, so a leaf reads
+ * contiguous memory.
+ */
+class TriangleBvh {
+public:
+  /// Group closestHit reports for a segment that hits nothing
+  static constexpr uint32_t kMiss = UINT32_MAX;
+
+  /**
+   * @brief build Meshes wound inside out are flipped, so every triangle
+   * faces out of its mesh
+   * @param models
+   */
+  void build(const std::vector<model::Model> &models);
+
+  /**
+   * @brief build Over loose triangles, such as the walls of a cavity. The
+   * tree can't be refit.
+   * @param corners Three per triangle
+   * @param groups One per triangle, reported by closestHit
+   */
+  void build(const std::vector<glm::vec3> &corners,
+             const std::vector<uint32_t> &groups);
+
+  /**
+   * @brief refit Moves the triangles of every model that moved since the
+   * last build or refit and recomputes the node bounds bottom up, the
+   * topology is kept
+   * @param models The ones the tree was built over
+   * @return true if any model moved
+   */
+  bool refit(const std::vector<model::Model> &models);
+
+  /**
+   * @brief setAttenuation Gives every triangle the attenuation constant of
+   * the material of its mesh, for opticalDepth. A fresh tree has none.
+   * @param alpha Per model the tree was built over, per entry of its
+   * material table, 1/m
+   */
+  void setAttenuation(const std::vector<std::vector<float>> &alpha);
+
+  /**
+   * @brief visibility Traces shadow rays from origin to every point in
+   * packets of neighbouring points, which share the node tests and every
+   * per-triangle term that only depends on the origin. A ray stops just
+   * short of its point, so the triangles a vertex belongs to don't hide it.
+   * @param origin World space
+   * @param x
+   * @param y
+   * @param z
+   * @param count
+   * @param offset Added to every point to bring it to world space
+   * @param visible 1 for a clear line of sight, 0 for an occluded one
+   */
+  void visibility(const glm::vec3 &origin, const float *x, const float *y,
+                  const float *z, size_t count, const glm::vec3 &offset,
+                  float *visible) const;
+
+  /**
+   * @brief opticalDepth Sum of alpha_i d_i over the bodies every segment
+   * from origin to a point runs through, d_i the length inside body i and
+   * alpha_i the attenuation constant of the mesh crossed. Each crossing adds
+   * alpha times the rest of the segment when it enters a mesh and takes it
+   * off when it leaves, so the crossings need no sorting.
+   * @param origin World space, outside every mesh
+   * @param x
+   * @param y
+   * @param z
+   * @param count
+   * @param offset Added to every point to bring it to world space
+   * @param depth Dimensionless, the power left is e^(-2 depth)
+   */
+  void opticalDepth(const glm::vec3 &origin, const float *x, const float *y,
+                    const float *z, size_t count, const glm::vec3 &offset,
+                    float *depth) const;
+
+  /**
+   * @brief closestHit Finds the nearest triangle along every segment from
+   * an origin to origin + direction, in packets of rays with origins of
+   * their own. Segments stop a small fraction of their length before their
+   * end, as shadow rays do.
+   * @param ox
+   * @param oy
+   * @param oz
+   * @param dx
+   * @param dy
+   * @param dz
+   * @param skip Group every ray ignores, the one it leaves from, kMiss for
+   * none
+   * @param count
+   * @param t Of the hit along the segment, 1 for a miss
+   * @param group Of the triangle hit, or the model for a tree over models,
+   * kMiss for a miss
+   */
+  void closestHit(const float *ox, const float *oy, const float *oz,
+                  const float *dx, const float *dy, const float *dz,
+                  const uint32_t *skip, size_t count, float *t,
+                  uint32_t *group) const;
+
+  size_t getNodeCount() const { return m_nodes.size(); }
+  size_t getTriangleCount() const { return m_model.size(); }
+
+private:
+  std::vector<BvhNode> m_nodes;
+  // Triangles in leaf order, a corner and the edges from it to the others
+  std::vector<float> m_ax, m_ay, m_az;
+  std::vector<float> m_e1x, m_e1y, m_e1z;
+  std::vector<float> m_e2x, m_e2y, m_e2z;
+  std::vector<uint32_t> m_model;      ///< Model or group of every triangle
+  std::vector<uint32_t> m_material;   ///< Table entry of its mesh
+  std::vector<float> m_alpha;         ///< 1/m, of its mesh
+  std::vector<glm::vec3> m_positions; ///< Of the models, at the last fit
+
+  /**
+   * @brief buildTriangles Builds the tree and stores the triangles in leaf
+   * order, m_model and m_material hold those of every triangle on entry
+   */
+  void buildTriangles(const std::vector<glm::vec3> &a,
+                      const std::vector<glm::vec3> &b,
+                      const std::vector<glm::vec3> &c);
+};
+
+} // namespace simulator
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace simulator {
+
+/**
+ * Single producer / single consumer triple buffer. The producer always owns a
+ * back slot it can fill at its own pace, the consumer always owns a front slot
+ * it can read at its own pace and the third slot is handed over through a
+ * single atomic exchange, so neither side ever waits for the other.
+ */
+template <typename T> class TripleBuffer {
+public:
+  TripleBuffer() = default;
+
+  /**
+   * @brief back Slot owned by the producer
+   * @return
+   */
+  T &back() { return m_slots[m_back]; }
+
+  /**
+   * @brief publish Hands the back slot over to the consumer
+   */
+  void publish() {
+    const uint8_t previous =
+        m_middle.exchange(m_back | kDirty, std::memory_order_acq_rel);
+    m_back = previous & kIndexMask;
+  }
+
+  /**
+   * @brief update Makes the latest published slot the front slot
+   * @return true if a new slot was published since the last call
+   */
+  bool update() {
+    if (!(m_middle.load(std::memory_order_relaxed) & kDirty)) {
+      return false;
+    }
+    const uint8_t previous =
+        m_middle.exchange(m_front, std::memory_order_acq_rel);
+    m_front = previous & kIndexMask;
+    return true;
+  }
+
+  /**
+   * @brief front Slot owned by the consumer
+   * @return
+   */
+  const T &front() const { return m_slots[m_front]; }
+
+  /**
+   * @brief forEachSlot Runs fn on every slot, only safe before the producer
+   * and the consumer start
+   * @param fn
+   */
+  template <typename Fn> void forEachSlot(Fn &&fn) {
+    for (auto &slot : m_slots) {
+      fn(slot);
+    }
+  }
+
+private:
+  static constexpr uint8_t kDirty = 0x4;
+  static constexpr uint8_t kIndexMask = 0x3;
+
+  std::array<T, 3> m_slots;
+  // Keep the shared index away from the slots the two threads write to
+  alignas(64) std::atomic<uint8_t> m_middle{1};
+  alignas(64) uint8_t m_back = 0;
+  alignas(64) uint8_t m_front = 2;
+};
+
+} // namespace simulator
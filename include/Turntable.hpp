@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <AbsorptionKernel.hpp>
+#include <FieldProvider.hpp>
+
+namespace simulator {
+namespace physics {
+
+/**
+ * Turntable the food spins on, about the axis through the first source
+ */
+struct TurntableConfig {
+  bool m_enabled = false;
+  double m_period = 12.0;         ///< s per revolution
+  int m_angle_count = 72;         ///< Angles the field is cached at
+  glm::vec3 m_axis{0.f, 1.f, 0.f}; ///< Unit direction
+  // Bytes the field cache of one model may take, fewer angles are cached
+  // when m_angle_count would not fit
+  uint64_t m_max_cache_bytes = uint64_t(512) << 20;
+};
+
+/**
+ * @brief turntablePivot
+ * @param sources
+ * @return Point the axis goes through, the first source or the origin
+ */
+glm::vec3 turntablePivot(const std::vector<FieldSource> &sources);
+
+/**
+ * @brief turntableAngle
+ * @param cfg
+ * @param time s
+ * @return rad, unwrapped
+ */
+double turntableAngle(const TurntableConfig &cfg, double time);
+
+/**
+ * Peak |E|^2 at a fixed set of body points for N evenly spaced turntable
+ * angles, plus its integral over a whole revolution. A step reads the mean
+ * over the arc it sweeps, so steps spanning whole revolutions average the
+ * field instead of aliasing, and the provider is never called after build.
+ * The cache takes N + 1 floats per point, N is capped to fit
+ * TurntableConfig::m_max_cache_bytes.
+ */
+class TurntableCache {
+public:
+  /**
+   * @brief build Samples the field at every point rotated to every angle,
+   * with fewer angles than configured when they would exceed the budget
+   * @param field
+   * @param x Body frame
+   * @param y
+   * @param z
+   * @param count
+   * @param offset Brings the points to world space before they turn
+   * @param pivot Point on the axis, world space
+   * @param cfg
+   * @throws std::runtime_error when the budget can't hold a single angle
+   */
+  void build(const FieldProvider &field, const float *x, const float *y,
+             const float *z, size_t count, const glm::vec3 &offset,
+             const glm::vec3 &pivot, const TurntableConfig &cfg);
+
+  /**
+   * @brief sample Field the absorption step integrates while the body turns
+   * from angle0 to angle1, as a real phasor since the phases are not cached
+   * @param angle0 rad
+   * @param angle1 rad
+   * @param field_re sqrt of the mean |E|^2 over the arc, V/m
+   * @param field_im Set to 0
+   */
+  void sample(double angle0, double angle1, float *field_re,
+              float *field_im) const;
+
+  bool empty() const { return m_intensity.empty(); }
+  size_t size() const { return m_count; }
+
+  /**
+   * @brief getAngleCount
+   * @return Angles cached, m_angle_count unless the budget capped it
+   */
+  int getAngleCount() const { return m_angles; }
+
+private:
+  size_t m_count = 0;
+  int m_angles = 0;
+  std::vector<float> m_intensity; ///< [angle][point], V^2/m^2
+  std::vector<float> m_revolution; ///< Per point, in angle spacings
+};
+
+} // namespace physics
+} // namespace simulator
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Mesh.hpp>
+
+namespace simulator {
+
+/**
+ * Regular grid over the bounding box of a model. Voxels are stored x fastest,
+ * then y, then z, and the outermost layer is always empty so stencils never
+ * need bounds checks.
+ */
+struct VoxelGrid {
+  glm::ivec3 m_dims{};   ///< Voxels per axis, border included
+  glm::vec3 m_origin{};  ///< Model space corner of voxel (0, 0, 0)
+  float m_spacing = 0.f; ///< m
+  std::vector<uint8_t> m_occupancy;
+  std::vector<uint8_t> m_material; ///< Material table index, where occupied
+
+  size_t size() const {
+    return static_cast<size_t>(m_dims.x) * m_dims.y * m_dims.z;
+  }
+
+  size_t index(int i, int j, int k) const {
+    return (static_cast<size_t>(k) * m_dims.y + j) * m_dims.x + i;
+  }
+
+  glm::vec3 center(int i, int j, int k) const {
+    return m_origin + m_spacing * glm::vec3(i + 0.5f, j + 0.5f, k + 0.5f);
+  }
+};
+
+/**
+ * @brief sizeVoxelGrid Fits a grid to the bounding box of a model, with an
+ * empty border, and leaves its arrays empty
+ * @param model At most 256 materials
+ * @param resolution Voxels along the longest side of the bounding box
+ * @param grid
+ */
+void sizeVoxelGrid(const model::Model &model, int resolution,
+                   VoxelGrid &grid);
+
+/**
+ * @brief voxelizeBands Voxelizes a model band of rows by band of rows, as
+ * voxelizeModel does, without ever holding the whole grid. The thread pool
+ * fills the bands side by side, each worker into one band it reuses, so
+ * at most a band per thread is alive.
+ * @param model
+ * @param shell See voxelizeModel
+ * @param grid From sizeVoxelGrid
+ * @param band_rows Rows along y per band
+ * @param sink sink(first_row, band) for every band, concurrently. The band
+ * is the grid restricted to its rows, from first_row on, and is only valid
+ * during the call.
+ */
+void voxelizeBands(const model::Model &model, bool shell,
+                   const VoxelGrid &grid, int band_rows,
+                   const std::function<void(int, const VoxelGrid &)> &sink);
+
+/**
+ * @brief voxelizeModel Fills the voxels whose center lies inside a closed
+ * mesh of the model, using the crossing parity of a ray cast along z through
+ * every column, and optionally every voxel the surface touches. Triangles are
+ * binned into bands of rows that the thread pool voxelizes independently.
+ * @param model At most 256 materials
+ * @param resolution Voxels along the longest side of the bounding box
+ * @param shell Also fill the voxels a triangle overlaps, so walls thinner
+ * than a voxel and open surfaces survive, at the cost of up to a voxel of
+ * extra thickness
+ * @param grid Inside voxels take the material of the triangle the ray
+ * entered through, a mesh later in the model wins where meshes overlap
+ */
+void voxelizeModel(model::Model &model, int resolution, bool shell,
+                   VoxelGrid &grid);
+
+} // namespace simulator
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace simulator {
+
+/**
+ * Pool for coarse independent tasks of uneven length, such as the runs of a
+ * sweep. Every worker owns a deque, pops its newest task and, once it runs
+ * dry, steals the oldest task of another worker, so a few long runs don't
+ * leave the rest of the node idle. Tasks run their ThreadPool kernels inline,
+ * the parallelism is across tasks.
+ */
+class WorkStealingPool {
+public:
+  using Task = std::function<void()>;
+
+  /**
+   * @brief WorkStealingPool
+   * @param threads 0 uses every hardware thread
+   */
+  explicit WorkStealingPool(size_t threads = 0);
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  /**
+   * @brief submit Queues a task, on the deque of the calling worker when a
+   * task submits more and round robin otherwise
+   * @param task
+   */
+  void submit(Task task);
+
+  /**
+   * @brief wait Blocks until every submitted task has run, then rethrows the
+   * first exception a task threw
+   */
+  void wait();
+
+  size_t getThreadCount() const { return m_workers.size(); }
+
+private:
+  struct Queue {
+    std::mutex m_mutex;
+    std::deque<Task> m_tasks;
+  };
+
+  /**
+   * @brief tryTake Own newest task first, then the oldest of the others
+   * @param worker
+   * @param task
+   * @return false if every deque was empty
+   */
+  bool tryTake(size_t worker, Task &task);
+
+  /**
+   * @brief workerLoop
+   * @param worker
+   */
+  void workerLoop(size_t worker);
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_workers;
+  std::atomic<size_t> m_next_queue{0};
+
+  std::mutex m_mutex;
+  std::condition_variable m_work_cv;
+  std::condition_variable m_done_cv;
+  size_t m_unclaimed = 0; ///< Queued tasks no worker has claimed yet
+  size_t m_pending = 0;   ///< Submitted tasks that haven't finished
+  bool m_stop = false;
+  std::exception_ptr m_error;
+};
+
+} // namespace simulator
@@ -0,0 +1,85 @@
+#include "AbsorptionKernel.hpp"
+
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+
+namespace simulator {
+namespace physics {
+
+// Keeps the argument of the trigonometric functions small, w * t reaches
+// 1e12 rad within minutes at oven frequencies
+static inline double wrapPhase(double phase) {
+  return std::fmod(phase, glm::two_pi<double>());
+}
+
+HarmonicFactors harmonicFactors(double omega, double t0, double dt,
+                                AbsorptionMode mode) {
+  HarmonicFactors factors;
+  factors.m_mean = 0.5 * dt;
+
+  if (mode == AbsorptionMode::INSTANTANEOUS || omega <= 0.0) {
+    const double phase = wrapPhase(2.0 * omega * t0);
+    factors.m_cos = 0.5 * dt * std::cos(phase);
+    factors.m_sin = -0.5 * dt * std::sin(phase);
+    return factors;
+  }
+
+  const double phase_0 = wrapPhase(2.0 * omega * t0);
+  const double phase_1 = wrapPhase(2.0 * omega * (t0 + dt));
+  factors.m_cos = (std::sin(phase_1) - std::sin(phase_0)) / (4.0 * omega);
+  factors.m_sin = (std::cos(phase_1) - std::cos(phase_0)) / (4.0 * omega);
+  return factors;
+}
+
+template <typename Real>
+void absorbField(const float *__restrict__ field_re,
+                 const float *__restrict__ field_im,
+                 Real *__restrict__ temperature, size_t count,
+                 float coefficient, const HarmonicFactors &factors) {
+  // a|P|^2 + b Re(P^2) + c Im(P^2) = (a + b) re^2 + (a - b) im^2 + 2c re im
+  const Real k_re =
+      static_cast<Real>(coefficient * (factors.m_mean + factors.m_cos));
+  const Real k_im =
+      static_cast<Real>(coefficient * (factors.m_mean - factors.m_cos));
+  const Real k_cross = static_cast<Real>(coefficient * 2.0 * factors.m_sin);
+
+  for (size_t i = 0; i < count; ++i) {
+    const Real re = field_re[i];
+    const Real im = field_im[i];
+    temperature[i] += k_re * re * re + k_im * im * im + k_cross * re * im;
+  }
+}
+
+template <typename Real>
+void absorbField(const float *__restrict__ field_re,
+                 const float *__restrict__ field_im,
+                 Real *__restrict__ temperature, size_t count,
+                 const float *__restrict__ coefficient,
+                 const HarmonicFactors &factors) {
+  const Real k_re = static_cast<Real>(factors.m_mean + factors.m_cos);
+  const Real k_im = static_cast<Real>(factors.m_mean - factors.m_cos);
+  const Real k_cross = static_cast<Real>(2.0 * factors.m_sin);
+
+  for (size_t i = 0; i < count; ++i) {
+    const Real re = field_re[i];
+    const Real im = field_im[i];
+    temperature[i] +=
+        coefficient[i] * (k_re * re * re + k_im * im * im + k_cross * re * im);
+  }
+}
+
+// The precisions of Precision.hpp
+template void absorbField<float>(const float *, const float *, float *,
+                                 size_t, float, const HarmonicFactors &);
+template void absorbField<float>(const float *, const float *, float *,
+                                 size_t, const float *,
+                                 const HarmonicFactors &);
+template void absorbField<double>(const float *, const float *, double *,
+                                  size_t, float, const HarmonicFactors &);
+template void absorbField<double>(const float *, const float *, double *,
+                                  size_t, const float *,
+                                  const HarmonicFactors &);
+
+} // namespace physics
+} // namespace simulator
@@ -0,0 +1,75 @@
+#include "Attenuation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+
+static constexpr double kSpeedOfLight = 299792458.0;            ///< m/s
+static constexpr double kVacuumPermittivity = 8.8541878128e-12; ///< F/m
+
+// Points whose optical depths are traced together, they stay in L1
+static constexpr size_t kBlockSize = 512;
+
+namespace simulator {
+namespace physics {
+
+float attenuationConstant(float conductivity, float relative_permittivity,
+                          float frequency) {
+  const double omega = glm::two_pi<double>() * frequency;
+  if (omega <= 0.0 || conductivity <= 0.f) {
+    return 0.f;
+  }
+  // alpha = w/c sqrt(er / 2) sqrt(sqrt(1 + tan^2) - 1) with the loss
+  // tangent sigma / (w e0 er)
+  const double er = std::max(relative_permittivity, 1.f);
+  const double loss_tangent = conductivity / (omega * kVacuumPermittivity * er);
+  const double spread = std::sqrt(1.0 + loss_tangent * loss_tangent) - 1.0;
+  return static_cast<float>(omega / kSpeedOfLight *
+                            std::sqrt(0.5 * er * spread));
+}
+
+std::vector<std::vector<float>>
+materialAttenuation(const std::vector<model::Model> &models, float frequency) {
+  std::vector<std::vector<float>> alpha(models.size());
+  for (size_t m = 0; m < models.size(); ++m) {
+    for (const auto &material : models[m].getMaterialTable().m_materials) {
+      alpha[m].push_back(attenuationConstant(
+          material.m_electrical_conductivity,
+          material.m_relative_permittivity, frequency));
+    }
+  }
+  return alpha;
+}
+
+void transmittedPower(const TriangleBvh &bodies,
+                      const std::vector<FieldSource> &sources,
+                      const float *x, const float *y, const float *z,
+                      size_t count, const glm::vec3 &offset,
+                      float *__restrict__ out) {
+  float total = 0.f;
+  for (const auto &source : sources) {
+    total += source.m_amplitude * source.m_amplitude;
+  }
+  if (total <= 0.f) {
+    std::fill(out, out + count, 1.f);
+    return;
+  }
+
+  float depth[kBlockSize];
+  for (size_t begin = 0; begin < count; begin += kBlockSize) {
+    const size_t n = std::min(kBlockSize, count - begin);
+    std::fill(out + begin, out + begin + n, 0.f);
+    for (const auto &source : sources) {
+      const float weight = source.m_amplitude * source.m_amplitude / total;
+      bodies.opticalDepth(source.m_position, x + begin, y + begin,
+                          z + begin, n, offset, depth);
+      for (size_t i = 0; i < n; ++i) {
+        out[begin + i] += weight * std::exp(-2.f * depth[i]);
+      }
+    }
+  }
+}
+
+} // namespace physics
+} // namespace simulator
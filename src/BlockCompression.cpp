@@ -0,0 +1,189 @@
+#include "BlockCompression.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// LZ4 block format limits
+static constexpr size_t kMinMatch = 4;
+static constexpr size_t kLastLiterals = 5; ///< A block always ends on these
+static constexpr size_t kMatchLimit = 12;  ///< No match starts this close
+static constexpr size_t kMaxOffset = 65535;
+static constexpr int kHashBits = 16;
+// Misses in a row before the search starts skipping, incompressible input
+// is then crossed quickly
+static constexpr int kSkipTrigger = 6;
+
+static uint32_t read32(const uint8_t *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint64_t read64(const uint8_t *p) {
+  uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint32_t hashSequence(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+/**
+ * @brief writeLength Bytes of 255 and a remainder for lengths past the 15
+ * the token holds
+ */
+static uint8_t *writeLength(uint8_t *out, size_t length) {
+  for (; length >= 255; length -= 255) {
+    *out++ = 255;
+  }
+  *out++ = static_cast<uint8_t>(length);
+  return out;
+}
+
+static bool readLength(const uint8_t *&in, const uint8_t *end,
+                       size_t &length) {
+  uint8_t byte;
+  do {
+    if (in >= end) {
+      return false;
+    }
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+/**
+ * @brief writeSequence Token, literals, offset and the match length
+ * @param match_length 0 for the closing literals
+ */
+static uint8_t *writeSequence(uint8_t *out, const uint8_t *literals,
+                              size_t literal_length, size_t offset,
+                              size_t match_length) {
+  uint8_t *token = out++;
+  const size_t match_code = match_length > 0 ? match_length - kMinMatch : 0;
+  *token = static_cast<uint8_t>(std::min<size_t>(literal_length, 15) << 4 |
+                                std::min<size_t>(match_code, 15));
+  if (literal_length >= 15) {
+    out = writeLength(out, literal_length - 15);
+  }
+  std::memcpy(out, literals, literal_length);
+  out += literal_length;
+  if (match_length == 0) {
+    return out;
+  }
+  *out++ = static_cast<uint8_t>(offset);
+  *out++ = static_cast<uint8_t>(offset >> 8);
+  if (match_code >= 15) {
+    out = writeLength(out, match_code - 15);
+  }
+  return out;
+}
+
+namespace simulator {
+
+size_t compressBound(size_t size) { return size + size / 255 + 16; }
+
+size_t compressBlock(const uint8_t *in, size_t size, uint8_t *out) {
+  uint8_t *op = out;
+  const uint8_t *anchor = in;
+
+  if (size > kMatchLimit) {
+    // Positions plus one, 0 is an empty slot
+    std::vector<uint32_t> table(size_t(1) << kHashBits, 0);
+    const uint8_t *ip = in;
+    const uint8_t *match_start_end = in + size - kMatchLimit;
+    const uint8_t *match_end = in + size - kLastLiterals;
+    int misses = 0;
+
+    while (ip < match_start_end) {
+      const uint32_t sequence = read32(ip);
+      const uint32_t hash = hashSequence(sequence);
+      const size_t position = static_cast<size_t>(ip - in);
+      const size_t candidate = table[hash];
+      table[hash] = static_cast<uint32_t>(position + 1);
+      if (candidate == 0 || position + 1 - candidate > kMaxOffset ||
+          read32(in + candidate - 1) != sequence) {
+        ip += 1 + (misses++ >> kSkipTrigger);
+        continue;
+      }
+      misses = 0;
+
+      // Extend eight bytes at a time, then finish byte by byte
+      const uint8_t *ref = in + candidate - 1;
+      const size_t max_length = static_cast<size_t>(match_end - ip);
+      size_t length = kMinMatch;
+      bool mismatch = false;
+      while (!mismatch && length + sizeof(uint64_t) <= max_length) {
+        const uint64_t diff = read64(ip + length) ^ read64(ref + length);
+        mismatch = diff != 0;
+        length += mismatch ? __builtin_ctzll(diff) >> 3 : sizeof(uint64_t);
+      }
+      while (!mismatch && length < max_length && ip[length] == ref[length]) {
+        ++length;
+      }
+
+      op = writeSequence(op, anchor, static_cast<size_t>(ip - anchor),
+                         static_cast<size_t>(ip - ref), length);
+      ip += length;
+      anchor = ip;
+    }
+  }
+
+  op = writeSequence(op, anchor, static_cast<size_t>(in + size - anchor), 0,
+                     0);
+  return static_cast<size_t>(op - out);
+}
+
+bool decompressBlock(const uint8_t *in, size_t size, uint8_t *out,
+                     size_t raw_size) {
+  const uint8_t *ip = in;
+  const uint8_t *end = in + size;
+  uint8_t *op = out;
+  uint8_t *out_end = out + raw_size;
+
+  while (ip < end) {
+    const uint8_t token = *ip++;
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && !readLength(ip, end, literal_length)) {
+      return false;
+    }
+    if (literal_length > static_cast<size_t>(end - ip) ||
+        literal_length > static_cast<size_t>(out_end - op)) {
+      return false;
+    }
+    std::memcpy(op, ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+    // The closing sequence has literals only
+    if (ip == end) {
+      break;
+    }
+
+    if (end - ip < 2) {
+      return false;
+    }
+    const size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+    ip += 2;
+    size_t match_length = token & 15;
+    if (match_length == 15 && !readLength(ip, end, match_length)) {
+      return false;
+    }
+    match_length += kMinMatch;
+    if (offset == 0 || offset > static_cast<size_t>(op - out) ||
+        match_length > static_cast<size_t>(out_end - op)) {
+      return false;
+    }
+    // Byte by byte, a match may overlap the bytes it produces
+    const uint8_t *ref = op - offset;
+    for (size_t i = 0; i < match_length; ++i) {
+      op[i] = ref[i];
+    }
+    op += match_length;
+  }
+  return op == out_end;
+}
+
+} // namespace simulator
@@ -0,0 +1,356 @@
+#include "CavityModeField.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <glm/gtc/constants.hpp>
+
+#include <ThreadPool.hpp>
+
+namespace fs = std::filesystem;
+
+static constexpr double kSpeedOfLight = 299792458.0; ///< m/s
+
+// Cache file layout, bump the version whenever it or the model changes
+static constexpr uint32_t kCacheMagic = 0x54464d43; ///< "CMFT"
+static constexpr uint32_t kCacheVersion = 1;
+
+// FNV-1a, only used to name the cache file, the key itself is compared
+static constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+static constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+namespace simulator {
+namespace physics {
+
+namespace {
+
+/**
+ * One mode, E = a * (p_x cx sy sz, p_y sx cy sz, p_z sx sy cz) with c and s
+ * the cos and sin of k * (x - cavity min) along every axis
+ */
+struct Mode {
+  glm::dvec3 m_k;
+  glm::dvec3 m_polarization; ///< Volume mean of |E|^2 is 1
+  std::complex<double> m_amplitude;
+};
+
+/**
+ * @brief meanSq Volume mean of cos^2 (or sin^2) of k x over whole half waves
+ */
+double meanSq(double k, bool cosine) {
+  if (k == 0.0) {
+    return cosine ? 1.0 : 0.0;
+  }
+  return 0.5;
+}
+
+glm::dvec3 modeShape(const Mode &mode, const glm::dvec3 &p) {
+  const glm::dvec3 kp = mode.m_k * p;
+  const glm::dvec3 c(std::cos(kp.x), std::cos(kp.y), std::cos(kp.z));
+  const glm::dvec3 s(std::sin(kp.x), std::sin(kp.y), std::sin(kp.z));
+  return mode.m_polarization * glm::dvec3(c.x * s.y * s.z, s.x * c.y * s.z,
+                                          s.x * s.y * c.z);
+}
+
+} // namespace
+
+CavityModeField::CavityModeField(const Cavity &cavity,
+                                 const std::vector<FieldSource> &sources,
+                                 float frequency, const CavityModeConfig &cfg)
+    : m_cavity(cavity), m_sources(sources), m_frequency(frequency),
+      m_cfg(cfg) {
+  const glm::vec3 extent = cavity.m_max - cavity.m_min;
+  if (frequency <= 0.f || cfg.m_cells_per_wavelength <= 0 ||
+      cfg.m_quality_factor <= 0.f) {
+    throw std::runtime_error(
+        "Cavity modes need a positive frequency, resolution and Q");
+  }
+  if (extent.x <= 0.f || extent.y <= 0.f || extent.z <= 0.f) {
+    throw std::runtime_error("Cavity has no volume");
+  }
+
+  m_key = {cavity.m_min.x,
+           cavity.m_min.y,
+           cavity.m_min.z,
+           cavity.m_max.x,
+           cavity.m_max.y,
+           cavity.m_max.z,
+           frequency,
+           cfg.m_quality_factor,
+           cfg.m_mode_band,
+           static_cast<float>(cfg.m_cells_per_wavelength)};
+  for (const auto &source : sources) {
+    m_key.insert(m_key.end(),
+                 {source.m_position.x, source.m_position.y,
+                  source.m_position.z, source.m_amplitude, source.m_phase});
+  }
+
+  std::string path;
+  if (!cfg.m_cache_dir.empty()) {
+    uint64_t hash = kFnvOffset;
+    const auto *bytes = reinterpret_cast<const unsigned char *>(m_key.data());
+    for (size_t b = 0; b < m_key.size() * sizeof(float); ++b) {
+      hash = (hash ^ bytes[b]) * kFnvPrime;
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "cavity_%016llx.bin",
+                  static_cast<unsigned long long>(hash));
+    path = (fs::path(cfg.m_cache_dir) / name).string();
+
+    if (loadCache(path)) {
+      return;
+    }
+  }
+
+  build();
+  if (!path.empty()) {
+    saveCache(path);
+  }
+}
+
+void CavityModeField::build() {
+  const glm::dvec3 lo(m_cavity.m_min);
+  const glm::dvec3 extent = glm::dvec3(m_cavity.m_max) - lo;
+  const double volume = extent.x * extent.y * extent.z;
+  const double k = glm::two_pi<double>() * m_frequency / kSpeedOfLight;
+  const double k_lo = k * std::max(1.0 - m_cfg.m_mode_band, 0.0);
+  const double k_hi = k * (1.0 + m_cfg.m_mode_band);
+  const double q = m_cfg.m_quality_factor;
+
+  // k_mnp = pi * (m / a, n / b, p / d), two polarizations per triple
+  std::vector<Mode> modes;
+  const glm::ivec3 max_index(glm::floor(k_hi * extent / glm::pi<double>()));
+  for (int p = 0; p <= max_index.z; ++p) {
+    for (int n = 0; n <= max_index.y; ++n) {
+      for (int m = 0; m <= max_index.x; ++m) {
+        const glm::dvec3 kv =
+            glm::pi<double>() * glm::dvec3(m, n, p) / extent;
+        const double kn = glm::length(kv);
+        if (kn < k_lo || kn > k_hi) {
+          continue;
+        }
+
+        // TE and TM with respect to z, both divergence free
+        const glm::dvec3 polarizations[] = {
+            glm::dvec3(kv.y, -kv.x, 0.0),
+            glm::dvec3(-kv.x * kv.z, -kv.y * kv.z,
+                       kv.x * kv.x + kv.y * kv.y)};
+        for (const auto &pol : polarizations) {
+          // Modes with a zero index along the wrong axis vanish everywhere
+          const double mean_sq =
+              pol.x * pol.x * meanSq(kv.x, true) * meanSq(kv.y, false) *
+                  meanSq(kv.z, false) +
+              pol.y * pol.y * meanSq(kv.x, false) * meanSq(kv.y, true) *
+                  meanSq(kv.z, false) +
+              pol.z * pol.z * meanSq(kv.x, false) * meanSq(kv.y, false) *
+                  meanSq(kv.z, true);
+          if (mean_sq <= 0.0) {
+            continue;
+          }
+
+          Mode mode;
+          mode.m_k = kv;
+          mode.m_polarization = pol / std::sqrt(mean_sq);
+
+          // Green's function expansion, scaled so a source of amplitude A
+          // matches the A / r of the free space model. The probe couples
+          // through E_z of the mode.
+          std::complex<double> drive = 0.0;
+          for (const auto &source : m_sources) {
+            const glm::dvec3 e =
+                modeShape(mode, glm::dvec3(source.m_position) - lo);
+            drive += std::polar(static_cast<double>(source.m_amplitude),
+                                static_cast<double>(source.m_phase)) *
+                     e.z;
+          }
+          const std::complex<double> response(kn * kn - k * k, k * kn / q);
+          mode.m_amplitude =
+              4.0 * glm::pi<double>() / volume * drive / response;
+          modes.push_back(mode);
+        }
+      }
+    }
+  }
+
+  const float h = static_cast<float>(glm::two_pi<double>() / k /
+                                     m_cfg.m_cells_per_wavelength);
+  m_table.m_spacing = h;
+  m_table.m_origin = m_cavity.m_min;
+  m_table.m_dims = glm::ivec3(glm::ceil(glm::vec3(extent) / h)) + 1;
+  m_table.m_values.assign(m_table.size(), 0.f);
+
+  const int nx = m_table.m_dims.x;
+  const int ny = m_table.m_dims.y;
+  const size_t mode_count = modes.size();
+
+  // Every mode separates per axis, the x factors are tabulated once
+  std::vector<float> cos_x(mode_count * nx);
+  std::vector<float> sin_x(mode_count * nx);
+  for (size_t md = 0; md < mode_count; ++md) {
+    for (int i = 0; i < nx; ++i) {
+      const double kx = modes[md].m_k.x * i * h;
+      cos_x[md * nx + i] = static_cast<float>(std::cos(kx));
+      sin_x[md * nx + i] = static_cast<float>(std::sin(kx));
+    }
+  }
+
+  ThreadPool::getInstance().parallelFor(
+      0, m_table.m_dims.z, [&](size_t k_begin, size_t k_end) {
+        // Real and imaginary part of the three components along one row
+        std::vector<float> acc(6 * static_cast<size_t>(nx));
+        float *__restrict__ ex_re = acc.data();
+        float *__restrict__ ex_im = ex_re + nx;
+        float *__restrict__ ey_re = ex_im + nx;
+        float *__restrict__ ey_im = ey_re + nx;
+        float *__restrict__ ez_re = ey_im + nx;
+        float *__restrict__ ez_im = ez_re + nx;
+
+        for (size_t kz = k_begin; kz < k_end; ++kz) {
+          for (int j = 0; j < ny; ++j) {
+            std::fill(acc.begin(), acc.end(), 0.f);
+
+            for (size_t md = 0; md < mode_count; ++md) {
+              const Mode &mode = modes[md];
+              const double ky = mode.m_k.y * j * h;
+              const double kk = mode.m_k.z * kz * h;
+              const double sy = std::sin(ky), cy = std::cos(ky);
+              const double sz = std::sin(kk), cz = std::cos(kk);
+              const glm::dvec3 w =
+                  mode.m_polarization * glm::dvec3(sy * sz, cy * sz, sy * cz);
+              const float ar = static_cast<float>(mode.m_amplitude.real());
+              const float ai = static_cast<float>(mode.m_amplitude.imag());
+              const float wx = static_cast<float>(w.x);
+              const float wy = static_cast<float>(w.y);
+              const float wz = static_cast<float>(w.z);
+
+              const float *__restrict__ cx = cos_x.data() + md * nx;
+              const float *__restrict__ sx = sin_x.data() + md * nx;
+              for (int i = 0; i < nx; ++i) {
+                const float fx = wx * cx[i];
+                const float fy = wy * sx[i];
+                const float fz = wz * sx[i];
+                ex_re[i] += ar * fx;
+                ex_im[i] += ai * fx;
+                ey_re[i] += ar * fy;
+                ey_im[i] += ai * fy;
+                ez_re[i] += ar * fz;
+                ez_im[i] += ai * fz;
+              }
+            }
+
+            float *out = m_table.m_values.data() +
+                         m_table.index(0, j, static_cast<int>(kz));
+            for (int i = 0; i < nx; ++i) {
+              out[i] = ex_re[i] * ex_re[i] + ex_im[i] * ex_im[i] +
+                       ey_re[i] * ey_re[i] + ey_im[i] * ey_im[i] +
+                       ez_re[i] * ez_re[i] + ez_im[i] * ez_im[i];
+            }
+          }
+        }
+      });
+}
+
+bool CavityModeField::loadCache(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  uint32_t magic = 0, version = 0;
+  uint64_t key_size = 0;
+  file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  file.read(reinterpret_cast<char *>(&version), sizeof(version));
+  file.read(reinterpret_cast<char *>(&key_size), sizeof(key_size));
+  if (!file || magic != kCacheMagic || version != kCacheVersion ||
+      key_size != m_key.size()) {
+    return false;
+  }
+
+  std::vector<float> key(key_size);
+  file.read(reinterpret_cast<char *>(key.data()), key_size * sizeof(float));
+  if (!file || key != m_key) {
+    return false;
+  }
+
+  FieldTable table;
+  file.read(reinterpret_cast<char *>(&table.m_dims), sizeof(table.m_dims));
+  file.read(reinterpret_cast<char *>(&table.m_origin), sizeof(table.m_origin));
+  file.read(reinterpret_cast<char *>(&table.m_spacing),
+            sizeof(table.m_spacing));
+  if (!file || table.m_dims.x <= 0 || table.m_dims.y <= 0 ||
+      table.m_dims.z <= 0) {
+    return false;
+  }
+
+  table.m_values.resize(table.size());
+  file.read(reinterpret_cast<char *>(table.m_values.data()),
+            table.m_values.size() * sizeof(float));
+  if (!file) {
+    return false;
+  }
+
+  m_table = std::move(table);
+  return true;
+}
+
+void CavityModeField::saveCache(const std::string &path) const {
+  std::error_code error;
+  fs::create_directories(fs::path(path).parent_path(), error);
+
+  // Written aside and renamed, a crash never leaves a torn table behind.
+  // Concurrent runs of a sweep may build the same table, each writes its own
+  const std::string partial =
+      path + ".tmp." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    std::ofstream file(partial, std::ios::binary | std::ios::trunc);
+    const uint64_t key_size = m_key.size();
+    file.write(reinterpret_cast<const char *>(&kCacheMagic),
+               sizeof(kCacheMagic));
+    file.write(reinterpret_cast<const char *>(&kCacheVersion),
+               sizeof(kCacheVersion));
+    file.write(reinterpret_cast<const char *>(&key_size), sizeof(key_size));
+    file.write(reinterpret_cast<const char *>(m_key.data()),
+               key_size * sizeof(float));
+    file.write(reinterpret_cast<const char *>(&m_table.m_dims),
+               sizeof(m_table.m_dims));
+    file.write(reinterpret_cast<const char *>(&m_table.m_origin),
+               sizeof(m_table.m_origin));
+    file.write(reinterpret_cast<const char *>(&m_table.m_spacing),
+               sizeof(m_table.m_spacing));
+    file.write(reinterpret_cast<const char *>(m_table.m_values.data()),
+               m_table.m_values.size() * sizeof(float));
+    if (!file) {
+      std::cerr << "Couldn't write the cavity mode cache " << partial << "\n";
+      return;
+    }
+  }
+
+  fs::rename(partial, path, error);
+  if (error) {
+    std::cerr << "Couldn't write the cavity mode cache " << path << "\n";
+  }
+}
+
+void CavityModeField::samplePhasor(const float *x, const float *y,
+                                   const float *z, size_t count,
+                                   const glm::vec3 &offset, float *field_re,
+                                   float *field_im) const {
+  m_table.sample(x, y, z, count, offset, field_re);
+  for (size_t i = 0; i < count; ++i) {
+    field_re[i] = std::sqrt(std::max(field_re[i], 0.f));
+    field_im[i] = 0.f;
+  }
+}
+
+} // namespace physics
+} // namespace simulator
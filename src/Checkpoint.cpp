@@ -0,0 +1,254 @@
+#include "Checkpoint.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout, bump the version whenever it or the state it holds changes
+static constexpr uint32_t kCheckpointMagic = 0x4b434d43; ///< "CMCK"
+static constexpr uint32_t kCheckpointVersion = 12;
+// Sections start on cache lines
+static constexpr uint64_t kAlignment = 64;
+
+static uint64_t alignUp(uint64_t offset) {
+  return (offset + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+/**
+ * @brief syncDirectory Flushes the directory holding the file, a rename
+ * only survives a crash once the directory entry is on disk
+ * @param path Of the file
+ * @return false if the directory can't be opened or synced
+ */
+static bool syncDirectory(const std::string &path) {
+  const size_t slash = path.find_last_of('/');
+  std::string directory = ".";
+  if (slash != std::string::npos) {
+    directory = slash == 0 ? "/" : path.substr(0, slash);
+  }
+  const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return false;
+  }
+  const bool ok = ::fsync(fd) == 0;
+  ::close(fd);
+  return ok;
+}
+
+/**
+ * @brief writeImage Maps a temporary file, copies the image in and renames
+ * it over the previous checkpoint, then syncs the directory
+ * @param path
+ * @param image
+ * @return false if anything failed, the previous checkpoint is kept then
+ */
+static bool writeImage(const std::string &path,
+                       const std::vector<char> &image) {
+  const std::string temp_path = path + ".tmp";
+  const int fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Can't open " << temp_path << "\n";
+    return false;
+  }
+
+  // Blocks are allocated up front, a full disk fails here instead of
+  // raising SIGBUS on a store into the mapping
+  bool ok = ::posix_fallocate(fd, 0, image.size()) == 0;
+  void *map = MAP_FAILED;
+  if (ok) {
+    map = ::mmap(nullptr, image.size(), PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd, 0);
+    ok = map != MAP_FAILED;
+  }
+  if (ok) {
+    std::memcpy(map, image.data(), image.size());
+    ok = ::msync(map, image.size(), MS_SYNC) == 0;
+    ::munmap(map, image.size());
+  }
+  ::close(fd);
+
+  if (ok) {
+    ok = std::rename(temp_path.c_str(), path.c_str()) == 0 &&
+         syncDirectory(path);
+  }
+  if (!ok) {
+    std::cerr << "Failed to write the checkpoint " << path << "\n";
+    ::unlink(temp_path.c_str());
+  }
+  return ok;
+}
+
+namespace simulator {
+
+void packCheckpoint(CheckpointHeader header,
+                    const std::vector<CheckpointSpan> &spans,
+                    std::vector<char> &image) {
+  header.m_magic = kCheckpointMagic;
+  header.m_version = kCheckpointVersion;
+  header.m_section_count = static_cast<uint32_t>(spans.size());
+
+  std::vector<CheckpointSection> table(spans.size());
+  uint64_t offset = alignUp(sizeof(CheckpointHeader) +
+                            spans.size() * sizeof(CheckpointSection));
+  for (size_t s = 0; s < spans.size(); ++s) {
+    table[s].m_kind = spans[s].m_kind;
+    table[s].m_index = spans[s].m_index;
+    table[s].m_offset = offset;
+    table[s].m_size = spans[s].m_size;
+    offset = alignUp(offset + spans[s].m_size);
+  }
+  header.m_file_size = offset;
+
+  // Padding is zeroed, stale bytes of a reused image never reach the disk
+  image.resize(offset);
+  char *out = image.data();
+  std::memset(out, 0, table.empty() ? offset : table.front().m_offset);
+  std::memcpy(out, &header, sizeof(header));
+  std::memcpy(out + sizeof(header), table.data(),
+              table.size() * sizeof(CheckpointSection));
+  for (size_t s = 0; s < spans.size(); ++s) {
+    const uint64_t begin = table[s].m_offset;
+    const uint64_t end = s + 1 < table.size() ? table[s + 1].m_offset : offset;
+    if (spans[s].m_size > 0) {
+      std::memcpy(out + begin, spans[s].m_data, spans[s].m_size);
+    }
+    std::memset(out + begin + spans[s].m_size, 0,
+                end - begin - spans[s].m_size);
+  }
+}
+
+CheckpointWriter::CheckpointWriter()
+    : m_thread(&CheckpointWriter::loop, this) {}
+
+CheckpointWriter::~CheckpointWriter() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wake.notify_one();
+  m_thread.join();
+}
+
+void CheckpointWriter::submit(const std::string &path,
+                              std::vector<char> &image) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_has_pending) {
+      ++m_dropped;
+    }
+    m_pending.swap(image);
+    m_pending_path = path;
+    m_has_pending = true;
+  }
+  m_wake.notify_one();
+}
+
+void CheckpointWriter::flush() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this] { return !m_has_pending && !m_busy; });
+}
+
+uint64_t CheckpointWriter::getWrittenCount() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_written;
+}
+
+uint64_t CheckpointWriter::getDroppedCount() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_dropped;
+}
+
+void CheckpointWriter::loop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_wake.wait(lock, [this] { return m_has_pending || m_quit; });
+    // A queued image is still written on the way out
+    if (!m_has_pending) {
+      return;
+    }
+    m_writing.swap(m_pending);
+    const std::string path = m_pending_path;
+    m_has_pending = false;
+    m_busy = true;
+
+    lock.unlock();
+    const bool ok = writeImage(path, m_writing);
+    lock.lock();
+
+    m_busy = false;
+    if (ok) {
+      ++m_written;
+    }
+    m_idle.notify_all();
+  }
+}
+
+CheckpointFile::CheckpointFile(const std::string &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Can't open " + path);
+  }
+  struct stat status;
+  if (::fstat(fd, &status) != 0 ||
+      static_cast<size_t>(status.st_size) < sizeof(CheckpointHeader)) {
+    ::close(fd);
+    throw std::runtime_error(path + " is not a checkpoint");
+  }
+
+  // The mapping outlives the descriptor
+  m_size = static_cast<size_t>(status.st_size);
+  void *map = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Can't map " + path);
+  }
+  m_data = static_cast<const char *>(map);
+  ::madvise(map, m_size, MADV_SEQUENTIAL);
+
+  const CheckpointHeader &header = getHeader();
+  bool valid = header.m_magic == kCheckpointMagic &&
+               header.m_version == kCheckpointVersion &&
+               header.m_file_size == m_size &&
+               sizeof(CheckpointHeader) +
+                       header.m_section_count * sizeof(CheckpointSection) <=
+                   m_size;
+  const auto *table = reinterpret_cast<const CheckpointSection *>(
+      m_data + sizeof(CheckpointHeader));
+  for (uint32_t s = 0; valid && s < header.m_section_count; ++s) {
+    valid = table[s].m_offset % kAlignment == 0 &&
+            table[s].m_offset <= m_size &&
+            table[s].m_size <= m_size - table[s].m_offset;
+  }
+  if (!valid) {
+    ::munmap(map, m_size);
+    throw std::runtime_error(path +
+                             " is torn or of another checkpoint version");
+  }
+}
+
+CheckpointFile::~CheckpointFile() {
+  ::munmap(const_cast<char *>(m_data), m_size);
+}
+
+const void *CheckpointFile::find(uint32_t kind, uint32_t index,
+                                 size_t &size) const {
+  const CheckpointHeader &header = getHeader();
+  const auto *table = reinterpret_cast<const CheckpointSection *>(
+      m_data + sizeof(CheckpointHeader));
+  for (uint32_t s = 0; s < header.m_section_count; ++s) {
+    if (table[s].m_kind == kind && table[s].m_index == index) {
+      size = table[s].m_size;
+      return m_data + table[s].m_offset;
+    }
+  }
+  size = 0;
+  return nullptr;
+}
+
+} // namespace simulator
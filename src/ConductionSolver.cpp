@@ -0,0 +1,730 @@
+#include "ConductionSolver.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+#include <glm/gtc/constants.hpp>
+
+#include <Attenuation.hpp>
+#include <ThreadPool.hpp>
+
+// FTCS on the 7-point stencil is stable for alpha * dt / h^2 <= 1/6
+static constexpr float kStabilityLimit = 1.f / 6.f;
+
+// Leaves a diffusion sweep or a field sample hands out at once
+static constexpr size_t kLeafGrain = 8;
+
+// Voxels whose properties are looked up together
+static constexpr size_t kPropertyBlock = 256;
+
+namespace simulator {
+
+ConductionSolver::ConductionSolver(model::Model &model, int resolution,
+                                   bool shell, const ConductionConfig &cfg)
+    : m_model(&model), m_cfg(cfg) {
+  const model::MaterialTable &table = model.getMaterialTable();
+
+  m_grid.build(model, resolution, shell);
+
+  const size_t count = m_grid.size();
+  m_material.resize(count);
+  m_conductivity.assign(count, 0.f);
+  m_inv_heat_capacity.assign(count, 0.f);
+  std::vector<bool> used(table.size(), false);
+  for (size_t v = 0; v < count; ++v) {
+    m_material[v] = m_grid.getMaterial(v);
+    if (!m_grid.isActive(v)) {
+      continue;
+    }
+    const model::Material &material = table.m_materials[m_material[v]];
+    const float volumetric_heat =
+        material.m_density * material.m_heat_capacity; ///< J/m^3*K
+    if (!(volumetric_heat > 0.f)) {
+      throw std::runtime_error("Model material is not configured");
+    }
+    m_conductivity[v] = material.m_thermal_conductivity;
+    m_inv_heat_capacity[v] = 1.f / volumetric_heat;
+    used[m_material[v]] = true;
+  }
+
+  for (size_t v = 0; v < count; ++v) {
+    if (!m_grid.isActive(v)) {
+      continue;
+    }
+    float conductance = 0.f;
+    for (int face = 0; face < 6; ++face) {
+      const size_t n = m_grid.neighbourSlot(v, face);
+      if (n != SparseGrid::kNoSlot) {
+        conductance += faceConductance(v, n);
+      }
+    }
+    m_max_diffusivity = std::max(
+        m_max_diffusivity, conductance * m_inv_heat_capacity[v] / 6.f);
+  }
+
+  // sigma * E^2 / (rho * c), the harmonic factors come in per step.
+  // Temperature dependent materials and phase changes get their rate per
+  // step instead.
+  const bool per_step = table.m_temperature_dependent || table.m_phase_change;
+  for (const auto &material : table.m_materials) {
+    const float volumetric_heat =
+        material.m_density * material.m_heat_capacity;
+    m_field_scale.push_back(
+        per_step || !(volumetric_heat > 0.f)
+            ? 1.f
+            : std::sqrt(material.m_electrical_conductivity / volumetric_heat));
+  }
+
+  // Diffusion moves the temperature with the constant capacity, reading it
+  // back from the enthalpy moves it c / c(T) times as far. The explicit
+  // limit has to hold where a curve is steepest, in the ice.
+  if (table.m_phase_change) {
+    for (size_t m = 0; m < table.size(); ++m) {
+      if (!used[m]) {
+        continue;
+      }
+      const model::Material &material = table.m_materials[m];
+      const model::PropertyTable &curve = material.m_temperature_table;
+      float rise = 0.f;
+      for (size_t s = 1; s < curve.m_values.size(); ++s) {
+        rise = std::max(rise, curve.m_values[s] - curve.m_values[s - 1]);
+      }
+      m_capacity_ratio =
+          std::max(m_capacity_ratio,
+                   material.m_heat_capacity * rise * curve.m_inv_spacing);
+    }
+  }
+
+  m_heating_re.assign(count, 0.f);
+  m_heating_im.assign(count, 0.f);
+
+  mapVertices();
+  if (m_cfg.m_scheme == ConductionScheme::CRANK_NICOLSON) {
+    assembleLaplacian();
+  }
+}
+
+size_t ConductionSolver::getEnthalpyCount() const {
+  return m_model->getMaterialTable().m_phase_change ? m_grid.size() : 0;
+}
+
+float ConductionSolver::faceConductance(size_t a, size_t b) const {
+  const float ka = m_conductivity[a];
+  const float kb = m_conductivity[b];
+  return ka + kb > 0.f ? 2.f * ka * kb / (ka + kb) : 0.f;
+}
+
+void ConductionSolver::assembleLaplacian() {
+  const size_t count = m_grid.size();
+  // Compact index of every voxel of the body, UINT32_MAX outside
+  std::vector<uint32_t> unknown(count, UINT32_MAX);
+  m_cells.clear();
+  float max_inv_heat = 0.f;
+  for (size_t v = 0; v < count; ++v) {
+    if (m_grid.isActive(v)) {
+      unknown[v] = static_cast<uint32_t>(m_cells.size());
+      m_cells.push_back(v);
+      max_inv_heat = std::max(max_inv_heat, m_inv_heat_capacity[v]);
+    }
+  }
+  m_unknown_scale.resize(m_cells.size());
+  for (size_t row = 0; row < m_cells.size(); ++row) {
+    m_unknown_scale[row] =
+        std::sqrt(max_inv_heat / m_inv_heat_capacity[m_cells[row]]);
+  }
+
+  m_laplacian.m_row_offsets.assign(1, 0);
+  m_laplacian.m_columns.clear();
+  m_laplacian.m_values.clear();
+  m_laplacian.m_row_offsets.reserve(m_cells.size() + 1);
+  m_laplacian.m_columns.reserve(7 * m_cells.size());
+  m_laplacian.m_values.reserve(7 * m_cells.size());
+
+  for (size_t row = 0; row < m_cells.size(); ++row) {
+    // Neighbours across a brick face don't follow slot order, so the
+    // columns of the row are sorted once it is complete
+    // rho c dT/dt = sum of G (T_n - T) over the faces, with T = y / s on
+    // both sides and the rows divided by s that is symmetric in y
+    const size_t cell = m_cells[row];
+    const float inv_heat = m_inv_heat_capacity[cell];
+    uint32_t columns[7];
+    float values[7];
+    int entries = 0;
+    float degree = 0.f;
+    for (int face = 0; face < 6; ++face) {
+      const size_t n = m_grid.neighbourSlot(cell, face);
+      if (n != SparseGrid::kNoSlot && unknown[n] != UINT32_MAX) {
+        const float conductance = faceConductance(cell, n);
+        columns[entries] = unknown[n];
+        values[entries++] =
+            -conductance * std::sqrt(inv_heat * m_inv_heat_capacity[n]);
+        degree += conductance * inv_heat;
+      }
+    }
+    columns[entries] = static_cast<uint32_t>(row);
+    values[entries++] = degree;
+    for (int e = 1; e < entries; ++e) {
+      for (int f = e; f > 0 && columns[f - 1] > columns[f]; --f) {
+        std::swap(columns[f - 1], columns[f]);
+        std::swap(values[f - 1], values[f]);
+      }
+    }
+    m_laplacian.m_columns.insert(m_laplacian.m_columns.end(), columns,
+                                 columns + entries);
+    m_laplacian.m_values.insert(m_laplacian.m_values.end(), values,
+                                values + entries);
+    m_laplacian.m_row_offsets.push_back(m_laplacian.m_columns.size());
+  }
+
+  m_system = m_laplacian;
+  m_system_ratio = -1.f;
+  m_increment.resize(m_cells.size());
+  m_rhs.resize(m_cells.size());
+}
+
+void ConductionSolver::mapVertices() {
+  const glm::ivec3 dims = m_grid.m_dims;
+  const auto clampIndex = [](int v, int n) { return std::clamp(v, 0, n - 1); };
+
+  auto &mesh_vec = m_model->getMeshVec();
+  m_vertex_voxels.resize(mesh_vec.size());
+
+  for (size_t m = 0; m < mesh_vec.size(); ++m) {
+    const auto &positions = mesh_vec[m].getVertPositions();
+    auto &voxels = m_vertex_voxels[m];
+    voxels.resize(positions.size());
+
+    for (size_t v = 0; v < positions.size(); ++v) {
+      const glm::vec3 cell =
+          (positions[v] - m_grid.m_origin) / m_grid.m_spacing;
+      const int i = clampIndex(static_cast<int>(cell.x), dims.x);
+      const int j = clampIndex(static_cast<int>(cell.y), dims.y);
+      const int k = clampIndex(static_cast<int>(cell.z), dims.z);
+
+      // Surface vertices often land in an empty voxel, read the closest
+      // voxel of the body around it instead. Every vertex is within a voxel
+      // of the body, so a leaf always covers the one it ends up with.
+      size_t best = m_grid.find(i, j, k);
+      float best_dist =
+          best != SparseGrid::kNoSlot && m_grid.isActive(best) ? 0.f : -1.f;
+      for (int dk = -1; dk <= 1 && best_dist != 0.f; ++dk) {
+        for (int dj = -1; dj <= 1; ++dj) {
+          for (int di = -1; di <= 1; ++di) {
+            const size_t slot = m_grid.find(clampIndex(i + di, dims.x),
+                                            clampIndex(j + dj, dims.y),
+                                            clampIndex(k + dk, dims.z));
+            if (slot == SparseGrid::kNoSlot || !m_grid.isActive(slot)) {
+              continue;
+            }
+            const glm::vec3 d = m_grid.center(slot) - positions[v];
+            const float dist = glm::dot(d, d);
+            if (best_dist < 0.f || dist < best_dist) {
+              best = slot;
+              best_dist = dist;
+            }
+          }
+        }
+      }
+      voxels[v] = best == SparseGrid::kNoSlot ? 0 : best;
+    }
+  }
+}
+
+void ConductionSolver::sampleField(const physics::FieldProvider &field) {
+  const float *scale = m_field_scale.data();
+  const glm::vec3 offset = m_model->getPosition();
+  constexpr size_t n = SparseGrid::kLeafVoxels;
+
+  ThreadPool::getInstance().parallelFor(
+      0, m_grid.getLeafCount(),
+      [&](size_t l_begin, size_t l_end) {
+        // One brick of voxel centers at a time goes through the provider
+        std::vector<float> x(n), y(n), z(n), re(n), im(n);
+        for (size_t leaf = l_begin; leaf < l_end; ++leaf) {
+          for (size_t s = 0; s < n; ++s) {
+            const glm::vec3 c = m_grid.center(leaf * n + s);
+            x[s] = c.x;
+            y[s] = c.y;
+            z[s] = c.z;
+          }
+          field.samplePhasor(x.data(), y.data(), z.data(), n, offset,
+                             re.data(), im.data());
+
+          const size_t first = leaf * n;
+          for (size_t s = 0; s < n; ++s) {
+            const float mask =
+                m_grid.isActive(first + s) ? scale[m_material[first + s]]
+                                           : 0.f;
+            m_heating_re[first + s] = mask * re[s];
+            m_heating_im[first + s] = mask * im[s];
+          }
+        }
+      },
+      kLeafGrain);
+}
+
+void ConductionSolver::attenuate(
+    const TriangleBvh &bodies,
+    const std::vector<physics::FieldSource> &sources) {
+  const glm::vec3 offset = m_model->getPosition();
+  constexpr size_t n = SparseGrid::kLeafVoxels;
+
+  ThreadPool::getInstance().parallelFor(
+      0, m_grid.getLeafCount(),
+      [&](size_t l_begin, size_t l_end) {
+        std::vector<float> x(n), y(n), z(n), power(n);
+        for (size_t leaf = l_begin; leaf < l_end; ++leaf) {
+          for (size_t s = 0; s < n; ++s) {
+            const glm::vec3 c = m_grid.center(leaf * n + s);
+            x[s] = c.x;
+            y[s] = c.y;
+            z[s] = c.z;
+          }
+          physics::transmittedPower(bodies, sources, x.data(), y.data(),
+                                    z.data(), n, offset, power.data());
+
+          // The heating holds the field, which falls off as the root
+          const size_t first = leaf * n;
+          for (size_t s = 0; s < n; ++s) {
+            const float amplitude = std::sqrt(power[s]);
+            m_heating_re[first + s] *= amplitude;
+            m_heating_im[first + s] *= amplitude;
+          }
+        }
+      },
+      kLeafGrain);
+}
+
+void ConductionSolver::buildTurntable(const physics::FieldProvider &field,
+                                      const glm::vec3 &pivot,
+                                      const physics::TurntableConfig &cfg) {
+  m_turntable_cells.clear();
+  for (size_t v = 0; v < m_grid.size(); ++v) {
+    if (m_grid.isActive(v)) {
+      m_turntable_cells.push_back(v);
+    }
+  }
+
+  const size_t count = m_turntable_cells.size();
+  std::vector<float> x(count), y(count), z(count);
+  for (size_t c = 0; c < count; ++c) {
+    const glm::vec3 center = m_grid.center(m_turntable_cells[c]);
+    x[c] = center.x;
+    y[c] = center.y;
+    z[c] = center.z;
+  }
+
+  m_turntable.build(field, x.data(), y.data(), z.data(), count,
+                    m_model->getPosition(), pivot, cfg);
+  m_turntable_re.resize(count);
+  m_turntable_im.resize(count);
+}
+
+void ConductionSolver::sampleTurntable(double angle0, double angle1) {
+  m_turntable.sample(angle0, angle1, m_turntable_re.data(),
+                     m_turntable_im.data());
+
+  // Voxels outside the body stay at the 0 the constructor set
+  const float *scale = m_field_scale.data();
+  const uint32_t *material = m_material.data();
+  const size_t *__restrict__ cells = m_turntable_cells.data();
+  ThreadPool::getInstance().parallelFor(
+      0, m_turntable_cells.size(),
+      [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+          const float s = scale[material[cells[c]]];
+          m_heating_re[cells[c]] = s * m_turntable_re[c];
+          m_heating_im[cells[c]] = s * m_turntable_im[c];
+        }
+      },
+      1 << 14);
+}
+
+void ConductionSolver::solveIncrement(float ratio) {
+  const float half = 0.5f * ratio;
+  // Only a new step size changes the values, the pattern stays
+  if (ratio != m_system_ratio) {
+    for (size_t row = 0; row < m_system.rows(); ++row) {
+      for (size_t e = m_laplacian.m_row_offsets[row];
+           e < m_laplacian.m_row_offsets[row + 1]; ++e) {
+        const float identity = m_laplacian.m_columns[e] == row ? 1.f : 0.f;
+        m_system.m_values[e] = identity + half * m_laplacian.m_values[e];
+      }
+    }
+    if (m_cfg.m_preconditioner == ConductionPreconditioner::MULTIGRID) {
+      // The hierarchy is dense, it takes the grid index of every unknown
+      const glm::ivec3 dims = m_grid.m_dims;
+      std::vector<size_t> voxels(m_cells.size());
+      for (size_t c = 0; c < m_cells.size(); ++c) {
+        const glm::ivec3 v = m_grid.coord(m_cells[c]);
+        voxels[c] = (static_cast<size_t>(v.z) * dims.y + v.y) * dims.x + v.x;
+      }
+      m_multigrid.update(dims, voxels, m_laplacian, half);
+    } else {
+      m_jacobi.update(m_system);
+    }
+    m_system_ratio = ratio;
+  }
+
+  std::fill(m_increment.begin(), m_increment.end(), 0.f);
+  const Preconditioner &preconditioner =
+      m_cfg.m_preconditioner == ConductionPreconditioner::MULTIGRID
+          ? static_cast<const Preconditioner &>(m_multigrid)
+          : m_jacobi;
+  m_last_solve = m_cg.solve(m_system, preconditioner, m_rhs.data(),
+                            m_increment.data(), m_cfg.m_cg);
+}
+
+template <typename Real>
+BasicConductionSolver<Real>::BasicConductionSolver(
+    model::Model &model, int resolution, bool shell,
+    const ConductionConfig &cfg)
+    : ConductionSolver(model, resolution, shell, cfg) {
+  const size_t count = m_grid.size();
+  m_reference = static_cast<Real>(model.getMeanTemperature());
+  m_temperature.assign(count, Real(0));
+  m_scratch = m_temperature;
+
+  const model::MaterialTable &table = model.getMaterialTable();
+  if (table.m_phase_change) {
+    const std::vector<float> temperature(count, model.getMeanTemperature());
+    std::vector<float> enthalpy(count);
+    table.m_enthalpy.lookup(m_material.data(), temperature.data(), count,
+                            enthalpy.data());
+    m_enthalpy.assign(enthalpy.begin(), enthalpy.end());
+  }
+  m_gathered.resize(m_cells.size());
+  m_product.resize(m_cells.size());
+}
+
+template <typename Real>
+void BasicConductionSolver<Real>::absorb(
+    const physics::HarmonicFactors &factors) {
+  const model::MaterialTable &table = m_model->getMaterialTable();
+  const bool temperature_dependent = table.m_temperature_dependent;
+  const bool phase_change = table.m_phase_change;
+  const uint32_t *material = m_material.data();
+
+  Real *__restrict__ value = m_temperature.data();
+
+  ThreadPool::getInstance().parallelFor(
+      0, m_temperature.size(),
+      [&](size_t begin, size_t end) {
+        if (!phase_change && !temperature_dependent) {
+          physics::absorbField(m_heating_re.data() + begin,
+                               m_heating_im.data() + begin, value + begin,
+                               end - begin, 1.f, factors);
+          return;
+        }
+
+        // The property tables take absolute float temperatures
+        float rate[kPropertyBlock], t[kPropertyBlock], h[kPropertyBlock];
+        for (size_t b = begin; b < end; b += kPropertyBlock) {
+          const size_t n = std::min(kPropertyBlock, end - b);
+          for (size_t i = 0; i < n; ++i) {
+            t[i] = static_cast<float>(m_reference + value[b + i]);
+          }
+          if (!phase_change) {
+            model::heatingRate(table, material + b, t, n, rate);
+            physics::absorbField(m_heating_re.data() + b,
+                                 m_heating_im.data() + b, value + b, n, rate,
+                                 factors);
+            continue;
+          }
+
+          Real *__restrict__ enthalpy = m_enthalpy.data() + b;
+          for (size_t i = 0; i < n; ++i) {
+            h[i] = static_cast<float>(enthalpy[i]);
+          }
+          model::enthalpyRate(table, material + b, t, h, n, rate);
+          physics::absorbField(m_heating_re.data() + b,
+                               m_heating_im.data() + b, enthalpy, n, rate,
+                               factors);
+          for (size_t i = 0; i < n; ++i) {
+            h[i] = static_cast<float>(enthalpy[i]);
+          }
+          table.m_temperature.lookup(material + b, h, n, t);
+          for (size_t i = 0; i < n; ++i) {
+            value[b + i] = static_cast<Real>(t[i]) - m_reference;
+          }
+        }
+      },
+      1 << 16);
+}
+
+template <typename Real>
+void BasicConductionSolver<Real>::diffuse(Real ratio) {
+  constexpr int kSize = SparseGrid::kLeafSize;
+  constexpr int kPadded = kSize + 2;
+  constexpr size_t kPaddedVoxels = kPadded * kPadded * kPadded;
+  constexpr size_t stride_y = kPadded;
+  constexpr size_t stride_z = kPadded * kPadded;
+
+  const Real *__restrict__ t = m_temperature.data();
+  const float *__restrict__ k = m_conductivity.data();
+  const float *__restrict__ inv_heat = m_inv_heat_capacity.data();
+  Real *__restrict__ out = m_scratch.data();
+
+  ThreadPool::getInstance().parallelFor(
+      0, m_grid.getLeafCount(),
+      [&](size_t l_begin, size_t l_end) {
+        // Temperatures and conductivities of the brick and the faces of its
+        // neighbours, a missing neighbour reads as empty and carries no
+        // flux. The buffer is the thread's own and outlives the sweep.
+        thread_local std::vector<Real> padded;
+        padded.resize(2 * kPaddedVoxels);
+        Real *__restrict__ pt = padded.data();
+        Real *__restrict__ pm = pt + kPaddedVoxels;
+        const auto pad = [](int x, int y, int z) {
+          return (static_cast<size_t>(z + 1) * kPadded + y + 1) * kPadded +
+                 x + 1;
+        };
+
+        for (size_t leaf = l_begin; leaf < l_end; ++leaf) {
+          std::fill(pt, pt + 2 * kPaddedVoxels, Real(0));
+          const size_t first = leaf * SparseGrid::kLeafVoxels;
+          const Real *brick_t = t + first;
+          const float *brick_k = k + first;
+          for (int z = 0; z < kSize; ++z) {
+            for (int y = 0; y < kSize; ++y) {
+              const size_t src = SparseGrid::localIndex(0, y, z);
+              std::copy(brick_t + src, brick_t + src + kSize,
+                        pt + pad(0, y, z));
+              std::copy(brick_k + src, brick_k + src + kSize,
+                        pm + pad(0, y, z));
+            }
+          }
+          for (int face = 0; face < 6; ++face) {
+            const uint32_t next = m_grid.getNeighbour(leaf, face);
+            if (next == SparseGrid::kNone) {
+              continue;
+            }
+            // The layer of the neighbour that touches this brick
+            const int axis = face / 2;
+            const int from = face % 2 ? 0 : kSize - 1;
+            const int to = face % 2 ? kSize : -1;
+            const size_t base = next * SparseGrid::kLeafVoxels;
+            for (int b = 0; b < kSize; ++b) {
+              for (int a = 0; a < kSize; ++a) {
+                glm::ivec3 src, dst;
+                src[axis] = from;
+                dst[axis] = to;
+                src[(axis + 1) % 3] = dst[(axis + 1) % 3] = a;
+                src[(axis + 2) % 3] = dst[(axis + 2) % 3] = b;
+                const size_t s = base + SparseGrid::localIndex(src.x, src.y,
+                                                               src.z);
+                pt[pad(dst.x, dst.y, dst.z)] = t[s];
+                pm[pad(dst.x, dst.y, dst.z)] = static_cast<Real>(k[s]);
+              }
+            }
+          }
+
+          for (int z = 0; z < kSize; ++z) {
+            for (int y = 0; y < kSize; ++y) {
+              const size_t row = pad(0, y, z);
+              const size_t local = SparseGrid::localIndex(0, y, z);
+              Real *__restrict__ dst = out + first + local;
+              const float *__restrict__ inv = inv_heat + first + local;
+              for (int x = 0; x < kSize; ++x) {
+                const size_t c = row + x;
+                const Real tc = pt[c];
+                const Real kc = pm[c];
+                // Harmonic mean conductance, faces to empty voxels carry no
+                // flux and the padding keeps its value
+                const auto face = [&](size_t o) {
+                  const Real sum =
+                      std::max(kc + pm[o], std::numeric_limits<Real>::min());
+                  return 2 * kc * pm[o] / sum * (pt[o] - tc);
+                };
+                const Real flux = face(c - 1) + face(c + 1) +
+                                  face(c - stride_y) + face(c + stride_y) +
+                                  face(c - stride_z) + face(c + stride_z);
+                dst[x] = tc + ratio * static_cast<Real>(inv[x]) * flux;
+              }
+            }
+          }
+        }
+      },
+      kLeafGrain);
+
+  m_temperature.swap(m_scratch);
+}
+
+template <typename Real>
+void BasicConductionSolver<Real>::stepImplicit(float ratio) {
+  const size_t n = m_cells.size();
+  const size_t *__restrict__ cells = m_cells.data();
+  Real *__restrict__ t = m_temperature.data();
+  Real *__restrict__ x = m_gathered.data();
+  Real *__restrict__ lx = m_product.data();
+  const float *__restrict__ scale = m_unknown_scale.data();
+  float *__restrict__ b = m_rhs.data();
+  const float *__restrict__ d = m_increment.data();
+  ThreadPool &pool = ThreadPool::getInstance();
+
+  pool.parallelFor(
+      0, n,
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          x[i] = static_cast<Real>(scale[i]) * t[cells[i]];
+        }
+      },
+      1 << 14);
+  // (I + r/2 L)(y + dy) = (I - r/2 L) y leaves -r L y on the right
+  m_laplacian.multiply(x, lx);
+  pool.parallelFor(
+      0, n,
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          b[i] = static_cast<float>(-static_cast<Real>(ratio) * lx[i]);
+        }
+      },
+      1 << 14);
+
+  solveIncrement(ratio);
+
+  pool.parallelFor(
+      0, n,
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          // T takes the change on its own so the scaling rounds only dT
+          const size_t s = cells[i];
+          t[s] += static_cast<Real>(d[i] / scale[i]);
+        }
+      },
+      1 << 14);
+}
+
+template <typename Real>
+void BasicConductionSolver<Real>::releaseLatentHeat() {
+  const model::MaterialTable &table = m_model->getMaterialTable();
+  // Diffusion ran with the constant capacity of each material, so that is
+  // what its change is worth in J/kg
+  std::vector<Real> capacity;
+  for (const auto &material : table.m_materials) {
+    capacity.push_back(material.m_heat_capacity);
+  }
+  const uint32_t *material = m_material.data();
+  Real *__restrict__ value = m_temperature.data();
+  const Real *__restrict__ before = m_scratch.data();
+
+  ThreadPool::getInstance().parallelFor(
+      0, m_temperature.size(),
+      [&](size_t begin, size_t end) {
+        float h[kPropertyBlock], t[kPropertyBlock];
+        for (size_t b = begin; b < end; b += kPropertyBlock) {
+          const size_t n = std::min(kPropertyBlock, end - b);
+          Real *__restrict__ enthalpy = m_enthalpy.data() + b;
+          for (size_t i = 0; i < n; ++i) {
+            enthalpy[i] +=
+                capacity[material[b + i]] * (value[b + i] - before[b + i]);
+            h[i] = static_cast<float>(enthalpy[i]);
+          }
+          table.m_temperature.lookup(material + b, h, n, t);
+          for (size_t i = 0; i < n; ++i) {
+            value[b + i] = static_cast<Real>(t[i]) - m_reference;
+          }
+        }
+      },
+      1 << 16);
+}
+
+template <typename Real>
+void BasicConductionSolver<Real>::getState(
+    double *temperature, double *enthalpy) const {
+  for (size_t v = 0; v < m_temperature.size(); ++v) {
+    temperature[v] = static_cast<double>(m_reference) +
+                     static_cast<double>(m_temperature[v]);
+  }
+  std::copy(m_enthalpy.begin(), m_enthalpy.end(), enthalpy);
+}
+
+template <typename Real>
+void BasicConductionSolver<Real>::setState(
+    const double *temperature, const double *enthalpy) {
+  for (size_t v = 0; v < m_temperature.size(); ++v) {
+    m_temperature[v] = static_cast<Real>(temperature[v] - m_reference);
+  }
+  if (!m_enthalpy.empty()) {
+    for (size_t v = 0; v < m_enthalpy.size(); ++v) {
+      m_enthalpy[v] = static_cast<Real>(enthalpy[v]);
+    }
+  }
+  gatherVertexTemperatures();
+}
+
+template <typename Real>
+void BasicConductionSolver<Real>::gatherVertexTemperatures() {
+  auto &mesh_vec = m_model->getMeshVec();
+  for (size_t m = 0; m < mesh_vec.size(); ++m) {
+    const auto &voxels = m_vertex_voxels[m];
+    auto &temperature = mesh_vec[m].m_temperature;
+    for (size_t v = 0; v < voxels.size(); ++v) {
+      temperature[v] =
+          static_cast<float>(m_reference + m_temperature[voxels[v]]);
+    }
+  }
+}
+
+template <typename Real>
+void BasicConductionSolver<Real>::step(
+    double timestamp, double dt, float frequency,
+    physics::AbsorptionMode mode) {
+  // Absorption first, then conduction spreads it (operator splitting)
+  const double omega = glm::two_pi<double>() * frequency;
+  absorb(physics::harmonicFactors(omega, timestamp, dt, mode));
+
+  const bool phase_change = m_model->getMaterialTable().m_phase_change;
+  const float h = m_grid.m_spacing;
+  const double total_ratio = dt / (h * h);
+  if (m_cfg.m_scheme == ConductionScheme::CRANK_NICOLSON) {
+    if (phase_change) {
+      m_scratch = m_temperature;
+    }
+    stepImplicit(static_cast<float>(total_ratio));
+    if (phase_change) {
+      releaseLatentHeat();
+    }
+    gatherVertexTemperatures();
+    return;
+  }
+
+  const double limit =
+      phase_change ? kStabilityLimit / m_capacity_ratio : kStabilityLimit;
+  const int substeps = std::max(
+      1, static_cast<int>(std::ceil(m_max_diffusivity * total_ratio / limit)));
+  const Real ratio = static_cast<Real>(total_ratio / substeps);
+
+  // Padding slots come out of a sweep unchanged, so both buffers agree on
+  // them. After the swap m_scratch holds the temperature before the sweep,
+  // and the latent heat goes in every sweep so no sweep crosses a plateau.
+  for (int s = 0; s < substeps; ++s) {
+    diffuse(ratio);
+    if (phase_change) {
+      releaseLatentHeat();
+    }
+  }
+
+  gatherVertexTemperatures();
+}
+
+template class BasicConductionSolver<float>;
+template class BasicConductionSolver<double>;
+
+std::unique_ptr<ConductionSolver>
+makeConductionSolver(model::Model &model, int resolution, bool shell,
+                     const ConductionConfig &cfg) {
+  switch (cfg.m_precision) {
+  case Precision::DOUBLE:
+    return std::make_unique<BasicConductionSolver<double>>(
+        model, resolution, shell, cfg);
+  default:
+    return std::make_unique<BasicConductionSolver<float>>(
+        model, resolution, shell, cfg);
+  }
+}
+
+} // namespace simulator
@@ -0,0 +1,141 @@
+#include "ConjugateGradient.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include <ThreadPool.hpp>
+
+// Elements per block of a vector kernel or reduction
+static constexpr size_t kBlockSize = 1 << 14;
+
+namespace simulator {
+
+void JacobiPreconditioner::update(const CsrMatrix &matrix) {
+  const size_t rows = matrix.rows();
+  m_inverse_diagonal.assign(rows, 1.f);
+  for (size_t row = 0; row < rows; ++row) {
+    for (size_t e = matrix.m_row_offsets[row];
+         e < matrix.m_row_offsets[row + 1]; ++e) {
+      if (matrix.m_columns[e] == row && matrix.m_values[e] != 0.f) {
+        m_inverse_diagonal[row] = 1.f / matrix.m_values[e];
+      }
+    }
+  }
+}
+
+void JacobiPreconditioner::apply(const float *r, float *z) const {
+  const float *__restrict__ inverse = m_inverse_diagonal.data();
+  ThreadPool::getInstance().parallelFor(
+      0, m_inverse_diagonal.size(),
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          z[i] = inverse[i] * r[i];
+        }
+      },
+      kBlockSize);
+}
+
+double ConjugateGradient::dot(const float *a, const float *b, size_t count) {
+  const size_t blocks = (count + kBlockSize - 1) / kBlockSize;
+  m_partials.assign(blocks, 0.0);
+
+  ThreadPool::getInstance().parallelFor(0, blocks, [&](size_t begin,
+                                                        size_t end) {
+    for (size_t block = begin; block < end; ++block) {
+      const size_t first = block * kBlockSize;
+      const size_t last = std::min(first + kBlockSize, count);
+      double sum = 0.0;
+      for (size_t i = first; i < last; ++i) {
+        sum += static_cast<double>(a[i]) * b[i];
+      }
+      m_partials[block] = sum;
+    }
+  });
+  return std::accumulate(m_partials.begin(), m_partials.end(), 0.0);
+}
+
+CgResult ConjugateGradient::solve(const CsrMatrix &matrix,
+                                  const Preconditioner &preconditioner,
+                                  const float *b, float *x,
+                                  const CgConfig &cfg) {
+  const size_t n = matrix.rows();
+  CgResult result;
+  if (n == 0) {
+    return result;
+  }
+
+  m_r.resize(n);
+  m_z.resize(n);
+  m_p.resize(n);
+  m_q.resize(n);
+  float *__restrict__ r = m_r.data();
+  float *__restrict__ z = m_z.data();
+  float *__restrict__ p = m_p.data();
+  float *__restrict__ q = m_q.data();
+  ThreadPool &pool = ThreadPool::getInstance();
+
+  // r = b - A * x, the warm start usually leaves little to do
+  matrix.multiply(x, q);
+  pool.parallelFor(
+      0, n,
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          r[i] = b[i] - q[i];
+        }
+      },
+      kBlockSize);
+
+  const double threshold_sq =
+      static_cast<double>(cfg.m_tolerance) * cfg.m_tolerance * n;
+  double r_sq = dot(r, r, n);
+  if (r_sq > threshold_sq) {
+    preconditioner.apply(r, z);
+    std::copy(z, z + n, p);
+    double rz = dot(r, z, n);
+
+    while (result.m_iterations < cfg.m_max_iterations) {
+      ++result.m_iterations;
+      matrix.multiply(p, q);
+      const double pq = dot(p, q, n);
+      if (!(pq > 0.0)) {
+        break;
+      }
+      const float alpha = static_cast<float>(rz / pq);
+
+      pool.parallelFor(
+          0, n,
+          [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+              x[i] += alpha * p[i];
+              r[i] -= alpha * q[i];
+            }
+          },
+          kBlockSize);
+
+      r_sq = dot(r, r, n);
+      if (r_sq <= threshold_sq) {
+        break;
+      }
+
+      preconditioner.apply(r, z);
+      const double rz_next = dot(r, z, n);
+      const float beta = static_cast<float>(rz_next / rz);
+      rz = rz_next;
+
+      pool.parallelFor(
+          0, n,
+          [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+              p[i] = z[i] + beta * p[i];
+            }
+          },
+          kBlockSize);
+    }
+  }
+
+  result.m_residual = static_cast<float>(std::sqrt(r_sq / n));
+  return result;
+}
+
+} // namespace simulator
@@ -0,0 +1,32 @@
+#include "CsrMatrix.hpp"
+
+#include <ThreadPool.hpp>
+
+// Rows per chunk, enough work to amortise claiming it
+static constexpr size_t kRowGrain = 4096;
+
+namespace simulator {
+
+template <typename T> void CsrMatrix::multiply(const T *x, T *y) const {
+  const size_t *__restrict__ offsets = m_row_offsets.data();
+  const uint32_t *__restrict__ columns = m_columns.data();
+  const float *__restrict__ values = m_values.data();
+
+  ThreadPool::getInstance().parallelFor(
+      0, rows(),
+      [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+          T sum = 0;
+          for (size_t e = offsets[row]; e < offsets[row + 1]; ++e) {
+            sum += static_cast<T>(values[e]) * x[columns[e]];
+          }
+          y[row] = sum;
+        }
+      },
+      kRowGrain);
+}
+
+template void CsrMatrix::multiply<float>(const float *, float *) const;
+template void CsrMatrix::multiply<double>(const double *, double *) const;
+
+} // namespace simulator
@@ -1,12 +1,21 @@
 #include "Demo.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 
+#include <Checkpoint.hpp>
 #include <Engine.hpp>
-#include <GraphicsUtils.hpp>
+#include <Ensemble.hpp>
 #include <ModelImport.hpp>
+#include <Solver.hpp>
+#include <Sweep.hpp>
+#include <TimeSeries.hpp>
 #include <WindowHandler.hpp>
 
 namespace fs = std::filesystem;
@@ -56,13 +65,88 @@ static simulator::EngineConfig configureEngine(fs::path &shaders_path) {
   checkShaders(fragment_path);
   checkShaders(vertex_path);
 
-  engine_cfg.m_source_position = glm::vec3(0.f, 0.f, 0.f);
+  simulator::physics::FieldSource magnetron;
+  magnetron.m_position = glm::vec3(0.f, 0.f, 0.f);
+  magnetron.m_amplitude = 1e3f;
+  engine_cfg.m_sources.push_back(magnetron);
   engine_cfg.m_vertex_shader_path = vertex_path.c_str();
   engine_cfg.m_fragment_shader_path = fragment_path.c_str();
 
   return engine_cfg;
 }
 
+static simulator::model::Material configureMaterial() {
+  // Water-like food sample
+  simulator::model::Material material;
+  material.m_density = 1000.f;
+  material.m_thickness = 0.02f;
+  material.m_heat_capacity = 4184.f;
+  material.m_electrical_conductivity = 0.5f;
+  material.m_thermal_conductivity = 0.6f;
+
+  // Ionic conduction rises about 2 %/K, which is what makes hot spots run
+  // away, and water expands as it warms
+  constexpr float kMinTemperature = 273.15f; ///< K
+  constexpr float kMaxTemperature = 373.15f; ///< K
+  constexpr size_t kTableSamples = 256;
+  using simulator::model::makePropertyTable;
+  material.m_electrical_conductivity_table = makePropertyTable(
+      [&material](float t) {
+        return material.m_electrical_conductivity *
+               (1.f + 0.02f * (t - simulator::model::kRoomTemperature));
+      },
+      kMinTemperature, kMaxTemperature, kTableSamples);
+  material.m_density_table = makePropertyTable(
+      [](float t) {
+        const float celsius = t - kMinTemperature;
+        return 1000.f - 0.0036f * (celsius - 4.f) * (celsius - 4.f);
+      },
+      kMinTemperature, kMaxTemperature, kTableSamples);
+
+  // Thawing and boiling hold the temperature while the latent heat goes in.
+  // Ice absorbs about a thousand times less than water, so a thawed spot
+  // runs away from the frozen rest.
+  material.m_latent_heat_fusion = 334e3f;
+  material.m_latent_heat_vaporization = 2.26e6f;
+  material.m_frozen_electrical_conductivity = 5e-4f;
+  material.m_heat_capacity_table = makePropertyTable(
+      [&material](float t) {
+        return t < kMinTemperature ? 2100.f : material.m_heat_capacity;
+      },
+      kMinTemperature - 20.f, kMaxTemperature, kTableSamples);
+  return material;
+}
+
+static simulator::model::MaterialTable configureMaterials() {
+  // Meshes of unknown Assimp materials are food, a "Dish" is glazed ceramic
+  // that barely absorbs and warms through conduction from the food
+  simulator::model::MaterialTable table;
+  table.add("", configureMaterial());
+  simulator::model::Material ceramic;
+  ceramic.m_density = 2400.f;
+  ceramic.m_thickness = 0.005f;
+  ceramic.m_heat_capacity = 850.f;
+  ceramic.m_electrical_conductivity = 1e-3f;
+  ceramic.m_thermal_conductivity = 1.5f;
+  ceramic.m_relative_permittivity = 6.f;
+  table.add("Dish", ceramic);
+  return table;
+}
+
+/**
+ * Appends one frame to the temperature file, a frame is the simulated time
+ * (double) followed by every vertex temperature (float)
+ */
+static void writeSnapshot(std::ofstream &out, simulator::Solver &solver) {
+  solver.publish();
+  solver.acquireSnapshot();
+  const simulator::TemperatureSnapshot &snapshot = solver.getSnapshot();
+  out.write(reinterpret_cast<const char *>(&snapshot.m_timeline),
+            sizeof(snapshot.m_timeline));
+  out.write(reinterpret_cast<const char *>(snapshot.m_temperature.data()),
+            snapshot.m_temperature.size() * sizeof(float));
+}
+
 void runSimulation() {
   simulator::WindowHandler::getInstance().initializeWindow();
 
@@ -71,22 +155,343 @@ void runSimulation() {
   resolvePaths(shaders_path, models_path);
 
   simulator::EngineConfig engine_cfg = configureEngine(shaders_path);
+  // Only the window shows the food turning, batch runs keep it still
+  engine_cfg.m_turntable.m_enabled = true;
 
   // Models are gonna be moved(&&) to the Engine
   fs::path model_path = models_path / "model.obj";
   fs::path texture_path = models_path / "";
   assert(fs::exists(model_path));
 
+  const simulator::model::MaterialTable materials = configureMaterials();
+
   constexpr int kTotalModels = 1;
   std::vector<simulator::model::Model> models;
   models.resize(kTotalModels);
 
   for (auto &m : models) {
+    m.setMaterials(materials);
     simulator::loadModel(model_path.c_str(), texture_path.c_str(), m);
-    simulator::graphics_utils::bindToGPU(m);
   }
 
   simulator::Engine engine(engine_cfg, models);
   while (engine.run() == simulator::EngineState::RUNNING) {
   }
 }
+
+void runHeadlessSimulation(double duration, double output_interval,
+                           const char *output_dir, double time_step,
+                           double tolerance) {
+  using Clock = std::chrono::steady_clock;
+  using Seconds = std::chrono::duration<double>;
+
+  fs::path models_path;
+  fs::path shaders_path;
+  resolvePaths(shaders_path, models_path);
+
+  simulator::EngineConfig engine_cfg = configureEngine(shaders_path);
+  // Cycle averaged absorption lets a step span many source periods
+  engine_cfg.m_time_step = time_step;
+  engine_cfg.m_adaptive.m_enabled = tolerance > 0.0;
+  engine_cfg.m_adaptive.m_tolerance = tolerance;
+  fs::create_directories(output_dir);
+  engine_cfg.m_step_log_path = (fs::path(output_dir) / "steps.csv").string();
+  engine_cfg.m_history.m_path =
+      (fs::path(output_dir) / "history.cmts").string();
+  const simulator::SolverConfig solver_cfg =
+      simulator::makeSolverConfig(engine_cfg);
+
+  fs::path model_path = models_path / "model.obj";
+  fs::path texture_path = models_path / "";
+  assert(fs::exists(model_path));
+
+  std::vector<simulator::model::Model> models(1);
+  for (auto &m : models) {
+    m.setMaterials(configureMaterials());
+    simulator::loadModel(model_path.c_str(), texture_path.c_str(), m, false);
+  }
+
+  simulator::Solver solver(models, solver_cfg);
+
+  const fs::path output_path = fs::path(output_dir) / "temperature.bin";
+  std::ofstream out(output_path, std::ios::binary);
+  if (!out.is_open()) {
+    throw std::runtime_error("Can't open " + output_path.string());
+  }
+
+  // Header: number of floats in every frame
+  const uint64_t vertex_count = solver.getVertexCount();
+  out.write(reinterpret_cast<const char *>(&vertex_count),
+            sizeof(vertex_count));
+  writeSnapshot(out, solver);
+
+  // Adaptive steps land on the frame times, fixed ones may pass them by round
+  // off, half the shortest step absorbs both
+  const double slack = 0.5 * std::min(solver_cfg.m_time_step,
+                                      solver_cfg.m_adaptive.m_min_step);
+  const uint64_t frames =
+      std::max<uint64_t>(1, std::llround(duration / output_interval));
+
+  double solver_seconds = 0.0;
+  for (uint64_t frame = 1; frame <= frames; ++frame) {
+    const double frame_end =
+        frame == frames ? duration : frame * output_interval;
+
+    // Only the stepping is timed, handing frames to the history and disk
+    // I/O are reported separately
+    const double history_before = solver.getHistorySeconds();
+    const auto start = Clock::now();
+    while (solver.getTimeline() < frame_end - slack) {
+      solver.step(frame_end);
+    }
+    solver_seconds += Seconds(Clock::now() - start).count() -
+                      (solver.getHistorySeconds() - history_before);
+
+    writeSnapshot(out, solver);
+  }
+  const auto close_start = Clock::now();
+  solver.closeHistory();
+  const double close_seconds = Seconds(Clock::now() - close_start).count();
+
+  const uint64_t total_steps = solver.getStepCount();
+  const double vertex_steps = static_cast<double>(vertex_count) * total_steps;
+  std::cout << "Simulated " << solver.getTimeline() << " s in " << total_steps
+            << " steps of " << vertex_count << " vertices";
+  if (solver_cfg.m_adaptive.m_enabled) {
+    std::cout << ", " << solver.getRejectedCount() << " steps rejected";
+  }
+  std::cout << "\n";
+  std::cout << "Solver time: " << solver_seconds << " s, throughput: "
+            << (solver_seconds > 0.0 ? vertex_steps / solver_seconds : 0.0)
+            << " vertex-steps/s\n";
+  std::cout << "Temperature fields written to " << output_path
+            << ", step sizes to " << solver_cfg.m_step_log_path << "\n";
+
+  // Every frame of the history against its raw floats
+  const fs::path history_path = solver_cfg.m_history.m_path;
+  const double raw_bytes = static_cast<double>(vertex_count) * sizeof(float) *
+                           (total_steps / solver_cfg.m_history.m_stride + 1);
+  std::cout << "History written to " << history_path << ", "
+            << raw_bytes / fs::file_size(history_path)
+            << "x smaller than raw floats, " << solver.getHistorySeconds()
+            << " s handing frames over, " << close_seconds
+            << " s flushing at the end, " << solver.getHistorySpilledCount()
+            << " frames queued past the depth\n";
+}
+
+void extractHistoryFrame(const char *history_path, double time,
+                         const char *output_path) {
+  simulator::TimeSeriesReader reader(history_path);
+  if (reader.getFrameCount() == 0) {
+    throw std::runtime_error(std::string(history_path) + " has no frames");
+  }
+  const size_t frame = reader.findFrame(time);
+  std::vector<float> temperature;
+  reader.readFrame(frame, temperature);
+
+  // Same layout as one frame of temperature.bin
+  std::ofstream out(output_path, std::ios::binary);
+  if (!out.is_open()) {
+    throw std::runtime_error(std::string("Can't open ") + output_path);
+  }
+  const uint64_t vertex_count = temperature.size();
+  const double frame_time = reader.getTime(frame);
+  out.write(reinterpret_cast<const char *>(&vertex_count),
+            sizeof(vertex_count));
+  out.write(reinterpret_cast<const char *>(&frame_time), sizeof(frame_time));
+  out.write(reinterpret_cast<const char *>(temperature.data()),
+            temperature.size() * sizeof(float));
+  std::cout << "Frame " << frame << " at " << frame_time << " s written to "
+            << output_path << "\n";
+  if (reader.getSkipped(frame) > 0) {
+    std::cout << "The history dropped " << reader.getSkipped(frame)
+              << " frames right before it\n";
+  }
+}
+
+void runParameterSweep(double duration, const char *output_path,
+                       size_t threads) {
+  using Clock = std::chrono::steady_clock;
+  using Seconds = std::chrono::duration<double>;
+
+  fs::path models_path;
+  fs::path shaders_path;
+  resolvePaths(shaders_path, models_path);
+
+  fs::path model_path = models_path / "model.obj";
+  fs::path texture_path = models_path / "";
+  assert(fs::exists(model_path));
+
+  // Imported once, every run reads it
+  simulator::model::Model prototype;
+  prototype.setMaterials(configureMaterials());
+  simulator::loadModel(model_path.c_str(), texture_path.c_str(), prototype,
+                       false);
+
+  simulator::EngineConfig base_engine = configureEngine(shaders_path);
+  base_engine.m_time_step = 0.1;
+  // steps_<run>.csv next to the summaries
+  base_engine.m_step_log_path =
+      (fs::path(output_path).parent_path() / "steps.csv").string();
+  const std::vector<simulator::EngineConfig> engines =
+      simulator::expandSweep(
+          simulator::expandSweep(
+              std::vector<simulator::EngineConfig>{base_engine},
+              std::vector<float>{2.40f * kGHz, 2.45f * kGHz, 2.50f * kGHz},
+              [](simulator::EngineConfig &cfg, float frequency) {
+                cfg.m_source_freq = frequency;
+              }),
+          std::vector<float>{-0.1f, 0.f, 0.1f},
+          [](simulator::EngineConfig &cfg, float x) {
+            cfg.m_sources.front().m_position.x = x;
+          });
+
+  const std::vector<simulator::model::Material> materials =
+      simulator::expandSweep(
+          simulator::expandSweep(
+              std::vector<simulator::model::Material>{configureMaterial()},
+              std::vector<float>{0.01f, 0.02f, 0.04f},
+              [](simulator::model::Material &material, float thickness) {
+                material.m_thickness = thickness;
+              }),
+          std::vector<float>{0.5f, 1.f, 2.f},
+          [](simulator::model::Material &material, float scale) {
+            // The conductivity curve scales with its constant
+            material.m_electrical_conductivity *= scale;
+            for (float &value : material.m_electrical_conductivity_table
+                                    .m_values) {
+              value *= scale;
+            }
+          });
+
+  simulator::SweepConfig sweep_cfg;
+  sweep_cfg.m_duration = duration;
+  sweep_cfg.m_threads = threads;
+  sweep_cfg.m_output_path = output_path;
+
+  const auto start = Clock::now();
+  const auto summaries =
+      simulator::runSweep(prototype, engines, materials, sweep_cfg);
+  std::cout << "Swept " << summaries.size() << " runs of " << duration
+            << " s in " << Seconds(Clock::now() - start).count()
+            << " s, summaries written to " << output_path << "\n";
+}
+
+void runEnsembleSimulation(size_t members, double duration,
+                           const char *output_dir) {
+  fs::path models_path;
+  fs::path shaders_path;
+  resolvePaths(shaders_path, models_path);
+
+  fs::path model_path = models_path / "model.obj";
+  fs::path texture_path = models_path / "";
+  assert(fs::exists(model_path));
+
+  simulator::model::Model prototype;
+  prototype.setMaterials(configureMaterials());
+  // The nominal properties are the ones of the food, entry 0
+  const simulator::model::Material material = prototype.getMaterial();
+  simulator::loadModel(model_path.c_str(), texture_path.c_str(), prototype,
+                       false);
+
+  simulator::EngineConfig engine_cfg = configureEngine(shaders_path);
+  engine_cfg.m_time_step = 0.1;
+  engine_cfg.m_step_log_path = (fs::path(output_dir) / "steps.csv").string();
+
+  // Typical error bars of measured food properties
+  fs::create_directories(output_dir);
+  simulator::EnsembleConfig ensemble_cfg;
+  ensemble_cfg.m_members = members;
+  ensemble_cfg.m_duration = duration;
+  ensemble_cfg.m_density.m_spread = 0.1f;
+  ensemble_cfg.m_heat_capacity.m_spread = 0.1f;
+  ensemble_cfg.m_electrical_conductivity.m_spread = 0.2f;
+  ensemble_cfg.m_members_path =
+      (fs::path(output_dir) / "members.csv").string();
+
+  const simulator::EnsembleResult result =
+      simulator::runEnsemble(prototype, engine_cfg, material, ensemble_cfg);
+
+  const fs::path output_path = fs::path(output_dir) / "ensemble.bin";
+  std::ofstream out(output_path, std::ios::binary);
+  if (!out.is_open()) {
+    throw std::runtime_error("Can't open " + output_path.string());
+  }
+  const uint64_t vertex_count = result.m_mean.size();
+  const uint64_t percentile_count = ensemble_cfg.m_percentiles.size();
+  out.write(reinterpret_cast<const char *>(&vertex_count),
+            sizeof(vertex_count));
+  out.write(reinterpret_cast<const char *>(&percentile_count),
+            sizeof(percentile_count));
+  out.write(reinterpret_cast<const char *>(ensemble_cfg.m_percentiles.data()),
+            percentile_count * sizeof(float));
+  const auto writeMap = [&out](const std::vector<float> &map) {
+    out.write(reinterpret_cast<const char *>(map.data()),
+              map.size() * sizeof(float));
+  };
+  writeMap(result.m_mean);
+  writeMap(result.m_std);
+  for (const auto &map : result.m_percentile_maps) {
+    writeMap(map);
+  }
+
+  std::cout << "Ran " << result.m_members << " members, temperature maps "
+            << "written to " << output_path << ", sampled properties to "
+            << ensemble_cfg.m_members_path << "\n";
+}
+
+void runResumableSimulation(double duration, const char *checkpoint_path,
+                            double interval) {
+  using Clock = std::chrono::steady_clock;
+  using Seconds = std::chrono::duration<double>;
+
+  fs::path models_path;
+  fs::path shaders_path;
+  resolvePaths(shaders_path, models_path);
+
+  fs::path model_path = models_path / "model.obj";
+  fs::path texture_path = models_path / "";
+  assert(fs::exists(model_path));
+
+  // A restarted run takes its configuration from the checkpoint
+  std::unique_ptr<simulator::CheckpointFile> checkpoint;
+  simulator::EngineConfig engine_cfg;
+  if (fs::exists(checkpoint_path)) {
+    checkpoint = std::make_unique<simulator::CheckpointFile>(checkpoint_path);
+    engine_cfg = simulator::unpackEngineConfig(*checkpoint);
+  } else {
+    engine_cfg = configureEngine(shaders_path);
+    engine_cfg.m_time_step = 0.1;
+  }
+  engine_cfg.m_checkpoint_path = checkpoint_path;
+  engine_cfg.m_checkpoint_interval = interval;
+  const simulator::SolverConfig solver_cfg =
+      simulator::makeSolverConfig(engine_cfg);
+
+  std::vector<simulator::model::Model> models(1);
+  for (auto &m : models) {
+    m.setMaterials(configureMaterials());
+    simulator::loadModel(model_path.c_str(), texture_path.c_str(), m, false);
+  }
+
+  simulator::Solver solver(models, solver_cfg);
+  if (checkpoint) {
+    const auto start = Clock::now();
+    solver.restore(*checkpoint);
+    checkpoint.reset();
+    std::cout << "Resumed at " << solver.getTimeline() << " s in "
+              << Seconds(Clock::now() - start).count() << " s\n";
+  }
+
+  const double slack = 0.5 * std::min(solver_cfg.m_time_step,
+                                      solver_cfg.m_adaptive.m_min_step);
+  while (solver.getTimeline() < duration - slack) {
+    solver.step(duration);
+  }
+  solver.checkpoint();
+  solver.flushCheckpoints();
+
+  std::cout << "Simulated " << solver.getTimeline() << " s in "
+            << solver.getStepCount() << " steps, checkpoint written to "
+            << checkpoint_path << "\n";
+}
@@ -2,14 +2,206 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <type_traits>
 
 #include <GraphicsUtils.hpp>
 #include <WindowHandler.hpp>
 
 constexpr double kTimeInterval = 1e-3; ///< ms
 
+// Temperatures mapped to the two ends of the heat colour ramp
+constexpr float kColdTemperature = simulator::model::kRoomTemperature; ///< K
+constexpr float kHotTemperature = 373.15f;                             ///< K
+
 namespace simulator {
 
+/**
+ * Fixed size part of the engine configuration as stored in a checkpoint
+ */
+struct EngineRecord {
+  float m_source_freq;
+  double m_time_scale;
+  double m_time_step;
+  physics::AbsorptionMode m_absorption_mode;
+  ThermalModel m_thermal_model;
+  int m_voxel_resolution;
+  bool m_voxel_shell;
+  ConductionConfig m_conduction;
+  AdaptiveStepConfig m_adaptive;
+  physics::FieldModel m_field_model;
+  bool m_occlusion;
+  bool m_attenuation;
+  physics::Cavity m_cavity;
+  physics::FdtdConfig m_fdtd;
+  float m_quality_factor;
+  float m_mode_band;
+  int m_cavity_cells_per_wavelength;
+  physics::RayTraceConfig m_ray_trace;
+  physics::TurntableConfig m_turntable;
+  double m_checkpoint_interval;
+  int m_history_stride;
+  int m_history_keyframe_interval;
+  int m_history_mantissa_bits;
+  uint64_t m_history_queue_depth;
+  bool m_history_drop_frames;
+};
+static_assert(std::is_trivially_copyable<EngineRecord>::value &&
+                  std::is_trivially_copyable<physics::FieldSource>::value,
+              "Checkpoint records are copied as bytes");
+
+/**
+ * Strings of the engine configuration, by their checkpoint section index
+ */
+enum EngineString : uint32_t {
+  STEP_LOG_PATH,
+  CAVITY_CACHE_DIR,
+  VERTEX_SHADER_PATH,
+  FRAGMENT_SHADER_PATH,
+  CHECKPOINT_PATH,
+  HISTORY_PATH,
+};
+
+std::vector<CheckpointBlob> packEngineConfig(const EngineConfig &cfg) {
+  // Value initialized, the padding is zeroed along with the fields
+  EngineRecord record = EngineRecord();
+  record.m_source_freq = cfg.m_source_freq;
+  record.m_time_scale = cfg.m_time_scale;
+  record.m_time_step = cfg.m_time_step;
+  record.m_absorption_mode = cfg.m_absorption_mode;
+  record.m_thermal_model = cfg.m_thermal_model;
+  record.m_voxel_resolution = cfg.m_voxel_resolution;
+  record.m_voxel_shell = cfg.m_voxel_shell;
+  record.m_conduction = cfg.m_conduction;
+  record.m_adaptive = cfg.m_adaptive;
+  record.m_field_model = cfg.m_field_model;
+  record.m_occlusion = cfg.m_occlusion;
+  record.m_attenuation = cfg.m_attenuation;
+  record.m_cavity = cfg.m_cavity;
+  record.m_fdtd = cfg.m_fdtd;
+  record.m_quality_factor = cfg.m_cavity_modes.m_quality_factor;
+  record.m_mode_band = cfg.m_cavity_modes.m_mode_band;
+  record.m_cavity_cells_per_wavelength =
+      cfg.m_cavity_modes.m_cells_per_wavelength;
+  record.m_ray_trace = cfg.m_ray_trace;
+  record.m_turntable = cfg.m_turntable;
+  record.m_checkpoint_interval = cfg.m_checkpoint_interval;
+  record.m_history_stride = cfg.m_history.m_stride;
+  record.m_history_keyframe_interval = cfg.m_history.m_keyframe_interval;
+  record.m_history_mantissa_bits = cfg.m_history.m_mantissa_bits;
+  record.m_history_queue_depth = cfg.m_history.m_queue_depth;
+  record.m_history_drop_frames = cfg.m_history.m_drop_frames;
+
+  const auto bytes = [](const void *data, size_t size) {
+    const char *begin = static_cast<const char *>(data);
+    return std::vector<char>(begin, begin + size);
+  };
+  const auto string = [&bytes](EngineString index, const std::string &value) {
+    return CheckpointBlob{ENGINE_STRING, index,
+                          bytes(value.data(), value.size())};
+  };
+
+  std::vector<CheckpointBlob> blobs;
+  blobs.push_back({ENGINE_RECORD, 0, bytes(&record, sizeof(record))});
+  blobs.push_back(
+      {ENGINE_SOURCES, 0,
+       bytes(cfg.m_sources.data(),
+             cfg.m_sources.size() * sizeof(physics::FieldSource))});
+  blobs.push_back(string(STEP_LOG_PATH, cfg.m_step_log_path));
+  blobs.push_back(string(CAVITY_CACHE_DIR, cfg.m_cavity_modes.m_cache_dir));
+  blobs.push_back(string(VERTEX_SHADER_PATH, cfg.m_vertex_shader_path));
+  blobs.push_back(string(FRAGMENT_SHADER_PATH, cfg.m_fragment_shader_path));
+  blobs.push_back(string(CHECKPOINT_PATH, cfg.m_checkpoint_path));
+  blobs.push_back(string(HISTORY_PATH, cfg.m_history.m_path));
+  return blobs;
+}
+
+EngineConfig unpackEngineConfig(const CheckpointFile &file) {
+  size_t size = 0;
+  const auto *record =
+      static_cast<const EngineRecord *>(file.find(ENGINE_RECORD, 0, size));
+  if (size != sizeof(EngineRecord)) {
+    throw std::runtime_error("Checkpoint has no engine configuration");
+  }
+
+  EngineConfig cfg;
+  cfg.m_source_freq = record->m_source_freq;
+  cfg.m_time_scale = record->m_time_scale;
+  cfg.m_time_step = record->m_time_step;
+  cfg.m_absorption_mode = record->m_absorption_mode;
+  cfg.m_thermal_model = record->m_thermal_model;
+  cfg.m_voxel_resolution = record->m_voxel_resolution;
+  cfg.m_voxel_shell = record->m_voxel_shell;
+  cfg.m_conduction = record->m_conduction;
+  cfg.m_adaptive = record->m_adaptive;
+  cfg.m_field_model = record->m_field_model;
+  cfg.m_occlusion = record->m_occlusion;
+  cfg.m_attenuation = record->m_attenuation;
+  cfg.m_cavity = record->m_cavity;
+  cfg.m_fdtd = record->m_fdtd;
+  cfg.m_cavity_modes.m_quality_factor = record->m_quality_factor;
+  cfg.m_cavity_modes.m_mode_band = record->m_mode_band;
+  cfg.m_cavity_modes.m_cells_per_wavelength =
+      record->m_cavity_cells_per_wavelength;
+  cfg.m_ray_trace = record->m_ray_trace;
+  cfg.m_turntable = record->m_turntable;
+  cfg.m_checkpoint_interval = record->m_checkpoint_interval;
+  cfg.m_history.m_stride = record->m_history_stride;
+  cfg.m_history.m_keyframe_interval = record->m_history_keyframe_interval;
+  cfg.m_history.m_mantissa_bits = record->m_history_mantissa_bits;
+  cfg.m_history.m_queue_depth = record->m_history_queue_depth;
+  cfg.m_history.m_drop_frames = record->m_history_drop_frames;
+
+  size_t count = 0;
+  const auto *sources =
+      file.findArray<physics::FieldSource>(ENGINE_SOURCES, 0, count);
+  cfg.m_sources.assign(sources, sources + count);
+
+  const auto string = [&file](EngineString index) {
+    size_t length = 0;
+    const char *data =
+        static_cast<const char *>(file.find(ENGINE_STRING, index, length));
+    return std::string(data, data + length);
+  };
+  cfg.m_step_log_path = string(STEP_LOG_PATH);
+  cfg.m_cavity_modes.m_cache_dir = string(CAVITY_CACHE_DIR);
+  cfg.m_vertex_shader_path = string(VERTEX_SHADER_PATH);
+  cfg.m_fragment_shader_path = string(FRAGMENT_SHADER_PATH);
+  cfg.m_checkpoint_path = string(CHECKPOINT_PATH);
+  cfg.m_history.m_path = string(HISTORY_PATH);
+  return cfg;
+}
+
+SolverConfig makeSolverConfig(const EngineConfig &cfg) {
+  SolverConfig solver_cfg;
+  solver_cfg.m_sources = cfg.m_sources;
+  solver_cfg.m_frequency = cfg.m_source_freq;
+  solver_cfg.m_absorption_mode = cfg.m_absorption_mode;
+  solver_cfg.m_thermal_model = cfg.m_thermal_model;
+  solver_cfg.m_voxel_resolution = cfg.m_voxel_resolution;
+  solver_cfg.m_voxel_shell = cfg.m_voxel_shell;
+  solver_cfg.m_conduction = cfg.m_conduction;
+  solver_cfg.m_field_model = cfg.m_field_model;
+  solver_cfg.m_occlusion = cfg.m_occlusion;
+  solver_cfg.m_attenuation = cfg.m_attenuation;
+  solver_cfg.m_cavity = cfg.m_cavity;
+  solver_cfg.m_fdtd = cfg.m_fdtd;
+  solver_cfg.m_cavity_modes = cfg.m_cavity_modes;
+  solver_cfg.m_ray_trace = cfg.m_ray_trace;
+  solver_cfg.m_turntable = cfg.m_turntable;
+  solver_cfg.m_time_step =
+      cfg.m_time_step > 0.0 ? cfg.m_time_step : kTimeInterval;
+  solver_cfg.m_time_scale = cfg.m_time_scale;
+  solver_cfg.m_adaptive = cfg.m_adaptive;
+  solver_cfg.m_step_log_path = cfg.m_step_log_path;
+  solver_cfg.m_history = cfg.m_history;
+  solver_cfg.m_checkpoint.m_path = cfg.m_checkpoint_path;
+  solver_cfg.m_checkpoint.m_interval = cfg.m_checkpoint_interval;
+  if (!cfg.m_checkpoint_path.empty()) {
+    solver_cfg.m_checkpoint.m_config = packEngineConfig(cfg);
+  }
+  return solver_cfg;
+}
+
 Engine::Engine(const EngineConfig &cfg, std::vector<model::Model> &models)
     : m_engine_cfg(cfg) {
 
@@ -41,6 +233,67 @@ Engine::Engine(const EngineConfig &cfg, std::vector<model::Model> &models)
 
   m_shader_cfg.m_rotation_id =
       glGetUniformLocation(m_shader_cfg.m_program_id, "rotation_mat");
+
+  m_shader_cfg.m_temperature_range_id =
+      glGetUniformLocation(m_shader_cfg.m_program_id, "temperature_range");
+
+  // Before the solver thread owns the models
+  for (const auto &m : m_models) {
+    m_buffers.push_back(graphics_utils::bindToGPU(m));
+  }
+
+  m_solver =
+      std::make_unique<Solver>(m_models, makeSolverConfig(m_engine_cfg));
+  // The models are the solver's from here on, drawing uses the positions the
+  // snapshots carry
+  m_positions = m_solver->getSnapshot().m_positions;
+  m_solver->start();
+}
+
+Engine::~Engine() {
+  // Join the solver before the models it is stepping go away
+  m_solver->stop();
+  if (m_solver->getLag() > 0.0) {
+    std::cerr << "Solver ended " << m_solver->getLag()
+              << " s of simulated time behind the wall clock\n";
+  }
+  m_solver.reset();
+  for (auto &buffers : m_buffers) {
+    graphics_utils::releaseGPU(buffers);
+  }
+  glDeleteProgram(m_shader_cfg.m_program_id);
+}
+
+void Engine::uploadTemperatures() {
+  // Never waits on the solver, keeps drawing the previous snapshot instead
+  if (!m_solver->acquireSnapshot()) {
+    return;
+  }
+
+  const TemperatureSnapshot &snapshot = m_solver->getSnapshot();
+  m_timeline = snapshot.m_timeline;
+  m_positions = snapshot.m_positions;
+
+  const float *temperature = snapshot.m_temperature.data();
+  for (size_t i = 0; i < m_models.size(); ++i) {
+    temperature = graphics_utils::uploadTemperature(m_models[i],
+                                                    m_buffers[i], temperature);
+  }
+}
+
+glm::mat4 Engine::turntableRotation(const glm::vec3 &position) const {
+  const physics::TurntableConfig &turntable = m_engine_cfg.m_turntable;
+  if (!turntable.m_enabled) {
+    return glm::mat4(1.0f);
+  }
+  const float angle =
+      static_cast<float>(physics::turntableAngle(turntable, m_timeline));
+  // About the pivot, expressed relative to the model origin
+  const glm::vec3 arm =
+      physics::turntablePivot(m_engine_cfg.m_sources) - position;
+  glm::mat4 rotation = glm::translate(glm::mat4(1.0f), arm);
+  rotation = glm::rotate(rotation, angle, glm::normalize(turntable.m_axis));
+  return glm::translate(rotation, -arm);
 }
 
 EngineState Engine::run() {
@@ -51,7 +304,7 @@ EngineState Engine::run() {
   //  glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  graphics_utils::updateOnEvents(m_camera, &m_models[0].getPosition());
+  graphics_utils::updateOnEvents(m_camera, &m_positions[0]);
 
   constexpr float fov = glm::radians(45.f);
   constexpr float aspect = 4.f / 3.f;
@@ -61,19 +314,24 @@ EngineState Engine::run() {
   const glm::mat4 model_mat = glm::mat4(1.0f);
   const glm::mat4 projection_mat = glm::perspective(fov, aspect, near, far);
   glm::mat4 view_mat = m_camera.getCameraModel();
-  const glm::mat4 rotation_matrix = glm::mat4(1.0f);
 
   // Upload the matrices to the GPU
   glUniformMatrix4fv(m_shader_cfg.m_matrix_id, 1, GL_FALSE, &model_mat[0][0]);
   glUniformMatrix4fv(m_shader_cfg.m_projec_id, 1, GL_FALSE,
                      &projection_mat[0][0]);
   glUniformMatrix4fv(m_shader_cfg.m_view_id, 1, GL_FALSE, &view_mat[0][0]);
-  glUniformMatrix4fv(m_shader_cfg.m_rotation_id, 1, GL_FALSE,
-                     &rotation_matrix[0][0]);
+  glUniform2f(m_shader_cfg.m_temperature_range_id, kColdTemperature,
+              kHotTemperature);
+
+  uploadTemperatures();
 
   // Render each model
-  for (auto &m : m_models) {
-    graphics_utils::render(m, m_shader_cfg.m_view_id, view_mat);
+  for (size_t i = 0; i < m_models.size(); ++i) {
+    const glm::mat4 rotation_matrix = turntableRotation(m_positions[i]);
+    glUniformMatrix4fv(m_shader_cfg.m_rotation_id, 1, GL_FALSE,
+                       &rotation_matrix[0][0]);
+    graphics_utils::render(m_models[i], m_buffers[i], m_positions[i],
+                           m_shader_cfg.m_view_id, view_mat);
   }
 
   glfwSwapBuffers(WindowHandler::getInstance().getWindow());
@@ -0,0 +1,191 @@
+#include "Ensemble.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include <CounterRng.hpp>
+#include <Solver.hpp>
+#include <Sweep.hpp>
+#include <WorkStealingPool.hpp>
+
+// A normal draw never scales a property below this
+static constexpr float kMinScale = 0.05f;
+// Members in flight per worker. Members fold in order, so one that finishes
+// early waits for the slower ones before it. The window bounds how many wait.
+static constexpr size_t kMembersPerThread = 2;
+
+namespace simulator {
+
+/**
+ * Fails the ensemble when a member leaves without folding, whatever threw,
+ * so the submit loop stops waiting for it
+ */
+struct FoldGuard {
+  std::mutex &m_mutex;
+  std::condition_variable &m_folded;
+  bool &m_failed;
+  bool m_done = false; ///< Set once the member folded
+
+  ~FoldGuard() {
+    if (m_done) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_failed = true;
+    }
+    m_folded.notify_one();
+  }
+};
+
+/**
+ * @brief drawScale
+ * @param rng
+ * @param uncertainty
+ * @return Factor the property is multiplied by
+ */
+static float drawScale(CounterRng &rng, const Uncertainty &uncertainty) {
+  // Always draws, so adding a spread to one property leaves the others be
+  const float draw = uncertainty.m_shape == UncertaintyShape::UNIFORM
+                         ? 2.f * rng.uniform() - 1.f
+                         : rng.normal();
+  return std::max(1.f + uncertainty.m_spread * draw, kMinScale);
+}
+
+static void scaleProperty(float scale, float &constant,
+                          model::PropertyTable &table) {
+  constant *= scale;
+  for (float &value : table.m_values) {
+    value *= scale;
+  }
+}
+
+model::Material sampleMaterial(const model::Material &base,
+                               const EnsembleConfig &cfg, size_t member) {
+  CounterRng rng(cfg.m_seed, member);
+  model::Material material = base;
+  scaleProperty(drawScale(rng, cfg.m_density), material.m_density,
+                material.m_density_table);
+  scaleProperty(drawScale(rng, cfg.m_heat_capacity), material.m_heat_capacity,
+                material.m_heat_capacity_table);
+  scaleProperty(drawScale(rng, cfg.m_electrical_conductivity),
+                material.m_electrical_conductivity,
+                material.m_electrical_conductivity_table);
+  return material;
+}
+
+EnsembleResult runEnsemble(const model::Model &prototype,
+                           const EngineConfig &engine,
+                           const model::Material &material,
+                           const EnsembleConfig &cfg) {
+  for (const float p : cfg.m_percentiles) {
+    if (!(p > 0.f && p < 1.f)) {
+      throw std::runtime_error("Ensemble percentiles must be in (0, 1)");
+    }
+  }
+
+  std::ofstream members_out;
+  if (!cfg.m_members_path.empty()) {
+    members_out.open(cfg.m_members_path);
+    if (!members_out.is_open()) {
+      throw std::runtime_error("Can't open " + cfg.m_members_path);
+    }
+    members_out.precision(9);
+    members_out << "member,density,heat_capacity,electrical_conductivity,"
+                   "mean_temperature,max_temperature\n";
+  }
+
+  size_t vertex_count = 0;
+  for (const auto &mesh : prototype.getMeshVec()) {
+    vertex_count += mesh.getVertPositions().size();
+  }
+  EnsembleAccumulator accumulator(vertex_count, cfg.m_percentiles);
+
+  // Members that finished ahead of an earlier one wait here
+  std::mutex fold_mutex;
+  std::condition_variable folded;
+  std::map<size_t, std::vector<float>> finished;
+  size_t next_member = 0;
+  bool failed = false; ///< A member threw, the ones after it never fold
+
+  SolverConfig solver_cfg = makeSolverConfig(engine);
+  solver_cfg.m_checkpoint.m_path.clear();
+  solver_cfg.m_history.m_path.clear();
+
+  const SharedGeometry geometry = prototype.shareGeometry();
+  WorkStealingPool pool(cfg.m_threads);
+  const size_t window = kMembersPerThread * pool.getThreadCount();
+  for (size_t member = 0; member < cfg.m_members; ++member) {
+    {
+      std::unique_lock<std::mutex> lock(fold_mutex);
+      folded.wait(lock,
+                  [&] { return failed || member < next_member + window; });
+      if (failed) {
+        break;
+      }
+    }
+    pool.submit([&, member] {
+      FoldGuard guard{fold_mutex, folded, failed};
+      std::vector<model::Model> models(1);
+      copyRunModel(prototype, sampleMaterial(material, cfg, member),
+                   cfg.m_initial_temperature, geometry, models.front());
+      {
+        SolverConfig member_cfg = solver_cfg;
+        member_cfg.m_step_log_path = runPath(engine.m_step_log_path, member);
+        Solver solver(models, member_cfg);
+        const double slack = 0.5 * std::min(solver_cfg.m_time_step,
+                                            solver_cfg.m_adaptive.m_min_step);
+        while (solver.getTimeline() < cfg.m_duration - slack) {
+          solver.step(cfg.m_duration);
+        }
+      }
+
+      std::vector<float> temperature;
+      temperature.reserve(vertex_count);
+      for (const auto &mesh : models.front().getMeshVec()) {
+        temperature.insert(temperature.end(), mesh.m_temperature.begin(),
+                           mesh.m_temperature.end());
+      }
+
+      std::unique_lock<std::mutex> lock(fold_mutex);
+      finished.emplace(member, std::move(temperature));
+      for (auto it = finished.find(next_member); it != finished.end();
+           it = finished.find(next_member)) {
+        accumulator.add(it->second.data());
+        if (members_out.is_open()) {
+          const model::Material sampled =
+              sampleMaterial(material, cfg, next_member);
+          const auto &t = it->second;
+          double sum = 0.0;
+          for (const float value : t) {
+            sum += value;
+          }
+          members_out << next_member << "," << sampled.m_density << ","
+                      << sampled.m_heat_capacity << ","
+                      << sampled.m_electrical_conductivity << ","
+                      << (t.empty() ? 0.0 : sum / t.size()) << ","
+                      << (t.empty() ? 0.f
+                                    : *std::max_element(t.begin(), t.end()))
+                      << "\n";
+        }
+        finished.erase(it);
+        ++next_member;
+      }
+      guard.m_done = true;
+      lock.unlock();
+      folded.notify_one();
+    });
+  }
+  pool.wait();
+
+  EnsembleResult result;
+  accumulator.finish(result);
+  return result;
+}
+
+} // namespace simulator
@@ -0,0 +1,152 @@
+#include "EnsembleAccumulator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// P^2 markers per percentile
+static constexpr int kMarkers = 5;
+
+namespace simulator {
+
+EnsembleAccumulator::EnsembleAccumulator(size_t count,
+                                         const std::vector<float> &percentiles)
+    : m_count(count), m_percentiles(percentiles), m_mean(count, 0.0),
+      m_m2(count, 0.0), m_heights(percentiles.size() * kMarkers * count, 0.f),
+      m_positions(percentiles.size() * kMarkers * count, 0.f) {}
+
+void EnsembleAccumulator::add(const float *temperature) {
+  ++m_n;
+  const double n = static_cast<double>(m_n);
+  for (size_t v = 0; v < m_count; ++v) {
+    const double delta = temperature[v] - m_mean[v];
+    m_mean[v] += delta / n;
+    m_m2[v] += delta * (temperature[v] - m_mean[v]);
+  }
+  for (size_t p = 0; p < m_percentiles.size(); ++p) {
+    for (size_t v = 0; v < m_count; ++v) {
+      addQuantile(p, v, temperature[v]);
+    }
+  }
+}
+
+void EnsembleAccumulator::finish(EnsembleResult &result) const {
+  result.m_members = m_n;
+  result.m_mean.resize(m_count);
+  result.m_std.resize(m_count);
+  for (size_t v = 0; v < m_count; ++v) {
+    result.m_mean[v] = static_cast<float>(m_mean[v]);
+    result.m_std[v] = m_n > 1 ? static_cast<float>(std::sqrt(
+                                    m_m2[v] / static_cast<double>(m_n - 1)))
+                              : 0.f;
+  }
+  result.m_percentile_maps.resize(m_percentiles.size());
+  for (size_t p = 0; p < m_percentiles.size(); ++p) {
+    auto &map = result.m_percentile_maps[p];
+    map.resize(m_count);
+    for (size_t v = 0; v < m_count; ++v) {
+      map[v] = quantile(p, v);
+    }
+  }
+}
+
+float &EnsembleAccumulator::height(size_t p, int marker, size_t v) {
+  return m_heights[(p * kMarkers + marker) * m_count + v];
+}
+
+float EnsembleAccumulator::height(size_t p, int marker, size_t v) const {
+  return m_heights[(p * kMarkers + marker) * m_count + v];
+}
+
+float &EnsembleAccumulator::position(size_t p, int marker, size_t v) {
+  return m_positions[(p * kMarkers + marker) * m_count + v];
+}
+
+void EnsembleAccumulator::addQuantile(size_t p, size_t v, float x) {
+  // The first five observations become the markers
+  if (m_n <= kMarkers) {
+    height(p, static_cast<int>(m_n) - 1, v) = x;
+    if (m_n == kMarkers) {
+      float q[kMarkers];
+      for (int i = 0; i < kMarkers; ++i) {
+        q[i] = height(p, i, v);
+      }
+      std::sort(q, q + kMarkers);
+      for (int i = 0; i < kMarkers; ++i) {
+        height(p, i, v) = q[i];
+        position(p, i, v) = static_cast<float>(i + 1);
+      }
+    }
+    return;
+  }
+
+  int cell;
+  if (x < height(p, 0, v)) {
+    height(p, 0, v) = x;
+    cell = 0;
+  } else if (x >= height(p, 4, v)) {
+    height(p, 4, v) = x;
+    cell = 3;
+  } else {
+    cell = 0;
+    while (x >= height(p, cell + 1, v)) {
+      ++cell;
+    }
+  }
+  for (int i = cell + 1; i < kMarkers; ++i) {
+    position(p, i, v) += 1.f;
+  }
+
+  const float fraction = m_percentiles[p];
+  const float last = static_cast<float>(m_n - 1);
+  const float desired[kMarkers] = {1.f, 1.f + last * fraction * 0.5f,
+                                   1.f + last * fraction,
+                                   1.f + last * (1.f + fraction) * 0.5f,
+                                   1.f + last};
+  for (int i = 1; i < kMarkers - 1; ++i) {
+    const float n = position(p, i, v);
+    const float n_lo = position(p, i - 1, v);
+    const float n_hi = position(p, i + 1, v);
+    const float d = desired[i] - n;
+    if (!((d >= 1.f && n_hi - n > 1.f) || (d <= -1.f && n_lo - n < -1.f))) {
+      continue;
+    }
+    const float s = d > 0.f ? 1.f : -1.f;
+    const float q = height(p, i, v);
+    const float q_lo = height(p, i - 1, v);
+    const float q_hi = height(p, i + 1, v);
+    // Piecewise parabolic through the neighbours, linear if it overshoots
+    const float parabolic =
+        q + s / (n_hi - n_lo) *
+                ((n - n_lo + s) * (q_hi - q) / (n_hi - n) +
+                 (n_hi - n - s) * (q - q_lo) / (n - n_lo));
+    if (q_lo < parabolic && parabolic < q_hi) {
+      height(p, i, v) = parabolic;
+    } else {
+      const int j = s > 0.f ? i + 1 : i - 1;
+      height(p, i, v) =
+          q + s * (height(p, j, v) - q) / (position(p, j, v) - n);
+    }
+    position(p, i, v) = n + s;
+  }
+}
+
+float EnsembleAccumulator::quantile(size_t p, size_t v) const {
+  if (m_n >= kMarkers) {
+    return height(p, 2, v);
+  }
+  if (m_n == 0) {
+    return 0.f;
+  }
+  // Too few members for the markers, interpolate the sorted samples
+  float q[kMarkers];
+  for (size_t i = 0; i < m_n; ++i) {
+    q[i] = height(p, static_cast<int>(i), v);
+  }
+  std::sort(q, q + m_n);
+  const float x = m_percentiles[p] * static_cast<float>(m_n - 1);
+  const size_t lo = static_cast<size_t>(x);
+  const size_t hi = std::min(lo + 1, m_n - 1);
+  return q[lo] + (x - static_cast<float>(lo)) * (q[hi] - q[lo]);
+}
+
+} // namespace simulator
@@ -0,0 +1,315 @@
+#include "FdtdField.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <glm/gtc/constants.hpp>
+
+#include <ThreadPool.hpp>
+
+static constexpr double kSpeedOfLight = 299792458.0; ///< m/s
+static constexpr double kEpsilon0 = 8.8541878128e-12; ///< F/m
+static constexpr double kMu0 = 1.25663706212e-6;      ///< H/m
+static constexpr double kEta0 = 376.730313668;        ///< Ohm
+
+// Polynomial grading of the absorbing layer conductivity
+static constexpr double kPmlOrder = 3.0;
+
+// Sources ramp up over a few periods so they don't kick off a broadband
+// transient that takes long to settle
+static constexpr int kRampPeriods = 3;
+
+namespace simulator {
+namespace physics {
+
+FdtdField::FdtdField(const Cavity &cavity, float frequency,
+                     float max_relative_permittivity, const FdtdConfig &cfg)
+    : m_cfg(cfg), m_frequency(frequency) {
+  if (frequency <= 0.f || cfg.m_cells_per_wavelength <= 0) {
+    throw std::runtime_error("FDTD needs a positive frequency and resolution");
+  }
+
+  const double wavelength = kSpeedOfLight / frequency /
+                            std::sqrt(std::max(max_relative_permittivity, 1.f));
+  m_spacing = static_cast<float>(wavelength / cfg.m_cells_per_wavelength);
+
+  const glm::vec3 extent = cavity.m_max - cavity.m_min;
+  const int pml = std::max(cfg.m_pml_cells, 0);
+  m_dims.x = static_cast<int>(std::ceil(extent.x / m_spacing)) + 1 + 2 * pml;
+  m_dims.y = static_cast<int>(std::ceil(extent.y / m_spacing)) + 1 + 2 * pml;
+  m_dims.z = static_cast<int>(std::ceil(extent.z / m_spacing)) + 1 + 2 * pml;
+  if (m_dims.x < 3 || m_dims.y < 3 || m_dims.z < 3) {
+    throw std::runtime_error("FDTD cavity is smaller than a cell");
+  }
+  m_origin = cavity.m_min - glm::vec3(pml * m_spacing);
+
+  // Round the step down to a whole fraction of the period, so the average
+  // covers complete cycles
+  const double dt_max =
+      cfg.m_courant * m_spacing / (kSpeedOfLight * std::sqrt(3.0));
+  const double period = 1.0 / frequency;
+  m_steps_per_period = static_cast<int>(std::ceil(period / dt_max));
+  m_dt = period / m_steps_per_period;
+
+  const size_t count = static_cast<size_t>(m_dims.x) * m_dims.y * m_dims.z;
+  for (auto *field : {&m_ex, &m_ey, &m_ez, &m_hx, &m_hy, &m_hz}) {
+    field->assign(count, 0.f);
+  }
+  m_sigma_e.assign(count, 0.f);
+  m_sigma_m.assign(count, 0.f);
+  m_eps_r.assign(count, 1.f);
+
+  if (pml == 0) {
+    return;
+  }
+
+  // Matched layer: sigma_m / mu0 = sigma_e / eps0 keeps the impedance of the
+  // layer equal to free space, so waves enter it without reflecting
+  const double sigma_max = 0.8 * (kPmlOrder + 1.0) / (kEta0 * m_spacing);
+  const auto depth = [pml](int n, int dim) {
+    const int into = std::max(pml - n, n - (dim - 1 - pml));
+    return std::max(into, 0) / static_cast<double>(pml);
+  };
+
+  for (int k = 0; k < m_dims.z; ++k) {
+    for (int j = 0; j < m_dims.y; ++j) {
+      for (int i = 0; i < m_dims.x; ++i) {
+        const double d = std::max(
+            depth(i, m_dims.x), std::max(depth(j, m_dims.y), depth(k, m_dims.z)));
+        const double sigma = sigma_max * std::pow(d, kPmlOrder);
+        m_sigma_e[index(i, j, k)] = static_cast<float>(sigma);
+        m_sigma_m[index(i, j, k)] = static_cast<float>(sigma * kMu0 / kEpsilon0);
+      }
+    }
+  }
+}
+
+void FdtdField::addSource(const FieldSource &source) {
+  const glm::vec3 cell = (source.m_position - m_origin) / m_spacing;
+  // Keep away from the walls, tangential E is pinned to 0 there
+  const int i = std::clamp(static_cast<int>(std::lround(cell.x)), 1,
+                           m_dims.x - 2);
+  const int j = std::clamp(static_cast<int>(std::lround(cell.y)), 1,
+                           m_dims.y - 2);
+  const int k = std::clamp(static_cast<int>(std::lround(cell.z)), 1,
+                           m_dims.z - 2);
+  m_source_cells.push_back(index(i, j, k));
+  m_sources.push_back(source);
+}
+
+void FdtdField::addMaterial(const SparseGrid &grid, const glm::vec3 &offset,
+                            const model::MaterialTable &materials) {
+  for (int k = 0; k < m_dims.z; ++k) {
+    for (int j = 0; j < m_dims.y; ++j) {
+      for (int i = 0; i < m_dims.x; ++i) {
+        const glm::vec3 center =
+            m_origin + m_spacing * glm::vec3(i + 0.5f, j + 0.5f, k + 0.5f);
+        const glm::vec3 voxel =
+            (center - offset - grid.m_origin) / grid.m_spacing;
+        if (voxel.x < 0.f || voxel.y < 0.f || voxel.z < 0.f ||
+            voxel.x >= grid.m_dims.x || voxel.y >= grid.m_dims.y ||
+            voxel.z >= grid.m_dims.z) {
+          continue;
+        }
+
+        const size_t v = grid.find(static_cast<int>(voxel.x),
+                                   static_cast<int>(voxel.y),
+                                   static_cast<int>(voxel.z));
+        if (v != SparseGrid::kNoSlot && grid.isActive(v)) {
+          const model::Material &material =
+              materials.m_materials[grid.getMaterial(v)];
+          m_sigma_e[index(i, j, k)] += material.m_electrical_conductivity;
+          m_eps_r[index(i, j, k)] = material.m_relative_permittivity;
+        }
+      }
+    }
+  }
+}
+
+void FdtdField::buildCoefficients() {
+  const size_t count = m_sigma_e.size();
+  m_ca.resize(count);
+  m_cb.resize(count);
+  m_da.resize(count);
+  m_db.resize(count);
+
+  for (size_t c = 0; c < count; ++c) {
+    const double eps = kEpsilon0 * m_eps_r[c];
+    const double loss_e = m_sigma_e[c] * m_dt / (2.0 * eps);
+    m_ca[c] = static_cast<float>((1.0 - loss_e) / (1.0 + loss_e));
+    m_cb[c] = static_cast<float>(m_dt / (eps * m_spacing) / (1.0 + loss_e));
+
+    const double loss_m = m_sigma_m[c] * m_dt / (2.0 * kMu0);
+    m_da[c] = static_cast<float>((1.0 - loss_m) / (1.0 + loss_m));
+    m_db[c] = static_cast<float>(m_dt / (kMu0 * m_spacing) / (1.0 + loss_m));
+  }
+}
+
+void FdtdField::updateH() {
+  const int nx = m_dims.x;
+  const int ny = m_dims.y;
+  const size_t sy = nx;
+  const size_t sz = static_cast<size_t>(nx) * ny;
+
+  const float *__restrict__ ex = m_ex.data();
+  const float *__restrict__ ey = m_ey.data();
+  const float *__restrict__ ez = m_ez.data();
+  float *__restrict__ hx = m_hx.data();
+  float *__restrict__ hy = m_hy.data();
+  float *__restrict__ hz = m_hz.data();
+  const float *__restrict__ da = m_da.data();
+  const float *__restrict__ db = m_db.data();
+
+  ThreadPool::getInstance().parallelFor(
+      0, m_dims.z - 1, [&](size_t k_begin, size_t k_end) {
+        for (size_t k = k_begin; k < k_end; ++k) {
+          for (int j = 0; j < ny - 1; ++j) {
+            const size_t row = (k * ny + j) * nx;
+            for (size_t c = row; c < row + nx - 1; ++c) {
+              hx[c] = da[c] * hx[c] -
+                      db[c] * ((ez[c + sy] - ez[c]) - (ey[c + sz] - ey[c]));
+              hy[c] = da[c] * hy[c] -
+                      db[c] * ((ex[c + sz] - ex[c]) - (ez[c + 1] - ez[c]));
+              hz[c] = da[c] * hz[c] -
+                      db[c] * ((ey[c + 1] - ey[c]) - (ex[c + sy] - ex[c]));
+            }
+          }
+        }
+      });
+}
+
+void FdtdField::updateE() {
+  const int nx = m_dims.x;
+  const int ny = m_dims.y;
+  const size_t sy = nx;
+  const size_t sz = static_cast<size_t>(nx) * ny;
+
+  float *__restrict__ ex = m_ex.data();
+  float *__restrict__ ey = m_ey.data();
+  float *__restrict__ ez = m_ez.data();
+  const float *__restrict__ hx = m_hx.data();
+  const float *__restrict__ hy = m_hy.data();
+  const float *__restrict__ hz = m_hz.data();
+  const float *__restrict__ ca = m_ca.data();
+  const float *__restrict__ cb = m_cb.data();
+
+  // The outer layer is never written, tangential E stays 0 on the walls
+  ThreadPool::getInstance().parallelFor(
+      1, m_dims.z - 1, [&](size_t k_begin, size_t k_end) {
+        for (size_t k = k_begin; k < k_end; ++k) {
+          for (int j = 1; j < ny - 1; ++j) {
+            const size_t row = (k * ny + j) * nx;
+            for (size_t c = row + 1; c < row + nx - 1; ++c) {
+              ex[c] = ca[c] * ex[c] +
+                      cb[c] * ((hz[c] - hz[c - sy]) - (hy[c] - hy[c - sz]));
+              ey[c] = ca[c] * ey[c] +
+                      cb[c] * ((hx[c] - hx[c - sz]) - (hz[c] - hz[c - 1]));
+              ez[c] = ca[c] * ez[c] +
+                      cb[c] * ((hy[c] - hy[c - 1]) - (hx[c] - hx[c - sy]));
+            }
+          }
+        }
+      });
+}
+
+void FdtdField::driveSources(double time) {
+  const double omega = glm::two_pi<double>() * m_frequency;
+  const double ramp_time = kRampPeriods / static_cast<double>(m_frequency);
+  const double ramp =
+      time < ramp_time
+          ? 0.5 * (1.0 - std::cos(glm::pi<double>() * time / ramp_time))
+          : 1.0;
+
+  for (size_t s = 0; s < m_sources.size(); ++s) {
+    m_ez[m_source_cells[s]] =
+        static_cast<float>(m_sources[s].m_amplitude * ramp *
+                           std::cos(omega * time + m_sources[s].m_phase));
+  }
+}
+
+void FdtdField::accumulateFieldSq() {
+  const int nx = m_dims.x;
+  const int ny = m_dims.y;
+  const size_t sy = nx;
+  const size_t sz = static_cast<size_t>(nx) * ny;
+  const int tx = m_table.m_dims.x;
+  const int ty = m_table.m_dims.y;
+
+  const float *__restrict__ ex = m_ex.data();
+  const float *__restrict__ ey = m_ey.data();
+  const float *__restrict__ ez = m_ez.data();
+  float *__restrict__ acc = m_table.m_values.data();
+
+  ThreadPool::getInstance().parallelFor(
+      0, m_table.m_dims.z, [&](size_t k_begin, size_t k_end) {
+        for (size_t k = k_begin; k < k_end; ++k) {
+          for (int j = 0; j < ty; ++j) {
+            const size_t row = (k * ny + j) * nx;
+            float *out = acc + (k * ty + j) * tx;
+            for (int i = 0; i < tx; ++i) {
+              // Each component is the mean of the 4 cell edges it lives on
+              const size_t c = row + i;
+              const float x =
+                  0.25f * (ex[c] + ex[c + sy] + ex[c + sz] + ex[c + sy + sz]);
+              const float y =
+                  0.25f * (ey[c] + ey[c + 1] + ey[c + sz] + ey[c + 1 + sz]);
+              const float z =
+                  0.25f * (ez[c] + ez[c + 1] + ez[c + sy] + ez[c + 1 + sy]);
+              out[i] += x * x + y * y + z * z;
+            }
+          }
+        }
+      });
+}
+
+void FdtdField::samplePhasor(const float *x, const float *y, const float *z,
+                             size_t count, const glm::vec3 &offset,
+                             float *field_re, float *field_im) const {
+  m_table.sample(x, y, z, count, offset, field_re);
+  for (size_t i = 0; i < count; ++i) {
+    field_re[i] = std::sqrt(std::max(field_re[i], 0.f));
+    field_im[i] = 0.f;
+  }
+}
+
+void FdtdField::solve() {
+  if (m_sources.empty()) {
+    throw std::runtime_error("FDTD has no source to drive");
+  }
+  buildCoefficients();
+
+  m_table.m_dims = m_dims - glm::ivec3(1, 1, 1);
+  m_table.m_origin = m_origin + glm::vec3(0.5f * m_spacing);
+  m_table.m_spacing = m_spacing;
+  m_table.m_values.assign(m_table.size(), 0.f);
+
+  const int warmup_steps = m_cfg.m_warmup_periods * m_steps_per_period;
+  const int average_steps =
+      std::max(m_cfg.m_average_periods, 1) * m_steps_per_period;
+
+  int step = 0;
+  for (; step < warmup_steps + average_steps; ++step) {
+    updateH();
+    updateE();
+    driveSources((step + 1) * m_dt);
+    if (step >= warmup_steps) {
+      accumulateFieldSq();
+    }
+  }
+
+  // Peak amplitude, E(t)^2 = 2 * <E^2> * cos^2(wt)
+  const float scale = 2.f / average_steps;
+  for (auto &v : m_table.m_values) {
+    v *= scale;
+  }
+
+  // Only the table is needed from now on
+  for (auto *field : {&m_ex, &m_ey, &m_ez, &m_hx, &m_hy, &m_hz, &m_ca, &m_cb,
+                      &m_da, &m_db}) {
+    std::vector<float>().swap(*field);
+  }
+}
+
+} // namespace physics
+} // namespace simulator
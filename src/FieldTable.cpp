@@ -0,0 +1,52 @@
+#include "FieldTable.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace simulator {
+namespace physics {
+
+void FieldTable::sample(const float *x, const float *y, const float *z,
+                        size_t count, const glm::vec3 &offset,
+                        float *out) const {
+  const float inv_h = 1.f / m_spacing;
+  const glm::vec3 shift = (offset - m_origin) * inv_h;
+
+  // Clamp so the upper corner of the cell stays inside the table
+  const float max_x = static_cast<float>(std::max(m_dims.x - 1, 0));
+  const float max_y = static_cast<float>(std::max(m_dims.y - 1, 0));
+  const float max_z = static_cast<float>(std::max(m_dims.z - 1, 0));
+  // Flat axes read the same sample twice
+  const size_t step_x = m_dims.x > 1 ? 1 : 0;
+  const size_t step_y = m_dims.y > 1 ? m_dims.x : 0;
+  const size_t step_z =
+      m_dims.z > 1 ? static_cast<size_t>(m_dims.x) * m_dims.y : 0;
+  const float *values = m_values.data();
+
+  for (size_t p = 0; p < count; ++p) {
+    const float gx = std::clamp(x[p] * inv_h + shift.x, 0.f, max_x);
+    const float gy = std::clamp(y[p] * inv_h + shift.y, 0.f, max_y);
+    const float gz = std::clamp(z[p] * inv_h + shift.z, 0.f, max_z);
+
+    // The last sample uses the cell below it with a weight of 1
+    const int i = std::min(static_cast<int>(gx), std::max(m_dims.x - 2, 0));
+    const int j = std::min(static_cast<int>(gy), std::max(m_dims.y - 2, 0));
+    const int k = std::min(static_cast<int>(gz), std::max(m_dims.z - 2, 0));
+    const float fx = gx - i;
+    const float fy = gy - j;
+    const float fz = gz - k;
+
+    const float *c = values + index(i, j, k);
+    const float c00 = c[0] + fx * (c[step_x] - c[0]);
+    const float c10 = c[step_y] + fx * (c[step_y + step_x] - c[step_y]);
+    const float c01 = c[step_z] + fx * (c[step_z + step_x] - c[step_z]);
+    const float c11 = c[step_z + step_y] +
+                      fx * (c[step_z + step_y + step_x] - c[step_z + step_y]);
+    const float c0 = c00 + fy * (c10 - c00);
+    const float c1 = c01 + fy * (c11 - c01);
+    out[p] = c0 + fz * (c1 - c0);
+  }
+}
+
+} // namespace physics
+} // namespace simulator
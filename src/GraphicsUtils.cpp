@@ -21,11 +21,12 @@ static void bindVAO(GLuint &vertex_array_id) {
 }
 
 template <typename T>
-void bindVBO(GLuint &vertex_buffer_id, std::vector<T> &buffer) {
+void bindVBO(GLuint &vertex_buffer_id, const std::vector<T> &buffer,
+             GLenum usage = GL_STATIC_DRAW) {
   glGenBuffers(1, &vertex_buffer_id);
   glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
-  glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(T), &buffer[0],
-               GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(T), buffer.data(),
+               usage);
 }
 
 static GraphicsRes compileShader(GLuint &shader_id, const char *path) {
@@ -152,45 +153,83 @@ GraphicsRes loadShaders(const char *fragment_shader_path,
   return GraphicsRes::SUCCESS;
 }
 
-void bindToGPU(model::Model &current_model) {
-  auto &mesh_vec = current_model.getMeshVec();
+ModelBuffers bindToGPU(const model::Model &current_model) {
+  const auto &mesh_vec = current_model.getMeshVec();
+  ModelBuffers buffers(mesh_vec.size());
 
   for (size_t index = 0; index < mesh_vec.size(); ++index) {
-    bindVAO(mesh_vec[index].m_VAO);
+    MeshBuffers &mesh_buffers = buffers[index];
+    bindVAO(mesh_buffers.m_VAO);
 
-    bindVBO(mesh_vec[index].m_VBO_pos, mesh_vec[index].m_vert_positions);
+    bindVBO(mesh_buffers.m_VBO_pos, mesh_vec[index].m_vert_positions);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
                           (void *)0);
 
-    bindVBO(mesh_vec[index].m_VBO_norm, mesh_vec[index].m_vert_normals);
+    bindVBO(mesh_buffers.m_VBO_norm, mesh_vec[index].m_vert_normals);
 
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
                           (void *)0);
 
-    bindVBO(mesh_vec[index].m_VBO_tex, mesh_vec[index].m_tex_coords);
+    bindVBO(mesh_buffers.m_VBO_tex, mesh_vec[index].m_tex_coords);
 
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float),
                           (void *)0);
 
-    glGenBuffers(1, &mesh_vec[index].m_EBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_vec[index].m_EBO);
+    // Rewritten with every solver snapshot
+    bindVBO(mesh_buffers.m_VBO_temp, mesh_vec[index].m_temperature,
+            GL_DYNAMIC_DRAW);
+
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)0);
+
+    glGenBuffers(1, &mesh_buffers.m_EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_buffers.m_EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                  sizeof(GLuint) * mesh_vec[index].m_vert_indices.size(),
                  mesh_vec[index].m_vert_indices.data(), GL_STATIC_DRAW);
 
     glBindVertexArray(0);
   }
+  return buffers;
+}
+
+void releaseGPU(ModelBuffers &buffers) {
+  for (auto &m : buffers) {
+    glDeleteVertexArrays(1, &m.m_VAO);
+    glDeleteBuffers(1, &m.m_VBO_pos);
+    glDeleteBuffers(1, &m.m_VBO_norm);
+    glDeleteBuffers(1, &m.m_VBO_tex);
+    glDeleteBuffers(1, &m.m_VBO_temp);
+    glDeleteBuffers(1, &m.m_EBO);
+  }
+  buffers.clear();
+}
+
+const float *uploadTemperature(const model::Model &model,
+                               const ModelBuffers &buffers,
+                               const float *temperature) {
+  const auto &mesh_vec = model.getMeshVec();
+  for (size_t i = 0; i < mesh_vec.size(); ++i) {
+    const size_t count = mesh_vec[i].m_temperature.size();
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[i].m_VBO_temp);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float), temperature);
+    temperature += count;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return temperature;
 }
 
-GraphicsRes render(model::Model &model, GLuint view_id, glm::mat4 view_matrix) {
+GraphicsRes render(const model::Model &model, const ModelBuffers &buffers,
+                   const glm::vec3 &position, GLuint view_id,
+                   glm::mat4 view_matrix) {
 
-  view_matrix = glm::translate(view_matrix, model.getPosition());
+  view_matrix = glm::translate(view_matrix, position);
   glUniformMatrix4fv(view_id, 1, GL_FALSE, &view_matrix[0][0]);
-  auto &mesh_vec = model.getMeshVec();
+  const auto &mesh_vec = model.getMeshVec();
 
   for (size_t i = 0; i < mesh_vec.size(); ++i) {
 
@@ -198,7 +237,7 @@ GraphicsRes render(model::Model &model, GLuint view_id, glm::mat4 view_matrix) {
         GL_TEXTURE_2D,
         mesh_vec[i].m_tex_handle); // Bind texture for the current mesh.
 
-    glBindVertexArray(mesh_vec[i].m_VAO);
+    glBindVertexArray(buffers[i].m_VAO);
 
     glDrawElements(GL_TRIANGLES, (GLsizei)mesh_vec[i].m_vert_indices.size(),
                    GL_UNSIGNED_INT, 0);
@@ -216,7 +255,7 @@ void debugOpenGL() {
   }
 }
 
-void updateOnEvents(CameraHandler &camera, glm::vec3 *model_pos) {
+void updateOnEvents(CameraHandler &camera, const glm::vec3 *model_pos) {
 
   constexpr float dtheta_quant = 0.1f;
   constexpr float dfi_quant = 0.1f;
@@ -1,3 +1,543 @@
 #include "Mesh.hpp"
 
-namespace simulator {}
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <tuple>
+
+#include <glm/gtc/constants.hpp>
+
+#include <Attenuation.hpp>
+#include <ThreadPool.hpp>
+
+// Vertices whose properties are looked up together
+static constexpr size_t kPropertyBlock = 256;
+// Vertices per task when sampling the field
+static constexpr size_t kFieldGrain = 4096;
+
+// The enthalpy tables reach this far past the transitions of the material,
+// the state clamps to their ends
+static constexpr float kPhaseMargin = 200.f;     ///< K
+static constexpr float kPhaseMinTemperature = 1.f; ///< K
+// Keeps the kinks at the plateaus within 0.1 K for water
+static constexpr float kPhaseSpacing = 300.f / 8191; ///< K
+// Integration steps of the heat capacity per table sample
+static constexpr size_t kPhaseRefinement = 4;
+
+namespace simulator {
+namespace model {
+
+/**
+ * @brief attenuateBlock Scales a block of absorption coefficients by the
+ * power share that reaches their vertices
+ */
+static inline void attenuateBlock(const float *__restrict__ attenuation,
+                                  size_t count,
+                                  float *__restrict__ coefficient) {
+  for (size_t i = 0; i < count; ++i) {
+    coefficient[i] *= attenuation[i];
+  }
+}
+
+Model::Model(Material &material) { setMaterial(material); }
+
+void Model::setMaterial(const Material &material) {
+  MaterialTable table;
+  table.add("", material);
+  setMaterials(table);
+}
+
+void Model::setMaterials(const MaterialTable &table) {
+  m_materials = table;
+  m_materials.bake();
+  assignMaterials();
+}
+
+void Model::assignMaterials() {
+  for (auto &mesh : m_mesh) {
+    mesh.m_material_index = m_materials.find(mesh.m_material_name);
+    mesh.m_material.assign(mesh.m_temperature.size(), mesh.m_material_index);
+  }
+  updateEnthalpy();
+}
+
+void Model::updateEnthalpy() {
+  if (!m_materials.m_phase_change) {
+    return;
+  }
+  for (auto &mesh : m_mesh) {
+    mesh.m_enthalpy.resize(mesh.m_temperature.size());
+    m_materials.m_enthalpy.lookup(mesh.m_material.data(),
+                                  mesh.m_temperature.data(),
+                                  mesh.m_temperature.size(),
+                                  mesh.m_enthalpy.data());
+  }
+}
+
+void Model::initializeThermalState(float temperature) {
+  for (auto &mesh : m_mesh) {
+    const size_t count = mesh.getVertPositions().size();
+    if (!mesh.m_shared_geometry) {
+      mesh.m_pos_x.resize(count);
+      mesh.m_pos_y.resize(count);
+      mesh.m_pos_z.resize(count);
+      for (size_t v = 0; v < count; ++v) {
+        mesh.m_pos_x[v] = mesh.m_vert_positions[v].x;
+        mesh.m_pos_y[v] = mesh.m_vert_positions[v].y;
+        mesh.m_pos_z[v] = mesh.m_vert_positions[v].z;
+      }
+    }
+
+    if (mesh.m_material.size() != count) {
+      mesh.m_material.assign(count, mesh.m_material_index);
+    }
+    mesh.m_temperature.assign(count, temperature);
+    mesh.m_attenuation.clear();
+  }
+  updateEnthalpy();
+  m_field_valid = false;
+}
+
+std::vector<std::shared_ptr<const MeshGeometry>>
+Model::shareGeometry() const {
+  std::vector<std::shared_ptr<const MeshGeometry>> shared;
+  shared.reserve(m_mesh.size());
+  for (const auto &mesh : m_mesh) {
+    if (mesh.m_shared_geometry) {
+      shared.push_back(mesh.m_shared_geometry);
+      continue;
+    }
+    auto geometry = std::make_shared<MeshGeometry>();
+    geometry->m_vert_positions = mesh.m_vert_positions;
+    geometry->m_vert_indices = mesh.m_vert_indices;
+    const size_t count = mesh.m_vert_positions.size();
+    geometry->m_pos_x.resize(count);
+    geometry->m_pos_y.resize(count);
+    geometry->m_pos_z.resize(count);
+    for (size_t v = 0; v < count; ++v) {
+      geometry->m_pos_x[v] = mesh.m_vert_positions[v].x;
+      geometry->m_pos_y[v] = mesh.m_vert_positions[v].y;
+      geometry->m_pos_z[v] = mesh.m_vert_positions[v].z;
+    }
+    shared.push_back(std::move(geometry));
+  }
+  return shared;
+}
+
+void Model::sampleField(const physics::FieldProvider &field) {
+  for (auto &mesh : m_mesh) {
+    const size_t count = mesh.m_temperature.size();
+    mesh.m_field_re.resize(count);
+    mesh.m_field_im.resize(count);
+    // Shadow rays make this the costly part of moving a model
+    ThreadPool::getInstance().parallelFor(
+        0, count,
+        [&](size_t begin, size_t end) {
+          field.samplePhasor(mesh.getPosX() + begin, mesh.getPosY() + begin,
+                             mesh.getPosZ() + begin, end - begin,
+                             m_position, mesh.m_field_re.data() + begin,
+                             mesh.m_field_im.data() + begin);
+        },
+        kFieldGrain);
+  }
+  m_field_position = m_position;
+  m_field_valid = true;
+}
+
+void Model::attenuate(const TriangleBvh &bodies,
+                      const std::vector<physics::FieldSource> &sources) {
+  for (auto &mesh : m_mesh) {
+    const size_t count = mesh.m_temperature.size();
+    mesh.m_attenuation.resize(count);
+    ThreadPool::getInstance().parallelFor(
+        0, count,
+        [&](size_t begin, size_t end) {
+          physics::transmittedPower(
+              bodies, sources, mesh.getPosX() + begin,
+              mesh.getPosY() + begin, mesh.getPosZ() + begin,
+              end - begin, m_position, mesh.m_attenuation.data() + begin);
+        },
+        kFieldGrain);
+  }
+}
+
+void Model::buildTurntable(const physics::FieldProvider &field,
+                           const glm::vec3 &pivot,
+                           const physics::TurntableConfig &cfg) {
+  for (auto &mesh : m_mesh) {
+    const size_t count = mesh.m_temperature.size();
+    mesh.m_field_re.resize(count);
+    mesh.m_field_im.resize(count);
+    mesh.m_turntable.build(field, mesh.getPosX(), mesh.getPosY(),
+                           mesh.getPosZ(), count, m_position, pivot,
+                           cfg);
+  }
+  m_field_position = m_position;
+  m_field_valid = true;
+}
+
+void Model::sampleTurntable(double angle0, double angle1) {
+  for (auto &mesh : m_mesh) {
+    mesh.m_turntable.sample(angle0, angle1, mesh.m_field_re.data(),
+                            mesh.m_field_im.data());
+  }
+}
+
+void Model::calculateTemperature(double timestamp, double dt, float frequency,
+                                 physics::AbsorptionMode mode) {
+  if (!m_materials.m_configured) {
+    throw std::runtime_error("Model material is not configured");
+  }
+
+  // sigma * E^2 / (4 * rho * h * c), E^2 comes from the cached field
+  const double omega = glm::two_pi<double>() * frequency;
+  const physics::HarmonicFactors factors =
+      physics::harmonicFactors(omega, timestamp, dt, mode);
+  const float *inv_thickness = m_materials.m_inv_thickness.data();
+  float coefficient[kPropertyBlock];
+
+  // The heat goes into the enthalpy, the temperature holds on the plateaus
+  if (m_materials.m_phase_change) {
+    for (auto &mesh : m_mesh) {
+      const size_t count = mesh.m_temperature.size();
+      for (size_t begin = 0; begin < count; begin += kPropertyBlock) {
+        const size_t n = std::min(kPropertyBlock, count - begin);
+        const uint32_t *material = mesh.m_material.data() + begin;
+        float *temperature = mesh.m_temperature.data() + begin;
+        float *enthalpy = mesh.m_enthalpy.data() + begin;
+        enthalpyRate(m_materials, material, temperature, enthalpy, n,
+                     coefficient);
+        for (size_t i = 0; i < n; ++i) {
+          coefficient[i] *= inv_thickness[material[i]];
+        }
+        if (!mesh.m_attenuation.empty()) {
+          attenuateBlock(mesh.m_attenuation.data() + begin, n, coefficient);
+        }
+        physics::absorbField(mesh.m_field_re.data() + begin,
+                             mesh.m_field_im.data() + begin, enthalpy, n,
+                             coefficient, factors);
+        m_materials.m_temperature.lookup(material, enthalpy, n, temperature);
+      }
+    }
+    return;
+  }
+
+  // A single constant material needs no gather at all
+  const bool uniform =
+      !m_materials.m_temperature_dependent && m_materials.size() == 1;
+
+  // Coefficients are gathered per block so they stay in L1
+  const float *absorption = m_materials.m_absorption.data();
+  for (auto &mesh : m_mesh) {
+    if (uniform && mesh.m_attenuation.empty()) {
+      physics::absorbField(mesh.m_field_re.data(), mesh.m_field_im.data(),
+                           mesh.m_temperature.data(),
+                           mesh.m_temperature.size(),
+                           m_materials.m_absorption.front(), factors);
+      continue;
+    }
+    const size_t count = mesh.m_temperature.size();
+    for (size_t begin = 0; begin < count; begin += kPropertyBlock) {
+      const size_t n = std::min(kPropertyBlock, count - begin);
+      const uint32_t *material = mesh.m_material.data() + begin;
+      float *temperature = mesh.m_temperature.data() + begin;
+      if (m_materials.m_temperature_dependent) {
+        heatingRate(m_materials, material, temperature, n, coefficient);
+        for (size_t i = 0; i < n; ++i) {
+          coefficient[i] *= inv_thickness[material[i]];
+        }
+      } else {
+        for (size_t i = 0; i < n; ++i) {
+          coefficient[i] = absorption[material[i]];
+        }
+      }
+      if (!mesh.m_attenuation.empty()) {
+        attenuateBlock(mesh.m_attenuation.data() + begin, n, coefficient);
+      }
+      physics::absorbField(mesh.m_field_re.data() + begin,
+                           mesh.m_field_im.data() + begin, temperature, n,
+                           coefficient, factors);
+    }
+  }
+}
+
+void heatingRate(const MaterialTable &table, const uint32_t *material,
+                 const float *temperature, size_t count, float *out) {
+  float sigma[kPropertyBlock];
+  float rho[kPropertyBlock];
+  float c[kPropertyBlock];
+
+  for (size_t begin = 0; begin < count; begin += kPropertyBlock) {
+    const size_t n = std::min(kPropertyBlock, count - begin);
+    const uint32_t *m = material + begin;
+    const float *t = temperature + begin;
+    table.m_electrical_conductivity.lookup(m, t, n, sigma);
+    table.m_density.lookup(m, t, n, rho);
+    table.m_heat_capacity.lookup(m, t, n, c);
+    for (size_t i = 0; i < n; ++i) {
+      out[begin + i] = sigma[i] / (rho[i] * c[i]);
+    }
+  }
+}
+
+void enthalpyRate(const MaterialTable &table, const uint32_t *material,
+                  const float *temperature, const float *enthalpy,
+                  size_t count, float *out) {
+  float sigma[kPropertyBlock];
+  float rho[kPropertyBlock];
+  float liquid[kPropertyBlock];
+  const float *frozen = table.m_frozen_electrical_conductivity.data();
+
+  for (size_t begin = 0; begin < count; begin += kPropertyBlock) {
+    const size_t n = std::min(kPropertyBlock, count - begin);
+    const uint32_t *m = material + begin;
+    const float *t = temperature + begin;
+    table.m_electrical_conductivity.lookup(m, t, n, sigma);
+    table.m_density.lookup(m, t, n, rho);
+    table.m_liquid_fraction.lookup(m, enthalpy + begin, n, liquid);
+    for (size_t i = 0; i < n; ++i) {
+      const float solid = frozen[m[i]];
+      out[begin + i] = (solid + liquid[i] * (sigma[i] - solid)) / rho[i];
+    }
+  }
+}
+
+uint32_t MaterialTable::add(const std::string &name,
+                            const Material &material) {
+  m_names.push_back(name);
+  m_materials.push_back(material);
+  return static_cast<uint32_t>(m_materials.size() - 1);
+}
+
+uint32_t MaterialTable::find(const std::string &name) const {
+  for (size_t m = 0; m < m_names.size(); ++m) {
+    if (m_names[m] == name) {
+      return static_cast<uint32_t>(m);
+    }
+  }
+  return 0;
+}
+
+void MaterialTable::bake() {
+  if (m_materials.empty()) {
+    throw std::runtime_error("A material table needs a material");
+  }
+  m_names.resize(m_materials.size());
+
+  const size_t count = m_materials.size();
+  m_inv_thickness.resize(count);
+  m_absorption.resize(count);
+  m_frozen_electrical_conductivity.resize(count);
+  m_temperature_dependent = false;
+  m_phase_change = false;
+  m_configured = true;
+  for (size_t m = 0; m < count; ++m) {
+    const Material &material = m_materials[m];
+    const float denominator = 4.f * material.m_density *
+                              material.m_thickness * material.m_heat_capacity;
+    m_configured = m_configured && denominator > 0.f;
+    m_inv_thickness[m] =
+        material.m_thickness > 0.f ? 1.f / (4.f * material.m_thickness) : 0.f;
+    m_absorption[m] = denominator > 0.f
+                          ? material.m_electrical_conductivity / denominator
+                          : 0.f;
+    m_frozen_electrical_conductivity[m] =
+        material.m_frozen_electrical_conductivity;
+    m_temperature_dependent =
+        m_temperature_dependent || material.isTemperatureDependent();
+    m_phase_change = m_phase_change || material.hasPhaseChange();
+  }
+
+  const auto tables = [this](PropertyTable Material::*table) {
+    std::vector<const PropertyTable *> rows;
+    for (const auto &material : m_materials) {
+      rows.push_back(&(material.*table));
+    }
+    return rows;
+  };
+  const auto constants = [this](float Material::*constant) {
+    std::vector<float> rows;
+    for (const auto &material : m_materials) {
+      rows.push_back(material.*constant);
+    }
+    return rows;
+  };
+
+  m_electrical_conductivity = PropertyStack();
+  m_density = PropertyStack();
+  m_heat_capacity = PropertyStack();
+  m_enthalpy = PropertyStack();
+  m_temperature = PropertyStack();
+  m_liquid_fraction = PropertyStack();
+  if (m_temperature_dependent || m_phase_change) {
+    m_electrical_conductivity =
+        makePropertyStack(tables(&Material::m_electrical_conductivity_table),
+                          constants(&Material::m_electrical_conductivity));
+    m_density = makePropertyStack(tables(&Material::m_density_table),
+                                  constants(&Material::m_density));
+    m_heat_capacity =
+        makePropertyStack(tables(&Material::m_heat_capacity_table),
+                          constants(&Material::m_heat_capacity));
+  }
+  if (!m_phase_change) {
+    return;
+  }
+
+  // Materials without latent heat stay liquid, sigma is their own
+  for (auto &material : m_materials) {
+    bakePhaseChange(material);
+  }
+  const std::vector<float> unused(count, 0.f);
+  m_enthalpy =
+      makePropertyStack(tables(&Material::m_enthalpy_table), unused);
+  m_temperature =
+      makePropertyStack(tables(&Material::m_temperature_table), unused);
+  m_liquid_fraction =
+      makePropertyStack(tables(&Material::m_liquid_fraction_table), unused);
+}
+
+void bakePhaseChange(Material &material) {
+  // Piecewise linear enthalpy curve, each latent heat adds a vertical
+  // segment at its transition temperature
+  const float fusion = material.m_latent_heat_fusion;
+  const float vaporization = material.m_latent_heat_vaporization;
+
+  // Both transitions bound the range even without their latent heat, so a
+  // material that only melts still reaches past its boiling point
+  const float lowest = std::min(material.m_melting_temperature,
+                                material.m_boiling_temperature);
+  const float highest = std::max(material.m_melting_temperature,
+                                 material.m_boiling_temperature);
+  const float min_temperature =
+      std::max(lowest - kPhaseMargin, kPhaseMinTemperature);
+  const float max_temperature = highest + kPhaseMargin;
+  const size_t samples =
+      static_cast<size_t>(
+          std::ceil((max_temperature - min_temperature) / kPhaseSpacing)) +
+      1;
+  const size_t steps = (samples - 1) * kPhaseRefinement;
+  const float step = (max_temperature - min_temperature) / steps;
+
+  std::vector<float> temperature(steps + 1);
+  for (size_t s = 0; s <= steps; ++s) {
+    temperature[s] = min_temperature + s * step;
+  }
+  std::vector<float> capacity(steps + 1, material.m_heat_capacity);
+  if (!material.m_heat_capacity_table.empty()) {
+    material.m_heat_capacity_table.lookup(temperature.data(), steps + 1,
+                                          capacity.data());
+  }
+
+  std::vector<double> curve_t, curve_h, curve_liquid;
+  curve_t.reserve(steps + 3);
+  curve_h.reserve(steps + 3);
+  curve_liquid.reserve(steps + 3);
+  const auto append = [&](double t, double h, double liquid) {
+    curve_t.push_back(t);
+    curve_h.push_back(h);
+    curve_liquid.push_back(liquid);
+  };
+
+  double h = 0.0;
+  bool melted = fusion <= 0.f;
+  bool boiled = vaporization <= 0.f;
+  append(temperature[0], 0.0, melted ? 1.0 : 0.0);
+  for (size_t s = 0; s < steps; ++s) {
+    const double t0 = temperature[s];
+    const double t1 = temperature[s + 1];
+    const double slope = (capacity[s + 1] - capacity[s]) / (t1 - t0);
+    // Trapezoid up to t, the capacity is linear over the step
+    const auto sensible = [&](double t) {
+      const double c = capacity[s] + slope * (t - t0);
+      return 0.5 * (capacity[s] + c) * (t - t0);
+    };
+
+    for (const auto &[latent, transition, done, fuses] :
+         {std::make_tuple(fusion, material.m_melting_temperature, &melted,
+                          true),
+          std::make_tuple(vaporization, material.m_boiling_temperature,
+                          &boiled, false)}) {
+      if (*done || transition >= t1) {
+        continue;
+      }
+      const double at = std::max<double>(transition, t0);
+      const double before = h + sensible(at);
+      append(at, before, fuses ? 0.0 : 1.0);
+      append(at, before + latent, 1.0);
+      h += latent;
+      *done = true;
+    }
+    h += sensible(t1);
+    append(t1, h, melted ? 1.0 : 0.0);
+  }
+
+  // Zero enthalpy is the solid at the melting point
+  double reference = 0.0;
+  if (fusion > 0.f) {
+    for (size_t p = 0; p < curve_t.size(); ++p) {
+      if (curve_t[p] >= material.m_melting_temperature) {
+        reference = curve_h[p];
+        break;
+      }
+    }
+  }
+  for (double &value : curve_h) {
+    value -= reference;
+  }
+
+  // Forward table for the initial state, starting below the transition
+  material.m_enthalpy_table = makePropertyTable(
+      [&](float t) {
+        const size_t p = std::upper_bound(curve_t.begin(), curve_t.end(),
+                                          static_cast<double>(t)) -
+                         curve_t.begin();
+        if (p == 0 || p == curve_t.size()) {
+          return static_cast<float>(p == 0 ? curve_h.front()
+                                           : curve_h.back());
+        }
+        // Past a vertical segment upper_bound lands on its top, so a
+        // transition temperature itself reads as the melted phase
+        const size_t lo = p - 1;
+        const double w = (t - curve_t[lo]) / (curve_t[p] - curve_t[lo]);
+        return static_cast<float>(curve_h[lo] +
+                                  w * (curve_h[p] - curve_h[lo]));
+      },
+      min_temperature, max_temperature, samples);
+
+  // Inverse tables, the curve is monotonic in the enthalpy
+  const auto inverse = [&](const std::vector<double> &values) {
+    return [&](float enthalpy) {
+      const size_t p = std::upper_bound(curve_h.begin(), curve_h.end(),
+                                        static_cast<double>(enthalpy)) -
+                       curve_h.begin();
+      if (p == 0 || p == curve_h.size()) {
+        return static_cast<float>(p == 0 ? values.front() : values.back());
+      }
+      const double span = curve_h[p] - curve_h[p - 1];
+      const double w = span > 0.0 ? (enthalpy - curve_h[p - 1]) / span : 0.0;
+      return static_cast<float>(values[p - 1] +
+                                w * (values[p] - values[p - 1]));
+    };
+  };
+  const float min_enthalpy = static_cast<float>(curve_h.front());
+  const float max_enthalpy = static_cast<float>(curve_h.back());
+  material.m_temperature_table = makePropertyTable(
+      inverse(curve_t), min_enthalpy, max_enthalpy, samples);
+  material.m_liquid_fraction_table = makePropertyTable(
+      inverse(curve_liquid), min_enthalpy, max_enthalpy, samples);
+}
+
+float Model::getMeanTemperature() const {
+  double sum = 0.0;
+  size_t count = 0;
+  for (const auto &mesh : m_mesh) {
+    for (const float t : mesh.m_temperature) {
+      sum += t;
+    }
+    count += mesh.m_temperature.size();
+  }
+  return count ? static_cast<float>(sum / count) : 0.f;
+}
+
+} // namespace model
+} // namespace simulator
@@ -54,7 +54,7 @@ static void loadTexture(std::vector<model::Texture> &texture_vec,
 }
 
 void loadModel(const char *model_path, const char *textures_path,
-               model::Model &model) {
+               model::Model &model, bool load_textures) {
   try {
     Assimp::Importer importer;
     aiNode *root_node = nullptr;
@@ -79,9 +79,14 @@ void loadModel(const char *model_path, const char *textures_path,
       mesh_vec[i].m_name = mesh->mName.C_Str();
 
       aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+      // Meshes pick their physical material by the Assimp material name
+      mesh_vec[i].m_material_name = material->GetName().C_Str();
+      mesh_vec[i].m_material_index =
+          model.getMaterialTable().find(mesh_vec[i].m_material_name);
 
       const auto total_textures =
-          material->GetTextureCount(aiTextureType_DIFFUSE);
+          load_textures ? material->GetTextureCount(aiTextureType_DIFFUSE)
+                        : 0u;
       texture_vec.reserve(total_textures);
 
       // Load textures
@@ -139,6 +144,8 @@ void loadModel(const char *model_path, const char *textures_path,
       }
     }
 
+    model.initializeThermalState(model::kRoomTemperature);
+
   } catch (std::exception &ex) {
     std::cerr << ex.what() << "/n";
     exit(0);
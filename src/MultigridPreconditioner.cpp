@@ -0,0 +1,297 @@
+#include "MultigridPreconditioner.hpp"
+
+#include <algorithm>
+
+#include <ThreadPool.hpp>
+
+static constexpr int kPreSweeps = 2;
+static constexpr int kPostSweeps = 2;
+
+// The coarsest level is small enough that sweeping it is as good as solving
+static constexpr int kCoarseSweeps = 8; ///< Each way
+static constexpr int kCoarsestCells = 4; ///< Along the shortest axis
+static constexpr size_t kMaxLevels = 12;
+
+namespace simulator {
+
+void MultigridPreconditioner::update(const glm::ivec3 &dims,
+                                     const std::vector<size_t> &cells,
+                                     const CsrMatrix &laplacian,
+                                     float coupling) {
+  m_cells = cells;
+  m_levels.clear();
+  m_levels.emplace_back();
+
+  Level &fine = m_levels.back();
+  fine.m_dims = dims;
+  const size_t count = fine.size();
+  fine.m_diag.assign(count, 0.f);
+  fine.m_wx.assign(count, 0.f);
+  fine.m_wy.assign(count, 0.f);
+  fine.m_wz.assign(count, 0.f);
+
+  const size_t stride_y = fine.m_dims.x;
+  const size_t stride_z = static_cast<size_t>(fine.m_dims.x) * fine.m_dims.y;
+  // Every off-diagonal of a row is a face, its direction comes from the
+  // grid index of the unknown across it
+  for (size_t row = 0; row < cells.size(); ++row) {
+    const size_t c = cells[row];
+    for (size_t e = laplacian.m_row_offsets[row];
+         e < laplacian.m_row_offsets[row + 1]; ++e) {
+      const float value = laplacian.m_values[e];
+      if (laplacian.m_columns[e] == row) {
+        fine.m_diag[c] = 1.f + coupling * value;
+        continue;
+      }
+      const size_t n = cells[laplacian.m_columns[e]];
+      const float weight = -coupling * value;
+      fine.m_wx[c] = n == c + 1 ? weight : fine.m_wx[c];
+      fine.m_wy[c] = n == c + stride_y ? weight : fine.m_wy[c];
+      fine.m_wz[c] = n == c + stride_z ? weight : fine.m_wz[c];
+    }
+  }
+
+  while (m_levels.size() < kMaxLevels) {
+    const glm::ivec3 inner = m_levels.back().m_dims - glm::ivec3(2, 2, 2);
+    if (std::min(inner.x, std::min(inner.y, inner.z)) <= kCoarsestCells) {
+      break;
+    }
+    coarsen();
+  }
+
+  for (auto &level : m_levels) {
+    const size_t n = level.size();
+    level.m_inv_diag.resize(n);
+    for (size_t c = 0; c < n; ++c) {
+      level.m_inv_diag[c] =
+          level.m_diag[c] > 0.f ? 1.f / level.m_diag[c] : 0.f;
+    }
+    // Borders and inactive cells stay 0 from here on
+    level.m_x.assign(n, 0.f);
+    level.m_b.assign(n, 0.f);
+    level.m_r.assign(n, 0.f);
+  }
+}
+
+void MultigridPreconditioner::coarsen() {
+  m_levels.emplace_back();
+  const Level &fine = m_levels[m_levels.size() - 2];
+  Level &coarse = m_levels.back();
+
+  // Interior cell I covers fine cells 2I - 1 and 2I, the border stays empty
+  coarse.m_dims =
+      (fine.m_dims - glm::ivec3(1, 1, 1)) / 2 + glm::ivec3(2, 2, 2);
+  const size_t count = coarse.size();
+  coarse.m_diag.assign(count, 0.f);
+  coarse.m_wx.assign(count, 0.f);
+  coarse.m_wy.assign(count, 0.f);
+  coarse.m_wz.assign(count, 0.f);
+
+  const glm::ivec3 dims = coarse.m_dims;
+  ThreadPool::getInstance().parallelFor(
+      1, dims.z - 1, [&](size_t k_begin, size_t k_end) {
+        for (int k = static_cast<int>(k_begin); k < static_cast<int>(k_end);
+             ++k) {
+          for (int j = 1; j < dims.y - 1; ++j) {
+            for (int i = 1; i < dims.x - 1; ++i) {
+              // P^T A P with P copying a coarse value to its 8 children:
+              // faces inside the block cancel against the diagonal, faces
+              // leaving it on the + side become the coarse coupling
+              float diag = 0.f, wx = 0.f, wy = 0.f, wz = 0.f;
+              for (int dk = 0; dk < 2; ++dk) {
+                for (int dj = 0; dj < 2; ++dj) {
+                  for (int di = 0; di < 2; ++di) {
+                    const size_t c =
+                        fine.index(2 * i - 1 + di, 2 * j - 1 + dj,
+                                   2 * k - 1 + dk);
+                    diag += fine.m_diag[c];
+                    if (di) {
+                      wx += fine.m_wx[c];
+                    } else {
+                      diag -= 2.f * fine.m_wx[c];
+                    }
+                    if (dj) {
+                      wy += fine.m_wy[c];
+                    } else {
+                      diag -= 2.f * fine.m_wy[c];
+                    }
+                    if (dk) {
+                      wz += fine.m_wz[c];
+                    } else {
+                      diag -= 2.f * fine.m_wz[c];
+                    }
+                  }
+                }
+              }
+              const size_t c = coarse.index(i, j, k);
+              coarse.m_diag[c] = diag;
+              coarse.m_wx[c] = wx;
+              coarse.m_wy[c] = wy;
+              coarse.m_wz[c] = wz;
+            }
+          }
+        }
+      });
+}
+
+void MultigridPreconditioner::residual(Level &level) {
+  const glm::ivec3 dims = level.m_dims;
+  const size_t sy = dims.x;
+  const size_t sz = static_cast<size_t>(dims.x) * dims.y;
+
+  const float *__restrict__ x = level.m_x.data();
+  const float *__restrict__ b = level.m_b.data();
+  const float *__restrict__ diag = level.m_diag.data();
+  const float *__restrict__ wx = level.m_wx.data();
+  const float *__restrict__ wy = level.m_wy.data();
+  const float *__restrict__ wz = level.m_wz.data();
+  float *__restrict__ r = level.m_r.data();
+
+  ThreadPool::getInstance().parallelFor(
+      1, dims.z - 1, [&](size_t k_begin, size_t k_end) {
+        for (size_t k = k_begin; k < k_end; ++k) {
+          for (int j = 1; j < dims.y - 1; ++j) {
+            const size_t row = (k * dims.y + j) * dims.x;
+            for (size_t c = row + 1; c < row + dims.x - 1; ++c) {
+              r[c] = b[c] - diag[c] * x[c] + wx[c] * x[c + 1] +
+                     wx[c - 1] * x[c - 1] + wy[c] * x[c + sy] +
+                     wy[c - sy] * x[c - sy] + wz[c] * x[c + sz] +
+                     wz[c - sz] * x[c - sz];
+            }
+          }
+        }
+      });
+}
+
+void MultigridPreconditioner::relax(Level &level, int color,
+                                    bool from_zero) {
+  const glm::ivec3 dims = level.m_dims;
+  const size_t sy = dims.x;
+  const size_t sz = static_cast<size_t>(dims.x) * dims.y;
+
+  float *__restrict__ x = level.m_x.data();
+  const float *__restrict__ b = level.m_b.data();
+  const float *__restrict__ inv_diag = level.m_inv_diag.data();
+  const float *__restrict__ wx = level.m_wx.data();
+  const float *__restrict__ wy = level.m_wy.data();
+  const float *__restrict__ wz = level.m_wz.data();
+
+  // Cells of one color only have neighbours of the other, slabs can run in
+  // parallel and update in place
+  ThreadPool::getInstance().parallelFor(
+      1, dims.z - 1, [&](size_t k_begin, size_t k_end) {
+        for (size_t k = k_begin; k < k_end; ++k) {
+          for (int j = 1; j < dims.y - 1; ++j) {
+            const size_t row = (k * dims.y + j) * dims.x;
+            const int first = 1 + ((1 + j + static_cast<int>(k) + color) & 1);
+            if (from_zero) {
+              for (size_t c = row + first; c < row + dims.x - 1; c += 2) {
+                x[c] = inv_diag[c] * b[c];
+              }
+              continue;
+            }
+            for (size_t c = row + first; c < row + dims.x - 1; c += 2) {
+              x[c] = inv_diag[c] *
+                     (b[c] + wx[c] * x[c + 1] + wx[c - 1] * x[c - 1] +
+                      wy[c] * x[c + sy] + wy[c - sy] * x[c - sy] +
+                      wz[c] * x[c + sz] + wz[c - sz] * x[c - sz]);
+            }
+          }
+        }
+      });
+}
+
+void MultigridPreconditioner::smooth(Level &level, int sweeps, bool forward,
+                                     bool from_zero) {
+  // Red then black on the way down, black then red on the way up, so the
+  // cycle stays symmetric
+  const int first = forward ? 0 : 1;
+  for (int s = 0; s < sweeps; ++s) {
+    relax(level, first, from_zero && s == 0);
+    relax(level, 1 - first, false);
+  }
+}
+
+void MultigridPreconditioner::cycle(size_t l) const {
+  Level &fine = m_levels[l];
+  if (l + 1 == m_levels.size()) {
+    smooth(fine, kCoarseSweeps, true, true);
+    smooth(fine, kCoarseSweeps, false, false);
+    return;
+  }
+
+  smooth(fine, kPreSweeps, true, true);
+  residual(fine);
+
+  // Restrict by summing the children, the transpose of the prolongation
+  Level &coarse = m_levels[l + 1];
+  const glm::ivec3 dims = coarse.m_dims;
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(1, dims.z - 1, [&](size_t k_begin, size_t k_end) {
+    for (int k = static_cast<int>(k_begin); k < static_cast<int>(k_end); ++k) {
+      for (int j = 1; j < dims.y - 1; ++j) {
+        for (int i = 1; i < dims.x - 1; ++i) {
+          float sum = 0.f;
+          for (int dk = 0; dk < 2; ++dk) {
+            for (int dj = 0; dj < 2; ++dj) {
+              const size_t c =
+                  fine.index(2 * i - 1, 2 * j - 1 + dj, 2 * k - 1 + dk);
+              sum += fine.m_r[c] + fine.m_r[c + 1];
+            }
+          }
+          coarse.m_b[coarse.index(i, j, k)] = sum;
+        }
+      }
+    }
+  });
+
+  cycle(l + 1);
+
+  // Every fine cell takes the correction of the block it belongs to
+  const glm::ivec3 fine_dims = fine.m_dims;
+  pool.parallelFor(1, fine_dims.z - 1, [&](size_t k_begin, size_t k_end) {
+    for (int k = static_cast<int>(k_begin); k < static_cast<int>(k_end); ++k) {
+      for (int j = 1; j < fine_dims.y - 1; ++j) {
+        const size_t row = fine.index(0, j, k);
+        const size_t coarse_row = coarse.index(0, (j + 1) / 2, (k + 1) / 2);
+        for (int i = 1; i < fine_dims.x - 1; ++i) {
+          // Inactive cells must stay 0
+          if (fine.m_diag[row + i] > 0.f) {
+            fine.m_x[row + i] += coarse.m_x[coarse_row + (i + 1) / 2];
+          }
+        }
+      }
+    }
+  });
+
+  smooth(fine, kPostSweeps, false, false);
+}
+
+void MultigridPreconditioner::apply(const float *r, float *z) const {
+  Level &fine = m_levels.front();
+  const size_t n = m_cells.size();
+  const size_t *__restrict__ cells = m_cells.data();
+  ThreadPool &pool = ThreadPool::getInstance();
+
+  pool.parallelFor(
+      0, n,
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          fine.m_b[cells[i]] = r[i];
+        }
+      },
+      1 << 14);
+
+  cycle(0);
+
+  pool.parallelFor(
+      0, n,
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          z[i] = fine.m_x[cells[i]];
+        }
+      },
+      1 << 14);
+}
+
+} // namespace simulator
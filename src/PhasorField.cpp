@@ -0,0 +1,116 @@
+#include "PhasorField.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+
+static constexpr float kSpeedOfLight = 299792458.f; ///< m/s
+
+// Points sitting on top of a source would otherwise blow up the 1/r term
+static constexpr float kMinDistanceSq = 1e-6f; ///< m^2
+
+// Vertices per block, the accumulators of a block stay in L1
+static constexpr size_t kBlockSize = 512;
+
+// Adding and subtracting 1.5 * 2^23 rounds a float to the nearest integer
+// without a call, which keeps the loop vectorizable
+static constexpr float kRoundMagic = 12582912.f;
+
+// pi / 2 split in two so the range reduction stays exact for a few turns
+static constexpr float kPiOver2Hi = 1.5707963705062866f;
+static constexpr float kPiOver2Lo = -4.371139000186243e-08f;
+static constexpr float kTwoOverPi = 0.6366197723675814f;
+
+namespace simulator {
+namespace physics {
+
+/**
+ * Branch free sin/cos (Cephes minimax polynomials on [-pi/4, pi/4] and
+ * quadrant selection), accurate to a few ulp over the phases of a cavity
+ */
+static inline void sinCos(float x, float &s, float &c) {
+  const float q = (x * kTwoOverPi + kRoundMagic) - kRoundMagic;
+  const float r = (x - q * kPiOver2Hi) - q * kPiOver2Lo;
+  const float r2 = r * r;
+
+  const float sin_r =
+      r + r * r2 *
+              (-1.6666654611e-1f +
+               r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+  const float cos_r =
+      1.f - 0.5f * r2 +
+      r2 * r2 *
+          (4.166664568298827e-2f +
+           r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+
+  const int quadrant = static_cast<int>(q);
+  const float swapped_sin = (quadrant & 1) ? cos_r : sin_r;
+  const float swapped_cos = (quadrant & 1) ? sin_r : cos_r;
+  s = (quadrant & 2) ? -swapped_sin : swapped_sin;
+  c = ((quadrant + 1) & 2) ? -swapped_cos : swapped_cos;
+}
+
+PhasorField::PhasorField(const std::vector<FieldSource> &sources,
+                         float frequency, const TriangleBvh *occluders)
+    : m_wavenumber(glm::two_pi<float>() * frequency / kSpeedOfLight),
+      m_occluders(occluders) {
+  for (const auto &source : sources) {
+    m_x.push_back(source.m_position.x);
+    m_y.push_back(source.m_position.y);
+    m_z.push_back(source.m_position.z);
+    m_amplitude.push_back(source.m_amplitude);
+    m_phase.push_back(source.m_phase);
+  }
+}
+
+void PhasorField::samplePhasor(const float *__restrict__ x,
+                               const float *__restrict__ y,
+                               const float *__restrict__ z, size_t count,
+                               const glm::vec3 &offset,
+                               float *__restrict__ field_re,
+                               float *__restrict__ field_im) const {
+  const float k = m_wavenumber;
+  float visible[kBlockSize];
+  std::fill(visible, visible + kBlockSize, 1.f);
+
+  for (size_t begin = 0; begin < count; begin += kBlockSize) {
+    const size_t end = std::min(begin + kBlockSize, count);
+    std::fill(field_re + begin, field_re + end, 0.f);
+    std::fill(field_im + begin, field_im + end, 0.f);
+
+    for (size_t s = 0; s < m_amplitude.size(); ++s) {
+      // Move the source into the frame of the points
+      const float sx = m_x[s] - offset.x;
+      const float sy = m_y[s] - offset.y;
+      const float sz = m_z[s] - offset.z;
+      const float amplitude = m_amplitude[s];
+      const float phase = m_phase[s];
+      if (m_occluders) {
+        m_occluders->visibility(glm::vec3(m_x[s], m_y[s], m_z[s]), x + begin,
+                                y + begin, z + begin, end - begin, offset,
+                                visible);
+      }
+
+      for (size_t i = begin; i < end; ++i) {
+        const float dx = x[i] - sx;
+        const float dy = y[i] - sy;
+        const float dz = z[i] - sz;
+        const float r_sq =
+            std::max(dx * dx + dy * dy + dz * dz, kMinDistanceSq);
+        const float r = std::sqrt(r_sq);
+
+        float sin_phase;
+        float cos_phase;
+        sinCos(phase - k * r, sin_phase, cos_phase);
+
+        const float magnitude = amplitude * visible[i - begin] / r;
+        field_re[i] += magnitude * cos_phase;
+        field_im[i] += magnitude * sin_phase;
+      }
+    }
+  }
+}
+
+} // namespace physics
+} // namespace simulator
@@ -0,0 +1,116 @@
+#include "PropertyTable.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace simulator {
+namespace model {
+
+void PropertyTable::lookup(const float *__restrict__ argument, size_t count,
+                           float *__restrict__ out) const {
+  const float *__restrict__ values = m_values.data();
+  const float last = static_cast<float>(m_values.size() - 1);
+  // The last sample is reached from the interval below it with a weight of 1
+  const int last_interval = static_cast<int>(m_values.size()) - 2;
+  const float min_argument = m_min_argument;
+  const float inv_spacing = m_inv_spacing;
+
+  for (size_t i = 0; i < count; ++i) {
+    const float x = std::min(
+        std::max((argument[i] - min_argument) * inv_spacing, 0.f), last);
+    const int interval = std::min(static_cast<int>(x), last_interval);
+    const float weight = x - static_cast<float>(interval);
+    const float lo = values[interval];
+    const float hi = values[interval + 1];
+    out[i] = lo + weight * (hi - lo);
+  }
+}
+
+void PropertyStack::lookup(const uint32_t *__restrict__ row,
+                           const float *__restrict__ argument, size_t count,
+                           float *__restrict__ out) const {
+  const float *__restrict__ values = m_values.data();
+  const float *__restrict__ min_argument = m_min_argument.data();
+  const float *__restrict__ inv_spacing = m_inv_spacing.data();
+  const size_t samples = m_samples;
+  const float last = static_cast<float>(samples - 1);
+  const int last_interval = static_cast<int>(samples) - 2;
+
+  for (size_t i = 0; i < count; ++i) {
+    const uint32_t r = row[i];
+    const float x = std::min(
+        std::max((argument[i] - min_argument[r]) * inv_spacing[r], 0.f),
+        last);
+    const int interval = std::min(static_cast<int>(x), last_interval);
+    const float weight = x - static_cast<float>(interval);
+    const float *sample = values + r * samples + interval;
+    out[i] = sample[0] + weight * (sample[1] - sample[0]);
+  }
+}
+
+PropertyTable makePropertyTable(const std::function<float(float)> &curve,
+                                float min_argument, float max_argument,
+                                size_t samples) {
+  if (samples < 2 || !(max_argument > min_argument)) {
+    throw std::runtime_error(
+        "A property table needs 2 samples over a positive range");
+  }
+
+  PropertyTable table;
+  const float spacing = (max_argument - min_argument) / (samples - 1);
+  table.m_min_argument = min_argument;
+  table.m_inv_spacing = 1.f / spacing;
+  table.m_values.resize(samples);
+  for (size_t s = 0; s < samples; ++s) {
+    table.m_values[s] = curve(min_argument + s * spacing);
+  }
+  return table;
+}
+
+PropertyStack
+makePropertyStack(const std::vector<const PropertyTable *> &tables,
+                  const std::vector<float> &constants) {
+  if (tables.empty() || tables.size() != constants.size()) {
+    throw std::runtime_error("A property stack needs a constant per table");
+  }
+
+  PropertyStack stack;
+  stack.m_samples = 2;
+  for (const PropertyTable *table : tables) {
+    stack.m_samples = std::max(stack.m_samples, table->m_values.size());
+  }
+  const size_t samples = stack.m_samples;
+  const size_t rows = tables.size();
+  stack.m_min_argument.assign(rows, 0.f);
+  stack.m_inv_spacing.assign(rows, 0.f);
+  stack.m_values.resize(rows * samples);
+
+  std::vector<float> argument(samples);
+  for (size_t r = 0; r < rows; ++r) {
+    const PropertyTable &table = *tables[r];
+    float *values = stack.m_values.data() + r * samples;
+    // A zero spacing reads the first sample for every argument
+    if (table.empty()) {
+      std::fill(values, values + samples, constants[r]);
+      continue;
+    }
+    if (table.m_values.size() == samples) {
+      stack.m_min_argument[r] = table.m_min_argument;
+      stack.m_inv_spacing[r] = table.m_inv_spacing;
+      std::copy(table.m_values.begin(), table.m_values.end(), values);
+      continue;
+    }
+    const float span = (table.m_values.size() - 1) / table.m_inv_spacing;
+    const float spacing = span / (samples - 1);
+    for (size_t s = 0; s < samples; ++s) {
+      argument[s] = table.m_min_argument + s * spacing;
+    }
+    table.lookup(argument.data(), samples, values);
+    stack.m_min_argument[r] = table.m_min_argument;
+    stack.m_inv_spacing[r] = 1.f / spacing;
+  }
+  return stack;
+}
+
+} // namespace model
+} // namespace simulator
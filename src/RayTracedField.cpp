@@ -0,0 +1,296 @@
+#include "RayTracedField.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include <glm/gtc/constants.hpp>
+
+#include <ThreadPool.hpp>
+
+static constexpr float kSpeedOfLight = 299792458.f; ///< m/s
+
+// Samples on top of a source would otherwise blow up the 1/r term
+static constexpr float kMinDistanceSq = 1e-6f; ///< m^2
+
+// Triangles whose normals and offsets agree this closely share a wall, the
+// offset relative to the size of the cavity
+static constexpr float kNormalTolerance = 1e-5f;
+static constexpr float kOffsetTolerance = 1e-4f;
+
+// Images grow with the walls to the power of the order, mirroring stops here
+static constexpr size_t kMaxImages = 1 << 16;
+
+// Table samples per tile edge, a tile is the unit the pool hands out
+static constexpr int kTileSize = 8;
+
+namespace simulator {
+namespace physics {
+
+RayTracedField::RayTracedField(const std::vector<glm::vec3> &walls,
+                               const std::vector<FieldSource> &sources,
+                               float frequency, const RayTraceConfig &cfg)
+    : m_cfg(cfg),
+      m_wavenumber(glm::two_pi<float>() * frequency / kSpeedOfLight) {
+  if (cfg.m_reflectance < 0.f || cfg.m_reflectance > 1.f ||
+      cfg.m_max_order < 0 || cfg.m_cells_per_wavelength < 1 ||
+      frequency <= 0.f) {
+    throw std::runtime_error("Ray tracing configuration out of range");
+  }
+
+  groupWalls(walls);
+  if (m_walls.empty()) {
+    throw std::runtime_error("Ray tracing needs the walls of a cavity");
+  }
+  mirrorSources(sources);
+
+  glm::vec3 lo(std::numeric_limits<float>::max());
+  glm::vec3 hi(-std::numeric_limits<float>::max());
+  for (const auto &corner : walls) {
+    lo = glm::min(lo, corner);
+    hi = glm::max(hi, corner);
+  }
+  build(lo, hi);
+}
+
+std::vector<glm::vec3> RayTracedField::boxWalls(const Cavity &cavity) {
+  const glm::vec3 &lo = cavity.m_min;
+  const glm::vec3 &hi = cavity.m_max;
+  std::vector<glm::vec3> corners;
+  for (int axis = 0; axis < 3; ++axis) {
+    const int u = (axis + 1) % 3;
+    const int v = (axis + 2) % 3;
+    for (const float side : {lo[axis], hi[axis]}) {
+      glm::vec3 quad[4];
+      for (int c = 0; c < 4; ++c) {
+        quad[c][axis] = side;
+        quad[c][u] = (c == 1 || c == 2) ? hi[u] : lo[u];
+        quad[c][v] = c >= 2 ? hi[v] : lo[v];
+      }
+      corners.insert(corners.end(), {quad[0], quad[1], quad[2]});
+      corners.insert(corners.end(), {quad[0], quad[2], quad[3]});
+    }
+  }
+  return corners;
+}
+
+void RayTracedField::groupWalls(const std::vector<glm::vec3> &corners) {
+  const size_t triangles = corners.size() / 3;
+  glm::vec3 center(0.f);
+  glm::vec3 lo(std::numeric_limits<float>::max());
+  glm::vec3 hi(-std::numeric_limits<float>::max());
+  for (size_t c = 0; c < 3 * triangles; ++c) {
+    center += corners[c] / static_cast<float>(3 * triangles);
+    lo = glm::min(lo, corners[c]);
+    hi = glm::max(hi, corners[c]);
+  }
+  const float offset_tolerance = kOffsetTolerance * glm::length(hi - lo);
+
+  std::vector<glm::vec3> kept;
+  std::vector<uint32_t> groups;
+  for (size_t t = 0; t < triangles; ++t) {
+    const glm::vec3 &a = corners[3 * t];
+    const glm::vec3 normal =
+        glm::cross(corners[3 * t + 1] - a, corners[3 * t + 2] - a);
+    const float length = glm::length(normal);
+    if (length == 0.f) {
+      continue;
+    }
+
+    // Facing the middle of the cavity, whatever the winding
+    Wall wall{normal / length, 0.f};
+    wall.m_offset = glm::dot(wall.m_normal, a);
+    if (glm::dot(wall.m_normal, center) < wall.m_offset) {
+      wall.m_normal = -wall.m_normal;
+      wall.m_offset = -wall.m_offset;
+    }
+
+    uint32_t group = 0;
+    while (group < m_walls.size() &&
+           !(glm::dot(m_walls[group].m_normal, wall.m_normal) >
+                 1.f - kNormalTolerance &&
+             std::fabs(m_walls[group].m_offset - wall.m_offset) <=
+                 offset_tolerance)) {
+      ++group;
+    }
+    if (group == m_walls.size()) {
+      m_walls.push_back(wall);
+    }
+    kept.insert(kept.end(), corners.begin() + 3 * t,
+                corners.begin() + 3 * t + 3);
+    groups.push_back(group);
+  }
+  m_bvh.build(kept, groups);
+}
+
+void RayTracedField::mirrorSources(const std::vector<FieldSource> &sources) {
+  for (const auto &source : sources) {
+    Image image;
+    image.m_position = source.m_position;
+    image.m_amplitude = source.m_amplitude;
+    image.m_phase = source.m_phase;
+    m_images.push_back(image);
+  }
+
+  size_t level_begin = 0;
+  for (int order = 1; order <= m_cfg.m_max_order; ++order) {
+    const size_t level_end = m_images.size();
+    for (size_t i = level_begin; i < level_end; ++i) {
+      const Image parent = m_images[i];
+      for (uint32_t w = 0; w < m_walls.size(); ++w) {
+        const Wall &wall = m_walls[w];
+        const float distance =
+            glm::dot(wall.m_normal, parent.m_position) - wall.m_offset;
+        if (w == parent.m_wall || distance <= 0.f) {
+          continue;
+        }
+        if (m_images.size() == kMaxImages) {
+          std::cerr << "Ray tracing stopped at " << kMaxImages
+                    << " images, order " << order << " is incomplete\n";
+          return;
+        }
+        Image image;
+        image.m_position = parent.m_position - 2.f * distance * wall.m_normal;
+        image.m_wall = w;
+        image.m_parent = static_cast<int32_t>(i);
+        image.m_amplitude = -m_cfg.m_reflectance * parent.m_amplitude;
+        image.m_phase = parent.m_phase;
+        m_images.push_back(image);
+      }
+    }
+    level_begin = level_end;
+  }
+}
+
+void RayTracedField::build(const glm::vec3 &lo, const glm::vec3 &hi) {
+  // Samples sit at cell centers, off the walls the paths are traced from
+  const float h = glm::two_pi<float>() / m_wavenumber /
+                  static_cast<float>(m_cfg.m_cells_per_wavelength);
+  const glm::vec3 extent = hi - lo;
+  m_re.m_spacing = h;
+  m_re.m_dims = glm::max(glm::ivec3(glm::ceil(extent / h)), glm::ivec3(1));
+  m_re.m_origin = lo + 0.5f * (extent - glm::vec3(m_re.m_dims - 1) * h);
+  m_re.m_values.assign(m_re.size(), 0.f);
+  m_im = m_re;
+
+  const glm::ivec3 dims = m_re.m_dims;
+  const glm::ivec3 tiles = (dims + kTileSize - 1) / kTileSize;
+  const size_t tile_count = static_cast<size_t>(tiles.x) * tiles.y * tiles.z;
+
+  const float k = m_wavenumber;
+  ThreadPool::getInstance().parallelFor(
+      0, tile_count,
+      [&](size_t t_begin, size_t t_end) {
+        constexpr size_t kTileSamples = kTileSize * kTileSize * kTileSize;
+        std::vector<float> buffer(13 * kTileSamples);
+        float *__restrict__ px = buffer.data();
+        float *__restrict__ py = px + kTileSamples;
+        float *__restrict__ pz = py + kTileSamples;
+        float *__restrict__ ox = pz + kTileSamples;
+        float *__restrict__ oy = ox + kTileSamples;
+        float *__restrict__ oz = oy + kTileSamples;
+        float *__restrict__ dx = oz + kTileSamples;
+        float *__restrict__ dy = dx + kTileSamples;
+        float *__restrict__ dz = dy + kTileSamples;
+        float *__restrict__ hit_t = dz + kTileSamples;
+        float *__restrict__ valid = hit_t + kTileSamples;
+        float *__restrict__ acc_re = valid + kTileSamples;
+        float *__restrict__ acc_im = acc_re + kTileSamples;
+        std::vector<uint32_t> hit_wall(kTileSamples);
+        std::vector<uint32_t> from_wall;
+        std::vector<size_t> slot(kTileSamples);
+
+        for (size_t tile = t_begin; tile < t_end; ++tile) {
+          const glm::ivec3 first =
+              kTileSize * glm::ivec3(static_cast<int>(tile % tiles.x),
+                                     static_cast<int>(tile / tiles.x %
+                                                      tiles.y),
+                                     static_cast<int>(tile / tiles.x /
+                                                      tiles.y));
+          const glm::ivec3 last = glm::min(first + kTileSize, dims);
+          size_t n = 0;
+          for (int kz = first.z; kz < last.z; ++kz) {
+            for (int j = first.y; j < last.y; ++j) {
+              for (int i = first.x; i < last.x; ++i) {
+                const glm::vec3 p =
+                    m_re.m_origin + glm::vec3(i, j, kz) * h;
+                px[n] = p.x;
+                py[n] = p.y;
+                pz[n] = p.z;
+                slot[n++] = m_re.index(i, j, kz);
+              }
+            }
+          }
+          std::fill(acc_re, acc_re + n, 0.f);
+          std::fill(acc_im, acc_im + n, 0.f);
+
+          for (const Image &image : m_images) {
+            // Back from the samples through the walls the image was
+            // mirrored in, every leg aimed at the image one order down
+            std::copy(px, px + n, ox);
+            std::copy(py, py + n, oy);
+            std::copy(pz, pz + n, oz);
+            std::fill(valid, valid + n, 1.f);
+            from_wall.assign(n, TriangleBvh::kMiss);
+            const Image *leg = &image;
+            float live = static_cast<float>(n);
+            while (live > 0.f) {
+              for (size_t s = 0; s < n; ++s) {
+                dx[s] = leg->m_position.x - ox[s];
+                dy[s] = leg->m_position.y - oy[s];
+                dz[s] = leg->m_position.z - oz[s];
+              }
+              m_bvh.closestHit(ox, oy, oz, dx, dy, dz, from_wall.data(), n,
+                               hit_t, hit_wall.data());
+              live = 0.f;
+              for (size_t s = 0; s < n; ++s) {
+                valid[s] = hit_wall[s] == leg->m_wall ? valid[s] : 0.f;
+                ox[s] += hit_t[s] * dx[s];
+                oy[s] += hit_t[s] * dy[s];
+                oz[s] += hit_t[s] * dz[s];
+                from_wall[s] = hit_wall[s];
+                live += valid[s];
+              }
+              if (leg->m_parent < 0) {
+                break;
+              }
+              leg = &m_images[leg->m_parent];
+            }
+            if (live == 0.f) {
+              continue;
+            }
+
+            for (size_t s = 0; s < n; ++s) {
+              const float ex = px[s] - image.m_position.x;
+              const float ey = py[s] - image.m_position.y;
+              const float ez = pz[s] - image.m_position.z;
+              const float length = std::sqrt(
+                  std::max(ex * ex + ey * ey + ez * ez, kMinDistanceSq));
+              const float phase = image.m_phase - k * length;
+              const float magnitude = valid[s] * image.m_amplitude / length;
+              acc_re[s] += magnitude * std::cos(phase);
+              acc_im[s] += magnitude * std::sin(phase);
+            }
+          }
+
+          for (size_t s = 0; s < n; ++s) {
+            m_re.m_values[slot[s]] = acc_re[s];
+            m_im.m_values[slot[s]] = acc_im[s];
+          }
+        }
+      },
+      1);
+}
+
+void RayTracedField::samplePhasor(const float *x, const float *y,
+                                  const float *z, size_t count,
+                                  const glm::vec3 &offset, float *field_re,
+                                  float *field_im) const {
+  m_re.sample(x, y, z, count, offset, field_re);
+  m_im.sample(x, y, z, count, offset, field_im);
+}
+
+} // namespace physics
+} // namespace simulator
@@ -0,0 +1,577 @@
+#include "Solver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#include <Attenuation.hpp>
+
+// Step size changes per step are kept within these factors
+static constexpr double kMaxGrowth = 4.0;
+static constexpr double kMaxShrink = 0.2;
+// Aim a little under the tolerance so the next step is rarely rejected
+static constexpr double kSafety = 0.9;
+// Order of the step for the error estimate. Absorption and diffusion are
+// split one after the other, which is first order even when Crank-Nicolson
+// diffuses. Surface absorption is integrated exactly and never limits it.
+static constexpr int kErrorOrder = 1;
+// Steps the solver thread catches up on before it publishes again. A solver
+// slower than the wall clock keeps the rest of its backlog for the next
+// round, so the display keeps updating and no simulated time is lost.
+static constexpr int kMaxCatchUpSteps = 8;
+
+namespace simulator {
+
+Solver::Solver(std::vector<model::Model> &models, const SolverConfig &cfg)
+    : m_models(models), m_cfg(cfg) {
+  if (m_cfg.m_thermal_model == ThermalModel::VOLUMETRIC) {
+    for (auto &m : m_models) {
+      m_conduction.push_back(makeConductionSolver(
+          m, m_cfg.m_voxel_resolution, m_cfg.m_voxel_shell,
+          m_cfg.m_conduction));
+    }
+  }
+  buildField();
+
+  m_next_step = m_cfg.m_time_step;
+
+  if (!m_cfg.m_step_log_path.empty()) {
+    m_step_log.open(m_cfg.m_step_log_path);
+    if (!m_step_log.is_open()) {
+      throw std::runtime_error("Can't open " + m_cfg.m_step_log_path);
+    }
+    m_step_log << "time,step,error,rejected\n";
+  }
+
+  if (!m_cfg.m_checkpoint.m_path.empty()) {
+    if (!(m_cfg.m_checkpoint.m_interval > 0.0)) {
+      throw std::runtime_error("Checkpoint interval must be positive");
+    }
+    m_checkpoint_writer = std::make_unique<CheckpointWriter>();
+    m_next_checkpoint = m_cfg.m_checkpoint.m_interval;
+  }
+
+  for (auto &m : m_models) {
+    for (const auto &mesh : m.getMeshVec()) {
+      m_vertex_count += mesh.m_temperature.size();
+    }
+  }
+
+  if (!m_cfg.m_history.m_path.empty()) {
+    m_history =
+        std::make_unique<TimeSeriesWriter>(m_cfg.m_history, m_vertex_count);
+    recordHistory();
+  }
+
+  // Size every slot up front so publishing never allocates
+  m_snapshots.forEachSlot([this](TemperatureSnapshot &snapshot) {
+    snapshot.m_temperature.resize(m_vertex_count);
+    snapshot.m_positions.resize(m_models.size());
+  });
+  publish();
+  m_snapshots.update();
+}
+
+void Solver::buildField() {
+  // Voxel centers are all behind the surface of their own model, and the
+  // turntable turns the vertices without their triangles
+  const bool occlusion = m_cfg.m_occlusion &&
+                         m_cfg.m_field_model == physics::FREE_SPACE &&
+                         m_cfg.m_thermal_model == ThermalModel::SURFACE &&
+                         !m_cfg.m_turntable.m_enabled;
+  if (m_cfg.m_occlusion && m_cfg.m_field_model == physics::FREE_SPACE &&
+      !occlusion) {
+    std::cerr << "Occlusion needs the surface model without a turntable, "
+                 "ignored\n";
+  }
+  // FDTD already decays the field through the lossy food
+  m_attenuate = m_cfg.m_attenuation &&
+                m_cfg.m_field_model != physics::FDTD &&
+                !m_cfg.m_turntable.m_enabled;
+  if (m_cfg.m_attenuation && !m_attenuate) {
+    std::cerr << "Attenuation needs a field without the food and no "
+                 "turntable, ignored\n";
+  }
+  if (occlusion || m_attenuate) {
+    m_bodies = std::make_unique<TriangleBvh>();
+    m_bodies->build(m_models);
+  }
+  if (m_attenuate) {
+    m_bodies->setAttenuation(
+        physics::materialAttenuation(m_models, m_cfg.m_frequency));
+  }
+
+  if (m_cfg.m_field_model == physics::FREE_SPACE) {
+    m_field = std::make_unique<physics::PhasorField>(
+        m_cfg.m_sources, m_cfg.m_frequency,
+        occlusion ? m_bodies.get() : nullptr);
+    return;
+  }
+  if (m_cfg.m_field_model == physics::CAVITY_MODES) {
+    m_field = std::make_unique<physics::CavityModeField>(
+        m_cfg.m_cavity, m_cfg.m_sources, m_cfg.m_frequency,
+        m_cfg.m_cavity_modes);
+    return;
+  }
+  if (m_cfg.m_field_model == physics::RAY_TRACED) {
+    m_field = std::make_unique<physics::RayTracedField>(
+        physics::RayTracedField::boxWalls(m_cfg.m_cavity), m_cfg.m_sources,
+        m_cfg.m_frequency, m_cfg.m_ray_trace);
+    return;
+  }
+
+  float max_permittivity = 1.f;
+  for (auto &m : m_models) {
+    for (const auto &material : m.getMaterialTable().m_materials) {
+      max_permittivity =
+          std::max(max_permittivity, material.m_relative_permittivity);
+    }
+  }
+
+  auto fdtd = std::make_unique<physics::FdtdField>(
+      m_cfg.m_cavity, m_cfg.m_frequency, max_permittivity, m_cfg.m_fdtd);
+  for (const auto &source : m_cfg.m_sources) {
+    fdtd->addSource(source);
+  }
+
+  // The food loads the cavity where it stands when the solver starts
+  for (size_t i = 0; i < m_models.size(); ++i) {
+    model::Model &m = m_models[i];
+    SparseGrid grid;
+    if (m_conduction.empty()) {
+      grid.build(m, m_cfg.m_voxel_resolution, m_cfg.m_voxel_shell);
+    }
+    const SparseGrid &body =
+        m_conduction.empty() ? grid : m_conduction[i]->getGrid();
+    fdtd->addMaterial(body, m.getPosition(), m.getMaterialTable());
+  }
+
+  fdtd->solve();
+  m_field = std::move(fdtd);
+}
+
+void Solver::start() {
+  if (m_running.exchange(true)) {
+    return;
+  }
+  m_thread = std::thread(&Solver::loop, this);
+}
+
+void Solver::stop() {
+  m_running.store(false);
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void Solver::advance(double timestamp, double dt) {
+  const float frequency = m_cfg.m_frequency;
+
+  // A model that moved changes the shadows it casts on the others, and the
+  // food the sources shine through
+  if (m_bodies && m_bodies->refit(m_models)) {
+    for (auto &m : m_models) {
+      m.invalidateField();
+    }
+  }
+
+  const physics::TurntableConfig &turntable = m_cfg.m_turntable;
+  for (size_t i = 0; i < m_models.size(); ++i) {
+    model::Model &m = m_models[i];
+    // Resample only when the model moved through the field
+    if (!m.isFieldValid() && turntable.m_enabled) {
+      const glm::vec3 pivot = physics::turntablePivot(m_cfg.m_sources);
+      // Conduction reads the voxels only, a vertex cache would go unused
+      if (m_conduction.empty()) {
+        m.buildTurntable(*m_field, pivot, turntable);
+      } else {
+        m_conduction[i]->buildTurntable(*m_field, pivot, turntable);
+        m.validateField();
+      }
+    } else if (!m.isFieldValid()) {
+      if (!m_conduction.empty()) {
+        m_conduction[i]->sampleField(*m_field);
+      }
+      m.sampleField(*m_field);
+      if (m_attenuate && !m_conduction.empty()) {
+        m_conduction[i]->attenuate(*m_bodies, m_cfg.m_sources);
+      } else if (m_attenuate) {
+        m.attenuate(*m_bodies, m_cfg.m_sources);
+      }
+    }
+
+    // On a turntable every step reads the arc it sweeps from the cache
+    if (turntable.m_enabled) {
+      const double angle0 = physics::turntableAngle(turntable, timestamp);
+      const double angle1 =
+          physics::turntableAngle(turntable, timestamp + dt);
+      if (m_conduction.empty()) {
+        m.sampleTurntable(angle0, angle1);
+      } else {
+        m_conduction[i]->sampleTurntable(angle0, angle1);
+      }
+    }
+
+    if (m_conduction.empty()) {
+      m.calculateTemperature(timestamp, dt, frequency,
+                             m_cfg.m_absorption_mode);
+    } else {
+      m_conduction[i]->step(timestamp, dt, frequency,
+                            m_cfg.m_absorption_mode);
+    }
+  }
+}
+
+double Solver::step(double end_time) {
+  const double h =
+      m_cfg.m_adaptive.m_enabled ? stepAdaptive(end_time) : stepFixed();
+  if (m_history && m_step_count % m_cfg.m_history.m_stride == 0) {
+    recordHistory();
+  }
+  if (m_checkpoint_writer && getTimeline() >= m_next_checkpoint) {
+    checkpoint();
+  }
+  return h;
+}
+
+double Solver::stepFixed() {
+  const double dt = m_cfg.m_time_step;
+  advance(m_step_count * dt, dt);
+  ++m_step_count;
+  // Derive the clock from the step count so it doesn't accumulate round off
+  m_timeline.store(m_step_count * dt, std::memory_order_relaxed);
+  if (m_step_log.is_open()) {
+    m_step_log << getTimeline() << "," << dt << ",0,0\n";
+  }
+  return dt;
+}
+
+double Solver::stepAdaptive(double end_time) {
+  const AdaptiveStepConfig &cfg = m_cfg.m_adaptive;
+  const double t = getTimeline();
+  // Richardson, the two half steps are closer to the solution by 2^p - 1
+  const double error_scale = 1.0 / ((1 << kErrorOrder) - 1);
+  const double exponent = 1.0 / (kErrorOrder + 1);
+
+  captureState(m_state_start);
+  int rejected = 0;
+  for (;;) {
+    // The minimum step yields to end_time, so the last step never passes it
+    const bool limited = end_time - t < m_next_step;
+    const double h =
+        std::min(std::max(m_next_step, cfg.m_min_step), end_time - t);
+
+    advance(t, h);
+    captureState(m_state_full);
+    restoreState(m_state_start);
+    advance(t, 0.5 * h);
+    advance(t + 0.5 * h, 0.5 * h);
+    const size_t temperatures = captureState(m_state_half);
+
+    double max_diff = 0.0;
+    for (size_t v = 0; v < temperatures; ++v) {
+      max_diff =
+          std::max(max_diff, std::fabs(m_state_half[v] - m_state_full[v]));
+    }
+    const double error = max_diff * error_scale;
+    const double factor =
+        error > 0.0 ? std::clamp(kSafety * std::pow(cfg.m_tolerance / error,
+                                                    exponent),
+                                 kMaxShrink, kMaxGrowth)
+                    : kMaxGrowth;
+    const double proposal =
+        std::clamp(h * factor, cfg.m_min_step, cfg.m_max_step);
+
+    if (error <= cfg.m_tolerance || h <= cfg.m_min_step) {
+      // A step cut short by end_time says nothing about growing further
+      if (!limited || factor < 1.0) {
+        m_next_step = proposal;
+      }
+      ++m_step_count;
+      m_timeline.store(t + h, std::memory_order_relaxed);
+      if (m_step_log.is_open()) {
+        m_step_log << t + h << "," << h << "," << error << "," << rejected
+                   << "\n";
+      }
+      return h;
+    }
+
+    restoreState(m_state_start);
+    m_next_step = proposal;
+    ++rejected;
+    ++m_rejected_count;
+  }
+}
+
+size_t Solver::captureState(std::vector<double> &state) const {
+  state.clear();
+  if (!m_conduction.empty()) {
+    size_t temperatures = 0, enthalpies = 0;
+    for (const auto &conduction : m_conduction) {
+      temperatures += conduction->getTemperatureCount();
+      enthalpies += conduction->getEnthalpyCount();
+    }
+    state.resize(temperatures + enthalpies);
+    double *t = state.data();
+    double *h = t + temperatures;
+    for (const auto &conduction : m_conduction) {
+      conduction->getState(t, h);
+      t += conduction->getTemperatureCount();
+      h += conduction->getEnthalpyCount();
+    }
+    return temperatures;
+  }
+  for (const auto &m : m_models) {
+    for (const auto &mesh : m.getMeshVec()) {
+      state.insert(state.end(), mesh.m_temperature.begin(),
+                   mesh.m_temperature.end());
+    }
+  }
+  const size_t temperatures = state.size();
+  for (const auto &m : m_models) {
+    for (const auto &mesh : m.getMeshVec()) {
+      state.insert(state.end(), mesh.m_enthalpy.begin(),
+                   mesh.m_enthalpy.end());
+    }
+  }
+  return temperatures;
+}
+
+void Solver::restoreState(const std::vector<double> &state) {
+  if (!m_conduction.empty()) {
+    size_t temperatures = 0;
+    for (const auto &conduction : m_conduction) {
+      temperatures += conduction->getTemperatureCount();
+    }
+    const double *t = state.data();
+    const double *h = t + temperatures;
+    for (auto &conduction : m_conduction) {
+      conduction->setState(t, h);
+      t += conduction->getTemperatureCount();
+      h += conduction->getEnthalpyCount();
+    }
+    return;
+  }
+  const double *in = state.data();
+  for (auto &m : m_models) {
+    for (auto &mesh : m.getMeshVec()) {
+      std::copy(in, in + mesh.m_temperature.size(),
+                mesh.m_temperature.begin());
+      in += mesh.m_temperature.size();
+    }
+  }
+  // Enthalpies follow in the same order, empty without a phase change
+  for (auto &m : m_models) {
+    for (auto &mesh : m.getMeshVec()) {
+      std::copy(in, in + mesh.m_enthalpy.size(), mesh.m_enthalpy.begin());
+      in += mesh.m_enthalpy.size();
+    }
+  }
+}
+
+void Solver::checkpoint() {
+  if (!m_checkpoint_writer) {
+    throw std::runtime_error("Checkpointing is not configured");
+  }
+
+  CheckpointHeader header;
+  header.m_timeline = getTimeline();
+  header.m_next_step = m_next_step;
+  header.m_step_count = m_step_count;
+  header.m_rejected_count = m_rejected_count;
+  header.m_model_count = static_cast<uint32_t>(m_models.size());
+
+  // Sections point into the live state, which is copied once while packing
+  std::vector<CheckpointSpan> spans;
+  for (const auto &blob : m_cfg.m_checkpoint.m_config) {
+    spans.push_back(
+        {blob.m_kind, blob.m_index, blob.m_bytes.data(), blob.m_bytes.size()});
+  }
+  // A restore checks them, the same state means little with other materials
+  std::vector<uint32_t> material_counts;
+  for (const auto &m : m_models) {
+    material_counts.push_back(
+        static_cast<uint32_t>(m.getMaterialTable().size()));
+  }
+  for (uint32_t i = 0; i < material_counts.size(); ++i) {
+    spans.push_back(
+        {MODEL_MATERIALS, i, &material_counts[i], sizeof(uint32_t)});
+  }
+  uint32_t mesh_index = 0;
+  for (const auto &m : m_models) {
+    for (const auto &mesh : m.getMeshVec()) {
+      spans.push_back({MESH_TEMPERATURE, mesh_index, mesh.m_temperature.data(),
+                       mesh.m_temperature.size() * sizeof(float)});
+      spans.push_back({MESH_ENTHALPY, mesh_index, mesh.m_enthalpy.data(),
+                       mesh.m_enthalpy.size() * sizeof(float)});
+      ++mesh_index;
+    }
+  }
+  header.m_mesh_count = mesh_index;
+  // Voxels are written in double whatever their precision, which holds
+  // every one of them exactly
+  size_t voxel_values = 0;
+  for (const auto &conduction : m_conduction) {
+    voxel_values +=
+        conduction->getTemperatureCount() + conduction->getEnthalpyCount();
+  }
+  m_checkpoint_voxels.resize(voxel_values);
+  double *voxels = m_checkpoint_voxels.data();
+  for (uint32_t i = 0; i < m_conduction.size(); ++i) {
+    const size_t temperatures = m_conduction[i]->getTemperatureCount();
+    const size_t enthalpies = m_conduction[i]->getEnthalpyCount();
+    m_conduction[i]->getState(voxels, voxels + temperatures);
+    spans.push_back(
+        {VOXEL_TEMPERATURE, i, voxels, temperatures * sizeof(double)});
+    spans.push_back({VOXEL_ENTHALPY, i, voxels + temperatures,
+                     enthalpies * sizeof(double)});
+    voxels += temperatures + enthalpies;
+  }
+
+  packCheckpoint(header, spans, m_checkpoint_image);
+  m_checkpoint_writer->submit(m_cfg.m_checkpoint.m_path, m_checkpoint_image);
+
+  // Long steps may cross several intervals, one checkpoint covers them
+  while (m_next_checkpoint <= header.m_timeline) {
+    m_next_checkpoint += m_cfg.m_checkpoint.m_interval;
+  }
+}
+
+void Solver::flushCheckpoints() {
+  if (m_checkpoint_writer) {
+    m_checkpoint_writer->flush();
+  }
+}
+
+void Solver::recordHistory() {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  m_history_frame.resize(m_vertex_count);
+  auto out = m_history_frame.begin();
+  for (const auto &m : m_models) {
+    for (const auto &mesh : m.getMeshVec()) {
+      out = std::copy(mesh.m_temperature.begin(), mesh.m_temperature.end(),
+                      out);
+    }
+  }
+  m_history->push(getTimeline(), m_history_frame);
+  m_history_seconds +=
+      std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void Solver::closeHistory() {
+  if (m_history) {
+    m_history->close();
+  }
+}
+
+void Solver::restore(const CheckpointFile &file) {
+  const CheckpointHeader &header = file.getHeader();
+  if (header.m_model_count != m_models.size()) {
+    throw std::runtime_error("Checkpoint does not match the models");
+  }
+
+  for (uint32_t i = 0; i < m_models.size(); ++i) {
+    size_t count = 0;
+    const uint32_t *materials =
+        file.findArray<uint32_t>(MODEL_MATERIALS, i, count);
+    if (count != 1 || *materials != m_models[i].getMaterialTable().size()) {
+      throw std::runtime_error(
+          "Checkpoint was written with another material table");
+    }
+  }
+
+  const auto restoreArray = [&file](uint32_t kind, uint32_t index,
+                                    std::vector<float> &out) {
+    size_t count = 0;
+    const float *in = file.findArray<float>(kind, index, count);
+    if (count != out.size()) {
+      throw std::runtime_error("Checkpoint does not match the models");
+    }
+    std::copy(in, in + count, out.begin());
+  };
+
+  uint32_t mesh_index = 0;
+  for (auto &m : m_models) {
+    for (auto &mesh : m.getMeshVec()) {
+      restoreArray(MESH_TEMPERATURE, mesh_index, mesh.m_temperature);
+      restoreArray(MESH_ENTHALPY, mesh_index, mesh.m_enthalpy);
+      ++mesh_index;
+    }
+  }
+  if (header.m_mesh_count != mesh_index) {
+    throw std::runtime_error("Checkpoint does not match the models");
+  }
+  for (uint32_t i = 0; i < m_conduction.size(); ++i) {
+    size_t temperatures = 0, enthalpies = 0;
+    const double *t =
+        file.findArray<double>(VOXEL_TEMPERATURE, i, temperatures);
+    const double *h = file.findArray<double>(VOXEL_ENTHALPY, i, enthalpies);
+    if (temperatures != m_conduction[i]->getTemperatureCount() ||
+        enthalpies != m_conduction[i]->getEnthalpyCount()) {
+      throw std::runtime_error("Checkpoint does not match the models");
+    }
+    m_conduction[i]->setState(t, h);
+  }
+
+  m_step_count = header.m_step_count;
+  m_rejected_count = header.m_rejected_count;
+  m_next_step = header.m_next_step;
+  m_timeline.store(header.m_timeline, std::memory_order_relaxed);
+  m_next_checkpoint = header.m_timeline + m_cfg.m_checkpoint.m_interval;
+  publish();
+}
+
+void Solver::publish() {
+  TemperatureSnapshot &snapshot = m_snapshots.back();
+  snapshot.m_timeline = getTimeline();
+
+  auto out = snapshot.m_temperature.begin();
+  for (auto &m : m_models) {
+    for (const auto &mesh : m.getMeshVec()) {
+      out = std::copy(mesh.m_temperature.begin(), mesh.m_temperature.end(),
+                      out);
+    }
+  }
+  for (size_t m = 0; m < m_models.size(); ++m) {
+    snapshot.m_positions[m] = m_models[m].getPosition();
+  }
+  m_snapshots.publish();
+}
+
+void Solver::loop() {
+  using Clock = std::chrono::steady_clock;
+  using Seconds = std::chrono::duration<double>;
+
+  auto previous = Clock::now();
+  double accumulator = 0.0; ///< Simulated time owed to the wall clock
+
+  while (m_running.load(std::memory_order_relaxed)) {
+    const auto now = Clock::now();
+    accumulator += Seconds(now - previous).count() * m_cfg.m_time_scale;
+    previous = now;
+
+    // Fixed steps keep m_next_step at the configured step
+    if (accumulator < m_next_step) {
+      std::this_thread::sleep_for(
+          Seconds((m_next_step - accumulator) / m_cfg.m_time_scale));
+      continue;
+    }
+
+    // Catch up on the steps that are due, up to the cap. What is left stays
+    // owed and is worked off after the publish.
+    int steps = 0;
+    while (accumulator >= m_next_step && steps < kMaxCatchUpSteps &&
+           m_running.load(std::memory_order_relaxed)) {
+      accumulator -= step();
+      ++steps;
+    }
+    m_lag.store(accumulator >= m_next_step ? accumulator : 0.0,
+                std::memory_order_relaxed);
+    publish();
+  }
+}
+
+} // namespace simulator
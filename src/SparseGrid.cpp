@@ -0,0 +1,186 @@
+#include "SparseGrid.hpp"
+
+#include <algorithm>
+
+#include <ThreadPool.hpp>
+
+// Voxels per block edge, a block is what one internal node covers
+static constexpr int kBlockLog2 = 7;
+
+namespace simulator {
+
+uint64_t SparseGrid::blockKey(int i, int j, int k) {
+  return (static_cast<uint64_t>(k >> kBlockLog2) << 42) |
+         (static_cast<uint64_t>(j >> kBlockLog2) << 21) |
+         static_cast<uint64_t>(i >> kBlockLog2);
+}
+
+namespace {
+
+/**
+ * Leaves of one row of bricks along y, in the order the band lays them out
+ */
+struct BrickRow {
+  std::vector<glm::ivec3> m_origins;
+  std::vector<uint64_t> m_active;
+  std::vector<uint8_t> m_material;
+};
+
+} // namespace
+
+void SparseGrid::build(const model::Model &model, int resolution,
+                       bool shell) {
+  static_assert(kLeafSize * kNodeSize == 1 << kBlockLog2,
+                "A block is an internal node of leaves");
+  VoxelGrid layout;
+  sizeVoxelGrid(model, resolution, layout);
+  m_dims = layout.m_dims;
+  m_origin = layout.m_origin;
+  m_spacing = layout.m_spacing;
+  m_root.clear();
+  m_children.clear();
+  m_leaf_origins.clear();
+  m_active.clear();
+  m_material.clear();
+
+  // A band per row of bricks, each keeps only the bricks holding a voxel of
+  // the body and is gone before the next band on its worker
+  const glm::ivec3 bricks = (m_dims + kLeafSize - 1) / kLeafSize;
+  std::vector<BrickRow> rows(bricks.y);
+  voxelizeBands(
+      model, shell, layout, kLeafSize,
+      [&](int first_row, const VoxelGrid &band) {
+        BrickRow &row = rows[first_row / kLeafSize];
+        uint64_t active[kLeafVoxels / 64];
+        uint8_t material[kLeafVoxels];
+        for (int bk = 0; bk < bricks.z; ++bk) {
+          for (int bi = 0; bi < bricks.x; ++bi) {
+            const glm::ivec3 origin =
+                kLeafSize * glm::ivec3(bi, first_row / kLeafSize, bk);
+            // Slots past the edge of the grid stay inactive
+            const glm::ivec3 last =
+                glm::min(origin + kLeafSize, m_dims) - origin;
+            std::fill(active, active + kLeafVoxels / 64, 0);
+            std::fill(material, material + kLeafVoxels, 0);
+            bool occupied = false;
+            for (int z = 0; z < last.z; ++z) {
+              for (int y = 0; y < last.y; ++y) {
+                const size_t v = band.index(origin.x, y, origin.z + z);
+                for (int x = 0; x < last.x; ++x) {
+                  if (!band.m_occupancy[v + x]) {
+                    continue;
+                  }
+                  const size_t slot = localIndex(x, y, z);
+                  active[slot >> 6] |= uint64_t(1) << (slot & 63);
+                  material[slot] = band.m_material[v + x];
+                  occupied = true;
+                }
+              }
+            }
+            if (!occupied) {
+              continue;
+            }
+            row.m_origins.push_back(origin);
+            row.m_active.insert(row.m_active.end(), active,
+                                active + kLeafVoxels / 64);
+            row.m_material.insert(row.m_material.end(), material,
+                                  material + kLeafVoxels);
+          }
+        }
+      });
+
+  // Leaves row by row of bricks, x fastest within a row, so neighbouring
+  // bricks sit close in memory
+  constexpr size_t node_children =
+      static_cast<size_t>(kNodeSize) * kNodeSize * kNodeSize;
+  for (BrickRow &row : rows) {
+    for (const glm::ivec3 &origin : row.m_origins) {
+      const uint32_t leaf = static_cast<uint32_t>(m_leaf_origins.size());
+      m_leaf_origins.push_back(origin);
+      const auto node = m_root.emplace(
+          blockKey(origin.x, origin.y, origin.z),
+          static_cast<uint32_t>(m_children.size() / node_children));
+      if (node.second) {
+        m_children.resize(m_children.size() + node_children, kNone);
+      }
+      m_children[node.first->second * node_children +
+                 childIndex(origin.x, origin.y, origin.z)] = leaf;
+    }
+    m_active.insert(m_active.end(), row.m_active.begin(),
+                    row.m_active.end());
+    m_material.insert(m_material.end(), row.m_material.begin(),
+                      row.m_material.end());
+    row = BrickRow();
+  }
+
+  const size_t leaves = m_leaf_origins.size();
+  m_neighbours.resize(6 * leaves);
+  ThreadPool::getInstance().parallelFor(
+      0, leaves,
+      [&](size_t l_begin, size_t l_end) {
+        for (size_t leaf = l_begin; leaf < l_end; ++leaf) {
+          for (int face = 0; face < 6; ++face) {
+            glm::ivec3 next = m_leaf_origins[leaf];
+            next[face / 2] += face % 2 ? kLeafSize : -kLeafSize;
+            m_neighbours[6 * leaf + face] = findLeaf(next.x, next.y, next.z);
+          }
+        }
+      },
+      16);
+
+  m_active_count = 0;
+  for (const uint64_t word : m_active) {
+    m_active_count += static_cast<size_t>(__builtin_popcountll(word));
+  }
+}
+
+size_t SparseGrid::childIndex(int i, int j, int k) {
+  return (static_cast<size_t>(k / kLeafSize % kNodeSize) * kNodeSize +
+          j / kLeafSize % kNodeSize) *
+             kNodeSize +
+         i / kLeafSize % kNodeSize;
+}
+
+uint32_t SparseGrid::findLeaf(int i, int j, int k) const {
+  if (i < 0 || j < 0 || k < 0 || i >= m_dims.x || j >= m_dims.y ||
+      k >= m_dims.z) {
+    return kNone;
+  }
+  const auto node = m_root.find(blockKey(i, j, k));
+  if (node == m_root.end()) {
+    return kNone;
+  }
+  return m_children[static_cast<size_t>(node->second) * kNodeSize *
+                        kNodeSize * kNodeSize +
+                    childIndex(i, j, k)];
+}
+
+size_t SparseGrid::find(int i, int j, int k) const {
+  const uint32_t leaf = findLeaf(i, j, k);
+  if (leaf == kNone) {
+    return kNoSlot;
+  }
+  return leaf * kLeafVoxels +
+         localIndex(i % kLeafSize, j % kLeafSize, k % kLeafSize);
+}
+
+size_t SparseGrid::neighbourSlot(size_t slot, int face) const {
+  const size_t leaf = slot / kLeafVoxels;
+  const size_t local = slot % kLeafVoxels;
+  glm::ivec3 c(static_cast<int>(local % kLeafSize),
+               static_cast<int>(local / kLeafSize % kLeafSize),
+               static_cast<int>(local / (kLeafSize * kLeafSize)));
+  const int axis = face / 2;
+  c[axis] += face % 2 ? 1 : -1;
+  if (c[axis] >= 0 && c[axis] < kLeafSize) {
+    return leaf * kLeafVoxels + localIndex(c.x, c.y, c.z);
+  }
+  const uint32_t next = getNeighbour(leaf, face);
+  if (next == kNone) {
+    return kNoSlot;
+  }
+  c[axis] = (c[axis] + kLeafSize) % kLeafSize;
+  return next * kLeafVoxels + localIndex(c.x, c.y, c.z);
+}
+
+} // namespace simulator
@@ -0,0 +1,172 @@
+#include "Sweep.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+#include <Solver.hpp>
+#include <WorkStealingPool.hpp>
+
+namespace simulator {
+
+void copyRunModel(const model::Model &prototype,
+                  const model::Material &material, float temperature,
+                  const SharedGeometry &geometry, model::Model &run) {
+  // The varied material stands in for the primary one, a dish or the other
+  // foods of the prototype keep theirs
+  model::MaterialTable table = prototype.getMaterialTable();
+  table.m_materials.front() = material;
+  run.setMaterials(table);
+  run.setPosition(prototype.getPosition());
+  auto &meshes = run.getMeshVec();
+  meshes.reserve(prototype.getMeshVec().size());
+  for (size_t m = 0; m < prototype.getMeshVec().size(); ++m) {
+    const model::Mesh &mesh = prototype.getMeshVec()[m];
+    meshes.emplace_back();
+    meshes.back().m_name = mesh.m_name;
+    meshes.back().m_material_name = mesh.m_material_name;
+    meshes.back().m_material_index = mesh.m_material_index;
+    meshes.back().m_shared_geometry = geometry[m];
+    meshes.back().m_material = mesh.m_material;
+  }
+  run.initializeThermalState(temperature);
+}
+
+std::string runPath(const std::string &path, size_t run) {
+  if (path.empty()) {
+    return path;
+  }
+  std::filesystem::path run_path(path);
+  run_path.replace_filename(run_path.stem().string() + "_" +
+                            std::to_string(run) +
+                            run_path.extension().string());
+  return run_path.string();
+}
+
+static void writeHeader(std::ofstream &out) {
+  out << "run,engine,material,frequency,source_count,source_x,source_y,"
+         "source_z,amplitude,thermal_model,thickness,electrical_conductivity,"
+         "density,heat_capacity,mean_temperature,min_temperature,"
+         "max_temperature,std_temperature,steps,rejected,wall_time\n";
+}
+
+static void writeRow(std::ofstream &out, size_t run,
+                     const EngineConfig &engine,
+                     const model::Material &material,
+                     const SweepSummary &summary) {
+  // The first source stands for the sweep over source positions
+  const physics::FieldSource source = engine.m_sources.empty()
+                                          ? physics::FieldSource()
+                                          : engine.m_sources.front();
+  out << run << "," << summary.m_engine << "," << summary.m_material << ","
+      << engine.m_source_freq << "," << engine.m_sources.size() << ","
+      << source.m_position.x << "," << source.m_position.y << ","
+      << source.m_position.z << "," << source.m_amplitude << ","
+      << (engine.m_thermal_model == VOLUMETRIC ? "volumetric" : "surface")
+      << "," << material.m_thickness << ","
+      << material.m_electrical_conductivity << "," << material.m_density << ","
+      << material.m_heat_capacity << "," << summary.m_mean_temperature << ","
+      << summary.m_min_temperature << "," << summary.m_max_temperature << ","
+      << summary.m_std_temperature << "," << summary.m_steps << ","
+      << summary.m_rejected << "," << summary.m_wall_time << "\n";
+}
+
+/**
+ * @brief summarize
+ * @param model
+ * @param summary Temperature statistics are filled in
+ */
+static void summarize(const model::Model &model, SweepSummary &summary) {
+  double sum = 0.0, sum_squares = 0.0;
+  float lo = std::numeric_limits<float>::max();
+  float hi = std::numeric_limits<float>::lowest();
+  size_t count = 0;
+  for (const auto &mesh : model.getMeshVec()) {
+    for (const float t : mesh.m_temperature) {
+      sum += t;
+      sum_squares += static_cast<double>(t) * t;
+      lo = std::min(lo, t);
+      hi = std::max(hi, t);
+    }
+    count += mesh.m_temperature.size();
+  }
+  if (count == 0) {
+    return;
+  }
+  const double mean = sum / count;
+  summary.m_mean_temperature = static_cast<float>(mean);
+  summary.m_min_temperature = lo;
+  summary.m_max_temperature = hi;
+  summary.m_std_temperature = static_cast<float>(
+      std::sqrt(std::max(sum_squares / count - mean * mean, 0.0)));
+}
+
+std::vector<SweepSummary>
+runSweep(const model::Model &prototype,
+         const std::vector<EngineConfig> &engines,
+         const std::vector<model::Material> &materials,
+         const SweepConfig &cfg) {
+  std::ofstream out(cfg.m_output_path);
+  if (!out.is_open()) {
+    throw std::runtime_error("Can't open " + cfg.m_output_path);
+  }
+  // Enough digits for mK differences between runs
+  out.precision(9);
+  writeHeader(out);
+  std::mutex out_mutex;
+
+  const size_t runs = engines.size() * materials.size();
+  std::vector<SweepSummary> summaries(runs);
+  const SharedGeometry geometry = prototype.shareGeometry();
+  WorkStealingPool pool(cfg.m_threads);
+
+  for (size_t run = 0; run < runs; ++run) {
+    pool.submit([&, run] {
+      using Clock = std::chrono::steady_clock;
+      const auto start = Clock::now();
+
+      SweepSummary &summary = summaries[run];
+      summary.m_engine = run / materials.size();
+      summary.m_material = run % materials.size();
+      const EngineConfig &engine = engines[summary.m_engine];
+      const model::Material &material = materials[summary.m_material];
+
+      std::vector<model::Model> models(1);
+      copyRunModel(prototype, material, cfg.m_initial_temperature, geometry,
+                   models.front());
+      SolverConfig solver_cfg = makeSolverConfig(engine);
+      solver_cfg.m_step_log_path = runPath(engine.m_step_log_path, run);
+      solver_cfg.m_checkpoint.m_path.clear();
+      solver_cfg.m_history.m_path.clear();
+
+      {
+        Solver solver(models, solver_cfg);
+        // Same end of run slack as the headless demo
+        const double slack = 0.5 * std::min(solver_cfg.m_time_step,
+                                            solver_cfg.m_adaptive.m_min_step);
+        while (solver.getTimeline() < cfg.m_duration - slack) {
+          solver.step(cfg.m_duration);
+        }
+        summary.m_steps = solver.getStepCount();
+        summary.m_rejected = solver.getRejectedCount();
+      }
+      summarize(models.front(), summary);
+      summary.m_wall_time =
+          std::chrono::duration<double>(Clock::now() - start).count();
+
+      // Rows land in completion order, the run column restores the grid
+      std::lock_guard<std::mutex> lock(out_mutex);
+      writeRow(out, run, engine, material, summary);
+      out.flush();
+    });
+  }
+  pool.wait();
+  return summaries;
+}
+
+} // namespace simulator
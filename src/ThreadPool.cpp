@@ -0,0 +1,101 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace simulator {
+
+// Set by InlineScope on the threads that must not use the workers
+static thread_local bool t_inline = false;
+
+ThreadPool::InlineScope::InlineScope() : m_previous(t_inline) {
+  t_inline = true;
+}
+
+ThreadPool::InlineScope::~InlineScope() { t_inline = m_previous; }
+
+ThreadPool::ThreadPool() {
+  const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+  m_workers.reserve(hw - 1);
+  for (size_t i = 0; i + 1 < hw; ++i) {
+    m_workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_job_cv.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::runChunks() {
+  for (;;) {
+    const size_t chunk_begin = m_next.fetch_add(m_grain);
+    if (chunk_begin >= m_end) {
+      return;
+    }
+    (*m_fn)(chunk_begin, std::min(chunk_begin + m_grain, m_end));
+  }
+}
+
+void ThreadPool::workerLoop() {
+  uint64_t seen_generation = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_job_cv.wait(lock, [&] {
+        return m_stop || m_generation != seen_generation;
+      });
+      if (m_stop) {
+        return;
+      }
+      seen_generation = m_generation;
+    }
+
+    runChunks();
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_busy_workers;
+    }
+    m_done_cv.notify_one();
+  }
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const RangeFn &fn,
+                             size_t grain) {
+  if (begin >= end) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+
+  // Not worth waking anybody up
+  if (m_workers.empty() || end - begin <= grain || t_inline) {
+    fn(begin, end);
+    return;
+  }
+
+  std::lock_guard<std::mutex> submit_lock(m_submit_mutex);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fn = &fn;
+    m_end = end;
+    m_grain = grain;
+    m_next.store(begin);
+    m_busy_workers = m_workers.size();
+    ++m_generation;
+  }
+  m_job_cv.notify_all();
+
+  runChunks();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done_cv.wait(lock, [this] { return m_busy_workers == 0; });
+  m_fn = nullptr;
+}
+
+} // namespace simulator
@@ -0,0 +1,396 @@
+#include "TimeSeries.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <BlockCompression.hpp>
+
+// File layout, bump the version whenever it or the frame coding changes
+static constexpr uint32_t kSeriesMagic = 0x53544d43; ///< "CMTS"
+static constexpr uint32_t kSeriesVersion = 2;
+static constexpr uint32_t kKeyframe = 1;
+
+/**
+ * Start of a time series file, the chunks follow it
+ */
+struct SeriesHeader {
+  uint32_t m_magic = kSeriesMagic;
+  uint32_t m_version = kSeriesVersion;
+  uint64_t m_vertex_count = 0;
+  uint32_t m_keyframe_interval = 0;
+  uint32_t m_mantissa_bits = 0;
+};
+
+/**
+ * End of a closed time series file, right after the index
+ */
+struct SeriesFooter {
+  uint64_t m_index_offset = 0;
+  uint64_t m_frame_count = 0;
+  uint32_t m_magic = kSeriesMagic;
+  uint32_t m_version = kSeriesVersion;
+};
+
+/**
+ * @brief predictionOrder
+ * @param frame
+ * @param interval
+ * @return 0 for a keyframe, 1 for the frame after it, 2 past that, which is
+ * the order of the prediction
+ */
+static size_t predictionOrder(size_t frame, size_t interval) {
+  return std::min<size_t>(frame % interval, 2);
+}
+
+/**
+ * @brief roundMantissa Round to nearest even on the kept bits, the error is
+ * at most half a unit of the last kept bit
+ * @param value
+ * @param dropped Mantissa bits dropped
+ * @return The kept bits, shifted down so neighbouring values are
+ * neighbouring integers and the residuals stay small
+ */
+static uint32_t roundMantissa(float value, int dropped) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if (dropped <= 0) {
+    return bits;
+  }
+  const uint32_t half = (1u << (dropped - 1)) - 1 + ((bits >> dropped) & 1);
+  return (bits + half) >> dropped;
+}
+
+namespace simulator {
+
+TimeSeriesWriter::TimeSeriesWriter(const TimeSeriesConfig &cfg,
+                                   size_t vertex_count)
+    : m_cfg(cfg), m_vertex_count(vertex_count) {
+  if (m_cfg.m_stride < 1 || m_cfg.m_keyframe_interval < 1 ||
+      m_cfg.m_mantissa_bits < 1 || m_cfg.m_mantissa_bits > 23 ||
+      m_cfg.m_queue_depth < 1) {
+    throw std::runtime_error("Time series is not configured");
+  }
+  m_file.open(m_cfg.m_path, std::ios::binary | std::ios::trunc);
+  if (!m_file.is_open()) {
+    throw std::runtime_error("Can't open " + m_cfg.m_path);
+  }
+
+  SeriesHeader header;
+  header.m_vertex_count = m_vertex_count;
+  header.m_keyframe_interval = static_cast<uint32_t>(m_cfg.m_keyframe_interval);
+  header.m_mantissa_bits = static_cast<uint32_t>(m_cfg.m_mantissa_bits);
+  m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  m_previous.resize(m_vertex_count);
+  m_before.resize(m_vertex_count);
+  m_shuffled.resize(m_vertex_count * sizeof(uint32_t));
+  m_compressed.resize(compressBound(m_shuffled.size()));
+  m_thread = std::thread(&TimeSeriesWriter::loop, this);
+}
+
+void TimeSeriesWriter::push(double time, std::vector<float> &frame) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_closed) {
+    return;
+  }
+  // A full queue means the disk is behind: the frame takes the place of the
+  // newest queued one, whose buffer goes back to the caller
+  if (m_cfg.m_drop_frames && m_queue.size() >= m_cfg.m_queue_depth) {
+    ++m_dropped;
+    ++m_queue.back().m_skipped;
+    m_queue.back().m_time = time;
+    m_queue.back().m_values.swap(frame);
+    frame.resize(m_vertex_count);
+    return;
+  }
+  // Otherwise the queue grows past its depth, the history stays lossless
+  // and only memory pays for the slow disk
+  if (m_queue.size() >= m_cfg.m_queue_depth) {
+    ++m_spilled;
+  }
+
+  Frame queued;
+  queued.m_time = time;
+  queued.m_values.swap(frame);
+  if (!m_free.empty()) {
+    frame.swap(m_free.back());
+    m_free.pop_back();
+  }
+  frame.resize(m_vertex_count);
+  m_queue.push_back(std::move(queued));
+  lock.unlock();
+  m_wake.notify_one();
+}
+
+void TimeSeriesWriter::close() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_closed) {
+      return;
+    }
+    m_closed = true;
+    m_quit = true;
+  }
+  m_wake.notify_one();
+  m_thread.join();
+
+  SeriesFooter footer;
+  footer.m_index_offset = static_cast<uint64_t>(m_file.tellp());
+  footer.m_frame_count = m_index.size();
+  m_file.write(reinterpret_cast<const char *>(m_index.data()),
+               m_index.size() * sizeof(TimeSeriesIndexEntry));
+  m_file.write(reinterpret_cast<const char *>(&footer), sizeof(footer));
+  m_file.close();
+  if (!m_file) {
+    std::cerr << "Couldn't write the time series " << m_cfg.m_path << "\n";
+  }
+  if (m_dropped > 0) {
+    std::cerr << "The time series " << m_cfg.m_path << " dropped " << m_dropped
+              << " frames the disk fell behind on\n";
+  }
+  if (m_spilled > 0) {
+    std::cerr << "The time series " << m_cfg.m_path << " queued " << m_spilled
+              << " frames past its depth of " << m_cfg.m_queue_depth
+              << " while the disk fell behind\n";
+  }
+}
+
+uint64_t TimeSeriesWriter::getFrameCount() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_frames;
+}
+
+uint64_t TimeSeriesWriter::getStoredBytes() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stored_bytes;
+}
+
+uint64_t TimeSeriesWriter::getDroppedCount() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_dropped;
+}
+
+uint64_t TimeSeriesWriter::getSpilledCount() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_spilled;
+}
+
+void TimeSeriesWriter::loop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_wake.wait(lock, [this] { return !m_queue.empty() || m_quit; });
+    // Queued frames are still written on the way out
+    if (m_queue.empty()) {
+      return;
+    }
+    Frame frame = std::move(m_queue.front());
+    m_queue.pop_front();
+
+    lock.unlock();
+    const uint64_t before = static_cast<uint64_t>(m_file.tellp());
+    encode(frame);
+    const uint64_t stored = static_cast<uint64_t>(m_file.tellp()) - before;
+    lock.lock();
+
+    ++m_frames;
+    m_stored_bytes += stored;
+    m_free.push_back(std::move(frame.m_values));
+  }
+}
+
+void TimeSeriesWriter::encode(const Frame &frame) {
+  if (m_failed) {
+    return;
+  }
+
+  const size_t count = m_vertex_count;
+  const size_t order =
+      predictionOrder(m_index.size(), m_cfg.m_keyframe_interval);
+  const bool key = order == 0;
+  const int dropped = 23 - m_cfg.m_mantissa_bits;
+  const float *__restrict__ values = frame.m_values.data();
+  uint32_t *__restrict__ previous = m_previous.data();
+  uint32_t *__restrict__ before = m_before.data();
+  uint8_t *__restrict__ planes = m_shuffled.data();
+
+  // Predictions wrap around like the decoder's, so any residual round trips
+  uint32_t neighbour = 0;
+  for (size_t v = 0; v < count; ++v) {
+    const uint32_t bits = roundMantissa(values[v], dropped);
+    const uint32_t prediction =
+        key ? neighbour
+            : order == 1 ? previous[v] : 2 * previous[v] - before[v];
+    const int32_t delta = static_cast<int32_t>(bits - prediction);
+    const uint32_t zigzag = static_cast<uint32_t>(delta) << 1 ^
+                            static_cast<uint32_t>(delta >> 31);
+    planes[v] = static_cast<uint8_t>(zigzag);
+    planes[count + v] = static_cast<uint8_t>(zigzag >> 8);
+    planes[2 * count + v] = static_cast<uint8_t>(zigzag >> 16);
+    planes[3 * count + v] = static_cast<uint8_t>(zigzag >> 24);
+    before[v] = previous[v];
+    previous[v] = bits;
+    neighbour = bits;
+  }
+  const size_t size =
+      compressBlock(m_shuffled.data(), m_shuffled.size(), m_compressed.data());
+
+  TimeSeriesChunk chunk;
+  chunk.m_time = frame.m_time;
+  chunk.m_frame = static_cast<uint32_t>(m_index.size());
+  chunk.m_flags = key ? kKeyframe : 0;
+  chunk.m_size = static_cast<uint32_t>(size);
+  chunk.m_skipped = frame.m_skipped;
+
+  TimeSeriesIndexEntry entry;
+  entry.m_time = chunk.m_time;
+  entry.m_offset = static_cast<uint64_t>(m_file.tellp());
+  entry.m_flags = chunk.m_flags;
+  entry.m_size = chunk.m_size;
+  entry.m_skipped = chunk.m_skipped;
+
+  m_file.write(reinterpret_cast<const char *>(&chunk), sizeof(chunk));
+  m_file.write(reinterpret_cast<const char *>(m_compressed.data()), size);
+  if (!m_file) {
+    // Frames after a failed write could not be decoded, stop here
+    std::cerr << "Couldn't write the time series " << m_cfg.m_path << "\n";
+    m_failed = true;
+    return;
+  }
+  m_index.push_back(entry);
+}
+
+TimeSeriesReader::TimeSeriesReader(const std::string &path)
+    : m_file(path, std::ios::binary) {
+  if (!m_file) {
+    throw std::runtime_error("Can't open " + path);
+  }
+  SeriesHeader header;
+  m_file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!m_file || header.m_magic != kSeriesMagic ||
+      header.m_version != kSeriesVersion) {
+    throw std::runtime_error(path + " is not a time series of this version");
+  }
+  m_vertex_count = header.m_vertex_count;
+  m_keyframe_interval = header.m_keyframe_interval;
+  m_dropped_bits = 23 - static_cast<int>(header.m_mantissa_bits);
+  if (m_keyframe_interval == 0 || m_dropped_bits < 0 || m_dropped_bits > 22) {
+    throw std::runtime_error(path + " is not a time series of this version");
+  }
+  m_bits.resize(m_vertex_count);
+  m_before.resize(m_vertex_count);
+  m_shuffled.resize(m_vertex_count * sizeof(uint32_t));
+
+  m_file.seekg(0, std::ios::end);
+  const uint64_t file_size = static_cast<uint64_t>(m_file.tellg());
+  SeriesFooter footer;
+  if (file_size >= sizeof(header) + sizeof(footer)) {
+    m_file.seekg(file_size - sizeof(footer));
+    m_file.read(reinterpret_cast<char *>(&footer), sizeof(footer));
+  }
+  const bool indexed =
+      m_file && footer.m_magic == kSeriesMagic &&
+      footer.m_version == kSeriesVersion &&
+      footer.m_index_offset + footer.m_frame_count *
+                                  sizeof(TimeSeriesIndexEntry) ==
+          file_size - sizeof(footer);
+  if (indexed) {
+    m_index.resize(footer.m_frame_count);
+    m_file.seekg(footer.m_index_offset);
+    m_file.read(reinterpret_cast<char *>(m_index.data()),
+                m_index.size() * sizeof(TimeSeriesIndexEntry));
+    return;
+  }
+
+  // No index, walk the chunks up to the last complete one
+  m_file.clear();
+  uint64_t offset = sizeof(header);
+  TimeSeriesChunk chunk;
+  while (offset + sizeof(chunk) <= file_size) {
+    m_file.seekg(offset);
+    m_file.read(reinterpret_cast<char *>(&chunk), sizeof(chunk));
+    if (!m_file || chunk.m_frame != m_index.size() ||
+        offset + sizeof(chunk) + chunk.m_size > file_size) {
+      break;
+    }
+    m_index.push_back({chunk.m_time, offset, chunk.m_flags, chunk.m_size,
+                       chunk.m_skipped});
+    offset += sizeof(chunk) + chunk.m_size;
+  }
+  m_file.clear();
+}
+
+size_t TimeSeriesReader::findFrame(double time) const {
+  const auto it = std::upper_bound(
+      m_index.begin(), m_index.end(), time,
+      [](double t, const TimeSeriesIndexEntry &entry) {
+        return t < entry.m_time;
+      });
+  return it == m_index.begin()
+             ? 0
+             : static_cast<size_t>(it - m_index.begin()) - 1;
+}
+
+void TimeSeriesReader::readFrame(size_t frame,
+                                 std::vector<float> &temperature) {
+  if (frame >= m_index.size()) {
+    throw std::runtime_error("Time series frame out of range");
+  }
+
+  // Continue from the decoded frame when the keyframe is not closer
+  size_t key = frame;
+  while (!(m_index[key].m_flags & kKeyframe)) {
+    --key;
+  }
+  const size_t first =
+      m_decoded != SIZE_MAX && m_decoded >= key && m_decoded <= frame
+          ? m_decoded + 1
+          : key;
+  for (size_t f = first; f <= frame; ++f) {
+    decode(f);
+  }
+
+  temperature.resize(m_vertex_count);
+  for (size_t v = 0; v < m_vertex_count; ++v) {
+    const uint32_t bits = m_bits[v] << m_dropped_bits;
+    std::memcpy(&temperature[v], &bits, sizeof(bits));
+  }
+}
+
+void TimeSeriesReader::decode(size_t frame) {
+  const TimeSeriesIndexEntry &entry = m_index[frame];
+  m_compressed.resize(entry.m_size);
+  m_file.seekg(entry.m_offset + sizeof(TimeSeriesChunk));
+  m_file.read(reinterpret_cast<char *>(m_compressed.data()), entry.m_size);
+  if (!m_file || !decompressBlock(m_compressed.data(), entry.m_size,
+                                  m_shuffled.data(), m_shuffled.size())) {
+    m_file.clear();
+    m_decoded = SIZE_MAX;
+    throw std::runtime_error("Corrupt time series frame " +
+                             std::to_string(frame));
+  }
+
+  const size_t count = m_vertex_count;
+  const size_t order = predictionOrder(frame, m_keyframe_interval);
+  const bool key = order == 0;
+  const uint8_t *__restrict__ planes = m_shuffled.data();
+  uint32_t *__restrict__ bits = m_bits.data();
+  uint32_t *__restrict__ before = m_before.data();
+  uint32_t neighbour = 0;
+  for (size_t v = 0; v < count; ++v) {
+    const uint32_t zigzag = planes[v] |
+                            static_cast<uint32_t>(planes[count + v]) << 8 |
+                            static_cast<uint32_t>(planes[2 * count + v]) << 16 |
+                            static_cast<uint32_t>(planes[3 * count + v]) << 24;
+    const uint32_t delta = zigzag >> 1 ^ (0u - (zigzag & 1));
+    const uint32_t prediction =
+        key ? neighbour : order == 1 ? bits[v] : 2 * bits[v] - before[v];
+    before[v] = bits[v];
+    bits[v] = prediction + delta;
+    neighbour = bits[v];
+  }
+  m_decoded = frame;
+}
+
+} // namespace simulator
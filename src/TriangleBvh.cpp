@@ -0,0 +1,839 @@
+#include "TriangleBvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <ThreadPool.hpp>
+
+// Centroid bins per axis of a split
+static constexpr int kBins = 16;
+// Leaves are always split past this many triangles
+static constexpr uint32_t kMaxLeafSize = 8;
+// A node test costs about as much as this many triangle tests
+static constexpr float kTraversalCost = 1.f;
+// Nodes this deep become leaves, so the traversal stack never overflows
+static constexpr int kMaxDepth = 56;
+static constexpr int kStackSize = 64;
+// Nodes with more triangles bin on the whole pool, in chunks of the grain
+static constexpr uint32_t kParallelBinning = 1 << 16;
+static constexpr uint32_t kBinningGrain = 1 << 14;
+// Subtrees built in parallel hold at least this many triangles
+static constexpr uint32_t kMinSubtree = 1024;
+// Rays traced together, the lane loops vectorize over them
+static constexpr size_t kPacketSize = 8;
+// Shadow rays end this fraction of their length before the point
+static constexpr float kEndTolerance = 1e-4f;
+// Smaller determinants are rays in the plane of the triangle
+static constexpr float kMinDeterminant = 1e-20f;
+// Stands in for a zero direction component, so slabs never see 0 * inf
+static constexpr float kMinDirection = 1e-30f;
+
+namespace simulator {
+
+namespace {
+
+struct Bounds {
+  glm::vec3 m_min{std::numeric_limits<float>::max()};
+  glm::vec3 m_max{-std::numeric_limits<float>::max()};
+
+  void grow(const glm::vec3 &point) {
+    m_min = glm::min(m_min, point);
+    m_max = glm::max(m_max, point);
+  }
+
+  void grow(const Bounds &bounds) {
+    m_min = glm::min(m_min, bounds.m_min);
+    m_max = glm::max(m_max, bounds.m_max);
+  }
+
+  /**
+   * @brief area Half the surface area, 0 for empty bounds
+   */
+  float area() const {
+    const glm::vec3 e = glm::max(m_max - m_min, glm::vec3(0.f));
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+  }
+};
+
+/**
+ * Bounds of the triangles of a node and of their centroids
+ */
+struct NodeExtent {
+  Bounds m_bounds;
+  Bounds m_centroids;
+
+  void merge(const NodeExtent &other) {
+    m_bounds.grow(other.m_bounds);
+    m_centroids.grow(other.m_centroids);
+  }
+};
+
+struct Bin {
+  Bounds m_bounds;
+  uint32_t m_count = 0;
+};
+
+struct BinSet {
+  Bin m_bins[3][kBins];
+
+  void merge(const BinSet &other) {
+    for (int axis = 0; axis < 3; ++axis) {
+      for (int b = 0; b < kBins; ++b) {
+        m_bins[axis][b].m_bounds.grow(other.m_bins[axis][b].m_bounds);
+        m_bins[axis][b].m_count += other.m_bins[axis][b].m_count;
+      }
+    }
+  }
+};
+
+/**
+ * Triangle as the build sees it. References are partitioned themselves,
+ * rather than indices to them, so every pass reads memory in order.
+ */
+struct Reference {
+  Bounds m_bounds;
+  uint32_t m_triangle = 0;
+
+  glm::vec3 centroid() const {
+    return 0.5f * (m_bounds.m_min + m_bounds.m_max);
+  }
+};
+
+using BuildInput = std::vector<Reference>;
+
+enum SplitKind { LEAF, BINNED, MEDIAN };
+
+struct Split {
+  Bounds m_bounds; ///< Of the node
+  SplitKind m_kind = LEAF;
+  int m_axis = 0;
+  int m_bin = 0; ///< Last bin on the left
+  int m_bin_count = kBins;
+  float m_bin_min = 0.f;
+  float m_bin_scale = 0.f;
+};
+
+/**
+ * @brief reduceRange Runs fn over [begin, end) in chunks and merges their
+ * partial results, on the pool if parallel
+ */
+template <typename T, typename Fn>
+T reduceRange(uint32_t begin, uint32_t end, bool parallel, const Fn &fn) {
+  if (!parallel) {
+    T result;
+    fn(begin, end, result);
+    return result;
+  }
+  const size_t chunks = (end - begin + kBinningGrain - 1) / kBinningGrain;
+  std::vector<T> partial(chunks);
+  ThreadPool::getInstance().parallelFor(0, chunks, [&](size_t c_begin,
+                                                       size_t c_end) {
+    for (size_t c = c_begin; c < c_end; ++c) {
+      const uint32_t b = begin + static_cast<uint32_t>(c) * kBinningGrain;
+      fn(b, std::min(end, b + kBinningGrain), partial[c]);
+    }
+  });
+  for (size_t c = 1; c < chunks; ++c) {
+    partial[0].merge(partial[c]);
+  }
+  return partial[0];
+}
+
+int binOf(const Split &split, const glm::vec3 &centroid) {
+  const int bin = static_cast<int>(
+      (centroid[split.m_axis] - split.m_bin_min) * split.m_bin_scale);
+  return std::min(std::max(bin, 0), split.m_bin_count - 1);
+}
+
+/**
+ * @brief findSplit Bins the centroids along every axis and picks the
+ * cheapest split by the surface area heuristic, or a leaf if that is cheaper
+ */
+Split findSplit(const BuildInput &in, uint32_t begin, uint32_t end, int depth,
+                bool parallel) {
+  const NodeExtent extent = reduceRange<NodeExtent>(
+      begin, end, parallel, [&](uint32_t b, uint32_t e, NodeExtent &out) {
+        for (uint32_t i = b; i < e; ++i) {
+          out.m_bounds.grow(in[i].m_bounds);
+          out.m_centroids.grow(in[i].centroid());
+        }
+      });
+
+  Split split;
+  split.m_bounds = extent.m_bounds;
+  const uint32_t count = end - begin;
+  if (count <= 1 || depth >= kMaxDepth) {
+    return split;
+  }
+
+  // Small nodes need fewer bins, which is most of them
+  const int bin_count = static_cast<int>(std::min<uint32_t>(kBins, count));
+  const glm::vec3 c_min = extent.m_centroids.m_min;
+  const glm::vec3 c_span = extent.m_centroids.m_max - c_min;
+  glm::vec3 scale(0.f);
+  for (int axis = 0; axis < 3; ++axis) {
+    // Just under the bin count, the largest centroid lands in the last bin
+    scale[axis] =
+        c_span[axis] > 0.f ? bin_count * 0.9999f / c_span[axis] : 0.f;
+  }
+  const BinSet bins = reduceRange<BinSet>(
+      begin, end, parallel, [&](uint32_t b, uint32_t e, BinSet &out) {
+        for (uint32_t i = b; i < e; ++i) {
+          const glm::vec3 centroid = in[i].centroid();
+          for (int axis = 0; axis < 3; ++axis) {
+            const int bin = std::min(
+                static_cast<int>((centroid[axis] - c_min[axis]) * scale[axis]),
+                bin_count - 1);
+            out.m_bins[axis][bin].m_bounds.grow(in[i].m_bounds);
+            ++out.m_bins[axis][bin].m_count;
+          }
+        }
+      });
+
+  // Costs relative to the area of the node, one unit per triangle test
+  float best_cost = std::numeric_limits<float>::max();
+  for (int axis = 0; axis < 3; ++axis) {
+    if (scale[axis] == 0.f) {
+      continue;
+    }
+    const Bin *axis_bins = bins.m_bins[axis];
+    float left_cost[kBins];
+    Bounds left;
+    uint32_t left_count = 0;
+    for (int b = 0; b < bin_count - 1; ++b) {
+      left.grow(axis_bins[b].m_bounds);
+      left_count += axis_bins[b].m_count;
+      left_cost[b] = left.area() * left_count;
+    }
+    Bounds right;
+    uint32_t right_count = 0;
+    for (int b = bin_count - 1; b > 0; --b) {
+      right.grow(axis_bins[b].m_bounds);
+      right_count += axis_bins[b].m_count;
+      if (right_count == 0 || right_count == count) {
+        continue;
+      }
+      const float cost = left_cost[b - 1] + right.area() * right_count;
+      if (cost < best_cost) {
+        best_cost = cost;
+        split.m_axis = axis;
+        split.m_bin = b - 1;
+      }
+    }
+  }
+
+  const float area = split.m_bounds.area();
+  const bool split_cheaper =
+      kTraversalCost * area + best_cost < static_cast<float>(count) * area;
+  if (best_cost < std::numeric_limits<float>::max() &&
+      (split_cheaper || count > kMaxLeafSize)) {
+    split.m_kind = BINNED;
+    split.m_bin_min = c_min[split.m_axis];
+    split.m_bin_scale = scale[split.m_axis];
+    split.m_bin_count = bin_count;
+  } else if (count > kMaxLeafSize) {
+    // Every centroid in one point, any halving is as good as another
+    split.m_kind = MEDIAN;
+  }
+  return split;
+}
+
+uint32_t partitionRange(BuildInput &in, uint32_t begin, uint32_t end,
+                        const Split &split) {
+  if (split.m_kind == MEDIAN) {
+    return begin + (end - begin) / 2;
+  }
+  Reference *refs = in.data();
+  const uint32_t middle = static_cast<uint32_t>(
+      std::partition(refs + begin, refs + end,
+                     [&](const Reference &ref) {
+                       return binOf(split, ref.centroid()) <= split.m_bin;
+                     }) -
+      refs);
+  // Rounding may bin a centroid on the edge differently than findSplit did
+  return middle == begin || middle == end ? begin + (end - begin) / 2
+                                          : middle;
+}
+
+void setBounds(BvhNode &node, const Bounds &bounds) {
+  node.m_min = bounds.m_min;
+  node.m_max = bounds.m_max;
+}
+
+/**
+ * @brief buildSubtree Serial build below node, children are appended
+ */
+void buildSubtree(BuildInput &in, std::vector<BvhNode> &nodes, uint32_t node,
+                  uint32_t begin, uint32_t end, int depth) {
+  const Split split = findSplit(in, begin, end, depth, false);
+  setBounds(nodes[node], split.m_bounds);
+  if (split.m_kind == LEAF) {
+    nodes[node].m_first = begin;
+    nodes[node].m_count = end - begin;
+    return;
+  }
+  const uint32_t middle = partitionRange(in, begin, end, split);
+  const uint32_t left = static_cast<uint32_t>(nodes.size());
+  nodes.resize(nodes.size() + 2);
+  nodes[node].m_first = left;
+  nodes[node].m_count = 0;
+  buildSubtree(in, nodes, left, begin, middle, depth + 1);
+  buildSubtree(in, nodes, left + 1, middle, end, depth + 1);
+}
+
+struct BuildTask {
+  uint32_t m_node;
+  uint32_t m_begin;
+  uint32_t m_end;
+  int m_depth;
+};
+
+} // namespace
+
+void TriangleBvh::build(const std::vector<model::Model> &models) {
+  // World space corners of every triangle
+  std::vector<glm::vec3> a, b, c;
+  m_model.clear();
+  m_material.clear();
+  m_positions.clear();
+  for (uint32_t m = 0; m < models.size(); ++m) {
+    const glm::vec3 &position = models[m].getPosition();
+    m_positions.push_back(position);
+    for (const auto &mesh : models[m].getMeshVec()) {
+      const auto &vertices = mesh.getVertPositions();
+      const auto &indices = mesh.getVertIndices();
+      // Six times the signed volume, negative for a mesh wound inwards
+      float volume = 0.f;
+      for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        volume += glm::dot(vertices[indices[i]],
+                           glm::cross(vertices[indices[i + 1]],
+                                      vertices[indices[i + 2]]));
+      }
+      const size_t second = volume < 0.f ? 2 : 1;
+      for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        a.push_back(vertices[indices[i]] + position);
+        b.push_back(vertices[indices[i + second]] + position);
+        c.push_back(vertices[indices[i + 3 - second]] + position);
+        m_model.push_back(m);
+        m_material.push_back(mesh.m_material_index);
+      }
+    }
+  }
+  buildTriangles(a, b, c);
+}
+
+void TriangleBvh::build(const std::vector<glm::vec3> &corners,
+                        const std::vector<uint32_t> &groups) {
+  if (corners.size() != 3 * groups.size()) {
+    throw std::runtime_error("A BVH needs three corners per triangle");
+  }
+  std::vector<glm::vec3> a, b, c;
+  for (size_t t = 0; t < groups.size(); ++t) {
+    a.push_back(corners[3 * t]);
+    b.push_back(corners[3 * t + 1]);
+    c.push_back(corners[3 * t + 2]);
+  }
+  m_model = groups;
+  m_material.assign(groups.size(), 0);
+  m_positions.clear();
+  buildTriangles(a, b, c);
+}
+
+void TriangleBvh::buildTriangles(const std::vector<glm::vec3> &a,
+                                 const std::vector<glm::vec3> &b,
+                                 const std::vector<glm::vec3> &c) {
+  const uint32_t count = static_cast<uint32_t>(a.size());
+  BuildInput in(count);
+  for (uint32_t t = 0; t < count; ++t) {
+    in[t].m_bounds.grow(a[t]);
+    in[t].m_bounds.grow(b[t]);
+    in[t].m_bounds.grow(c[t]);
+    in[t].m_triangle = t;
+  }
+
+  m_nodes.clear();
+  if (count > 0) {
+    // Split the top on the pool until there are a few subtrees per thread
+    const uint32_t subtree_size = std::max<uint32_t>(
+        kMinSubtree,
+        count / (4 * ThreadPool::getInstance().getThreadCount()));
+    std::vector<BuildTask> pending{{0, 0, count, 0}};
+    std::vector<BuildTask> subtrees;
+    m_nodes.resize(1);
+    while (!pending.empty()) {
+      const BuildTask task = pending.back();
+      pending.pop_back();
+      const uint32_t size = task.m_end - task.m_begin;
+      if (size <= subtree_size) {
+        subtrees.push_back(task);
+        continue;
+      }
+      const Split split = findSplit(in, task.m_begin, task.m_end,
+                                    task.m_depth, size >= kParallelBinning);
+      setBounds(m_nodes[task.m_node], split.m_bounds);
+      if (split.m_kind == LEAF) {
+        m_nodes[task.m_node].m_first = task.m_begin;
+        m_nodes[task.m_node].m_count = size;
+        continue;
+      }
+      const uint32_t middle =
+          partitionRange(in, task.m_begin, task.m_end, split);
+      const uint32_t left = static_cast<uint32_t>(m_nodes.size());
+      m_nodes.resize(m_nodes.size() + 2);
+      m_nodes[task.m_node].m_first = left;
+      pending.push_back({left, task.m_begin, middle, task.m_depth + 1});
+      pending.push_back({left + 1, middle, task.m_end, task.m_depth + 1});
+    }
+
+    // Subtrees cover disjoint ranges of the references, so they build side by
+    // side and are spliced in after their roots
+    std::vector<std::vector<BvhNode>> local(subtrees.size());
+    ThreadPool::getInstance().parallelFor(
+        0, subtrees.size(),
+        [&](size_t s_begin, size_t s_end) {
+          for (size_t s = s_begin; s < s_end; ++s) {
+            const BuildTask &task = subtrees[s];
+            local[s].resize(1);
+            buildSubtree(in, local[s], 0, task.m_begin, task.m_end,
+                         task.m_depth);
+          }
+        },
+        1);
+    for (size_t s = 0; s < subtrees.size(); ++s) {
+      const uint32_t base = static_cast<uint32_t>(m_nodes.size()) - 1;
+      for (BvhNode &node : local[s]) {
+        if (node.m_count == 0) {
+          node.m_first += base;
+        }
+      }
+      m_nodes[subtrees[s].m_node] = local[s].front();
+      m_nodes.insert(m_nodes.end(), local[s].begin() + 1, local[s].end());
+    }
+  }
+
+  // Triangles in leaf order
+  const std::vector<uint32_t> triangle_model = m_model;
+  const std::vector<uint32_t> triangle_material = m_material;
+  for (auto *array : {&m_ax, &m_ay, &m_az, &m_e1x, &m_e1y, &m_e1z, &m_e2x,
+                      &m_e2y, &m_e2z}) {
+    array->resize(count);
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint32_t t = in[i].m_triangle;
+    const glm::vec3 e1 = b[t] - a[t];
+    const glm::vec3 e2 = c[t] - a[t];
+    m_ax[i] = a[t].x;
+    m_ay[i] = a[t].y;
+    m_az[i] = a[t].z;
+    m_e1x[i] = e1.x;
+    m_e1y[i] = e1.y;
+    m_e1z[i] = e1.z;
+    m_e2x[i] = e2.x;
+    m_e2y[i] = e2.y;
+    m_e2z[i] = e2.z;
+    m_model[i] = triangle_model[t];
+    m_material[i] = triangle_material[t];
+  }
+  m_alpha.assign(count, 0.f);
+}
+
+bool TriangleBvh::refit(const std::vector<model::Model> &models) {
+  if (models.size() != m_positions.size()) {
+    throw std::runtime_error("A BVH refits the models it was built over");
+  }
+  std::vector<glm::vec3> delta(models.size());
+  bool moved = false;
+  for (size_t m = 0; m < models.size(); ++m) {
+    delta[m] = models[m].getPosition() - m_positions[m];
+    moved = moved || delta[m] != glm::vec3(0.f);
+    m_positions[m] = models[m].getPosition();
+  }
+  if (!moved || m_nodes.empty()) {
+    return moved;
+  }
+
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(
+      0, m_model.size(),
+      [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+          const glm::vec3 &d = delta[m_model[t]];
+          m_ax[t] += d.x;
+          m_ay[t] += d.y;
+          m_az[t] += d.z;
+        }
+      },
+      kBinningGrain);
+
+  pool.parallelFor(
+      0, m_nodes.size(),
+      [&](size_t begin, size_t end) {
+        for (size_t n = begin; n < end; ++n) {
+          BvhNode &node = m_nodes[n];
+          if (node.m_count == 0) {
+            continue;
+          }
+          Bounds bounds;
+          for (uint32_t t = node.m_first; t < node.m_first + node.m_count;
+               ++t) {
+            const glm::vec3 a(m_ax[t], m_ay[t], m_az[t]);
+            bounds.grow(a);
+            bounds.grow(a + glm::vec3(m_e1x[t], m_e1y[t], m_e1z[t]));
+            bounds.grow(a + glm::vec3(m_e2x[t], m_e2y[t], m_e2z[t]));
+          }
+          setBounds(node, bounds);
+        }
+      },
+      kBinningGrain);
+
+  // Children come after their parent
+  for (size_t n = m_nodes.size(); n-- > 0;) {
+    BvhNode &node = m_nodes[n];
+    if (node.m_count == 0) {
+      const BvhNode &left = m_nodes[node.m_first];
+      const BvhNode &right = m_nodes[node.m_first + 1];
+      node.m_min = glm::min(left.m_min, right.m_min);
+      node.m_max = glm::max(left.m_max, right.m_max);
+    }
+  }
+  return true;
+}
+
+void TriangleBvh::setAttenuation(
+    const std::vector<std::vector<float>> &alpha) {
+  if (alpha.size() != m_positions.size()) {
+    throw std::runtime_error("A BVH takes the materials of its models");
+  }
+  for (size_t t = 0; t < m_model.size(); ++t) {
+    const std::vector<float> &table = alpha[m_model[t]];
+    if (m_material[t] >= table.size()) {
+      throw std::runtime_error("A mesh uses a material its model lacks");
+    }
+    m_alpha[t] = table[m_material[t]];
+  }
+}
+
+void TriangleBvh::visibility(const glm::vec3 &origin,
+                             const float *__restrict__ x,
+                             const float *__restrict__ y,
+                             const float *__restrict__ z, size_t count,
+                             const glm::vec3 &offset,
+                             float *__restrict__ visible) const {
+  if (m_nodes.empty()) {
+    std::fill(visible, visible + count, 1.f);
+    return;
+  }
+
+  const float t_max = 1.f - kEndTolerance;
+  for (size_t begin = 0; begin < count; begin += kPacketSize) {
+    const size_t n = std::min(kPacketSize, count - begin);
+
+    // Rays run from the origin to their point as t goes from 0 to 1. Empty
+    // lanes repeat the first ray and start out finished.
+    float dx[kPacketSize], dy[kPacketSize], dz[kPacketSize];
+    float inv_x[kPacketSize], inv_y[kPacketSize], inv_z[kPacketSize];
+    float active[kPacketSize];
+    for (size_t l = 0; l < kPacketSize; ++l) {
+      const size_t i = begin + (l < n ? l : 0);
+      dx[l] = x[i] + offset.x - origin.x;
+      dy[l] = y[i] + offset.y - origin.y;
+      dz[l] = z[i] + offset.z - origin.z;
+      inv_x[l] = 1.f / (dx[l] != 0.f ? dx[l] : kMinDirection);
+      inv_y[l] = 1.f / (dy[l] != 0.f ? dy[l] : kMinDirection);
+      inv_z[l] = 1.f / (dz[l] != 0.f ? dz[l] : kMinDirection);
+      active[l] = l < n ? 1.f : 0.f;
+    }
+    size_t remaining = n;
+
+    uint32_t stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0 && remaining > 0) {
+      const BvhNode &node = m_nodes[stack[--top]];
+
+      // Slabs, the node corners relative to the origin are shared by the
+      // packet
+      const glm::vec3 lo = node.m_min - origin;
+      const glm::vec3 hi = node.m_max - origin;
+      float hits = 0.f;
+      for (size_t l = 0; l < kPacketSize; ++l) {
+        const float x0 = lo.x * inv_x[l], x1 = hi.x * inv_x[l];
+        const float y0 = lo.y * inv_y[l], y1 = hi.y * inv_y[l];
+        const float z0 = lo.z * inv_z[l], z1 = hi.z * inv_z[l];
+        const float t_near = std::max(
+            std::max(std::min(x0, x1), std::min(y0, y1)),
+            std::max(std::min(z0, z1), 0.f));
+        const float t_far =
+            std::min(std::min(std::max(x0, x1), std::max(y0, y1)),
+                     std::min(std::max(z0, z1), t_max));
+        hits += t_near <= t_far ? active[l] : 0.f;
+      }
+      if (hits == 0.f) {
+        continue;
+      }
+
+      if (node.m_count == 0) {
+        // Nearer child on top of the stack
+        const BvhNode &left = m_nodes[node.m_first];
+        const BvhNode &right = m_nodes[node.m_first + 1];
+        const glm::vec3 left_center = 0.5f * (left.m_min + left.m_max);
+        const glm::vec3 right_center = 0.5f * (right.m_min + right.m_max);
+        const bool left_near = glm::dot(left_center - origin,
+                                        left_center - origin) <=
+                               glm::dot(right_center - origin,
+                                        right_center - origin);
+        stack[top++] = node.m_first + (left_near ? 1 : 0);
+        stack[top++] = node.m_first + (left_near ? 0 : 1);
+        continue;
+      }
+
+      // Moller-Trumbore, the terms of the origin are taken out of the lanes
+      for (uint32_t t = node.m_first;
+           t < node.m_first + node.m_count && remaining > 0; ++t) {
+        const float e1x = m_e1x[t], e1y = m_e1y[t], e1z = m_e1z[t];
+        const float e2x = m_e2x[t], e2y = m_e2y[t], e2z = m_e2z[t];
+        const float sx = origin.x - m_ax[t];
+        const float sy = origin.y - m_ay[t];
+        const float sz = origin.z - m_az[t];
+        const float qx = sy * e1z - sz * e1y;
+        const float qy = sz * e1x - sx * e1z;
+        const float qz = sx * e1y - sy * e1x;
+        const float t_num = e2x * qx + e2y * qy + e2z * qz;
+
+        float occluded = 0.f;
+        for (size_t l = 0; l < kPacketSize; ++l) {
+          const float px = dy[l] * e2z - dz[l] * e2y;
+          const float py = dz[l] * e2x - dx[l] * e2z;
+          const float pz = dx[l] * e2y - dy[l] * e2x;
+          const float det = e1x * px + e1y * py + e1z * pz;
+          const float inv_det = 1.f / det;
+          const float u = (sx * px + sy * py + sz * pz) * inv_det;
+          const float v = (dx[l] * qx + dy[l] * qy + dz[l] * qz) * inv_det;
+          const float hit_t = t_num * inv_det;
+          const bool hit = std::fabs(det) > kMinDeterminant && u >= 0.f &&
+                           v >= 0.f && u + v <= 1.f && hit_t > 0.f &&
+                           hit_t < t_max;
+          const float blocked = hit ? active[l] : 0.f;
+          active[l] -= blocked;
+          occluded += blocked;
+        }
+        remaining -= static_cast<size_t>(occluded);
+      }
+    }
+
+    std::copy(active, active + n, visible + begin);
+  }
+}
+
+void TriangleBvh::opticalDepth(const glm::vec3 &origin,
+                               const float *__restrict__ x,
+                               const float *__restrict__ y,
+                               const float *__restrict__ z, size_t count,
+                               const glm::vec3 &offset,
+                               float *__restrict__ depth) const {
+  for (size_t begin = 0; begin < count; begin += kPacketSize) {
+    const size_t n = std::min(kPacketSize, count - begin);
+
+    // Same packets as the shadow rays, but every crossing counts
+    float dx[kPacketSize], dy[kPacketSize], dz[kPacketSize];
+    float inv_x[kPacketSize], inv_y[kPacketSize], inv_z[kPacketSize];
+    float inside[kPacketSize];
+    for (size_t l = 0; l < kPacketSize; ++l) {
+      const size_t i = begin + (l < n ? l : 0);
+      dx[l] = x[i] + offset.x - origin.x;
+      dy[l] = y[i] + offset.y - origin.y;
+      dz[l] = z[i] + offset.z - origin.z;
+      inv_x[l] = 1.f / (dx[l] != 0.f ? dx[l] : kMinDirection);
+      inv_y[l] = 1.f / (dy[l] != 0.f ? dy[l] : kMinDirection);
+      inv_z[l] = 1.f / (dz[l] != 0.f ? dz[l] : kMinDirection);
+      inside[l] = 0.f;
+    }
+
+    uint32_t stack[kStackSize];
+    int top = 0;
+    if (!m_nodes.empty()) {
+      stack[top++] = 0;
+    }
+    while (top > 0) {
+      const BvhNode &node = m_nodes[stack[--top]];
+      const glm::vec3 lo = node.m_min - origin;
+      const glm::vec3 hi = node.m_max - origin;
+      float hits = 0.f;
+      for (size_t l = 0; l < kPacketSize; ++l) {
+        const float x0 = lo.x * inv_x[l], x1 = hi.x * inv_x[l];
+        const float y0 = lo.y * inv_y[l], y1 = hi.y * inv_y[l];
+        const float z0 = lo.z * inv_z[l], z1 = hi.z * inv_z[l];
+        const float t_near = std::max(
+            std::max(std::min(x0, x1), std::min(y0, y1)),
+            std::max(std::min(z0, z1), 0.f));
+        const float t_far =
+            std::min(std::min(std::max(x0, x1), std::max(y0, y1)),
+                     std::min(std::max(z0, z1), 1.f));
+        hits += t_near <= t_far ? 1.f : 0.f;
+      }
+      if (hits == 0.f) {
+        continue;
+      }
+      if (node.m_count == 0) {
+        stack[top++] = node.m_first;
+        stack[top++] = node.m_first + 1;
+        continue;
+      }
+
+      for (uint32_t t = node.m_first; t < node.m_first + node.m_count; ++t) {
+        const float e1x = m_e1x[t], e1y = m_e1y[t], e1z = m_e1z[t];
+        const float e2x = m_e2x[t], e2y = m_e2y[t], e2z = m_e2z[t];
+        const float sx = origin.x - m_ax[t];
+        const float sy = origin.y - m_ay[t];
+        const float sz = origin.z - m_az[t];
+        const float qx = sy * e1z - sz * e1y;
+        const float qy = sz * e1x - sx * e1z;
+        const float qz = sx * e1y - sy * e1x;
+        const float t_num = e2x * qx + e2y * qy + e2z * qz;
+        const float alpha = m_alpha[t];
+
+        for (size_t l = 0; l < kPacketSize; ++l) {
+          const float px = dy[l] * e2z - dz[l] * e2y;
+          const float py = dz[l] * e2x - dx[l] * e2z;
+          const float pz = dx[l] * e2y - dy[l] * e2x;
+          const float det = e1x * px + e1y * py + e1z * pz;
+          const float inv_det = 1.f / det;
+          const float u = (sx * px + sy * py + sz * pz) * inv_det;
+          const float v = (dx[l] * qx + dy[l] * qy + dz[l] * qz) * inv_det;
+          const float hit_t = t_num * inv_det;
+          const bool hit = std::fabs(det) > kMinDeterminant && u >= 0.f &&
+                           v >= 0.f && u + v <= 1.f && hit_t > 0.f &&
+                           hit_t < 1.f;
+          // det = -dot(d, n), positive where the ray enters
+          const float rest = det > 0.f ? 1.f - hit_t : hit_t - 1.f;
+          inside[l] += hit ? alpha * rest : 0.f;
+        }
+      }
+    }
+
+    for (size_t l = 0; l < n; ++l) {
+      const float span =
+          std::sqrt(dx[l] * dx[l] + dy[l] * dy[l] + dz[l] * dz[l]);
+      depth[begin + l] = std::max(inside[l], 0.f) * span;
+    }
+  }
+}
+
+void TriangleBvh::closestHit(
+    const float *__restrict__ ox, const float *__restrict__ oy,
+    const float *__restrict__ oz, const float *__restrict__ dx,
+    const float *__restrict__ dy, const float *__restrict__ dz,
+    const uint32_t *__restrict__ skip, size_t count, float *__restrict__ t,
+    uint32_t *__restrict__ group) const {
+  // A ray leaving a triangle ignores its group rather than a stretch of its
+  // length, which would lose the hits next to a shared edge
+  const float t_max = 1.f - kEndTolerance;
+  for (size_t begin = 0; begin < count; begin += kPacketSize) {
+    const size_t n = std::min(kPacketSize, count - begin);
+
+    // Empty lanes repeat the first ray, with a nearest hit no node can beat
+    float px[kPacketSize], py[kPacketSize], pz[kPacketSize];
+    float qx[kPacketSize], qy[kPacketSize], qz[kPacketSize];
+    float inv_x[kPacketSize], inv_y[kPacketSize], inv_z[kPacketSize];
+    float nearest[kPacketSize];
+    uint32_t hit_group[kPacketSize];
+    uint32_t skip_group[kPacketSize];
+    for (size_t l = 0; l < kPacketSize; ++l) {
+      const size_t i = begin + (l < n ? l : 0);
+      px[l] = ox[i];
+      py[l] = oy[i];
+      pz[l] = oz[i];
+      qx[l] = dx[i];
+      qy[l] = dy[i];
+      qz[l] = dz[i];
+      inv_x[l] = 1.f / (qx[l] != 0.f ? qx[l] : kMinDirection);
+      inv_y[l] = 1.f / (qy[l] != 0.f ? qy[l] : kMinDirection);
+      inv_z[l] = 1.f / (qz[l] != 0.f ? qz[l] : kMinDirection);
+      nearest[l] = l < n ? t_max : -1.f;
+      hit_group[l] = kMiss;
+      skip_group[l] = skip[i];
+    }
+
+    uint32_t stack[kStackSize];
+    int top = 0;
+    if (!m_nodes.empty()) {
+      stack[top++] = 0;
+    }
+    const glm::vec3 lead(px[0], py[0], pz[0]);
+    while (top > 0) {
+      const BvhNode &node = m_nodes[stack[--top]];
+
+      // Slabs clipped to the nearest hit so far of every lane
+      float hits = 0.f;
+      for (size_t l = 0; l < kPacketSize; ++l) {
+        const float x0 = (node.m_min.x - px[l]) * inv_x[l];
+        const float x1 = (node.m_max.x - px[l]) * inv_x[l];
+        const float y0 = (node.m_min.y - py[l]) * inv_y[l];
+        const float y1 = (node.m_max.y - py[l]) * inv_y[l];
+        const float z0 = (node.m_min.z - pz[l]) * inv_z[l];
+        const float z1 = (node.m_max.z - pz[l]) * inv_z[l];
+        const float t_near = std::max(
+            std::max(std::min(x0, x1), std::min(y0, y1)),
+            std::max(std::min(z0, z1), 0.f));
+        const float t_far =
+            std::min(std::min(std::max(x0, x1), std::max(y0, y1)),
+                     std::min(std::max(z0, z1), nearest[l]));
+        hits += t_near <= t_far ? 1.f : 0.f;
+      }
+      if (hits == 0.f) {
+        continue;
+      }
+
+      if (node.m_count == 0) {
+        // Nearer child to the first ray on top of the stack
+        const BvhNode &left = m_nodes[node.m_first];
+        const BvhNode &right = m_nodes[node.m_first + 1];
+        const glm::vec3 left_center = 0.5f * (left.m_min + left.m_max);
+        const glm::vec3 right_center = 0.5f * (right.m_min + right.m_max);
+        const bool left_near =
+            glm::dot(left_center - lead, left_center - lead) <=
+            glm::dot(right_center - lead, right_center - lead);
+        stack[top++] = node.m_first + (left_near ? 1 : 0);
+        stack[top++] = node.m_first + (left_near ? 0 : 1);
+        continue;
+      }
+
+      // Moller-Trumbore, every lane has an origin of its own
+      for (uint32_t tri = node.m_first; tri < node.m_first + node.m_count;
+           ++tri) {
+        const float e1x = m_e1x[tri], e1y = m_e1y[tri], e1z = m_e1z[tri];
+        const float e2x = m_e2x[tri], e2y = m_e2y[tri], e2z = m_e2z[tri];
+        const float ax = m_ax[tri], ay = m_ay[tri], az = m_az[tri];
+        const uint32_t tri_group = m_model[tri];
+        for (size_t l = 0; l < kPacketSize; ++l) {
+          const float sx = px[l] - ax, sy = py[l] - ay, sz = pz[l] - az;
+          const float cx = qy[l] * e2z - qz[l] * e2y;
+          const float cy = qz[l] * e2x - qx[l] * e2z;
+          const float cz = qx[l] * e2y - qy[l] * e2x;
+          const float wx = sy * e1z - sz * e1y;
+          const float wy = sz * e1x - sx * e1z;
+          const float wz = sx * e1y - sy * e1x;
+          const float det = e1x * cx + e1y * cy + e1z * cz;
+          const float inv_det = 1.f / det;
+          const float u = (sx * cx + sy * cy + sz * cz) * inv_det;
+          const float v = (qx[l] * wx + qy[l] * wy + qz[l] * wz) * inv_det;
+          const float hit_t = (e2x * wx + e2y * wy + e2z * wz) * inv_det;
+          const bool hit = std::fabs(det) > kMinDeterminant && u >= 0.f &&
+                           v >= 0.f && u + v <= 1.f && hit_t > 0.f &&
+                           hit_t < nearest[l] && tri_group != skip_group[l];
+          nearest[l] = hit ? hit_t : nearest[l];
+          hit_group[l] = hit ? tri_group : hit_group[l];
+        }
+      }
+    }
+
+    for (size_t l = 0; l < n; ++l) {
+      t[begin + l] = hit_group[l] == kMiss ? 1.f : nearest[l];
+      group[begin + l] = hit_group[l];
+    }
+  }
+}
+
+} // namespace simulator
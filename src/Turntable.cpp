@@ -0,0 +1,188 @@
+#include "Turntable.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#include <glm/gtc/constants.hpp>
+
+#include <ThreadPool.hpp>
+
+// Points rotated and sampled together
+static constexpr size_t kPointBlock = 4096;
+
+namespace simulator {
+namespace physics {
+
+glm::vec3 turntablePivot(const std::vector<FieldSource> &sources) {
+  return sources.empty() ? glm::vec3() : sources.front().m_position;
+}
+
+double turntableAngle(const TurntableConfig &cfg, double time) {
+  return glm::two_pi<double>() * time / cfg.m_period;
+}
+
+void TurntableCache::build(const FieldProvider &field, const float *x,
+                           const float *y, const float *z, size_t count,
+                           const glm::vec3 &offset, const glm::vec3 &pivot,
+                           const TurntableConfig &cfg) {
+  if (cfg.m_angle_count < 1 || !(cfg.m_period > 0.0) ||
+      glm::dot(cfg.m_axis, cfg.m_axis) <= 0.f) {
+    throw std::runtime_error("Turntable is not configured");
+  }
+
+  // A row of intensities per angle and the revolution row
+  const uint64_t row_bytes = std::max<uint64_t>(count, 1) * sizeof(float);
+  const uint64_t fit = cfg.m_max_cache_bytes / row_bytes;
+  if (fit < 2) {
+    throw std::runtime_error("Turntable cache budget is too small");
+  }
+  int angles = cfg.m_angle_count;
+  if (static_cast<uint64_t>(angles) + 1 > fit) {
+    angles = static_cast<int>(fit - 1);
+    std::cerr << "Turntable cache capped at " << angles << " of "
+              << cfg.m_angle_count << " angles for " << count << " points\n";
+  }
+  m_count = count;
+  m_angles = angles;
+  m_intensity.resize(static_cast<size_t>(angles) * count);
+  m_revolution.resize(count);
+
+  const glm::vec3 axis = glm::normalize(cfg.m_axis);
+  const size_t blocks = (count + kPointBlock - 1) / kPointBlock;
+
+  ThreadPool::getInstance().parallelFor(
+      0, angles * blocks,
+      [&](size_t task_begin, size_t task_end) {
+        std::vector<float> px(kPointBlock), py(kPointBlock), pz(kPointBlock);
+        std::vector<float> re(kPointBlock), im(kPointBlock);
+        for (size_t task = task_begin; task < task_end; ++task) {
+          const size_t a = task / blocks;
+          const size_t begin = (task % blocks) * kPointBlock;
+          const size_t n = std::min(kPointBlock, count - begin);
+          const double angle = glm::two_pi<double>() * a / angles;
+          const float c = static_cast<float>(std::cos(angle));
+          const float s = static_cast<float>(std::sin(angle));
+
+          // Rodrigues, d cos + (axis x d) sin + axis (axis . d)(1 - cos)
+          for (size_t i = 0; i < n; ++i) {
+            const glm::vec3 d =
+                glm::vec3(x[begin + i], y[begin + i], z[begin + i]) + offset -
+                pivot;
+            const glm::vec3 turned = pivot + d * c +
+                                     glm::cross(axis, d) * s +
+                                     axis * (glm::dot(axis, d) * (1.f - c));
+            px[i] = turned.x;
+            py[i] = turned.y;
+            pz[i] = turned.z;
+          }
+          field.samplePhasor(px.data(), py.data(), pz.data(), n, glm::vec3(),
+                             re.data(), im.data());
+
+          float *row = m_intensity.data() + a * count + begin;
+          for (size_t i = 0; i < n; ++i) {
+            row[i] = re[i] * re[i] + im[i] * im[i];
+          }
+        }
+      },
+      1);
+
+  // The trapezoids of a closed revolution weigh every angle once
+  std::fill(m_revolution.begin(), m_revolution.end(), 0.f);
+  float *__restrict__ revolution = m_revolution.data();
+  for (int a = 0; a < angles; ++a) {
+    const float *__restrict__ row = m_intensity.data() + a * count;
+    for (size_t i = 0; i < count; ++i) {
+      revolution[i] += row[i];
+    }
+  }
+}
+
+void TurntableCache::sample(double angle0, double angle1, float *field_re,
+                            float *field_im) const {
+  const double spacing = glm::two_pi<double>() / m_angles;
+  const double u0 = angle0 / spacing;
+  const double u1 = angle1 / spacing;
+
+  // Revolutions are split off in double, so the floats below only ever see
+  // less than one turn and long runs lose no precision
+  const auto locate = [this](double u, double &turns, size_t &row,
+                             float &weight) {
+    turns = std::floor(u / m_angles);
+    const double position = u - turns * m_angles;
+    row = std::min(static_cast<size_t>(position),
+                   static_cast<size_t>(m_angles - 1));
+    weight = static_cast<float>(position - row);
+  };
+  double turns0, turns1;
+  size_t row0, row1;
+  float w0, w1;
+  locate(u0, turns0, row0, w0);
+  locate(u1, turns1, row1, w1);
+
+  const size_t count = m_count;
+  const int angles = m_angles;
+  const float *__restrict__ intensity = m_intensity.data();
+  const float *__restrict__ i0 = intensity + row0 * count;
+  const float *__restrict__ n0 = intensity + ((row0 + 1) % angles) * count;
+  const float *__restrict__ i1 = intensity + row1 * count;
+  const float *__restrict__ n1 = intensity + ((row1 + 1) % angles) * count;
+  const float *__restrict__ full = m_revolution.data();
+  float *__restrict__ re = field_re;
+  float *__restrict__ im = field_im;
+
+  const double span = u1 - u0;
+  // An arc within one interval averages the interpolation at its midpoint,
+  // which also spares the difference of two integrals short steps would
+  // lose to round off
+  const bool within = turns0 == turns1 && row0 == row1;
+  const float midpoint = 0.5f * (w0 + w1);
+  const float turns = static_cast<float>(turns1 - turns0);
+  const float inv_span = within ? 0.f : static_cast<float>(1.0 / span);
+  const float h0 = 0.5f * w0 * w0;
+  const float h1 = 0.5f * w1 * w1;
+  // The whole intervals from row0 to row1 are summed, or those from row1 to
+  // row0 taken off when the arc wraps past angle 0
+  const size_t first = std::min(row0, row1);
+  const size_t last = std::max(row0, row1);
+  const float direction = row1 >= row0 ? 1.f : -1.f;
+
+  ThreadPool::getInstance().parallelFor(
+      0, count,
+      [&](size_t begin, size_t end) {
+        if (within) {
+          for (size_t p = begin; p < end; ++p) {
+            const float value = i0[p] + midpoint * (n0[p] - i0[p]);
+            re[p] = std::sqrt(std::max(value, 0.f));
+            im[p] = 0.f;
+          }
+          return;
+        }
+        // Trapezoids row by row, so the loops over the points vectorize.
+        // The buffer is the thread's own and outlives the call.
+        thread_local std::vector<float> between;
+        between.assign(end - begin, 0.f);
+        float *__restrict__ sum = between.data() - begin;
+        for (size_t a = first; a < last; ++a) {
+          const float *__restrict__ lo = intensity + a * count;
+          const float *__restrict__ hi = intensity + (a + 1) * count;
+          for (size_t p = begin; p < end; ++p) {
+            sum[p] += 0.5f * (lo[p] + hi[p]);
+          }
+        }
+        // Integral of the linear interpolation within the end intervals
+        for (size_t p = begin; p < end; ++p) {
+          const float g0 = w0 * i0[p] + h0 * (n0[p] - i0[p]);
+          const float g1 = w1 * i1[p] + h1 * (n1[p] - i1[p]);
+          const float mean =
+              (turns * full[p] + direction * sum[p] + g1 - g0) * inv_span;
+          re[p] = std::sqrt(std::max(mean, 0.f));
+          im[p] = 0.f;
+        }
+      },
+      1 << 14);
+}
+
+} // namespace physics
+} // namespace simulator
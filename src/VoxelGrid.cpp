@@ -0,0 +1,512 @@
+#include "VoxelGrid.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+#include <ThreadPool.hpp>
+
+namespace simulator {
+
+// Triangles seen edge-on from the z axis never cross a column ray
+static constexpr float kDegenerateArea = 1e-12f;
+
+// Barycentric slack so a ray through a shared edge can't slip between the two
+// triangles, the duplicate crossing it produces is merged afterwards
+static constexpr float kEdgeTolerance = 1e-5f;
+
+// Rows of columns per band of the dense grid, a band is the unit the pool
+// hands out and owns every voxel of its rows, so bands never write the same
+// voxel
+static constexpr int kBandRows = 4;
+
+// Slices of the triangle list binned independently, the bins keep triangle
+// order so the grid doesn't depend on the thread count
+static constexpr size_t kBinChunks = 64;
+
+// Candidate voxels tested against a triangle at once
+static constexpr size_t kShellBlock = 256;
+
+namespace {
+
+/**
+ * Triangles of every mesh of a model under one index, in mesh order
+ */
+struct TriangleIndex {
+  const std::vector<model::Mesh> *m_meshes = nullptr;
+  std::vector<size_t> m_first; ///< Triangle of every mesh, the count last
+
+  uint32_t meshOf(size_t t) const {
+    return static_cast<uint32_t>(
+        std::upper_bound(m_first.begin(), m_first.end(), t) -
+        m_first.begin() - 1);
+  }
+
+  void corners(size_t t, uint32_t mesh, glm::vec3 &a, glm::vec3 &b,
+               glm::vec3 &c) const {
+    const model::Mesh &m = (*m_meshes)[mesh];
+    const auto &positions = m.getVertPositions();
+    const size_t *ind = m.getVertIndices().data() + 3 * (t - m_first[mesh]);
+    a = positions[ind[0]];
+    b = positions[ind[1]];
+    c = positions[ind[2]];
+  }
+
+  /// Of the first corner
+  uint8_t material(size_t t, uint32_t mesh) const {
+    const model::Mesh &m = (*m_meshes)[mesh];
+    return static_cast<uint8_t>(
+        m.m_material.size() == m.getVertPositions().size()
+            ? m.m_material[m.getVertIndices()[3 * (t - m_first[mesh])]]
+            : m.m_material_index);
+  }
+};
+
+/**
+ * Surface crossing of the ray up a column
+ */
+struct Crossing {
+  uint32_t m_column; ///< Within the band
+  uint32_t m_mesh;
+  float m_z;
+  uint8_t m_material;
+};
+
+} // namespace
+
+/**
+ * @brief edgeAxes Projects the corners of a triangle, relative to a cube
+ * center, on x, y and z crossed with one of its edges
+ * @return 1 if any of the three axes separates the two
+ */
+static inline int edgeAxes(const glm::vec3 &e, const float *radius, float v0x,
+                           float v0y, float v0z, float v1x, float v1y,
+                           float v1z, float v2x, float v2y, float v2z) {
+  const float p0 = e.y * v0z - e.z * v0y;
+  const float p1 = e.y * v1z - e.z * v1y;
+  const float p2 = e.y * v2z - e.z * v2y;
+  const float q0 = e.z * v0x - e.x * v0z;
+  const float q1 = e.z * v1x - e.x * v1z;
+  const float q2 = e.z * v2x - e.x * v2z;
+  const float r0 = e.x * v0y - e.y * v0x;
+  const float r1 = e.x * v1y - e.y * v1x;
+  const float r2 = e.x * v2y - e.y * v2x;
+  return (std::min(p0, std::min(p1, p2)) > radius[0]) |
+         (std::max(p0, std::max(p1, p2)) < -radius[0]) |
+         (std::min(q0, std::min(q1, q2)) > radius[1]) |
+         (std::max(q0, std::max(q1, q2)) < -radius[1]) |
+         (std::min(r0, std::min(r1, r2)) > radius[2]) |
+         (std::max(r0, std::max(r1, r2)) < -radius[2]);
+}
+
+/**
+ * @brief overlapBoxes Separating axis test of a triangle against a run of
+ * cubes, the 3 face normals of the cube, the triangle normal and the 9 edge
+ * cross products. Every lane computes every axis, so the loop vectorizes.
+ * @param a
+ * @param b
+ * @param c
+ * @param half Half the edge of the cubes
+ * @param x Of the cube centers
+ * @param y
+ * @param z
+ * @param count
+ * @param hit 1 where the triangle touches the cube
+ */
+static void overlapBoxes(const glm::vec3 &a, const glm::vec3 &b,
+                         const glm::vec3 &c, float half,
+                         const float *__restrict__ x,
+                         const float *__restrict__ y,
+                         const float *__restrict__ z, size_t count,
+                         uint8_t *__restrict__ hit) {
+  const glm::vec3 e[3] = {b - a, c - b, a - c};
+  const glm::vec3 n = glm::cross(e[0], e[1]);
+  const float plane = glm::dot(n, a);
+  const float plane_radius =
+      half * (std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z));
+  float radius[9];
+  for (int k = 0; k < 3; ++k) {
+    radius[3 * k] = half * (std::fabs(e[k].y) + std::fabs(e[k].z));
+    radius[3 * k + 1] = half * (std::fabs(e[k].x) + std::fabs(e[k].z));
+    radius[3 * k + 2] = half * (std::fabs(e[k].x) + std::fabs(e[k].y));
+  }
+
+  for (size_t s = 0; s < count; ++s) {
+    const float v0x = a.x - x[s], v0y = a.y - y[s], v0z = a.z - z[s];
+    const float v1x = b.x - x[s], v1y = b.y - y[s], v1z = b.z - z[s];
+    const float v2x = c.x - x[s], v2y = c.y - y[s], v2z = c.z - z[s];
+
+    // Bitwise ors, a branch per axis would keep the loop scalar
+    int apart = (std::min(v0x, std::min(v1x, v2x)) > half) |
+                (std::max(v0x, std::max(v1x, v2x)) < -half) |
+                (std::min(v0y, std::min(v1y, v2y)) > half) |
+                (std::max(v0y, std::max(v1y, v2y)) < -half) |
+                (std::min(v0z, std::min(v1z, v2z)) > half) |
+                (std::max(v0z, std::max(v1z, v2z)) < -half);
+    apart |= std::fabs(n.x * x[s] + n.y * y[s] + n.z * z[s] - plane) >
+             plane_radius;
+
+    // Axes x, y and z crossed with every edge, spelled out since a loop
+    // over the edges inside the lane loop keeps it from vectorizing
+    apart |= edgeAxes(e[0], radius, v0x, v0y, v0z, v1x, v1y, v1z, v2x, v2y,
+                      v2z) |
+             edgeAxes(e[1], radius + 3, v0x, v0y, v0z, v1x, v1y, v1z, v2x,
+                      v2y, v2z) |
+             edgeAxes(e[2], radius + 6, v0x, v0y, v0z, v1x, v1y, v1z, v2x,
+                      v2y, v2z);
+    hit[s] = static_cast<uint8_t>(apart ^ 1);
+  }
+}
+
+void sizeVoxelGrid(const model::Model &model, int resolution,
+                   VoxelGrid &grid) {
+  if (resolution <= 0) {
+    throw std::runtime_error("Voxel resolution must be positive");
+  }
+  if (model.getMaterialTable().size() > 256) {
+    throw std::runtime_error("Voxels index at most 256 materials");
+  }
+
+  glm::vec3 lo(FLT_MAX);
+  glm::vec3 hi(-FLT_MAX);
+  for (const auto &mesh : model.getMeshVec()) {
+    for (const auto &p : mesh.getVertPositions()) {
+      lo = glm::min(lo, p);
+      hi = glm::max(hi, p);
+    }
+  }
+
+  const glm::vec3 extent = hi - lo;
+  const float longest = std::max(extent.x, std::max(extent.y, extent.z));
+  if (!(longest > 0.f)) {
+    throw std::runtime_error("Can't voxelize an empty model");
+  }
+
+  const float h = longest / resolution;
+  grid.m_spacing = h;
+  grid.m_origin = lo - glm::vec3(h);
+  grid.m_dims.x = static_cast<int>(std::ceil(extent.x / h)) + 2;
+  grid.m_dims.y = static_cast<int>(std::ceil(extent.y / h)) + 2;
+  grid.m_dims.z = static_cast<int>(std::ceil(extent.z / h)) + 2;
+  grid.m_occupancy.clear();
+  grid.m_material.clear();
+}
+
+void voxelizeBands(const model::Model &model, bool shell,
+                   const VoxelGrid &grid, int band_rows,
+                   const std::function<void(int, const VoxelGrid &)> &sink) {
+  if (band_rows <= 0) {
+    throw std::runtime_error("Voxel bands need at least one row");
+  }
+  const float h = grid.m_spacing;
+  const int nx = grid.m_dims.x;
+  const int ny = grid.m_dims.y;
+  const int nz = grid.m_dims.z;
+  const glm::vec3 origin = grid.m_origin;
+  const int bands = (ny + band_rows - 1) / band_rows;
+  ThreadPool &pool = ThreadPool::getInstance();
+
+  TriangleIndex triangles;
+  triangles.m_meshes = &model.getMeshVec();
+  triangles.m_first.push_back(0);
+  for (const auto &mesh : model.getMeshVec()) {
+    triangles.m_first.push_back(triangles.m_first.back() +
+                                mesh.getVertIndices().size() / 3);
+  }
+
+  // Bands of the rows a triangle reaches through a column center or, for
+  // the shell, through any voxel. Empty when it reaches none.
+  auto bandRange = [&](size_t t, int &first, int &last) {
+    glm::vec3 a, b, c;
+    triangles.corners(t, triangles.meshOf(t), a, b, c);
+    const float min_y = (std::min(a.y, std::min(b.y, c.y)) - origin.y) / h;
+    const float max_y = (std::max(a.y, std::max(b.y, c.y)) - origin.y) / h;
+    const int row_lo = std::max(
+        0, static_cast<int>(shell ? std::floor(min_y)
+                                  : std::ceil(min_y - 0.5f)));
+    const int row_hi = std::min(
+        ny - 1, static_cast<int>(shell ? std::floor(max_y)
+                                       : std::floor(max_y - 0.5f)));
+    first = row_lo / band_rows;
+    last = row_lo <= row_hi ? row_hi / band_rows : first - 1;
+  };
+
+  // Triangles binned by the bands of the rows they reach, slice by slice,
+  // so a band reads its triangles in order from the bins of every slice
+  const size_t triangle_count = triangles.m_first.back();
+  const size_t chunk_size = (triangle_count + kBinChunks - 1) / kBinChunks;
+  std::vector<std::vector<uint32_t>> bins(kBinChunks * bands);
+  pool.parallelFor(
+      0, kBinChunks,
+      [&](size_t c_begin, size_t c_end) {
+        for (size_t c = c_begin; c < c_end; ++c) {
+          const size_t t_end = std::min(triangle_count, (c + 1) * chunk_size);
+          for (size_t t = c * chunk_size; t < t_end; ++t) {
+            int first, last;
+            bandRange(t, first, last);
+            for (int b = first; b <= last; ++b) {
+              bins[c * bands + b].push_back(static_cast<uint32_t>(t));
+            }
+          }
+        }
+      },
+      1);
+
+  pool.parallelFor(
+      0, bands,
+      [&](size_t b_begin, size_t b_end) {
+        // Reused band after band, the sink sees every band before the next
+        // one overwrites it
+        VoxelGrid slab;
+        slab.m_spacing = h;
+        std::vector<uint32_t> band_triangles;
+        std::vector<Crossing> crossings;
+        std::vector<Crossing> bucketed;
+        std::vector<size_t> column_cursor;
+        std::vector<float> px(kShellBlock), py(kShellBlock), pz(kShellBlock);
+        std::vector<size_t> slot(kShellBlock);
+        std::vector<uint8_t> touched(kShellBlock);
+
+        for (size_t band = b_begin; band < b_end; ++band) {
+          const int band_lo = static_cast<int>(band) * band_rows;
+          const int band_hi = std::min(ny, band_lo + band_rows) - 1;
+          slab.m_dims = glm::ivec3(nx, band_hi - band_lo + 1, nz);
+          slab.m_origin = origin + glm::vec3(0.f, band_lo * h, 0.f);
+          slab.m_occupancy.assign(slab.size(), 0);
+          slab.m_material.assign(slab.size(), 0);
+
+          band_triangles.clear();
+          for (size_t c = 0; c < kBinChunks; ++c) {
+            const auto &bin = bins[c * bands + band];
+            band_triangles.insert(band_triangles.end(), bin.begin(),
+                                  bin.end());
+          }
+
+          // Height of every surface crossing of the columns of the band
+          crossings.clear();
+          for (const uint32_t t : band_triangles) {
+            const uint32_t mesh = triangles.meshOf(t);
+            glm::vec3 a, b, c;
+            triangles.corners(t, mesh, a, b, c);
+
+            const float det =
+                (b.y - c.y) * (a.x - c.x) + (c.x - b.x) * (a.y - c.y);
+            if (std::fabs(det) < kDegenerateArea) {
+              continue;
+            }
+
+            // Columns whose center falls inside the xy bounding box
+            const float min_x = std::min(a.x, std::min(b.x, c.x));
+            const float max_x = std::max(a.x, std::max(b.x, c.x));
+            const float min_y = std::min(a.y, std::min(b.y, c.y));
+            const float max_y = std::max(a.y, std::max(b.y, c.y));
+            const int i_lo = std::max(
+                0, static_cast<int>(std::ceil((min_x - origin.x) / h - 0.5f)));
+            const int i_hi = std::min(
+                nx - 1,
+                static_cast<int>(std::floor((max_x - origin.x) / h - 0.5f)));
+            const int j_lo = std::max(
+                band_lo,
+                static_cast<int>(std::ceil((min_y - origin.y) / h - 0.5f)));
+            const int j_hi = std::min(
+                band_hi,
+                static_cast<int>(std::floor((max_y - origin.y) / h - 0.5f)));
+
+            for (int j = j_lo; j <= j_hi; ++j) {
+              const float py_j = origin.y + (j + 0.5f) * h;
+              for (int i = i_lo; i <= i_hi; ++i) {
+                const float px_i = origin.x + (i + 0.5f) * h;
+
+                const float w0 = ((b.y - c.y) * (px_i - c.x) +
+                                  (c.x - b.x) * (py_j - c.y)) /
+                                 det;
+                const float w1 = ((c.y - a.y) * (px_i - c.x) +
+                                  (a.x - c.x) * (py_j - c.y)) /
+                                 det;
+                const float w2 = 1.f - w0 - w1;
+                if (w0 < -kEdgeTolerance || w1 < -kEdgeTolerance ||
+                    w2 < -kEdgeTolerance) {
+                  continue;
+                }
+
+                crossings.push_back(
+                    {static_cast<uint32_t>((j - band_lo) * nx + i),
+                     mesh, w0 * a.z + w1 * b.z + w2 * c.z,
+                     triangles.material(t, mesh)});
+              }
+            }
+          }
+
+          // Bucketed by column, then by mesh and height within a column,
+          // both stable so equal crossings keep triangle order
+          const size_t columns = static_cast<size_t>(band_rows) * nx;
+          column_cursor.assign(columns + 1, 0);
+          for (const Crossing &crossing : crossings) {
+            ++column_cursor[crossing.m_column + 1];
+          }
+          for (size_t col = 0; col < columns; ++col) {
+            column_cursor[col + 1] += column_cursor[col];
+          }
+          bucketed.resize(crossings.size());
+          for (const Crossing &crossing : crossings) {
+            bucketed[column_cursor[crossing.m_column]++] = crossing;
+          }
+          crossings.swap(bucketed);
+          for (size_t hit = 1; hit < crossings.size(); ++hit) {
+            const Crossing crossing = crossings[hit];
+            size_t to = hit;
+            while (to > 0 &&
+                   crossings[to - 1].m_column == crossing.m_column &&
+                   (crossings[to - 1].m_mesh > crossing.m_mesh ||
+                    (crossings[to - 1].m_mesh == crossing.m_mesh &&
+                     crossings[to - 1].m_z > crossing.m_z))) {
+              crossings[to] = crossings[to - 1];
+              --to;
+            }
+            crossings[to] = crossing;
+          }
+          // A ray through a shared edge reports the same crossing twice
+          const float merge_distance = kEdgeTolerance * h;
+          crossings.erase(std::unique(crossings.begin(), crossings.end(),
+                                      [merge_distance](const Crossing &l,
+                                                       const Crossing &r) {
+                                        return l.m_column == r.m_column &&
+                                               l.m_mesh == r.m_mesh &&
+                                               r.m_z - l.m_z < merge_distance;
+                                      }),
+                          crossings.end());
+
+          // Inside between every entering and leaving crossing of a mesh,
+          // with the material of the entering triangle
+          for (size_t run = 0; run < crossings.size();) {
+            size_t run_end = run + 1;
+            while (run_end < crossings.size() &&
+                   crossings[run_end].m_column == crossings[run].m_column &&
+                   crossings[run_end].m_mesh == crossings[run].m_mesh) {
+              ++run_end;
+            }
+            const int i = static_cast<int>(crossings[run].m_column % nx);
+            const int j =
+                band_lo + static_cast<int>(crossings[run].m_column / nx);
+            for (size_t hit = run; hit + 1 < run_end; hit += 2) {
+              const int k_lo = std::max(
+                  0, static_cast<int>(std::ceil(
+                         (crossings[hit].m_z - origin.z) / h - 0.5f)));
+              const int k_hi = std::min(
+                  nz - 1, static_cast<int>(std::floor(
+                              (crossings[hit + 1].m_z - origin.z) / h -
+                              0.5f)));
+              for (int k = k_lo; k <= k_hi; ++k) {
+                const size_t v = slab.index(i, j - band_lo, k);
+                slab.m_occupancy[v] = 1;
+                slab.m_material[v] = crossings[hit].m_material;
+              }
+            }
+            run = run_end;
+          }
+
+          if (!shell) {
+            sink(band_lo, slab);
+            continue;
+          }
+
+          // Every voxel a triangle touches, tested in blocks of candidates
+          // from the columns under the triangle, each narrowed to the
+          // heights the triangle plane passes through over it
+          for (const uint32_t t : band_triangles) {
+            const uint32_t mesh = triangles.meshOf(t);
+            glm::vec3 a, b, c;
+            triangles.corners(t, mesh, a, b, c);
+            const glm::vec3 t_lo = (glm::min(a, glm::min(b, c)) - origin) / h;
+            const glm::vec3 t_hi = (glm::max(a, glm::max(b, c)) - origin) / h;
+            const int i_lo = std::max(0, static_cast<int>(t_lo.x));
+            const int i_hi = std::min(nx - 1, static_cast<int>(t_hi.x));
+            const int j_lo = std::max(band_lo, static_cast<int>(t_lo.y));
+            const int j_hi = std::min(band_hi, static_cast<int>(t_hi.y));
+            const int k_lo = std::max(0, static_cast<int>(t_lo.z));
+            const int k_hi = std::min(nz - 1, static_cast<int>(t_hi.z));
+            const glm::vec3 n = glm::cross(b - a, c - a);
+            const bool slanted = std::fabs(n.z) >= kDegenerateArea;
+            const uint8_t material = triangles.material(t, mesh);
+
+            size_t n_candidates = 0;
+            auto flush = [&]() {
+              overlapBoxes(a, b, c, 0.5f * h, px.data(), py.data(),
+                           pz.data(), n_candidates, touched.data());
+              for (size_t s = 0; s < n_candidates; ++s) {
+                if (touched[s] && !slab.m_occupancy[slot[s]]) {
+                  slab.m_occupancy[slot[s]] = 1;
+                  slab.m_material[slot[s]] = material;
+                }
+              }
+              n_candidates = 0;
+            };
+
+            for (int j = j_lo; j <= j_hi; ++j) {
+              for (int i = i_lo; i <= i_hi; ++i) {
+                int kc_lo = k_lo;
+                int kc_hi = k_hi;
+                if (slanted) {
+                  // Plane height over the corners of the column
+                  float z_lo = FLT_MAX;
+                  float z_hi = -FLT_MAX;
+                  for (int corner = 0; corner < 4; ++corner) {
+                    const float x = origin.x + (i + (corner & 1)) * h;
+                    const float y = origin.y + (j + (corner >> 1)) * h;
+                    const float z =
+                        a.z - (n.x * (x - a.x) + n.y * (y - a.y)) / n.z;
+                    z_lo = std::min(z_lo, z);
+                    z_hi = std::max(z_hi, z);
+                  }
+                  kc_lo = std::max(
+                      kc_lo, static_cast<int>(std::max(
+                                 std::floor((z_lo - origin.z) / h), -1.f)));
+                  kc_hi = std::min(
+                      kc_hi, static_cast<int>(std::min(
+                                 std::floor((z_hi - origin.z) / h),
+                                 static_cast<float>(nz))));
+                }
+                for (int k = kc_lo; k <= kc_hi; ++k) {
+                  const glm::vec3 center = grid.center(i, j, k);
+                  px[n_candidates] = center.x;
+                  py[n_candidates] = center.y;
+                  pz[n_candidates] = center.z;
+                  slot[n_candidates++] = slab.index(i, j - band_lo, k);
+                  if (n_candidates == kShellBlock) {
+                    flush();
+                  }
+                }
+              }
+            }
+            flush();
+          }
+          sink(band_lo, slab);
+        }
+      },
+      1);
+}
+
+void voxelizeModel(model::Model &model, int resolution, bool shell,
+                   VoxelGrid &grid) {
+  sizeVoxelGrid(model, resolution, grid);
+  grid.m_occupancy.assign(grid.size(), 0);
+  grid.m_material.assign(grid.size(), 0);
+  voxelizeBands(model, shell, grid, kBandRows,
+                [&grid](int first_row, const VoxelGrid &band) {
+                  // Bands own disjoint rows, so they copy side by side
+                  for (int k = 0; k < band.m_dims.z; ++k) {
+                    for (int j = 0; j < band.m_dims.y; ++j) {
+                      const size_t from = band.index(0, j, k);
+                      const size_t to = grid.index(0, first_row + j, k);
+                      std::copy_n(band.m_occupancy.data() + from,
+                                  band.m_dims.x, grid.m_occupancy.data() + to);
+                      std::copy_n(band.m_material.data() + from,
+                                  band.m_dims.x, grid.m_material.data() + to);
+                    }
+                  }
+                });
+}
+
+} // namespace simulator
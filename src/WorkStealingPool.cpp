@@ -0,0 +1,124 @@
+#include "WorkStealingPool.hpp"
+
+#include <algorithm>
+
+#include <ThreadPool.hpp>
+
+namespace simulator {
+
+// Lets a task find the deque of the worker running it
+static thread_local const WorkStealingPool *t_pool = nullptr;
+static thread_local size_t t_worker = 0;
+
+WorkStealingPool::WorkStealingPool(size_t threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    m_queues.push_back(std::make_unique<Queue>());
+  }
+  m_workers.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    m_workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_work_cv.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void WorkStealingPool::submit(Task task) {
+  const size_t queue = t_pool == this
+                           ? t_worker
+                           : m_next_queue.fetch_add(1) % m_queues.size();
+  // Counted before it is pushed, a worker that claims it early spins until
+  // the push lands instead of missing it
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_unclaimed;
+    ++m_pending;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_queues[queue]->m_mutex);
+    m_queues[queue]->m_tasks.push_back(std::move(task));
+  }
+  m_work_cv.notify_one();
+}
+
+void WorkStealingPool::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done_cv.wait(lock, [this] { return m_pending == 0; });
+  if (m_error) {
+    std::exception_ptr error = m_error;
+    m_error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+bool WorkStealingPool::tryTake(size_t worker, Task &task) {
+  {
+    Queue &own = *m_queues[worker];
+    std::lock_guard<std::mutex> lock(own.m_mutex);
+    if (!own.m_tasks.empty()) {
+      task = std::move(own.m_tasks.back());
+      own.m_tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < m_queues.size(); ++i) {
+    Queue &victim = *m_queues[(worker + i) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(victim.m_mutex);
+    if (!victim.m_tasks.empty()) {
+      task = std::move(victim.m_tasks.front());
+      victim.m_tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::workerLoop(size_t worker) {
+  t_pool = this;
+  t_worker = worker;
+  const ThreadPool::InlineScope inline_kernels;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_work_cv.wait(lock, [this] { return m_stop || m_unclaimed > 0; });
+      if (m_stop) {
+        return;
+      }
+      --m_unclaimed;
+    }
+
+    // The claim guarantees a task, it may still be on its way in
+    Task task;
+    while (!tryTake(worker, task)) {
+      std::this_thread::yield();
+    }
+
+    try {
+      task();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_error) {
+        m_error = std::current_exception();
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_pending == 0) {
+      m_done_cv.notify_all();
+    }
+  }
+}
+
+} // namespace simulator
@@ -1,6 +1,89 @@
 #include <Demo.hpp>
 
+#include <cstring>
+#include <iostream>
+#include <string>
+
 int main(int argc, char **argv) {
+  if (argc > 1 && std::strcmp(argv[1], "--headless") == 0) {
+    try {
+      const double duration = argc > 2 ? std::stod(argv[2]) : 10.0;
+      const double output_interval = argc > 3 ? std::stod(argv[3]) : 1.0;
+      const char *output_dir = argc > 4 ? argv[4] : ".";
+      const double time_step = argc > 5 ? std::stod(argv[5]) : 0.0;
+      const double tolerance = argc > 6 ? std::stod(argv[6]) : 0.0;
+      runHeadlessSimulation(duration, output_interval, output_dir, time_step,
+                            tolerance);
+    } catch (std::exception &ex) {
+      std::cerr << ex.what() << "\n";
+      std::cerr << "Usage: " << argv[0]
+                << " --headless [seconds] [output_interval] [output_dir]"
+                   " [time_step] [tolerance]\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (argc > 1 && std::strcmp(argv[1], "--history") == 0) {
+    try {
+      const char *history_path = argc > 2 ? argv[2] : "history.cmts";
+      const double time = argc > 3 ? std::stod(argv[3]) : 0.0;
+      const char *output_path = argc > 4 ? argv[4] : "frame.bin";
+      extractHistoryFrame(history_path, time, output_path);
+    } catch (std::exception &ex) {
+      std::cerr << ex.what() << "\n";
+      std::cerr << "Usage: " << argv[0]
+                << " --history [history] [seconds] [output]\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (argc > 1 && std::strcmp(argv[1], "--sweep") == 0) {
+    try {
+      const double duration = argc > 2 ? std::stod(argv[2]) : 10.0;
+      const char *output_path = argc > 3 ? argv[3] : "sweep.csv";
+      const size_t threads = argc > 4 ? std::stoul(argv[4]) : 0;
+      runParameterSweep(duration, output_path, threads);
+    } catch (std::exception &ex) {
+      std::cerr << ex.what() << "\n";
+      std::cerr << "Usage: " << argv[0]
+                << " --sweep [seconds] [output_csv] [threads]\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (argc > 1 && std::strcmp(argv[1], "--ensemble") == 0) {
+    try {
+      const size_t members = argc > 2 ? std::stoul(argv[2]) : 64;
+      const double duration = argc > 3 ? std::stod(argv[3]) : 10.0;
+      const char *output_dir = argc > 4 ? argv[4] : ".";
+      runEnsembleSimulation(members, duration, output_dir);
+    } catch (std::exception &ex) {
+      std::cerr << ex.what() << "\n";
+      std::cerr << "Usage: " << argv[0]
+                << " --ensemble [members] [seconds] [output_dir]\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (argc > 1 && std::strcmp(argv[1], "--resume") == 0) {
+    try {
+      const double duration = argc > 2 ? std::stod(argv[2]) : 10.0;
+      const char *checkpoint_path = argc > 3 ? argv[3] : "checkpoint.bin";
+      const double interval = argc > 4 ? std::stod(argv[4]) : 60.0;
+      runResumableSimulation(duration, checkpoint_path, interval);
+    } catch (std::exception &ex) {
+      std::cerr << ex.what() << "\n";
+      std::cerr << "Usage: " << argv[0]
+                << " --resume [seconds] [checkpoint] [interval]\n";
+      return 1;
+    }
+    return 0;
+  }
+
   runSimulation();
   return 0;
 }
@@ -3,9 +3,13 @@
 out vec4 fragment_colour;
 
 in vec2 uv;
+in float heat;
 uniform sampler2D image;
 
 void main()
 {
-        fragment_colour = texture( image, uv );
+        // Yellow -> red ramp blended over the texture as the vertex heats up
+        vec3 heat_colour = mix(vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), heat);
+        vec4 texel = texture( image, uv );
+        fragment_colour = vec4(mix(texel.rgb, heat_colour, heat), texel.a);
 }
@@ -3,6 +3,7 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in float aTemperature;
 
 uniform mat4 model_mat;
 uniform mat4 view_mat;
@@ -10,12 +11,17 @@ uniform mat4 projection_mat;
 // Default values to translation and rotation uniform
 uniform mat4 translation_mat;
 uniform mat4 rotation_mat;
+// Temperatures (K) mapped to the cold and the hot end of the colour ramp
+uniform vec2 temperature_range;
 
 out vec2 uv;
+out float heat;
 
 
 void main()
 {
         uv = aTexCoord;
+        heat = clamp((aTemperature - temperature_range.x) /
+                     (temperature_range.y - temperature_range.x), 0.0, 1.0);
         gl_Position = projection_mat * view_mat * model_mat * rotation_mat * vec4(aPos,1.0) ;
 }
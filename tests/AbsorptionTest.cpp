@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <glm/gtc/constants.hpp>
+
+#include <AbsorptionKernel.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr double kFrequency = 2.45e9; ///< Hz
+
+/**
+ * @brief squaredField Integrates Re(P e^(iwt))^2 over [t0, t0 + dt] with
+ * Simpson's rule, a thousand samples a period
+ * @param re
+ * @param im
+ * @param omega rad/s
+ * @param t0 s
+ * @param dt s
+ * @return V^2 s/m^2
+ */
+static double squaredField(double re, double im, double omega, double t0,
+                           double dt) {
+  const int intervals =
+      2 * static_cast<int>(std::ceil(500.0 * omega * dt /
+                                     glm::two_pi<double>()));
+  const double h = dt / intervals;
+  double sum = 0.0;
+  for (int i = 0; i <= intervals; ++i) {
+    const double phase = omega * (t0 + i * h);
+    const double e = re * std::cos(phase) - im * std::sin(phase);
+    const double weight = i == 0 || i == intervals ? 1.0 : i % 2 ? 4.0 : 2.0;
+    sum += weight * e * e;
+  }
+  return sum * h / 3.0;
+}
+
+/**
+ * @brief cycleAverageIsExact The closed form matches the integral over steps
+ * that end anywhere in a period, and whole periods give |P|^2 dt / 2
+ */
+static void cycleAverageIsExact() {
+  const double omega = glm::two_pi<double>() * kFrequency;
+  const double period = 1.0 / kFrequency;
+  const double re = 3.0, im = -4.0;
+
+  double worst = 0.0;
+  for (const double periods : {0.13, 0.5, 1.0, 2.71, 7.0}) {
+    for (const double start : {0.0, 0.37, 5.9}) {
+      const double t0 = start * period;
+      const double dt = periods * period;
+      const physics::HarmonicFactors f =
+          physics::harmonicFactors(omega, t0, dt, physics::CYCLE_AVERAGED);
+      const double closed = f.m_mean * (re * re + im * im) +
+                            f.m_cos * (re * re - im * im) +
+                            f.m_sin * 2.0 * re * im;
+      const double reference = squaredField(re, im, omega, t0, dt);
+      worst = std::max(worst, std::fabs(closed - reference) / reference);
+    }
+  }
+  test::check(worst <= 1e-6, "cycle average departs from the integral",
+              worst);
+
+  const physics::HarmonicFactors whole = physics::harmonicFactors(
+      omega, 0.37 * period, 1000.0 * period, physics::CYCLE_AVERAGED);
+  const double oscillating =
+      std::max(std::fabs(whole.m_cos), std::fabs(whole.m_sin)) / whole.m_mean;
+  test::check(oscillating <= 1e-6, "whole periods keep an oscillating part",
+              oscillating);
+}
+
+/**
+ * @brief kernelAddsTheIntegral absorbField adds coefficient times the
+ * integral to every temperature, with one coefficient or one per vertex
+ */
+static void kernelAddsTheIntegral() {
+  constexpr size_t kCount = 37;
+  // A step of a few periods adds nK, counted from 0 K so no digit is lost
+  constexpr float kStart = 0.f;         ///< K
+  constexpr float kCoefficient = 1e-7f; ///< K/s per V^2/m^2
+  const double omega = glm::two_pi<double>() * kFrequency;
+  const double t0 = 0.21 / kFrequency;
+  const double dt = 3.4 / kFrequency;
+  const physics::HarmonicFactors factors =
+      physics::harmonicFactors(omega, t0, dt, physics::CYCLE_AVERAGED);
+
+  std::vector<float> field_re(kCount), field_im(kCount);
+  std::vector<float> coefficients(kCount);
+  for (size_t i = 0; i < kCount; ++i) {
+    field_re[i] = 1e4f * std::cos(0.3f * i);
+    field_im[i] = 1e4f * std::sin(0.7f * i);
+    coefficients[i] = kCoefficient * (1.f + 0.1f * i);
+  }
+  std::vector<double> uniform(kCount, kStart), varying(kCount, kStart);
+  physics::absorbField<double>(field_re.data(), field_im.data(),
+                               uniform.data(), kCount, kCoefficient, factors);
+  physics::absorbField<double>(field_re.data(), field_im.data(),
+                               varying.data(), kCount, coefficients.data(),
+                               factors);
+
+  double worst = 0.0;
+  for (size_t i = 0; i < kCount; ++i) {
+    const double integral =
+        squaredField(field_re[i], field_im[i], omega, t0, dt);
+    worst = std::max(worst, std::fabs((uniform[i] - kStart) -
+                                      kCoefficient * integral) /
+                                (kCoefficient * integral));
+    worst = std::max(worst, std::fabs((varying[i] - kStart) -
+                                      coefficients[i] * integral) /
+                                (coefficients[i] * integral));
+  }
+  test::check(worst <= 1e-5, "absorbed heat departs from the integral",
+              worst);
+}
+
+int main() {
+  cycleAverageIsExact();
+  kernelAddsTheIntegral();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
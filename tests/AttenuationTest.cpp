@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <Attenuation.hpp>
+#include <TriangleBvh.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr float kFrequency = 2.45e9f; ///< Hz
+static constexpr float kSide = 0.1f;         ///< m, of the test cube
+static constexpr double kVacuumPermittivity = 8.8541878128e-12; ///< F/m
+static constexpr double kVacuumPermeability = 1.25663706212e-6; ///< H/m
+
+/**
+ * @brief referenceConstant -Im of the complex wavenumber of a lossy
+ * dielectric, w sqrt(mu0 e0 (er - i sigma / (w e0)))
+ * @param conductivity S/m
+ * @param relative_permittivity
+ * @return 1/m
+ */
+static double referenceConstant(double conductivity,
+                                double relative_permittivity) {
+  const double omega = glm::two_pi<double>() * kFrequency;
+  const std::complex<double> permittivity(
+      relative_permittivity, -conductivity / (omega * kVacuumPermittivity));
+  const std::complex<double> k =
+      omega * std::sqrt(kVacuumPermeability * kVacuumPermittivity *
+                        permittivity);
+  return std::fabs(k.imag());
+}
+
+/**
+ * @brief constantMatchesWavenumber The decay rate follows the complex
+ * wavenumber from low-loss dielectrics to water, tends to
+ * sqrt(pi f mu0 sigma) in a good conductor and vanishes without loss
+ */
+static void constantMatchesWavenumber() {
+  double worst = 0.0;
+  const double materials[][2] = {
+      {1e-4, 4.0}, {1e-2, 6.0}, {0.5, 78.0}, {2.0, 50.0}, {50.0, 1.0}};
+  for (const auto &material : materials) {
+    const double alpha = physics::attenuationConstant(
+        static_cast<float>(material[0]), static_cast<float>(material[1]),
+        kFrequency);
+    const double expected = referenceConstant(material[0], material[1]);
+    worst = std::max(worst, std::fabs(alpha - expected) / expected);
+  }
+  test::check(worst <= 1e-5, "alpha departs from the wavenumber", worst);
+
+  const double copper = 5.8e7; ///< S/m
+  const double conductor = std::sqrt(glm::pi<double>() * kFrequency *
+                                     kVacuumPermeability * copper);
+  const double alpha = physics::attenuationConstant(
+      static_cast<float>(copper), 1.f, kFrequency);
+  test::check(std::fabs(alpha - conductor) <= 1e-4 * conductor,
+              "alpha misses the good conductor limit",
+              (alpha - conductor) / conductor);
+  test::check(physics::attenuationConstant(0.f, 4.f, kFrequency) == 0.f,
+              "a lossless dielectric attenuates", 0.0);
+}
+
+/**
+ * @brief makeCube Closed box mesh kSide across, a corner at the origin
+ * @param model
+ * @param conductivity S/m, of its material
+ * @param relative_permittivity
+ */
+static void makeCube(model::Model &model, float conductivity,
+                     float relative_permittivity) {
+  model::Material material;
+  material.m_electrical_conductivity = conductivity;
+  material.m_relative_permittivity = relative_permittivity;
+  model.setMaterial(material);
+  auto &meshes = model.getMeshVec();
+  meshes.resize(1);
+  model::Mesh &mesh = meshes[0];
+  for (int c = 0; c < 8; ++c) {
+    mesh.m_vert_positions.push_back(
+        kSide * glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+  }
+  const unsigned faces[12][3] = {{0, 2, 1}, {1, 2, 3}, {4, 5, 6}, {5, 7, 6},
+                                 {0, 1, 4}, {1, 5, 4}, {2, 6, 3}, {3, 6, 7},
+                                 {0, 4, 2}, {2, 4, 6}, {1, 3, 5}, {3, 7, 5}};
+  for (const auto &face : faces) {
+    mesh.m_vert_indices.insert(mesh.m_vert_indices.end(), face, face + 3);
+  }
+}
+
+/**
+ * @brief powerFollowsLambert Points on a line through the cube, lit from
+ * both ends by sources of different strength, keep e^(-2 alpha d) of each
+ * with d the depth along its ray, and the points past the cube keep what
+ * crossed all of it
+ */
+static void powerFollowsLambert() {
+  constexpr size_t kPoints = 64;
+  // Off the diagonals of the faces, so no ray runs along a shared edge
+  constexpr float kY = 0.3f * kSide, kZ = 0.45f * kSide;
+  std::vector<model::Model> models(1);
+  makeCube(models[0], 1.f, 78.f); // Salted water
+  TriangleBvh bodies;
+  bodies.build(models);
+  bodies.setAttenuation(physics::materialAttenuation(models, kFrequency));
+
+  std::vector<physics::FieldSource> sources(2);
+  sources[0].m_position = glm::vec3(-1.f, kY, kZ);
+  sources[0].m_amplitude = 1e3f;
+  sources[1].m_position = glm::vec3(kSide + 0.5f, kY, kZ);
+  sources[1].m_amplitude = 5e2f;
+  const double weight0 = 0.8, weight1 = 0.2; // By A^2
+
+  const double alpha = physics::attenuationConstant(1.f, 78.f, kFrequency);
+  std::vector<float> x(kPoints), y(kPoints, kY), z(kPoints, kZ);
+  std::vector<float> power(kPoints);
+  for (size_t p = 0; p < kPoints; ++p) {
+    // From just inside the near face to past the far one
+    x[p] = (0.01f + 1.4f * p / kPoints) * kSide;
+  }
+  physics::transmittedPower(bodies, sources, x.data(), y.data(), z.data(),
+                            kPoints, glm::vec3(0.f), power.data());
+
+  double worst = 0.0, deepest = 1.0;
+  for (size_t p = 0; p < kPoints; ++p) {
+    const double depth0 = std::min(x[p], kSide);
+    const double depth1 = std::max(kSide - x[p], 0.f);
+    const double expected = weight0 * std::exp(-2.0 * alpha * depth0) +
+                            weight1 * std::exp(-2.0 * alpha * depth1);
+    worst = std::max(worst, std::fabs(power[p] - expected) / expected);
+    deepest = std::min(deepest, expected);
+  }
+  test::check(deepest < 0.2, "the cube barely attenuates", deepest);
+  test::check(worst <= 1e-4, "transmitted power departs from Lambert's law",
+              worst);
+}
+
+/**
+ * @brief depthSumsBodies A ray through a cube of water and then a ceramic
+ * cube behind it loses alpha d in each at the rate of that body, whatever
+ * the material of the point it ends at
+ */
+static void depthSumsBodies() {
+  constexpr size_t kPoints = 64;
+  constexpr float kY = 0.3f * kSide, kZ = 0.45f * kSide;
+  constexpr float kGap = 0.5f * kSide; ///< m, of air between the cubes
+  std::vector<model::Model> models(2);
+  makeCube(models[0], 0.5f, 78.f);
+  makeCube(models[1], 0.05f, 6.f);
+  models[1].setPosition(glm::vec3(kSide + kGap, 0.f, 0.f));
+  TriangleBvh bodies;
+  bodies.build(models);
+  bodies.setAttenuation(physics::materialAttenuation(models, kFrequency));
+
+  std::vector<physics::FieldSource> sources(1);
+  sources[0].m_position = glm::vec3(-1.f, kY, kZ);
+  sources[0].m_amplitude = 1e3f;
+
+  const double alpha_water =
+      physics::attenuationConstant(0.5f, 78.f, kFrequency);
+  const double alpha_ceramic =
+      physics::attenuationConstant(0.05f, 6.f, kFrequency);
+  std::vector<float> x(kPoints), y(kPoints, kY), z(kPoints, kZ);
+  std::vector<float> power(kPoints);
+  for (size_t p = 0; p < kPoints; ++p) {
+    // From inside the water to past the ceramic
+    x[p] = (0.01f + 3.f * p / kPoints) * kSide;
+  }
+  physics::transmittedPower(bodies, sources, x.data(), y.data(), z.data(),
+                            kPoints, glm::vec3(0.f), power.data());
+
+  double worst = 0.0;
+  for (size_t p = 0; p < kPoints; ++p) {
+    const double water = std::min(x[p], kSide);
+    const double ceramic =
+        std::min(std::max(x[p] - kSide - kGap, 0.f), kSide);
+    const double expected =
+        std::exp(-2.0 * (alpha_water * water + alpha_ceramic * ceramic));
+    worst = std::max(worst, std::fabs(power[p] - expected) / expected);
+  }
+  test::check(alpha_ceramic < 0.5 * alpha_water,
+              "the ceramic attenuates like water", alpha_ceramic);
+  test::check(worst <= 1e-4, "optical depth departs from the sum over bodies",
+              worst);
+}
+
+int main() {
+  constantMatchesWavenumber();
+  powerFollowsLambert();
+  depthSumsBodies();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <CavityModeField.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+namespace fs = std::filesystem;
+
+static constexpr float kFrequency = 2.45e9f; ///< Hz
+// Written at the end of a cache file, no mode sum lands on it
+static constexpr float kSentinel = -1234.5f;
+
+/**
+ * @brief makeConfig Coarse table in a cache directory of its own, emptied
+ * @return
+ */
+static physics::CavityModeConfig makeConfig() {
+  physics::CavityModeConfig cfg;
+  cfg.m_cells_per_wavelength = 8;
+  cfg.m_cache_dir =
+      (fs::temp_directory_path() / "cavity_mode_field_test").string();
+  fs::remove_all(cfg.m_cache_dir);
+  return cfg;
+}
+
+/**
+ * @brief cacheFiles
+ * @param dir
+ * @return Every file in the cache directory, partial files included
+ */
+static std::vector<fs::path> cacheFiles(const std::string &dir) {
+  std::vector<fs::path> files;
+  for (const auto &entry : fs::directory_iterator(dir)) {
+    files.push_back(entry.path());
+  }
+  return files;
+}
+
+/**
+ * @brief cacheReadsBack The first construction writes one table, the second
+ * reads it back bit for bit instead of summing the modes again. The last
+ * value of the file is overwritten in between, only a load can return it.
+ */
+static void cacheReadsBack() {
+  const physics::CavityModeConfig cfg = makeConfig();
+  physics::Cavity cavity;
+  std::vector<physics::FieldSource> sources(1);
+  sources[0].m_position = glm::vec3(0.05f, 0.12f, -0.03f);
+  sources[0].m_amplitude = 300.f;
+
+  const physics::CavityModeField built(cavity, sources, kFrequency, cfg);
+  const std::vector<fs::path> files = cacheFiles(cfg.m_cache_dir);
+  test::check(files.size() == 1, "the build didn't write exactly one file",
+              static_cast<double>(files.size()));
+  if (files.size() != 1) {
+    return;
+  }
+
+  const physics::CavityModeField loaded(cavity, sources, kFrequency, cfg);
+  const physics::FieldTable &a = built.getTable();
+  const physics::FieldTable &b = loaded.getTable();
+  test::check(a.m_dims == b.m_dims && a.m_origin == b.m_origin &&
+                  a.m_spacing == b.m_spacing && a.m_values == b.m_values,
+              "the cached table differs from the built one", 0);
+
+  {
+    std::fstream file(files[0], std::ios::binary | std::ios::in |
+                                    std::ios::out);
+    file.seekp(-static_cast<std::streamoff>(sizeof(float)), std::ios::end);
+    file.write(reinterpret_cast<const char *>(&kSentinel), sizeof(kSentinel));
+  }
+  const physics::CavityModeField tampered(cavity, sources, kFrequency, cfg);
+  test::check(tampered.getTable().m_values.back() == kSentinel,
+              "a matching cache is rebuilt instead of read",
+              tampered.getTable().m_values.back());
+
+  fs::remove_all(cfg.m_cache_dir);
+}
+
+/**
+ * @brief changedSetupRebuilds A moved source or another frequency gets a
+ * file of its own and a table of its own, never the cached one
+ */
+static void changedSetupRebuilds() {
+  const physics::CavityModeConfig cfg = makeConfig();
+  physics::Cavity cavity;
+  std::vector<physics::FieldSource> sources(1);
+  sources[0].m_position = glm::vec3(0.05f, 0.12f, -0.03f);
+  sources[0].m_amplitude = 300.f;
+
+  const physics::CavityModeField original(cavity, sources, kFrequency, cfg);
+  {
+    const fs::path file = cacheFiles(cfg.m_cache_dir).front();
+    std::fstream stream(file, std::ios::binary | std::ios::in |
+                                  std::ios::out);
+    stream.seekp(-static_cast<std::streamoff>(sizeof(float)), std::ios::end);
+    stream.write(reinterpret_cast<const char *>(&kSentinel),
+                 sizeof(kSentinel));
+  }
+
+  std::vector<physics::FieldSource> moved = sources;
+  moved[0].m_position.x += 0.01f;
+  const physics::CavityModeField displaced(cavity, moved, kFrequency, cfg);
+  const physics::CavityModeField detuned(cavity, sources, 0.99f * kFrequency,
+                                         cfg);
+
+  const size_t files = cacheFiles(cfg.m_cache_dir).size();
+  test::check(files == 3, "a changed setup shares a cache file",
+              static_cast<double>(files));
+  test::check(displaced.getTable().m_values.back() != kSentinel &&
+                  displaced.getTable().m_values !=
+                      original.getTable().m_values,
+              "a moved source reads the cached table", 0);
+  test::check(detuned.getTable().m_values.back() != kSentinel &&
+                  detuned.getTable().m_values != original.getTable().m_values,
+              "another frequency reads the cached table", 0);
+
+  fs::remove_all(cfg.m_cache_dir);
+}
+
+/**
+ * @brief edgesAreNodes Every component of every mode vanishes on the edges
+ * of the box, where two metal walls meet, while the interior is lit
+ */
+static void edgesAreNodes() {
+  physics::CavityModeConfig cfg;
+  cfg.m_cells_per_wavelength = 8;
+  cfg.m_cache_dir.clear();
+  physics::Cavity cavity;
+  std::vector<physics::FieldSource> sources(2);
+  sources[0].m_position = glm::vec3(0.05f, 0.12f, -0.03f);
+  sources[0].m_amplitude = 300.f;
+  sources[1].m_position = glm::vec3(-0.11f, 0.1f, 0.07f);
+  sources[1].m_amplitude = 200.f;
+  sources[1].m_phase = 1.f;
+  const physics::CavityModeField field(cavity, sources, kFrequency, cfg);
+  const physics::FieldTable &table = field.getTable();
+
+  // The edges along z through the min corner in x and y
+  float edge = 0.f;
+  for (int k = 0; k < table.m_dims.z; ++k) {
+    edge = std::max(edge, table.m_values[table.index(0, 0, k)]);
+  }
+  const float peak =
+      *std::max_element(table.m_values.begin(), table.m_values.end());
+  test::check(peak > 1.f, "the cavity is dark", peak);
+  test::check(edge <= 1e-6f * peak, "the field reaches an edge of the box",
+              edge / peak);
+}
+
+int main() {
+  cacheReadsBack();
+  changedSetupRebuilds();
+  edgesAreNodes();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
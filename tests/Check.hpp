@@ -0,0 +1,32 @@
+#pragma once
+
+#include <iostream>
+
+namespace simulator {
+namespace test {
+
+/**
+ * @brief failures
+ * @return Checks that failed so far, what main returns
+ */
+inline int &failures() {
+  static int count = 0;
+  return count;
+}
+
+/**
+ * @brief check Reports a failed condition and carries on, so one run lists
+ * every broken claim
+ * @param condition
+ * @param what Printed with the measured value when the check fails
+ * @param value
+ */
+inline void check(bool condition, const char *what, double value) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << " (" << value << ")" << std::endl;
+    ++failures();
+  }
+}
+
+} // namespace test
+} // namespace simulator
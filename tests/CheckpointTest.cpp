@@ -0,0 +1,202 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Checkpoint.hpp>
+#include <Solver.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr char kPath[] = "CheckpointTest.cmck";
+static constexpr float kFrequency = 2.45e9f; ///< Hz
+static constexpr double kStep = 0.5;         ///< s
+
+/**
+ * @brief packedImageReadsBack Sections of any size, empty ones included,
+ * come back from the file bit for bit and with the header they went out with
+ */
+static void packedImageReadsBack() {
+  std::vector<float> floats(1001);
+  std::vector<double> doubles(77);
+  for (size_t i = 0; i < floats.size(); ++i) {
+    floats[i] = std::sin(0.1f * i) * 300.f;
+  }
+  for (size_t i = 0; i < doubles.size(); ++i) {
+    doubles[i] = 1.0 / (i + 1.0);
+  }
+  const std::vector<CheckpointSpan> spans = {
+      {MESH_TEMPERATURE, 0, floats.data(), floats.size() * sizeof(float)},
+      {MESH_ENTHALPY, 0, nullptr, 0},
+      {VOXEL_TEMPERATURE, 3, doubles.data(), doubles.size() * sizeof(double)},
+  };
+  CheckpointHeader header;
+  header.m_timeline = 12.5;
+  header.m_next_step = 0.25;
+  header.m_step_count = 40;
+  header.m_rejected_count = 2;
+  header.m_model_count = 1;
+  header.m_mesh_count = 1;
+
+  std::vector<char> image;
+  packCheckpoint(header, spans, image);
+  {
+    CheckpointWriter writer;
+    writer.submit(kPath, image);
+    writer.flush();
+    test::check(writer.getWrittenCount() == 1, "the image was not written",
+                static_cast<double>(writer.getWrittenCount()));
+  }
+
+  const CheckpointFile file(kPath);
+  const CheckpointHeader &read = file.getHeader();
+  test::check(read.m_timeline == header.m_timeline &&
+                  read.m_next_step == header.m_next_step &&
+                  read.m_step_count == header.m_step_count &&
+                  read.m_rejected_count == header.m_rejected_count &&
+                  read.m_section_count == spans.size(),
+              "the header changed on the way", read.m_timeline);
+
+  size_t count = 0;
+  const float *f = file.findArray<float>(MESH_TEMPERATURE, 0, count);
+  test::check(count == floats.size() &&
+                  std::memcmp(f, floats.data(), count * sizeof(float)) == 0,
+              "a float section changed on the way", static_cast<double>(count));
+  const double *d = file.findArray<double>(VOXEL_TEMPERATURE, 3, count);
+  test::check(count == doubles.size() &&
+                  std::memcmp(d, doubles.data(), count * sizeof(double)) == 0,
+              "a double section changed on the way",
+              static_cast<double>(count));
+  file.findArray<float>(MESH_ENTHALPY, 0, count);
+  test::check(count == 0, "an empty section grew", static_cast<double>(count));
+  file.findArray<float>(MESH_TEMPERATURE, 1, count);
+  test::check(count == 0, "a missing section was found",
+              static_cast<double>(count));
+}
+
+/**
+ * @brief makeModel Closed box mesh 10 cm across, with a second material when
+ * dish is set
+ * @param model
+ * @param dish
+ */
+static void makeModel(model::Model &model, bool dish) {
+  model::MaterialTable table;
+  model::Material food;
+  food.m_density = 1000.f;
+  food.m_thickness = 0.02f;
+  food.m_heat_capacity = 4184.f;
+  food.m_electrical_conductivity = 0.5f;
+  food.m_thermal_conductivity = 0.6f;
+  table.add("", food);
+  if (dish) {
+    model::Material ceramic = food;
+    ceramic.m_density = 2400.f;
+    ceramic.m_electrical_conductivity = 1e-3f;
+    table.add("Dish", ceramic);
+  }
+  model.setMaterials(table);
+
+  auto &meshes = model.getMeshVec();
+  meshes.resize(1);
+  model::Mesh &mesh = meshes[0];
+  for (int c = 0; c < 8; ++c) {
+    mesh.m_vert_positions.push_back(
+        0.1f * glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+  }
+  const unsigned faces[12][3] = {{0, 2, 1}, {1, 2, 3}, {4, 5, 6}, {5, 7, 6},
+                                 {0, 1, 4}, {1, 5, 4}, {2, 6, 3}, {3, 6, 7},
+                                 {0, 4, 2}, {2, 4, 6}, {1, 3, 5}, {3, 7, 5}};
+  for (const auto &face : faces) {
+    mesh.m_vert_indices.insert(mesh.m_vert_indices.end(), face, face + 3);
+  }
+  model.initializeThermalState(model::kRoomTemperature);
+}
+
+static SolverConfig solverConfig() {
+  SolverConfig cfg;
+  physics::FieldSource source;
+  source.m_position = glm::vec3(-0.07f, 0.06f, 0.05f);
+  source.m_amplitude = 1e3f;
+  cfg.m_sources = {source};
+  cfg.m_frequency = kFrequency;
+  cfg.m_time_step = kStep;
+  cfg.m_checkpoint.m_path = kPath;
+  cfg.m_checkpoint.m_interval = 1e9;
+  cfg.m_step_log_path.clear();
+  return cfg;
+}
+
+/**
+ * @brief solverResumesBitForBit A run restored from a checkpoint takes the
+ * same steps as the one that wrote it, and a model with another material
+ * table is turned away
+ */
+static void solverResumesBitForBit() {
+  constexpr int kSteps = 20;
+  const SolverConfig cfg = solverConfig();
+
+  std::vector<model::Model> written(1);
+  makeModel(written.front(), true);
+  std::vector<float> expected;
+  {
+    Solver solver(written, cfg);
+    for (int s = 0; s < kSteps; ++s) {
+      solver.step();
+    }
+    solver.checkpoint();
+    solver.flushCheckpoints();
+    for (int s = 0; s < kSteps; ++s) {
+      solver.step();
+    }
+    expected = written.front().getMeshVec().front().m_temperature;
+  }
+  test::check(expected.front() > model::kRoomTemperature,
+              "the checkpointed model never heats", expected.front());
+
+  std::vector<model::Model> resumed(1);
+  makeModel(resumed.front(), true);
+  {
+    Solver solver(resumed, cfg);
+    solver.restore(CheckpointFile(kPath));
+    test::check(solver.getTimeline() == kSteps * kStep,
+                "the timeline was not restored", solver.getTimeline());
+    for (int s = 0; s < kSteps; ++s) {
+      solver.step();
+    }
+  }
+  const std::vector<float> &actual =
+      resumed.front().getMeshVec().front().m_temperature;
+  test::check(actual.size() == expected.size() &&
+                  std::memcmp(actual.data(), expected.data(),
+                              actual.size() * sizeof(float)) == 0,
+              "the resumed run departs from the written one",
+              actual.front() - expected.front());
+
+  std::vector<model::Model> other(1);
+  makeModel(other.front(), false);
+  bool rejected = false;
+  {
+    Solver solver(other, cfg);
+    try {
+      solver.restore(CheckpointFile(kPath));
+    } catch (const std::runtime_error &) {
+      rejected = true;
+    }
+  }
+  test::check(rejected, "another material table was restored", 0.0);
+}
+
+int main() {
+  packedImageReadsBack();
+  solverResumesBitForBit();
+  std::filesystem::remove(kPath);
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <ConductionSolver.hpp>
+#include <PhasorField.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr float kFrequency = 2.45e9f; ///< Hz
+static constexpr float kSide = 0.1f;         ///< m, of the test cube
+
+/**
+ * @brief addBox Appends a closed box mesh
+ * @param model
+ * @param lo m, corner
+ * @param hi m, opposite corner
+ * @param material Into the material table of the model
+ */
+static void addBox(model::Model &model, const glm::vec3 &lo,
+                   const glm::vec3 &hi, uint32_t material = 0) {
+  auto &meshes = model.getMeshVec();
+  meshes.emplace_back();
+  model::Mesh &mesh = meshes.back();
+  mesh.m_material_index = material;
+  for (int c = 0; c < 8; ++c) {
+    mesh.m_vert_positions.push_back(
+        lo + (hi - lo) * glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+    mesh.m_vert_normals.push_back(glm::vec3(0.f));
+    mesh.m_tex_coords.push_back(glm::vec2(0.f));
+  }
+  const unsigned faces[12][3] = {{0, 2, 1}, {1, 2, 3}, {4, 5, 6}, {5, 7, 6},
+                                 {0, 1, 4}, {1, 5, 4}, {2, 6, 3}, {3, 6, 7},
+                                 {0, 4, 2}, {2, 4, 6}, {1, 3, 5}, {3, 7, 5}};
+  for (const auto &face : faces) {
+    mesh.m_vert_indices.insert(mesh.m_vert_indices.end(), face, face + 3);
+  }
+}
+
+/**
+ * @brief makeCube Closed box mesh kSide across, a corner at the origin
+ * @param model
+ * @param material
+ * @param temperature K, of every vertex
+ */
+static void makeCube(model::Model &model, const model::Material &material,
+                     float temperature = model::kRoomTemperature) {
+  model.setMaterial(material);
+  addBox(model, glm::vec3(0.f), glm::vec3(kSide));
+  model.initializeThermalState(temperature);
+}
+
+static model::Material water() {
+  model::Material material;
+  material.m_density = 1000.f;
+  material.m_thickness = 0.02f;
+  material.m_heat_capacity = 4184.f;
+  material.m_electrical_conductivity = 0.5f;
+  material.m_thermal_conductivity = 0.6f;
+  return material;
+}
+
+/**
+ * @brief ice Water that freezes, with the capacity of ice below the melting
+ * point
+ * @return
+ */
+static model::Material ice() {
+  model::Material material = water();
+  material.m_latent_heat_fusion = 334e3f;
+  material.m_frozen_electrical_conductivity = 5e-4f;
+  material.m_heat_capacity_table = model::makePropertyTable(
+      [](float t) { return t < 273.15f ? 2100.f : 4184.f; }, 200.f, 400.f,
+      201);
+  return material;
+}
+
+/**
+ * @brief ceramic A dish that conducts better and absorbs far less than water
+ * @return
+ */
+static model::Material ceramic() {
+  model::Material material;
+  material.m_density = 2400.f;
+  material.m_thickness = 0.02f;
+  material.m_heat_capacity = 800.f;
+  material.m_electrical_conductivity = 1e-2f;
+  material.m_thermal_conductivity = 1.5f;
+  return material;
+}
+
+/**
+ * @brief makeLayers Water under a ceramic layer of the same thickness, the
+ * two meshes meeting halfway up the cube
+ * @param model
+ * @param conducting Without it neither material conducts heat
+ */
+static void makeLayers(model::Model &model, bool conducting) {
+  model::MaterialTable table;
+  model::Material food = water(), dish = ceramic();
+  if (!conducting) {
+    food.m_thermal_conductivity = dish.m_thermal_conductivity = 0.f;
+  }
+  table.add("", food);
+  table.add("Dish", dish);
+  model.setMaterials(table);
+  addBox(model, glm::vec3(0.f), glm::vec3(kSide, kSide, 0.5f * kSide), 0);
+  addBox(model, glm::vec3(0.f, 0.f, 0.5f * kSide), glm::vec3(kSide), 1);
+  model.initializeThermalState(model::kRoomTemperature);
+}
+
+/**
+ * @brief volumetricHeat
+ * @param model
+ * @param grid
+ * @param v Slot
+ * @return rho * c of the material of the slot, 0 outside the body, J/m^3*K
+ */
+static double volumetricHeat(const model::Model &model, const SparseGrid &grid,
+                             size_t v) {
+  if (!grid.isActive(v)) {
+    return 0.0;
+  }
+  const model::Material &material =
+      model.getMaterialTable().m_materials[grid.getMaterial(v)];
+  return static_cast<double>(material.m_density) * material.m_heat_capacity;
+}
+
+static physics::PhasorField source() {
+  physics::FieldSource source;
+  source.m_position = glm::vec3(-0.07f, 0.06f, 0.05f);
+  source.m_amplitude = 1e3f;
+  return physics::PhasorField({source}, kFrequency);
+}
+
+/**
+ * @brief heat Runs a cube through a field
+ * @param cfg
+ * @param resolution
+ * @param dt s
+ * @param steps
+ * @param material
+ * @param iterations Summed CG iterations, when not null
+ * @return Temperature of every slot, K
+ */
+static std::vector<double> heat(const ConductionConfig &cfg, int resolution,
+                                double dt, int steps,
+                                const model::Material &material,
+                                int *iterations = nullptr) {
+  model::Model model;
+  makeCube(model, material);
+  auto conduction = makeConductionSolver(model, resolution, false, cfg);
+  conduction->sampleField(source());
+  for (int s = 0; s < steps; ++s) {
+    conduction->step(s * dt, dt, kFrequency, physics::CYCLE_AVERAGED);
+    if (iterations) {
+      *iterations += conduction->getLastSolve().m_iterations;
+    }
+  }
+  std::vector<double> temperature(conduction->getTemperatureCount());
+  std::vector<double> enthalpy(conduction->getEnthalpyCount());
+  conduction->getState(temperature.data(), enthalpy.data());
+  return temperature;
+}
+
+/**
+ * @brief crankNicolsonMatchesExplicit A 100x longer implicit step keeps the
+ * heating of the explicit run
+ */
+static void crankNicolsonMatchesExplicit() {
+  ConductionConfig cfg;
+  const std::vector<double> explicit_run =
+      heat(cfg, 32, 0.06, 10000, water());
+  cfg.m_scheme = ConductionScheme::CRANK_NICOLSON;
+  const std::vector<double> implicit_run = heat(cfg, 32, 6.0, 100, water());
+
+  double rise = 0.0, difference = 0.0;
+  for (size_t v = 0; v < explicit_run.size(); ++v) {
+    rise = std::max(rise, explicit_run[v] - model::kRoomTemperature);
+    difference =
+        std::max(difference, std::fabs(explicit_run[v] - implicit_run[v]));
+  }
+  test::check(rise > 1.0, "the test cube barely heats", rise);
+  test::check(difference <= 1.5e-3 * rise,
+              "Crank-Nicolson departs from the explicit run",
+              difference / rise);
+}
+
+/**
+ * @brief multigridIterationsStayFlat The V-cycle needs a few iterations at
+ * any resolution, where Jacobi's grow with it
+ */
+static void multigridIterationsStayFlat() {
+  constexpr int kSteps = 5;
+  ConductionConfig cfg;
+  cfg.m_scheme = ConductionScheme::CRANK_NICOLSON;
+  cfg.m_cg.m_max_iterations = 2000;
+  for (const int resolution : {32, 64}) {
+    int multigrid = 0, jacobi = 0;
+    cfg.m_preconditioner = ConductionPreconditioner::MULTIGRID;
+    heat(cfg, resolution, 60.0, kSteps, water(), &multigrid);
+    cfg.m_preconditioner = ConductionPreconditioner::JACOBI;
+    heat(cfg, resolution, 60.0, kSteps, water(), &jacobi);
+    test::check(multigrid <= 5 * kSteps,
+                "multigrid needs more than 5 iterations a step",
+                double(multigrid) / kSteps);
+    test::check(4 * multigrid <= jacobi,
+                "multigrid saves less than 4x the Jacobi iterations",
+                double(jacobi) / multigrid);
+  }
+}
+
+/**
+ * @brief frozenBlockStaysBounded A checkerboard on frozen voxels, stepped
+ * explicitly at the stability limit of water. Read back through the curve of
+ * ice, with half the capacity, the same sweeps would amplify it.
+ */
+static void frozenBlockStaysBounded() {
+  constexpr double kStart = 253.15;  ///< K
+  constexpr double kAmplitude = 0.5; ///< K
+  model::Model model;
+  makeCube(model, ice(), kStart);
+  auto conduction = makeConductionSolver(model, 16, false, ConductionConfig());
+  const SparseGrid &grid = conduction->getGrid();
+
+  std::vector<double> temperature(conduction->getTemperatureCount());
+  std::vector<double> enthalpy(conduction->getEnthalpyCount());
+  conduction->getState(temperature.data(), enthalpy.data());
+  const model::Material &material = model.getMaterial();
+  for (size_t v = 0; v < temperature.size(); ++v) {
+    const glm::ivec3 c = grid.coord(v);
+    const double sign = (c.x + c.y + c.z) % 2 ? 1.0 : -1.0;
+    temperature[v] = kStart + sign * kAmplitude;
+    const float t = static_cast<float>(temperature[v]);
+    float h = 0.f;
+    material.m_enthalpy_table.lookup(&t, 1, &h);
+    enthalpy[v] = h;
+  }
+  conduction->setState(temperature.data(), enthalpy.data());
+
+  const double diffusivity =
+      material.m_thermal_conductivity /
+      (material.m_density * material.m_heat_capacity);
+  const double dt = 0.99 / 6.0 * grid.m_spacing * grid.m_spacing / diffusivity;
+  for (int s = 0; s < 50; ++s) {
+    conduction->step(s * dt, dt, kFrequency, physics::CYCLE_AVERAGED);
+  }
+
+  conduction->getState(temperature.data(), enthalpy.data());
+  double deviation = 0.0;
+  for (size_t v = 0; v < temperature.size(); ++v) {
+    if (grid.isActive(v)) {
+      deviation = std::max(deviation, std::fabs(temperature[v] - kStart));
+    }
+  }
+  test::check(deviation <= kAmplitude, "frozen voxels run away", deviation);
+}
+
+/**
+ * @brief phaseTablesFollowTheTransitions A material that boils far above
+ * water keeps its curve up to past the boiling point instead of flattening
+ * out at a fixed end
+ */
+static void phaseTablesFollowTheTransitions() {
+  model::Material material = ice();
+  material.m_boiling_temperature = 600.f;
+  material.m_latent_heat_vaporization = 1e6f;
+  model::bakePhaseChange(material);
+
+  // Sensible heat only, well above the boiling point
+  const float t[2] = {650.f, 700.f};
+  float h[2], back[2];
+  material.m_enthalpy_table.lookup(t, 2, h);
+  material.m_temperature_table.lookup(h, 2, back);
+  const double capacity = (h[1] - h[0]) / (t[1] - t[0]);
+  test::check(std::fabs(capacity - material.m_heat_capacity) <=
+                  1e-3 * material.m_heat_capacity,
+              "the enthalpy curve is flat past the boiling point", capacity);
+  test::check(std::fabs(back[1] - t[1]) <= 0.1,
+              "the temperature doesn't read back past the boiling point",
+              back[1]);
+}
+
+/**
+ * @brief singleKeepsSmallIncrements Steps that each add about 1 mK to the
+ * hot voxels heat a float state as far as a double one, since the state is
+ * kept relative to the starting temperature
+ */
+static void singleKeepsSmallIncrements() {
+  constexpr double kDt = 1e-4; ///< s
+  constexpr int kSteps = 20000;
+  ConductionConfig cfg;
+  const std::vector<double> single = heat(cfg, 16, kDt, kSteps, water());
+  cfg.m_precision = Precision::DOUBLE;
+  const std::vector<double> reference = heat(cfg, 16, kDt, kSteps, water());
+
+  double rise = 0.0, difference = 0.0;
+  for (size_t v = 0; v < single.size(); ++v) {
+    rise = std::max(rise, reference[v] - model::kRoomTemperature);
+    difference = std::max(difference, std::fabs(single[v] - reference[v]));
+  }
+  test::check(rise > 4.0, "the test cube barely heats", rise);
+  test::check(difference <= 1e-3 * rise, "float drifts from double",
+              difference / rise);
+}
+
+/**
+ * @brief layersExchangeHeat Hot water under a cold dish, without a field.
+ * Heat crosses the interface, the sum of rho c T stays put, and a 20x longer
+ * implicit step ends where the explicit run does.
+ */
+static void layersExchangeHeat() {
+  constexpr double kHot = 350.0; ///< K
+  constexpr double kTime = 2000.0; ///< s
+  std::vector<double> end[2];
+  double energy[2] = {0.0, 0.0}, dish_rise = 0.0;
+  for (int run = 0; run < 2; ++run) {
+    ConductionConfig cfg;
+    const double dt = run ? 20.0 : 1.0;
+    if (run) {
+      cfg.m_scheme = ConductionScheme::CRANK_NICOLSON;
+    }
+    model::Model model;
+    makeLayers(model, true);
+    auto conduction = makeConductionSolver(model, 16, false, cfg);
+    const SparseGrid &grid = conduction->getGrid();
+    std::vector<double> temperature(conduction->getTemperatureCount());
+    std::vector<double> enthalpy(conduction->getEnthalpyCount());
+    conduction->getState(temperature.data(), enthalpy.data());
+    double start = 0.0;
+    for (size_t v = 0; v < temperature.size(); ++v) {
+      if (grid.isActive(v) && grid.getMaterial(v) == 0) {
+        temperature[v] = kHot;
+      }
+      start += volumetricHeat(model, grid, v) *
+               (temperature[v] - model::kRoomTemperature);
+    }
+    conduction->setState(temperature.data(), enthalpy.data());
+    for (int s = 0; s * dt < kTime; ++s) {
+      conduction->step(s * dt, dt, kFrequency, physics::CYCLE_AVERAGED);
+    }
+
+    end[run].resize(temperature.size());
+    conduction->getState(end[run].data(), enthalpy.data());
+    double finish = 0.0;
+    for (size_t v = 0; v < temperature.size(); ++v) {
+      finish += volumetricHeat(model, grid, v) *
+                (end[run][v] - model::kRoomTemperature);
+      if (grid.isActive(v) && grid.getMaterial(v) == 1) {
+        dish_rise = std::max(dish_rise, end[run][v] - model::kRoomTemperature);
+      }
+    }
+    energy[run] = std::fabs(finish - start) / start;
+  }
+
+  double difference = 0.0;
+  for (size_t v = 0; v < end[0].size(); ++v) {
+    difference = std::max(difference, std::fabs(end[0][v] - end[1][v]));
+  }
+  test::check(dish_rise > 5.0, "no heat crosses into the dish", dish_rise);
+  test::check(energy[0] <= 1e-4, "the explicit sweeps lose heat", energy[0]);
+  test::check(energy[1] <= 1e-4, "Crank-Nicolson loses heat", energy[1]);
+  test::check(difference <= 1e-3 * (kHot - model::kRoomTemperature),
+              "Crank-Nicolson departs from the explicit run over two "
+              "materials",
+              difference);
+}
+
+/**
+ * @brief dishHeatsAsCeramic Without conduction every voxel heats at
+ * sigma |E|^2 / (2 rho c) of its own material
+ */
+static void dishHeatsAsCeramic() {
+  constexpr double kDt = 1.0; ///< s
+  constexpr int kSteps = 10;
+  model::Model model;
+  makeLayers(model, false);
+  auto conduction = makeConductionSolver(model, 16, false, ConductionConfig());
+  const physics::PhasorField field = source();
+  conduction->sampleField(field);
+  for (int s = 0; s < kSteps; ++s) {
+    conduction->step(s * kDt, kDt, kFrequency, physics::CYCLE_AVERAGED);
+  }
+  const SparseGrid &grid = conduction->getGrid();
+  std::vector<double> temperature(conduction->getTemperatureCount());
+  std::vector<double> enthalpy(conduction->getEnthalpyCount());
+  conduction->getState(temperature.data(), enthalpy.data());
+
+  double worst = 0.0;
+  for (size_t v = 0; v < temperature.size(); ++v) {
+    if (!grid.isActive(v)) {
+      continue;
+    }
+    const glm::vec3 c = grid.center(v);
+    float re = 0.f, im = 0.f;
+    field.samplePhasor(&c.x, &c.y, &c.z, 1, model.getPosition(), &re, &im);
+    const double sigma = model.getMaterialTable()
+                             .m_materials[grid.getMaterial(v)]
+                             .m_electrical_conductivity;
+    const double expected = 0.5 * sigma * (re * re + im * im) * kDt *
+                            kSteps / volumetricHeat(model, grid, v);
+    worst = std::max(worst,
+                     std::fabs(temperature[v] - model::kRoomTemperature -
+                               expected) /
+                         expected);
+  }
+  test::check(worst <= 1e-3, "a voxel heats as another material", worst);
+}
+
+int main() {
+  crankNicolsonMatchesExplicit();
+  multigridIterationsStayFlat();
+  frozenBlockStaysBounded();
+  phaseTablesFollowTheTransitions();
+  singleKeepsSmallIncrements();
+  layersExchangeHeat();
+  dishHeatsAsCeramic();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <EnsembleAccumulator.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr size_t kVertices = 3;
+
+/**
+ * @brief exactQuantile Linear interpolation between the sorted samples, the
+ * estimate P^2 tracks
+ * @param samples
+ * @param fraction In (0, 1)
+ * @return
+ */
+static double exactQuantile(std::vector<float> samples, float fraction) {
+  std::sort(samples.begin(), samples.end());
+  const double x = fraction * static_cast<double>(samples.size() - 1);
+  const size_t lo = static_cast<size_t>(x);
+  const size_t hi = std::min(lo + 1, samples.size() - 1);
+  return samples[lo] + (x - lo) * (samples[hi] - samples[lo]);
+}
+
+/**
+ * @brief fold Adds one member after another, vertex v drawing from its own
+ * distribution
+ * @param members
+ * @param percentiles
+ * @param samples Filled with the members of every vertex
+ * @return
+ */
+static EnsembleResult fold(size_t members,
+                           const std::vector<float> &percentiles,
+                           std::vector<std::vector<float>> &samples) {
+  std::mt19937 rng(11);
+  // Far from 0 so a naive sum of squares would lose the spread
+  std::normal_distribution<float> normal(350.f, 4.f);
+  std::uniform_real_distribution<float> uniform(300.f, 310.f);
+  std::exponential_distribution<float> exponential(0.5f);
+  samples.assign(kVertices, {});
+  EnsembleAccumulator accumulator(kVertices, percentiles);
+  float member[kVertices];
+  for (size_t m = 0; m < members; ++m) {
+    member[0] = normal(rng);
+    member[1] = uniform(rng);
+    member[2] = 290.f + exponential(rng);
+    for (size_t v = 0; v < kVertices; ++v) {
+      samples[v].push_back(member[v]);
+    }
+    accumulator.add(member);
+  }
+  EnsembleResult result;
+  accumulator.finish(result);
+  return result;
+}
+
+/**
+ * @brief welfordMatchesTwoPass Mean and sample deviation match the two-pass
+ * sums in double
+ */
+static void welfordMatchesTwoPass() {
+  std::vector<std::vector<float>> samples;
+  const EnsembleResult result = fold(5000, {0.5f}, samples);
+  test::check(result.m_members == 5000, "the member count is off",
+              static_cast<double>(result.m_members));
+
+  double mean_error = 0.0, std_error = 0.0;
+  for (size_t v = 0; v < kVertices; ++v) {
+    double mean = 0.0;
+    for (const float x : samples[v]) {
+      mean += x;
+    }
+    mean /= samples[v].size();
+    double m2 = 0.0;
+    for (const float x : samples[v]) {
+      m2 += (x - mean) * (x - mean);
+    }
+    const double deviation = std::sqrt(m2 / (samples[v].size() - 1));
+    mean_error = std::max(mean_error,
+                          std::fabs(result.m_mean[v] - mean) / mean);
+    std_error = std::max(std_error,
+                         std::fabs(result.m_std[v] - deviation) / deviation);
+  }
+  test::check(mean_error <= 1e-6, "the mean departs from two passes",
+              mean_error);
+  test::check(std_error <= 1e-6, "the deviation departs from two passes",
+              std_error);
+}
+
+/**
+ * @brief percentilesTrackTheSamples P^2 lands within 2 % of a standard
+ * deviation of the sorted samples over a large ensemble, and is exact while
+ * there are too few members for its markers
+ */
+static void percentilesTrackTheSamples() {
+  const std::vector<float> percentiles{0.05f, 0.5f, 0.95f};
+  std::vector<std::vector<float>> samples;
+  const EnsembleResult large = fold(20000, percentiles, samples);
+  double worst = 0.0;
+  for (size_t p = 0; p < percentiles.size(); ++p) {
+    for (size_t v = 0; v < kVertices; ++v) {
+      const double exact = exactQuantile(samples[v], percentiles[p]);
+      worst = std::max(worst, std::fabs(large.m_percentile_maps[p][v] -
+                                        exact) /
+                                  large.m_std[v]);
+    }
+  }
+  test::check(worst <= 0.02, "a P^2 percentile strays from the samples",
+              worst);
+
+  const EnsembleResult small = fold(4, percentiles, samples);
+  double small_error = 0.0;
+  for (size_t p = 0; p < percentiles.size(); ++p) {
+    for (size_t v = 0; v < kVertices; ++v) {
+      small_error = std::max(
+          small_error, std::fabs(small.m_percentile_maps[p][v] -
+                                 exactQuantile(samples[v], percentiles[p])));
+    }
+  }
+  test::check(small_error <= 1e-4,
+              "a percentile of a few members departs from the samples",
+              small_error);
+}
+
+int main() {
+  welfordMatchesTwoPass();
+  percentilesTrackTheSamples();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+
+#include <FdtdField.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr float kFrequency = 2.45e9f;          ///< Hz
+static constexpr double kSpeedOfLight = 299792458.0;  ///< m/s
+static constexpr int kSamples = 21;
+
+/**
+ * @brief spreadOfFarField Solves a source in the middle of the default
+ * cavity and reads r^2 |E|^2 along x, one to three half wavelengths out
+ * @param pml_cells
+ * @return Largest over smallest r^2 |E|^2, 1 for a wave that only spreads
+ */
+static double spreadOfFarField(int pml_cells) {
+  physics::Cavity cavity;
+  physics::FdtdConfig cfg;
+  cfg.m_cells_per_wavelength = 12;
+  cfg.m_pml_cells = pml_cells;
+  physics::FdtdField field(cavity, kFrequency, 1.f, cfg);
+  physics::FieldSource source;
+  source.m_position = 0.5f * (cavity.m_min + cavity.m_max);
+  source.m_amplitude = 100.f;
+  field.addSource(source);
+  field.solve();
+
+  const double wavelength = kSpeedOfLight / kFrequency;
+  double lo = 1e30, hi = 0.0;
+  for (int s = 0; s < kSamples; ++s) {
+    const float r =
+        static_cast<float>((0.5 + s / (kSamples - 1.0)) * wavelength);
+    const float x = source.m_position.x + r;
+    const float y = source.m_position.y, z = source.m_position.z;
+    float re = 0.f, im = 0.f;
+    field.samplePhasor(&x, &y, &z, 1, glm::vec3(0.f), &re, &im);
+    const double power = static_cast<double>(re) * re * r * r;
+    lo = std::min(lo, power);
+    hi = std::max(hi, power);
+  }
+  return hi / lo;
+}
+
+/**
+ * @brief pmlAbsorbsOutgoingWaves With the absorbing layer the wave leaves
+ * the source as in free space, |E| falling as 1/r once past the near field.
+ * With bare metal walls the reflections stand and r^2 |E|^2 swings between
+ * nodes and antinodes.
+ */
+static void pmlAbsorbsOutgoingWaves() {
+  const double absorbed = spreadOfFarField(8);
+  test::check(absorbed < 1.3, "the absorbing layer reflects", absorbed);
+  const double reflected = spreadOfFarField(0);
+  test::check(reflected > 3.0, "the metal walls leave no standing wave",
+              reflected);
+}
+
+int main() {
+  pmlAbsorbsOutgoingWaves();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
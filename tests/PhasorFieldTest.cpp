@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <PhasorField.hpp>
+#include <TriangleBvh.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr float kFrequency = 2.45e9f;         ///< Hz
+static constexpr double kSpeedOfLight = 299792458.0; ///< m/s
+// Not a multiple of the block the kernel works on, so the tail is covered
+static constexpr size_t kPoints = 5000;
+
+/**
+ * @brief referencePhasor Sum of A / r e^(i(phi - kr)) over the sources, in
+ * double with the library sin and cos
+ * @param sources
+ * @param p
+ * @param magnitude Sum of A / r, what cancellation leaves the error relative
+ * to
+ * @return
+ */
+static std::complex<double>
+referencePhasor(const std::vector<physics::FieldSource> &sources,
+                const glm::vec3 &p, double &magnitude) {
+  const double k = glm::two_pi<double>() * kFrequency / kSpeedOfLight;
+  std::complex<double> sum = 0.0;
+  magnitude = 0.0;
+  for (const auto &source : sources) {
+    const glm::dvec3 d = glm::dvec3(p) - glm::dvec3(source.m_position);
+    const double r = std::sqrt(glm::dot(d, d));
+    sum += source.m_amplitude / r * std::polar(1.0, source.m_phase - k * r);
+    magnitude += source.m_amplitude / r;
+  }
+  return sum;
+}
+
+/**
+ * @brief sumMatchesReference 16 magnetrons with random phases around a
+ * box of points: the batched kernel agrees with the scalar complex sum at
+ * every point
+ */
+static void sumMatchesReference() {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> wall(-0.25f, 0.25f);
+  std::uniform_real_distribution<float> inner(-0.15f, 0.15f);
+  std::uniform_real_distribution<float> phase(0.f, glm::two_pi<float>());
+  std::uniform_real_distribution<float> amplitude(50.f, 500.f);
+
+  std::vector<physics::FieldSource> sources(16);
+  for (size_t s = 0; s < sources.size(); ++s) {
+    // On the faces of the cavity, clear of the points
+    glm::vec3 position(wall(rng), wall(rng), wall(rng));
+    position[s % 3] = s % 2 ? 0.25f : -0.25f;
+    sources[s].m_position = position;
+    sources[s].m_amplitude = amplitude(rng);
+    sources[s].m_phase = phase(rng);
+  }
+  physics::PhasorField field(sources, kFrequency);
+
+  const glm::vec3 offset(0.01f, -0.02f, 0.005f);
+  std::vector<float> x(kPoints), y(kPoints), z(kPoints);
+  for (size_t p = 0; p < kPoints; ++p) {
+    x[p] = inner(rng);
+    y[p] = inner(rng);
+    z[p] = inner(rng);
+  }
+  std::vector<float> re(kPoints), im(kPoints);
+  field.samplePhasor(x.data(), y.data(), z.data(), kPoints, offset,
+                     re.data(), im.data());
+
+  double worst = 0.0;
+  for (size_t p = 0; p < kPoints; ++p) {
+    double magnitude = 0.0;
+    const std::complex<double> expected = referencePhasor(
+        sources, glm::vec3(x[p], y[p], z[p]) + offset, magnitude);
+    worst = std::max(worst, std::abs(std::complex<double>(re[p], im[p]) -
+                                     expected) /
+                                magnitude);
+  }
+  test::check(worst <= 1e-5, "the phasor sum departs from the reference",
+              worst);
+}
+
+/**
+ * @brief occludedSourceDrops A plate between one source and the points
+ * leaves them the field of the other source alone
+ */
+static void occludedSourceDrops() {
+  std::vector<physics::FieldSource> sources(2);
+  sources[0].m_position = glm::vec3(-0.2f, 0.f, 0.f);
+  sources[0].m_amplitude = 300.f;
+  sources[1].m_position = glm::vec3(0.2f, 0.05f, 0.f);
+  sources[1].m_amplitude = 200.f;
+  sources[1].m_phase = 1.f;
+
+  // Plate in the plane x = -0.1, far wider than the points
+  const std::vector<glm::vec3> corners = {
+      {-0.1f, -1.f, -1.f}, {-0.1f, 1.f, -1.f}, {-0.1f, 1.f, 1.f},
+      {-0.1f, -1.f, -1.f}, {-0.1f, 1.f, 1.f},  {-0.1f, -1.f, 1.f}};
+  TriangleBvh plate;
+  plate.build(corners, {0, 0});
+  physics::PhasorField shadowed(sources, kFrequency, &plate);
+
+  constexpr size_t kLine = 100;
+  std::vector<float> x(kLine), y(kLine, 0.02f), z(kLine, -0.03f);
+  for (size_t p = 0; p < kLine; ++p) {
+    x[p] = -0.05f + 0.2f * p / kLine;
+  }
+  std::vector<float> re(kLine), im(kLine);
+  shadowed.samplePhasor(x.data(), y.data(), z.data(), kLine, glm::vec3(0.f),
+                        re.data(), im.data());
+
+  const std::vector<physics::FieldSource> lit = {sources[1]};
+  double worst = 0.0;
+  for (size_t p = 0; p < kLine; ++p) {
+    double magnitude = 0.0;
+    const std::complex<double> expected =
+        referencePhasor(lit, glm::vec3(x[p], y[p], z[p]), magnitude);
+    worst = std::max(worst, std::abs(std::complex<double>(re[p], im[p]) -
+                                     expected) /
+                                magnitude);
+  }
+  test::check(worst <= 1e-5, "a source shines through the plate", worst);
+}
+
+int main() {
+  sumMatchesReference();
+  occludedSourceDrops();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <Mesh.hpp>
+#include <PropertyTable.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr float kMin = 250.f; ///< K
+static constexpr float kMax = 400.f; ///< K
+
+/**
+ * @brief arguments Random temperatures over the table and up to 50 K past
+ * either end of it
+ * @param count
+ * @return K
+ */
+static std::vector<float> arguments(size_t count) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> uniform(kMin - 50.f, kMax + 50.f);
+  std::vector<float> t(count);
+  for (float &value : t) {
+    value = uniform(rng);
+  }
+  return t;
+}
+
+/**
+ * @brief tableInterpolates A linear curve comes back to round off, a curved
+ * one within the h^2 / 8 * max|f''| bound of linear interpolation, and both
+ * clamp to their end samples outside the range
+ */
+static void tableInterpolates() {
+  const auto line = [](float t) { return 3.f * t - 100.f; };
+  const auto parabola = [](float t) { return 1e-3f * t * t; };
+  constexpr size_t kSamples = 31;
+  const model::PropertyTable linear =
+      model::makePropertyTable(line, kMin, kMax, kSamples);
+  const model::PropertyTable curved =
+      model::makePropertyTable(parabola, kMin, kMax, kSamples);
+
+  const std::vector<float> t = arguments(1000);
+  std::vector<float> out_linear(t.size()), out_curved(t.size());
+  linear.lookup(t.data(), t.size(), out_linear.data());
+  curved.lookup(t.data(), t.size(), out_curved.data());
+
+  const float spacing = (kMax - kMin) / (kSamples - 1);
+  const double bound = spacing * spacing / 8.0 * 2e-3;
+  double linear_error = 0.0, curved_error = 0.0;
+  for (size_t i = 0; i < t.size(); ++i) {
+    const float clamped = std::clamp(t[i], kMin, kMax);
+    const double linear_expected = line(clamped);
+    const double curved_expected = parabola(clamped);
+    linear_error =
+        std::max(linear_error, std::fabs(out_linear[i] - linear_expected) /
+                                   std::fabs(linear_expected));
+    curved_error =
+        std::max(curved_error, std::fabs(out_curved[i] - curved_expected));
+  }
+  test::check(linear_error <= 1e-5, "a linear table departs from its line",
+              linear_error);
+  test::check(curved_error <= 1.01 * bound,
+              "a curved table exceeds the interpolation bound",
+              curved_error / bound);
+}
+
+/**
+ * @brief stackMatchesTables Every row of a stack reads like the table it was
+ * made from, whether it kept its samples, was resampled or is a constant
+ */
+static void stackMatchesTables() {
+  const model::PropertyTable fine = model::makePropertyTable(
+      [](float t) { return 2.f * t; }, kMin, kMax, 61);
+  const model::PropertyTable coarse = model::makePropertyTable(
+      [](float t) { return 1000.f - t; }, 200.f, 350.f, 7);
+  const model::PropertyTable none;
+  const model::PropertyStack stack =
+      model::makePropertyStack({&fine, &coarse, &none}, {0.f, 0.f, 4.5f});
+
+  const std::vector<float> t = arguments(999);
+  std::vector<uint32_t> rows(t.size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    rows[i] = static_cast<uint32_t>(i % 3);
+  }
+  std::vector<float> stacked(t.size());
+  stack.lookup(rows.data(), t.data(), t.size(), stacked.data());
+
+  double error = 0.0;
+  for (size_t i = 0; i < t.size(); ++i) {
+    float expected = 4.5f;
+    if (rows[i] != 2) {
+      (rows[i] == 0 ? fine : coarse).lookup(&t[i], 1, &expected);
+    }
+    error = std::max(error, std::fabs(static_cast<double>(stacked[i]) -
+                                      expected) /
+                                std::fabs(expected));
+  }
+  test::check(error <= 1e-5, "a stacked row departs from its table", error);
+}
+
+/**
+ * @brief heatingRateFollowsTables sigma / (rho * c) gathered over a table
+ * of two materials, one with every property read from its curve and one
+ * with the constants only
+ */
+static void heatingRateFollowsTables() {
+  model::Material curved;
+  curved.m_density = 1000.f;
+  curved.m_heat_capacity = 4184.f;
+  curved.m_electrical_conductivity = 0.5f;
+  const auto sigma = [](float t) { return 0.5f + 0.01f * (t - 293.15f); };
+  const auto c = [](float t) { return 4000.f + 2.f * (t - 293.15f); };
+  curved.m_electrical_conductivity_table =
+      model::makePropertyTable(sigma, kMin, kMax, 151);
+  curved.m_heat_capacity_table =
+      model::makePropertyTable(c, kMin, kMax, 151);
+  model::Material constant;
+  constant.m_density = 2400.f;
+  constant.m_heat_capacity = 800.f;
+  constant.m_electrical_conductivity = 1e-2f;
+  model::MaterialTable table;
+  table.add("curved", curved);
+  table.add("constant", constant);
+  table.bake();
+
+  std::vector<float> t = arguments(700);
+  std::vector<uint32_t> material(t.size());
+  for (size_t i = 0; i < t.size(); ++i) {
+    t[i] = std::clamp(t[i], kMin, kMax);
+    material[i] = static_cast<uint32_t>(i % 2);
+  }
+  std::vector<float> rate(t.size());
+  model::heatingRate(table, material.data(), t.data(), t.size(),
+                     rate.data());
+
+  double error = 0.0;
+  for (size_t i = 0; i < t.size(); ++i) {
+    const double expected =
+        material[i] ? constant.m_electrical_conductivity /
+                          (constant.m_density * constant.m_heat_capacity)
+                    : sigma(t[i]) / (curved.m_density * c(t[i]));
+    error = std::max(error, std::fabs(rate[i] - expected) / expected);
+  }
+  test::check(error <= 1e-5, "the heating rate departs from the curves",
+              error);
+}
+
+/**
+ * @brief enthalpyRateBlendsPhases sigma / rho gathered over a table of a
+ * melting material, whose conductivity goes from the frozen one to its curve
+ * with the melted fraction, and one without phase change
+ */
+static void enthalpyRateBlendsPhases() {
+  constexpr float kMelting = 273.15f; ///< K
+  constexpr float kFusion = 3.34e5f;  ///< J/kg
+  model::Material melting;
+  melting.m_density = 1000.f;
+  melting.m_heat_capacity = 4000.f;
+  melting.m_electrical_conductivity = 0.5f;
+  melting.m_frozen_electrical_conductivity = 0.01f;
+  melting.m_melting_temperature = kMelting;
+  melting.m_latent_heat_fusion = kFusion;
+  const auto sigma = [](float t) { return 0.5f + 0.01f * (t - 293.15f); };
+  melting.m_electrical_conductivity_table =
+      model::makePropertyTable(sigma, kMin, kMax, 151);
+  model::Material constant;
+  constant.m_density = 2400.f;
+  constant.m_heat_capacity = 800.f;
+  constant.m_electrical_conductivity = 1e-2f;
+  model::MaterialTable table;
+  table.add("melting", melting);
+  table.add("constant", constant);
+  table.bake();
+
+  // Enthalpies from 20 K below the melting point, zero is the solid at it,
+  // to 40 K above it, with the temperature each one sits at
+  constexpr size_t kCount = 800;
+  const float c = melting.m_heat_capacity;
+  std::vector<float> t(kCount), h(kCount), liquid(kCount);
+  std::vector<uint32_t> material(kCount);
+  for (size_t i = 0; i < kCount; ++i) {
+    h[i] = -20.f * c + (kFusion + 60.f * c) * i / (kCount - 1);
+    liquid[i] = std::clamp(h[i] / kFusion, 0.f, 1.f);
+    t[i] = kMelting + std::min(h[i], 0.f) / c +
+           std::max(h[i] - kFusion, 0.f) / c;
+    material[i] = static_cast<uint32_t>(i % 2);
+  }
+  std::vector<float> rate(kCount);
+  model::enthalpyRate(table, material.data(), t.data(), h.data(), kCount,
+                      rate.data());
+
+  double error = 0.0;
+  for (size_t i = 0; i < kCount; ++i) {
+    const float frozen = melting.m_frozen_electrical_conductivity;
+    const double expected =
+        material[i] ? constant.m_electrical_conductivity / constant.m_density
+                    : (frozen + liquid[i] * (sigma(t[i]) - frozen)) /
+                          melting.m_density;
+    error = std::max(error, std::fabs(rate[i] - expected) / expected);
+  }
+  test::check(error <= 1e-4, "the enthalpy rate departs from the phases",
+              error);
+}
+
+int main() {
+  tableInterpolates();
+  stackMatchesTables();
+  heatingRateFollowsTables();
+  enthalpyRateBlendsPhases();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <RayTracedField.hpp>
+#include <TriangleBvh.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+using namespace simulator::physics;
+
+static constexpr double kSpeedOfLight = 299792458.0; ///< m/s
+
+/**
+ * @brief closestHitMatchesBruteForce Random triangles and segments, some of
+ * which skip a triangle as rays leaving a wall do
+ */
+static void closestHitMatchesBruteForce() {
+  constexpr int kTriangles = 500;
+  constexpr int kRays = 5000;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+  const auto random = [&] {
+    return glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+  };
+
+  std::vector<glm::vec3> corners;
+  std::vector<uint32_t> groups;
+  for (int t = 0; t < kTriangles; ++t) {
+    const glm::vec3 center = random();
+    for (int k = 0; k < 3; ++k) {
+      corners.push_back(center + 0.2f * random());
+    }
+    groups.push_back(t);
+  }
+  TriangleBvh bvh;
+  bvh.build(corners, groups);
+
+  std::vector<float> ox(kRays), oy(kRays), oz(kRays);
+  std::vector<float> dx(kRays), dy(kRays), dz(kRays), t(kRays);
+  std::vector<uint32_t> skip(kRays), group(kRays);
+  for (int r = 0; r < kRays; ++r) {
+    const glm::vec3 o = random(), d = 2.f * random();
+    ox[r] = o.x, oy[r] = o.y, oz[r] = o.z;
+    dx[r] = d.x, dy[r] = d.y, dz[r] = d.z;
+    skip[r] = r % 7 == 0 ? r % kTriangles : TriangleBvh::kMiss;
+  }
+  bvh.closestHit(ox.data(), oy.data(), oz.data(), dx.data(), dy.data(),
+                 dz.data(), skip.data(), kRays, t.data(), group.data());
+
+  int mismatches = 0, hits = 0;
+  for (int r = 0; r < kRays; ++r) {
+    const glm::vec3 o(ox[r], oy[r], oz[r]), d(dx[r], dy[r], dz[r]);
+    float best = 1.f;
+    uint32_t best_group = TriangleBvh::kMiss;
+    for (int tri = 0; tri < kTriangles; ++tri) {
+      const glm::vec3 a = corners[3 * tri];
+      const glm::vec3 e1 = corners[3 * tri + 1] - a;
+      const glm::vec3 e2 = corners[3 * tri + 2] - a;
+      const glm::vec3 p = glm::cross(d, e2);
+      const float det = glm::dot(e1, p);
+      if (std::fabs(det) < 1e-20f || static_cast<uint32_t>(tri) == skip[r]) {
+        continue;
+      }
+      const glm::vec3 s = o - a;
+      const glm::vec3 q = glm::cross(s, e1);
+      const float u = glm::dot(s, p) / det;
+      const float v = glm::dot(d, q) / det;
+      const float hit = glm::dot(e2, q) / det;
+      if (u >= 0.f && v >= 0.f && u + v <= 1.f && hit > 0.f && hit < best) {
+        best = hit;
+        best_group = tri;
+      }
+    }
+    hits += best_group != TriangleBvh::kMiss;
+    const bool same = best_group == group[r] &&
+                      (best_group == TriangleBvh::kMiss ||
+                       std::fabs(best - t[r]) <= 1e-5f);
+    mismatches += !same;
+  }
+  test::check(hits > kRays / 10, "closest hit: too few rays hit", hits);
+  test::check(mismatches == 0, "closest hit differs from brute force",
+              mismatches);
+}
+
+/**
+ * @brief tableMatchesImageLattice In a box the images of a source form a
+ * lattice, mirrored in a face or translated by twice the box per axis, so
+ * the field is a closed-form sum over it
+ */
+static void tableMatchesImageLattice() {
+  constexpr int kOrder = 3;
+  constexpr float kReflectance = 0.8f;
+  constexpr float kFrequency = 2.45e9f;
+
+  Cavity cavity;
+  cavity.m_min = glm::vec3(-0.2f, -0.15f, -0.18f);
+  cavity.m_max = glm::vec3(0.23f, 0.17f, 0.2f);
+  std::vector<FieldSource> sources(2);
+  sources[0].m_position = glm::vec3(0.03f, -0.05f, 0.02f);
+  sources[0].m_amplitude = 1000.f;
+  sources[0].m_phase = 0.3f;
+  sources[1].m_position = glm::vec3(-0.1f, 0.08f, -0.04f);
+  sources[1].m_amplitude = 600.f;
+  sources[1].m_phase = -1.f;
+
+  RayTraceConfig cfg;
+  cfg.m_max_order = kOrder;
+  cfg.m_reflectance = kReflectance;
+  const RayTracedField field(RayTracedField::boxWalls(cavity), sources,
+                             kFrequency, cfg);
+  const FieldTable &re = field.getRealTable();
+  const FieldTable &im = field.getImagTable();
+
+  // Image m along an axis: translated by 2 m L when unmirrored, reflected
+  // by |2m| walls, mirrored and translated when odd, by |2m - 1| walls
+  struct Image {
+    double m_position[3];
+    double m_amplitude, m_phase;
+  };
+  std::vector<Image> images;
+  for (const FieldSource &source : sources) {
+    for (int mx = -kOrder; mx <= kOrder; ++mx) {
+      for (int my = -kOrder; my <= kOrder; ++my) {
+        for (int mz = -kOrder; mz <= kOrder; ++mz) {
+          for (int mirror = 0; mirror < 8; ++mirror) {
+            const int shift[3] = {mx, my, mz};
+            Image image{{}, source.m_amplitude, source.m_phase};
+            int order = 0;
+            for (int a = 0; a < 3; ++a) {
+              const double lo = cavity.m_min[a];
+              const double length = cavity.m_max[a] - lo;
+              const double offset = source.m_position[a] - lo;
+              const bool mirrored = (mirror >> a) & 1;
+              image.m_position[a] =
+                  lo + 2 * shift[a] * length + (mirrored ? -offset : offset);
+              order += std::abs(2 * shift[a] - (mirrored ? 1 : 0));
+            }
+            if (order <= kOrder) {
+              image.m_amplitude *= std::pow(-kReflectance, order);
+              images.push_back(image);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  const double k = 2.0 * M_PI * kFrequency / kSpeedOfLight;
+  double max_error = 0.0, max_value = 0.0;
+  for (int z = 0; z < re.m_dims.z; ++z) {
+    for (int y = 0; y < re.m_dims.y; ++y) {
+      for (int x = 0; x < re.m_dims.x; ++x) {
+        const glm::vec3 p = re.m_origin + glm::vec3(x, y, z) * re.m_spacing;
+        std::complex<double> sum = 0.0;
+        for (const Image &image : images) {
+          double r = 0.0;
+          for (int a = 0; a < 3; ++a) {
+            const double d = p[a] - image.m_position[a];
+            r += d * d;
+          }
+          r = std::max(std::sqrt(r), 1e-3);
+          sum += std::polar(image.m_amplitude / r, image.m_phase - k * r);
+        }
+        const size_t i = re.index(x, y, z);
+        const std::complex<double> table(re.m_values[i], im.m_values[i]);
+        max_error = std::max(max_error, std::abs(sum - table));
+        max_value = std::max(max_value, std::abs(sum));
+      }
+    }
+  }
+  test::check(max_error <= 1e-6 * max_value,
+              "ray traced table differs from the image lattice",
+              max_error / max_value);
+}
+
+int main() {
+  closestHitMatchesBruteForce();
+  tableMatchesImageLattice();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
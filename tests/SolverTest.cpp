@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Solver.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr float kFrequency = 2.45e9f; ///< Hz
+static constexpr double kDuration = 60.0;    ///< s
+static constexpr double kTolerance = 0.01;   ///< K
+
+/**
+ * @brief makeModel Closed box mesh 10 cm across of a food whose conductivity
+ * rises 2 %/K, so its heating accelerates smoothly
+ * @param model
+ */
+static void makeModel(model::Model &model) {
+  model::Material food;
+  food.m_density = 1000.f;
+  food.m_thickness = 0.02f;
+  food.m_heat_capacity = 4184.f;
+  food.m_electrical_conductivity = 0.5f;
+  food.m_electrical_conductivity_table = model::makePropertyTable(
+      [&food](float t) {
+        return food.m_electrical_conductivity *
+               (1.f + 0.02f * (t - model::kRoomTemperature));
+      },
+      250.f, 400.f, 256);
+  model.setMaterial(food);
+
+  auto &meshes = model.getMeshVec();
+  meshes.resize(1);
+  model::Mesh &mesh = meshes[0];
+  for (int c = 0; c < 8; ++c) {
+    mesh.m_vert_positions.push_back(
+        0.1f * glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+  }
+  const unsigned faces[12][3] = {{0, 2, 1}, {1, 2, 3}, {4, 5, 6}, {5, 7, 6},
+                                 {0, 1, 4}, {1, 5, 4}, {2, 6, 3}, {3, 6, 7},
+                                 {0, 4, 2}, {2, 4, 6}, {1, 3, 5}, {3, 7, 5}};
+  for (const auto &face : faces) {
+    mesh.m_vert_indices.insert(mesh.m_vert_indices.end(), face, face + 3);
+  }
+  model.initializeThermalState(model::kRoomTemperature);
+}
+
+static SolverConfig solverConfig() {
+  SolverConfig cfg;
+  physics::FieldSource source;
+  source.m_position = glm::vec3(-0.07f, 0.06f, 0.05f);
+  source.m_amplitude = 60.f;
+  cfg.m_sources = {source};
+  cfg.m_frequency = kFrequency;
+  cfg.m_step_log_path.clear();
+  return cfg;
+}
+
+/**
+ * @brief run Steps a fresh model to end_time the way the headless demo does
+ * @param cfg
+ * @param end_time s
+ * @param steps Taken
+ * @return Final vertex temperatures, K
+ */
+static std::vector<float> run(const SolverConfig &cfg, double end_time,
+                              uint64_t &steps) {
+  std::vector<model::Model> models(1);
+  makeModel(models.front());
+  Solver solver(models, cfg);
+  const double slack =
+      0.5 * std::min(cfg.m_time_step, cfg.m_adaptive.m_min_step);
+  while (solver.getTimeline() < end_time - slack) {
+    solver.step(end_time);
+  }
+  steps = solver.getStepCount();
+  return models.front().getMeshVec().front().m_temperature;
+}
+
+/**
+ * @brief adaptiveMeetsTolerance With sigma = sigma0 (1 + b (T - T0)) every
+ * vertex heats as T - T0 = (e^(a b t) - 1) / b, a its initial rate. Adaptive
+ * steps stay within the tolerance of every step taken of that curve, and
+ * take about as many steps as a first order method needs for it: two half
+ * Euler steps leave h^2 T'' / 4, so the step is sqrt(4 tol / T'') on the
+ * hottest vertex.
+ */
+static void adaptiveMeetsTolerance() {
+  constexpr double kSlope = 0.02; ///< 1/K, of the conductivity
+  // A first Euler step reads the initial rate of every vertex exactly
+  SolverConfig first = solverConfig();
+  first.m_time_step = 1.0;
+  uint64_t steps = 0;
+  const std::vector<float> start = run(first, 1.0, steps);
+
+  SolverConfig adaptive = solverConfig();
+  adaptive.m_time_step = 0.1;
+  adaptive.m_adaptive.m_enabled = true;
+  adaptive.m_adaptive.m_tolerance = kTolerance;
+  const std::vector<float> result = run(adaptive, kDuration, steps);
+
+  double rise = 0.0, error = 0.0, hottest = 0.0;
+  for (size_t v = 0; v < result.size(); ++v) {
+    const double rate = start[v] - model::kRoomTemperature; // K/s
+    const double expected =
+        std::expm1(rate * kSlope * kDuration) / kSlope;
+    rise = std::max(rise, expected);
+    hottest = std::max(hottest, rate);
+    error = std::max(error, std::fabs(result[v] - model::kRoomTemperature -
+                                      expected));
+  }
+  test::check(rise > 10.0, "the food barely heats", rise);
+  test::check(error <= steps * kTolerance,
+              "adaptive steps miss their tolerance", error);
+
+  // Integral of dt / h with T'' = a^2 b e^(a b t)
+  const double growth = hottest * kSlope;
+  const double expected_steps =
+      std::sqrt(hottest * hottest * kSlope / (4.0 * kTolerance)) * 2.0 /
+      growth * std::expm1(0.5 * growth * kDuration);
+  const double ratio = steps / expected_steps;
+  test::check(ratio > 0.8 && ratio < 2.0,
+              "the adaptive step count is off the error model", ratio);
+}
+
+/**
+ * @brief lastStepLandsOnEnd A step to an end time less than the minimum
+ * step away lands on it instead of passing it
+ */
+static void lastStepLandsOnEnd() {
+  SolverConfig cfg = solverConfig();
+  cfg.m_time_step = 0.1;
+  cfg.m_adaptive.m_enabled = true;
+  cfg.m_adaptive.m_tolerance = kTolerance;
+  cfg.m_adaptive.m_min_step = 0.05;
+
+  std::vector<model::Model> models(1);
+  makeModel(models.front());
+  Solver solver(models, cfg);
+  while (solver.getTimeline() < 1.0) {
+    solver.step(1.0);
+  }
+  const double end_time = 1.0 + 0.2 * cfg.m_adaptive.m_min_step;
+  solver.step(end_time);
+  test::check(std::fabs(solver.getTimeline() - end_time) <= 1e-12,
+              "the last adaptive step passed the end",
+              solver.getTimeline() - end_time);
+}
+
+int main() {
+  adaptiveMeetsTolerance();
+  lastStepLandsOnEnd();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include <BlockCompression.hpp>
+#include <TimeSeries.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr size_t kVertices = 2000;
+static constexpr int kFrames = 1000;
+static constexpr char kPath[] = "TimeSeriesTest.cmts";
+
+/**
+ * @brief codecRoundTrips Random, sparse and repetitive blocks come back as
+ * they went in, and a corrupted block is rejected without overrunning
+ */
+static void codecRoundTrips() {
+  std::mt19937 rng(1);
+  int failed = 0;
+  for (int round = 0; round < 2000; ++round) {
+    std::vector<uint8_t> block(rng() % 5000);
+    for (uint8_t &byte : block) {
+      switch (round % 3) {
+      case 0:
+        byte = static_cast<uint8_t>(rng());
+        break;
+      case 1:
+        byte = rng() % 4 == 0 ? rng() % 3 : 0;
+        break;
+      default:
+        byte = "abcabcabd"[rng() % 9];
+      }
+    }
+    std::vector<uint8_t> compressed(compressBound(block.size()));
+    std::vector<uint8_t> decoded(block.size());
+    const size_t size =
+        compressBlock(block.data(), block.size(), compressed.data());
+    failed += size > compressed.size() ||
+              !decompressBlock(compressed.data(), size, decoded.data(),
+                               decoded.size()) ||
+              decoded != block;
+    if (size > 2) {
+      compressed[rng() % size] ^= 1 + rng() % 255;
+      decompressBlock(compressed.data(), size, decoded.data(), decoded.size());
+    }
+  }
+  test::check(failed == 0, "compressed blocks don't round trip", failed);
+}
+
+/**
+ * @brief makeFrames Vertices heated in float steps at rates that vary
+ * smoothly over the body and slowly over time, as the solver does under a
+ * fixed field
+ * @return kFrames frames
+ */
+static std::vector<std::vector<float>> makeFrames() {
+  std::vector<std::vector<float>> frames(kFrames);
+  std::vector<float> temperature(kVertices, 293.15f);
+  for (int f = 0; f < kFrames; ++f) {
+    for (size_t v = 0; v < kVertices; ++v) {
+      const float rate = 0.05f + 0.04f * std::sin(0.01f * v) - 2e-5f * f;
+      temperature[v] += rate * 0.1f;
+    }
+    frames[f] = temperature;
+  }
+  return frames;
+}
+
+/**
+ * @brief historyRoundTrips Lossless frames are read back exactly by time,
+ * in random order, and the file of a killed run is indexed again
+ */
+static void historyRoundTrips() {
+  TimeSeriesConfig cfg;
+  cfg.m_path = kPath;
+  cfg.m_queue_depth = kFrames;
+  const std::vector<std::vector<float>> frames = makeFrames();
+  uint64_t stored_bytes = 0, stored_frames = 0;
+  {
+    TimeSeriesWriter writer(cfg, kVertices);
+    std::vector<float> frame;
+    for (int f = 0; f < kFrames; ++f) {
+      frame = frames[f];
+      writer.push(0.1 * f, frame);
+    }
+    writer.close();
+    stored_bytes = writer.getStoredBytes();
+    stored_frames = writer.getFrameCount();
+  }
+  test::check(stored_frames == kFrames, "frames went missing", stored_frames);
+  const double ratio =
+      4.0 * kVertices * stored_frames / std::max<uint64_t>(stored_bytes, 1);
+  test::check(ratio >= 12.0, "lossless history compresses less than 12x",
+              ratio);
+
+  std::mt19937 rng(2);
+  std::vector<float> read;
+  int wrong = 0;
+  {
+    TimeSeriesReader reader(kPath);
+    for (int k = 0; k < 300; ++k) {
+      const size_t f = k < 100 ? k : rng() % reader.getFrameCount();
+      const long written = std::lround(reader.getTime(f) / 0.1);
+      wrong += reader.findFrame(reader.getTime(f)) != f;
+      reader.readFrame(f, read);
+      wrong += read != frames[written];
+    }
+  }
+  test::check(wrong == 0, "frames read back differ", wrong);
+
+  // Cut the index and part of the chunks off
+  std::filesystem::resize_file(kPath,
+                               std::filesystem::file_size(kPath) * 2 / 3);
+  TimeSeriesReader truncated(kPath);
+  const size_t last = truncated.getFrameCount() - 1;
+  truncated.readFrame(last, read);
+  const long written = std::lround(truncated.getTime(last) / 0.1);
+  test::check(last > 0 && read == frames[written],
+              "truncated history doesn't read back", last);
+  std::filesystem::remove(kPath);
+}
+
+/**
+ * @brief pushFrames Pushes every frame back to back through a queue of one
+ * @param drop_frames
+ * @param dropped Frames the writer skipped
+ * @param spilled Frames the writer queued past the depth
+ * @return Frames the writer stored
+ */
+static uint64_t pushFrames(const std::vector<std::vector<float>> &frames,
+                           bool drop_frames, uint64_t &dropped,
+                           uint64_t &spilled) {
+  TimeSeriesConfig cfg;
+  cfg.m_path = kPath;
+  cfg.m_queue_depth = 1;
+  cfg.m_drop_frames = drop_frames;
+  TimeSeriesWriter writer(cfg, kVertices);
+  std::vector<float> frame;
+  for (int f = 0; f < kFrames; ++f) {
+    frame = frames[f];
+    writer.push(0.1 * f, frame);
+  }
+  writer.close();
+  dropped = writer.getDroppedCount();
+  spilled = writer.getSpilledCount();
+  return writer.getFrameCount();
+}
+
+/**
+ * @brief fullQueueSpills A queue of one can't keep up with pushes back to
+ * back, the frames past it spill and every one is stored and reads back
+ */
+static void fullQueueSpills() {
+  const std::vector<std::vector<float>> frames = makeFrames();
+  uint64_t dropped = 0, spilled = 0;
+  const uint64_t stored = pushFrames(frames, false, dropped, spilled);
+  test::check(stored == kFrames && dropped == 0,
+              "a full queue lost frames without m_drop_frames",
+              static_cast<double>(dropped));
+  test::check(spilled < kFrames, "the first frame spilled past an empty queue",
+              static_cast<double>(spilled));
+
+  std::vector<float> read;
+  int wrong = 0;
+  {
+    TimeSeriesReader reader(kPath);
+    for (size_t f = 0; f < reader.getFrameCount(); ++f) {
+      reader.readFrame(f, read);
+      wrong += read != frames[f] || reader.getSkipped(f) != 0;
+    }
+  }
+  test::check(wrong == 0, "spilled frames differ", wrong);
+  std::filesystem::remove(kPath);
+}
+
+/**
+ * @brief fullQueueDropsFrames With m_drop_frames the frames that don't fit
+ * are counted and skipped, the index records every gap, and the frames kept
+ * still read back exactly
+ */
+static void fullQueueDropsFrames() {
+  const std::vector<std::vector<float>> frames = makeFrames();
+  uint64_t dropped = 0, spilled = 0;
+  const uint64_t stored = pushFrames(frames, true, dropped, spilled);
+  test::check(stored + dropped == kFrames,
+              "frames are neither stored nor dropped",
+              double(stored + dropped));
+
+  std::vector<float> read;
+  int wrong = 0, gaps = 0;
+  uint64_t skipped = 0;
+  {
+    TimeSeriesReader reader(kPath);
+    long previous = -1;
+    for (size_t f = 0; f < reader.getFrameCount(); ++f) {
+      const long written = std::lround(reader.getTime(f) / 0.1);
+      reader.readFrame(f, read);
+      wrong += read != frames[written];
+      gaps += written - previous - 1 != reader.getSkipped(f);
+      skipped += reader.getSkipped(f);
+      previous = written;
+    }
+  }
+  test::check(wrong == 0, "frames kept past a full queue differ", wrong);
+  test::check(gaps == 0 && skipped == dropped,
+              "the index doesn't account for the skipped frames", gaps);
+  std::filesystem::remove(kPath);
+}
+
+int main() {
+  codecRoundTrips();
+  historyRoundTrips();
+  fullQueueSpills();
+  fullQueueDropsFrames();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <TriangleBvh.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+// Shadow rays stop this fraction of their length short of their point
+static constexpr float kEndTolerance = 1e-4f;
+
+/**
+ * @brief segmentHits Moller-Trumbore against one triangle, for the brute
+ * force reference
+ * @param o Start of the segment
+ * @param d To its end
+ * @param a
+ * @param b
+ * @param c
+ * @return Whether the triangle crosses the segment before its tolerance
+ */
+static bool segmentHits(const glm::vec3 &o, const glm::vec3 &d,
+                        const glm::vec3 &a, const glm::vec3 &b,
+                        const glm::vec3 &c) {
+  const glm::vec3 e1 = b - a, e2 = c - a;
+  const glm::vec3 p = glm::cross(d, e2);
+  const float det = glm::dot(e1, p);
+  if (std::fabs(det) < 1e-20f) {
+    return false;
+  }
+  const glm::vec3 s = o - a;
+  const glm::vec3 q = glm::cross(s, e1);
+  const float u = glm::dot(s, p) / det;
+  const float v = glm::dot(d, q) / det;
+  const float t = glm::dot(e2, q) / det;
+  return u >= 0.f && v >= 0.f && u + v <= 1.f && t > 0.f &&
+         t < 1.f - kEndTolerance;
+}
+
+/**
+ * @brief addMesh Appends a mesh of loose triangles to a model
+ * @param model
+ * @param corners Three per triangle, relative to the model
+ */
+static void addMesh(model::Model &model,
+                    const std::vector<glm::vec3> &corners) {
+  auto &meshes = model.getMeshVec();
+  meshes.emplace_back();
+  model::Mesh &mesh = meshes.back();
+  for (const glm::vec3 &corner : corners) {
+    mesh.m_vert_indices.push_back(
+        static_cast<unsigned>(mesh.m_vert_positions.size()));
+    mesh.m_vert_positions.push_back(corner);
+  }
+}
+
+/**
+ * @brief visibilityMatchesBruteForce Random triangles spread over models,
+ * shadow rays to random points and to the corners of the triangles, which
+ * their own triangles must not hide
+ */
+static void visibilityMatchesBruteForce() {
+  constexpr int kModels = 40;
+  constexpr int kTrianglesPerModel = 12;
+  constexpr int kPoints = 4000;
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+  const auto random = [&] {
+    return glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+  };
+
+  std::vector<model::Model> models(kModels);
+  std::vector<glm::vec3> world; // Three corners per triangle
+  for (auto &model : models) {
+    model.setPosition(0.5f * random());
+    std::vector<glm::vec3> corners;
+    for (int t = 0; t < kTrianglesPerModel; ++t) {
+      const glm::vec3 center = random();
+      for (int k = 0; k < 3; ++k) {
+        corners.push_back(center + 0.2f * random());
+        world.push_back(corners.back() + model.getPosition());
+      }
+    }
+    addMesh(model, corners);
+  }
+  TriangleBvh bvh;
+  bvh.build(models);
+
+  const glm::vec3 origin(0.1f, -2.f, 0.3f);
+  const glm::vec3 offset(0.25f, 0.f, -0.5f);
+  std::vector<float> x(kPoints), y(kPoints), z(kPoints), visible(kPoints);
+  for (int p = 0; p < kPoints; ++p) {
+    const glm::vec3 point = p % 5 ? 1.5f * random() : world[p % world.size()];
+    x[p] = point.x - offset.x;
+    y[p] = point.y - offset.y;
+    z[p] = point.z - offset.z;
+  }
+  bvh.visibility(origin, x.data(), y.data(), z.data(), kPoints, offset,
+                 visible.data());
+
+  int mismatches = 0, hidden = 0;
+  for (int p = 0; p < kPoints; ++p) {
+    const glm::vec3 d = glm::vec3(x[p], y[p], z[p]) + offset - origin;
+    bool occluded = false;
+    for (size_t t = 0; t < world.size() && !occluded; t += 3) {
+      occluded = segmentHits(origin, d, world[t], world[t + 1], world[t + 2]);
+    }
+    hidden += occluded;
+    mismatches += occluded != (visible[p] == 0.f);
+  }
+  test::check(hidden > kPoints / 10, "too few shadow rays are blocked",
+              hidden);
+  test::check(hidden < kPoints - kPoints / 10,
+              "too few shadow rays get through", hidden);
+  test::check(mismatches == 0, "visibility differs from brute force",
+              mismatches);
+}
+
+/**
+ * @brief refitMovesShadows A plate that moves out of the way stops casting
+ * its shadow once the tree is refit, and a refit with nothing moved reports
+ * so
+ */
+static void refitMovesShadows() {
+  std::vector<model::Model> models(1);
+  addMesh(models[0], {{-0.5f, -0.5f, 0.5f}, {0.5f, -0.5f, 0.5f},
+                      {0.5f, 0.5f, 0.5f}, {-0.5f, -0.5f, 0.5f},
+                      {0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}});
+  TriangleBvh bvh;
+  bvh.build(models);
+
+  const glm::vec3 origin(0.f);
+  const float x = 0.1f, y = -0.2f, z = 1.f;
+  float visible = 1.f;
+  bvh.visibility(origin, &x, &y, &z, 1, glm::vec3(0.f), &visible);
+  test::check(visible == 0.f, "the plate casts no shadow", visible);
+
+  models[0].setPosition(glm::vec3(2.f, 0.f, 0.f));
+  test::check(bvh.refit(models), "the refit missed the move", 0.0);
+  bvh.visibility(origin, &x, &y, &z, 1, glm::vec3(0.f), &visible);
+  test::check(visible == 1.f, "the moved plate still casts its shadow",
+              visible);
+  test::check(!bvh.refit(models), "a refit without a move reports one", 1.0);
+}
+
+int main() {
+  visibilityMatchesBruteForce();
+  refitMovesShadows();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
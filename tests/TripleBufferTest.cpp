@@ -0,0 +1,91 @@
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+
+#include <TripleBuffer.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr uint64_t kPublishes = 200000;
+
+/**
+ * Large enough that a torn copy would show, every entry holds the sequence
+ * number of the publish that wrote it
+ */
+struct Frame {
+  std::array<uint64_t, 64> m_values{};
+};
+
+/**
+ * @brief handsOverLatest On one thread the consumer sees nothing until a
+ * publish, then exactly the latest slot published, once
+ */
+static void handsOverLatest() {
+  TripleBuffer<Frame> buffer;
+  test::check(!buffer.update(), "update reports a slot never published", 0);
+
+  for (uint64_t sequence = 1; sequence <= 3; ++sequence) {
+    buffer.back().m_values.fill(sequence);
+    buffer.publish();
+  }
+  test::check(buffer.update(), "update misses the publishes", 0);
+  test::check(buffer.front().m_values[0] == 3,
+              "the front is not the latest publish",
+              static_cast<double>(buffer.front().m_values[0]));
+  test::check(!buffer.update(), "update hands the same slot over twice", 0);
+
+  // The producer never gets the slot the consumer is reading
+  buffer.back().m_values.fill(4);
+  test::check(buffer.front().m_values[0] == 3,
+              "the producer writes into the front slot",
+              static_cast<double>(buffer.front().m_values[0]));
+}
+
+/**
+ * @brief concurrentNeverTears A producer publishing as fast as it can and a
+ * consumer polling as fast as it can: every front the consumer reads is one
+ * whole publish, sequence numbers never go back, and the last publish
+ * arrives
+ */
+static void concurrentNeverTears() {
+  TripleBuffer<Frame> buffer;
+  std::thread producer([&buffer]() {
+    for (uint64_t sequence = 1; sequence <= kPublishes; ++sequence) {
+      buffer.back().m_values.fill(sequence);
+      buffer.publish();
+    }
+  });
+
+  uint64_t torn = 0, backwards = 0, reads = 0, latest = 0;
+  while (latest < kPublishes) {
+    if (!buffer.update()) {
+      continue;
+    }
+    const Frame &front = buffer.front();
+    const uint64_t sequence = front.m_values[0];
+    for (const uint64_t value : front.m_values) {
+      torn += value != sequence;
+    }
+    backwards += sequence < latest;
+    latest = sequence;
+    ++reads;
+  }
+  producer.join();
+
+  test::check(torn == 0, "the consumer read a torn frame",
+              static_cast<double>(torn));
+  test::check(backwards == 0, "the consumer went back in time",
+              static_cast<double>(backwards));
+  test::check(reads > 0 && reads <= kPublishes,
+              "the consumer read more frames than were published",
+              static_cast<double>(reads));
+}
+
+int main() {
+  handsOverLatest();
+  concurrentNeverTears();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <Turntable.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr size_t kPoints = 50;
+static constexpr double kBase = 2.0;  ///< V^2/m^2
+static constexpr double kSlope = 1.0; ///< V^2/m^3
+
+/**
+ * |E|^2 rising linearly along x, so the mean over an arc of the circle a
+ * point sweeps has a closed form
+ */
+class RampField : public physics::FieldProvider {
+public:
+  void samplePhasor(const float *x, const float *, const float *,
+                    size_t count, const glm::vec3 &offset, float *field_re,
+                    float *field_im) const override {
+    for (size_t i = 0; i < count; ++i) {
+      field_re[i] = static_cast<float>(
+          std::sqrt(kBase + kSlope * (x[i] + offset.x)));
+      field_im[i] = 0.f;
+    }
+  }
+};
+
+/**
+ * @brief arcMean Mean |E|^2 of the ramp over the arc a point sweeps about
+ * the vertical axis through the pivot
+ * @param d Point relative to the pivot, world space
+ * @param pivot
+ * @param angle0 rad
+ * @param angle1 rad
+ * @return
+ */
+static double arcMean(const glm::dvec3 &d, const glm::dvec3 &pivot,
+                      double angle0, double angle1) {
+  // x turns as d.x cos + d.z sin about +y
+  const double x =
+      (d.x * (std::sin(angle1) - std::sin(angle0)) -
+       d.z * (std::cos(angle1) - std::cos(angle0))) /
+      (angle1 - angle0);
+  return kBase + kSlope * (pivot.x + x);
+}
+
+/**
+ * @brief arcMatchesClosedForm Points at several radii and heights around an
+ * off-centre pivot. The cached angles themselves read the field at the
+ * turned point, and arcs within an interval, across several, wrapping past
+ * angle 0, longer than a revolution or a million seconds in read the closed
+ * form mean up to the interpolation between angles.
+ */
+static void arcMatchesClosedForm() {
+  std::vector<float> x(kPoints), y(kPoints), z(kPoints);
+  for (size_t p = 0; p < kPoints; ++p) {
+    const double radius = 0.2 * (p + 1) / kPoints;
+    const double phi = 2.4 * p;
+    x[p] = static_cast<float>(radius * std::cos(phi));
+    y[p] = 0.01f * p;
+    z[p] = static_cast<float>(radius * std::sin(phi));
+  }
+  const glm::vec3 offset(0.01f, 0.02f, -0.03f);
+  const glm::vec3 pivot(0.05f, 0.f, 0.02f);
+
+  physics::TurntableConfig cfg;
+  cfg.m_enabled = true;
+  physics::TurntableCache cache;
+  cache.build(RampField(), x.data(), y.data(), z.data(), kPoints, offset,
+              pivot, cfg);
+  test::check(cache.size() == kPoints && cache.getAngleCount() == 72,
+              "the cache lost points or angles", cache.getAngleCount());
+
+  const double spacing = glm::two_pi<double>() / cfg.m_angle_count;
+  const double late = physics::turntableAngle(cfg, 1e6);
+  // Start and end of every arc, rad
+  const double arcs[][2] = {{3 * spacing, 3 * spacing},
+                            {5.2 * spacing, 5.7 * spacing},
+                            {1.3 * spacing, 9.8 * spacing},
+                            {70.4 * spacing, 74.1 * spacing},
+                            {0.6, 0.6 + 2.5 * glm::two_pi<double>()},
+                            {late, late + 0.3}};
+
+  std::vector<float> re(kPoints), im(kPoints);
+  for (const auto &arc : arcs) {
+    cache.sample(arc[0], arc[1], re.data(), im.data());
+    double worst = 0.0;
+    for (size_t p = 0; p < kPoints; ++p) {
+      const glm::dvec3 d =
+          glm::dvec3(x[p], y[p], z[p]) + glm::dvec3(offset) -
+          glm::dvec3(pivot);
+      const double expected =
+          arc[0] == arc[1]
+              ? kBase + kSlope * (pivot.x + d.x * std::cos(arc[0]) +
+                                  d.z * std::sin(arc[0]))
+              : arcMean(d, glm::dvec3(pivot), arc[0], arc[1]);
+      const double power = static_cast<double>(re[p]) * re[p];
+      worst = std::max(worst, std::abs(power - expected) / expected);
+      worst = std::max(worst, static_cast<double>(std::abs(im[p])));
+    }
+    // A cached angle is read as it was sampled, between them the chords of
+    // the circle fall short by up to r (1 - cos(spacing / 2))
+    const double tolerance = arc[0] == arc[1] ? 1e-6 : 2e-4;
+    test::check(worst <= tolerance,
+                "the turning field departs from the closed form", worst);
+  }
+}
+
+/**
+ * @brief budgetCapsAngles A budget short of the configured angles caches as
+ * many as fit, and one that can't hold a single angle throws
+ */
+static void budgetCapsAngles() {
+  std::vector<float> x(kPoints, 0.1f), y(kPoints, 0.f), z(kPoints, 0.f);
+  physics::TurntableConfig cfg;
+  cfg.m_enabled = true;
+  cfg.m_max_cache_bytes = 11 * kPoints * sizeof(float);
+  physics::TurntableCache cache;
+  cache.build(RampField(), x.data(), y.data(), z.data(), kPoints, glm::vec3(),
+              glm::vec3(), cfg);
+  test::check(cache.getAngleCount() == 10,
+              "the budget doesn't cap the cached angles",
+              cache.getAngleCount());
+
+  cfg.m_max_cache_bytes = kPoints * sizeof(float);
+  bool threw = false;
+  try {
+    cache.build(RampField(), x.data(), y.data(), z.data(), kPoints,
+                glm::vec3(), glm::vec3(), cfg);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  test::check(threw, "a budget without room for an angle is accepted", 0);
+}
+
+int main() {
+  arcMatchesClosedForm();
+  budgetCapsAngles();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <SparseGrid.hpp>
+#include <VoxelGrid.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+/**
+ * @brief addSphere Closed UV sphere
+ * @param mesh
+ * @param radius m
+ * @param center
+ * @param material Table index of every vertex
+ */
+static void addSphere(model::Mesh &mesh, float radius,
+                      const glm::vec3 &center, uint32_t material) {
+  constexpr int kAround = 40, kUp = 20;
+  const size_t base = mesh.m_vert_positions.size();
+  for (int j = 0; j <= kUp; ++j) {
+    for (int i = 0; i < kAround; ++i) {
+      const float theta = static_cast<float>(M_PI) * j / kUp;
+      const float phi = 2.f * static_cast<float>(M_PI) * i / kAround;
+      mesh.m_vert_positions.push_back(
+          center + radius * glm::vec3(std::sin(theta) * std::cos(phi),
+                                      std::cos(theta),
+                                      std::sin(theta) * std::sin(phi)));
+      mesh.m_vert_normals.push_back(glm::vec3(0.f));
+      mesh.m_tex_coords.push_back(glm::vec2(0.f));
+      mesh.m_material.push_back(material);
+    }
+  }
+  for (int j = 0; j < kUp; ++j) {
+    for (int i = 0; i < kAround; ++i) {
+      const size_t a = base + j * kAround + i;
+      const size_t b = base + j * kAround + (i + 1) % kAround;
+      for (const size_t v : {a, a + kAround, b, b, a + kAround, b + kAround}) {
+        mesh.m_vert_indices.push_back(v);
+      }
+    }
+  }
+}
+
+/**
+ * @brief crossings Heights at which the vertical line through (x, y) crosses
+ * the mesh, triangle by triangle
+ * @param mesh
+ * @param x
+ * @param y
+ * @return
+ */
+static std::vector<float> crossings(const model::Mesh &mesh, float x,
+                                    float y) {
+  std::vector<float> heights;
+  for (size_t t = 0; t < mesh.m_vert_indices.size(); t += 3) {
+    const glm::vec3 &a = mesh.m_vert_positions[mesh.m_vert_indices[t]];
+    const glm::vec3 &b = mesh.m_vert_positions[mesh.m_vert_indices[t + 1]];
+    const glm::vec3 &c = mesh.m_vert_positions[mesh.m_vert_indices[t + 2]];
+    const float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+    if (std::fabs(area) < 1e-12f) {
+      continue;
+    }
+    const float u = (b.x - x) * (c.y - y) - (c.x - x) * (b.y - y);
+    const float v = (c.x - x) * (a.y - y) - (a.x - x) * (c.y - y);
+    const float w = area - u - v;
+    if ((u < 0.f || v < 0.f || w < 0.f) && (u > 0.f || v > 0.f || w > 0.f)) {
+      continue;
+    }
+    heights.push_back((u * a.z + v * b.z + w * c.z) / area);
+  }
+  return heights;
+}
+
+/**
+ * @brief inside
+ * @param heights Crossings of the column
+ * @param z
+ * @return Whether an odd number of them lies above z
+ */
+static bool inside(const std::vector<float> &heights, float z) {
+  bool odd = false;
+  for (const float h : heights) {
+    odd ^= h > z;
+  }
+  return odd;
+}
+
+/**
+ * @brief matchesBruteForce Two spheres in one mesh and one in another: the
+ * parity fill takes the voxels whose center a brute-force parity test puts
+ * inside, and the shell keeps all of them
+ */
+static void matchesBruteForce() {
+  model::Model model;
+  auto &meshes = model.getMeshVec();
+  meshes.resize(2);
+  addSphere(meshes[0], 0.03f, glm::vec3(0.f), 0);
+  addSphere(meshes[0], 0.02f, glm::vec3(0.07f, 0.01f, 0.f), 0);
+  addSphere(meshes[1], 0.025f, glm::vec3(0.f, 0.07f, 0.02f), 0);
+
+  for (const int resolution : {17, 32, 64}) {
+    VoxelGrid grid, shell;
+    voxelizeModel(model, resolution, false, grid);
+    voxelizeModel(model, resolution, true, shell);
+    int differ = 0, lost = 0;
+    for (int j = 0; j < grid.m_dims.y; ++j) {
+      for (int i = 0; i < grid.m_dims.x; ++i) {
+        const glm::vec3 p = grid.center(i, j, 0);
+        const std::vector<float> first = crossings(meshes[0], p.x, p.y);
+        const std::vector<float> second = crossings(meshes[1], p.x, p.y);
+        for (int k = 0; k < grid.m_dims.z; ++k) {
+          const float z = grid.center(i, j, k).z;
+          const size_t v = grid.index(i, j, k);
+          const bool body = inside(first, z) || inside(second, z);
+          differ += body != (grid.m_occupancy[v] != 0);
+          lost += grid.m_occupancy[v] && !shell.m_occupancy[v];
+        }
+      }
+    }
+    test::check(differ == 0, "voxels differ from the brute-force parity",
+                differ);
+    test::check(lost == 0, "the shell drops voxels of the parity fill", lost);
+  }
+}
+
+/**
+ * @brief nestedMeshKeepsItsMaterial A sphere of another material inside a
+ * sphere fills its own voxels instead of hollowing the outer one out
+ */
+static void nestedMeshKeepsItsMaterial() {
+  model::Model model;
+  auto &meshes = model.getMeshVec();
+  meshes.resize(2);
+  addSphere(meshes[0], 0.05f, glm::vec3(0.f), 0);
+  addSphere(meshes[1], 0.02f, glm::vec3(0.f), 1);
+
+  VoxelGrid grid;
+  voxelizeModel(model, 64, false, grid);
+  int differ = 0;
+  for (int j = 0; j < grid.m_dims.y; ++j) {
+    for (int i = 0; i < grid.m_dims.x; ++i) {
+      const glm::vec3 p = grid.center(i, j, 0);
+      const std::vector<float> outer = crossings(meshes[0], p.x, p.y);
+      const std::vector<float> inner = crossings(meshes[1], p.x, p.y);
+      for (int k = 0; k < grid.m_dims.z; ++k) {
+        const float z = grid.center(i, j, k).z;
+        const size_t v = grid.index(i, j, k);
+        const bool core = inside(inner, z);
+        const bool body = core || inside(outer, z);
+        differ += body != (grid.m_occupancy[v] != 0);
+        differ += body && grid.m_material[v] != (core ? 1 : 0);
+      }
+    }
+  }
+  test::check(differ == 0, "nested voxels lose their material", differ);
+}
+
+/**
+ * @brief sparseMatchesDense The sparse grid built band by band holds the
+ * voxels and materials of the dense grid, a leaf for exactly the bricks
+ * they touch, and leaf neighbours that agree with the root lookup
+ */
+static void sparseMatchesDense() {
+  model::Model model;
+  auto &meshes = model.getMeshVec();
+  meshes.resize(2);
+  addSphere(meshes[0], 0.05f, glm::vec3(0.f), 0);
+  addSphere(meshes[0], 0.02f, glm::vec3(0.09f, 0.01f, 0.f), 0);
+  addSphere(meshes[1], 0.02f, glm::vec3(0.f), 1);
+
+  constexpr int kSize = SparseGrid::kLeafSize;
+  for (const int resolution : {17, 64}) {
+    for (const bool shell : {false, true}) {
+      VoxelGrid dense;
+      voxelizeModel(model, resolution, shell, dense);
+      SparseGrid sparse;
+      sparse.build(model, resolution, shell);
+
+      int differ = 0;
+      size_t occupied = 0;
+      std::vector<uint8_t> bricks;
+      const glm::ivec3 brick_dims = (dense.m_dims + kSize - 1) / kSize;
+      bricks.assign(static_cast<size_t>(brick_dims.x) * brick_dims.y *
+                        brick_dims.z,
+                    0);
+      for (int k = 0; k < dense.m_dims.z; ++k) {
+        for (int j = 0; j < dense.m_dims.y; ++j) {
+          for (int i = 0; i < dense.m_dims.x; ++i) {
+            const size_t v = dense.index(i, j, k);
+            const size_t slot = sparse.find(i, j, k);
+            const bool active =
+                slot != SparseGrid::kNoSlot && sparse.isActive(slot);
+            differ += active != (dense.m_occupancy[v] != 0);
+            differ += active && sparse.getMaterial(slot) != dense.m_material[v];
+            if (dense.m_occupancy[v]) {
+              ++occupied;
+              bricks[(static_cast<size_t>(k / kSize) * brick_dims.y +
+                      j / kSize) * brick_dims.x + i / kSize] = 1;
+            }
+          }
+        }
+      }
+      size_t brick_count = 0;
+      for (const uint8_t brick : bricks) {
+        brick_count += brick;
+      }
+
+      // The neighbour of a voxel across a face is the slot the lookup finds,
+      // within the grid
+      int wrong_neighbours = 0;
+      for (size_t slot = 0; slot < sparse.size(); ++slot) {
+        if (!sparse.isActive(slot)) {
+          continue;
+        }
+        const glm::ivec3 c = sparse.coord(slot);
+        for (int face = 0; face < 6; ++face) {
+          glm::ivec3 n = c;
+          n[face / 2] += face % 2 ? 1 : -1;
+          if (n.x < 0 || n.y < 0 || n.z < 0 || n.x >= dense.m_dims.x ||
+              n.y >= dense.m_dims.y || n.z >= dense.m_dims.z) {
+            continue;
+          }
+          wrong_neighbours +=
+              sparse.neighbourSlot(slot, face) != sparse.find(n.x, n.y, n.z);
+        }
+      }
+
+      test::check(differ == 0, "sparse voxels differ from the dense grid",
+                  differ);
+      test::check(sparse.getActiveCount() == occupied,
+                  "sparse grid miscounts its voxels",
+                  static_cast<double>(sparse.getActiveCount()) - occupied);
+      test::check(sparse.getLeafCount() == brick_count,
+                  "sparse leaves differ from the occupied bricks",
+                  static_cast<double>(sparse.getLeafCount()) - brick_count);
+      test::check(wrong_neighbours == 0,
+                  "leaf neighbours disagree with the root lookup",
+                  wrong_neighbours);
+    }
+  }
+}
+
+int main() {
+  matchesBruteForce();
+  nestedMeshKeepsItsMaterial();
+  sparseMatchesDense();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
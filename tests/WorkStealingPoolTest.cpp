@@ -0,0 +1,145 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <ThreadPool.hpp>
+#include <WorkStealingPool.hpp>
+
+#include "Check.hpp"
+
+using namespace simulator;
+
+static constexpr size_t kTasks = 1000;
+static constexpr size_t kChildren = 64;
+
+/**
+ * @brief everyTaskOnce Many tiny tasks on several workers, each runs exactly
+ * once before wait returns, and the pool takes a second batch after it
+ */
+static void everyTaskOnce() {
+  WorkStealingPool pool(4);
+  std::vector<std::atomic<int>> runs(kTasks);
+  for (int batch = 0; batch < 2; ++batch) {
+    for (size_t t = 0; t < kTasks; ++t) {
+      pool.submit([&runs, t]() { runs[t].fetch_add(1); });
+    }
+    pool.wait();
+  }
+
+  size_t wrong = 0;
+  for (const auto &count : runs) {
+    wrong += count.load() != 2;
+  }
+  test::check(wrong == 0, "tasks ran other than once per batch",
+              static_cast<double>(wrong));
+}
+
+/**
+ * @brief ownTasksNewestFirst A lone worker pops the tasks it submitted
+ * newest first
+ */
+static void ownTasksNewestFirst() {
+  WorkStealingPool pool(1);
+  std::vector<size_t> order;
+  pool.submit([&pool, &order]() {
+    for (size_t c = 0; c < 10; ++c) {
+      pool.submit([&order, c]() { order.push_back(c); });
+    }
+  });
+  pool.wait();
+
+  bool reversed = order.size() == 10;
+  for (size_t i = 0; reversed && i < order.size(); ++i) {
+    reversed = order[i] == order.size() - 1 - i;
+  }
+  test::check(reversed, "a worker doesn't pop its newest task first",
+              static_cast<double>(order.size()));
+}
+
+/**
+ * @brief childrenAreStolen Every child of one task lands on the deque of
+ * its worker, the idle workers steal them so they run on several threads.
+ * Their kernels stay on the thread running them.
+ */
+static void childrenAreStolen() {
+  WorkStealingPool pool(4);
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  std::atomic<size_t> done{0};
+  std::atomic<size_t> outside{0};
+
+  pool.submit([&]() {
+    for (size_t c = 0; c < kChildren; ++c) {
+      pool.submit([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        const std::thread::id self = std::this_thread::get_id();
+        ThreadPool::getInstance().parallelFor(
+            0, 1000, [&](size_t, size_t) {
+              outside += std::this_thread::get_id() != self;
+            });
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          threads.insert(self);
+        }
+        ++done;
+      });
+    }
+  });
+  pool.wait();
+
+  test::check(done == kChildren, "children went missing",
+              static_cast<double>(done));
+  test::check(threads.size() > 1, "no worker stole a child",
+              static_cast<double>(threads.size()));
+  test::check(outside == 0, "a kernel left the thread of its task",
+              static_cast<double>(outside));
+}
+
+/**
+ * @brief waitRethrows A throwing task doesn't stop the others, wait
+ * rethrows it once and the next wait is clean
+ */
+static void waitRethrows() {
+  WorkStealingPool pool(4);
+  std::atomic<size_t> done{0};
+  for (size_t t = 0; t < 100; ++t) {
+    pool.submit([&done, t]() {
+      if (t == 37) {
+        throw std::runtime_error("task failed");
+      }
+      ++done;
+    });
+  }
+
+  bool threw = false;
+  try {
+    pool.wait();
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  test::check(threw, "wait swallows the exception of a task", 0);
+  test::check(done == 99, "a throwing task stops the others",
+              static_cast<double>(done));
+
+  pool.submit([]() {});
+  threw = false;
+  try {
+    pool.wait();
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  test::check(!threw, "wait rethrows an exception twice", 0);
+}
+
+int main() {
+  everyTaskOnce();
+  ownTasksNewestFirst();
+  childrenAreStolen();
+  waitRethrows();
+  return test::failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}